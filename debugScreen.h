@@ -26,11 +26,14 @@ typedef struct PsvDebugScreenFont {
 #define FROM_3BIT(c,dark) (((!!((c)&4))<<23)  | ((!!((c)&2))<<15)     | ((!!((c)&1))<<7) | (dark ? 0 : 0x7F7F7F))
 #define FROM_6BIT(c     ) ((((c)%6)*(51<<16)) | ((((c)/6)%6)*(51<<8)) | ((((c)/36)%6)*51))
 #define FROM_FULL(r,g,b ) ((r<<16) | (g<<8) | (b))
-#define CLEARSCRN(H,toH,W,toW) for(int h = H; h < toH; h++)for(int w = W; w < toW; w++)((uint32_t*)base)[h*SCREEN_FB_WIDTH + w] = colorBg;
+#define CLEARSCRN(H,toH,W,toW) do{for(int h = H; h < toH; h++)for(int w = W; w < toW; w++)((uint32_t*)base)[h*SCREEN_FB_WIDTH + w] = colorBg;psvDebugScreenDirty(W, H, toW, toH);}while(0)
 
 static int mutex, coordX, savedX, coordY, savedY;
 static uint32_t defaultFg = 0xFFFFFFFF, colorFg = 0xFFFFFFFF;
 static uint32_t defaultBg = 0xFF000000, colorBg = 0xFF000000;
+static uint32_t rowFg, rowBg, rowNibble[16][4]; // 4 pixels for each 4 bit pattern in rowFg/rowBg
+static int rowValid;
+static int dirtyX0 = SCREEN_WIDTH, dirtyY0 = SCREEN_HEIGHT, dirtyX1, dirtyY1; // written since last psvDebugScreenTakeDirty()
 
 
 #ifdef __vita__
@@ -44,6 +47,26 @@ static void* base; // pointer to frame buffer
 static char base[SCREEN_FB_WIDTH * SCREEN_HEIGHT * 4];
 #endif
 
+static void psvDebugScreenDirty(int x0, int y0, int x1, int y1) {
+	if (x0 < dirtyX0) dirtyX0 = x0 < 0 ? 0 : x0;
+	if (y0 < dirtyY0) dirtyY0 = y0 < 0 ? 0 : y0;
+	if (x1 > dirtyX1) dirtyX1 = x1 > SCREEN_WIDTH ? SCREEN_WIDTH : x1;
+	if (y1 > dirtyY1) dirtyY1 = y1 > SCREEN_HEIGHT ? SCREEN_HEIGHT : y1;
+}
+
+// Returns 0 if nothing was drawn since the last call, else the bounding box of it
+int psvDebugScreenTakeDirty(int *x, int *y, int *w, int *h) {
+	sceKernelLockMutex(mutex, 1, NULL);
+	int dirty = dirtyX0 < dirtyX1 && dirtyY0 < dirtyY1;
+	*x = dirty ? dirtyX0 : 0;
+	*y = dirty ? dirtyY0 : 0;
+	*w = dirty ? dirtyX1 - dirtyX0 : 0;
+	*h = dirty ? dirtyY1 - dirtyY0 : 0;
+	dirtyX0 = SCREEN_WIDTH; dirtyY0 = SCREEN_HEIGHT; dirtyX1 = dirtyY1 = 0;
+	sceKernelUnlockMutex(mutex, 1);
+	return dirty;
+}
+
 static size_t psvDebugScreenEscape(const unsigned char *str) {
 	for(unsigned i = 0, argc = 0, arg[32] = {0}; argc < (sizeof(arg)/sizeof(*arg)) && str[i]!='\0'; i++)
 		switch(str[i]) {
@@ -102,9 +125,83 @@ int psvDebugScreenInit() {
 #endif
 }
 
+// Pre-expands the 16 nibble patterns for the current colors, so a glyph row byte becomes two 16 byte copies
+static void psvDebugScreenExpandRows() {
+	if (rowValid && rowFg == colorFg && rowBg == colorBg)
+		return;
+	for (int n = 0; n < 16; n++)
+		for (int b = 0; b < 4; b++)
+			rowNibble[n][b] = (n & (8 >> b)) ? colorFg : colorBg;
+	rowFg = colorFg;
+	rowBg = colorBg;
+	rowValid = 1;
+}
+
+// Moves the screen up by whole text lines until a glyph fits at coordY, clearing what scrolls in
+static void psvDebugScreenScroll() {
+	int lines = (coordY + F.height - SCREEN_HEIGHT + F.size_h - 1) / F.size_h;
+	int pixels = lines * F.size_h;
+	if (pixels >= SCREEN_HEIGHT) {
+		CLEARSCRN(0, SCREEN_HEIGHT, 0, SCREEN_WIDTH);
+		coordY = 0;
+		return;
+	}
+	uint32_t *vram = (uint32_t*)base;
+	memmove(vram, vram + pixels * SCREEN_FB_WIDTH, (SCREEN_HEIGHT - pixels) * SCREEN_FB_WIDTH * sizeof(uint32_t));
+	CLEARSCRN(SCREEN_HEIGHT - pixels, SCREEN_HEIGHT, 0, SCREEN_WIDTH);
+	psvDebugScreenDirty(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+	coordY -= pixels;
+	savedY -= pixels;
+}
+
+// Draws count glyphs side by side at the cursor, one framebuffer row at a time
+static void psvDebugScreenBlit(const unsigned char *run, int count) {
+	int bytes_per_glyph = (F.width * F.height) / 8;
+	uint32_t *vram = ((uint32_t*)base) + coordX + coordY * SCREEN_FB_WIDTH;
+	if (F.width % 8 == 0) {
+		psvDebugScreenExpandRows();
+		for (int row = 0; row < F.size_h; row++, vram += SCREEN_FB_WIDTH) {
+			uint32_t *pixel = vram;
+			for (int g = 0; g < count; g++) {
+				int col = 0;
+				if (row < F.height) {
+					const uint8_t *font = &F.glyphs[(run[g] - F.first) * bytes_per_glyph + row * (F.width / 8)];
+					for (; col < F.width; col += 8, font++, pixel += 8) {
+						memcpy(pixel, rowNibble[*font >> 4], sizeof(rowNibble[0]));
+						memcpy(pixel + 4, rowNibble[*font & 0xF], sizeof(rowNibble[0]));
+					}
+				}
+				for (; col < F.size_w; col++)
+					*pixel++ = colorBg;// right and bottom margin
+			}
+		}
+	} else for (int g = 0; g < count; g++, vram += F.size_w) { // rows not byte aligned: bit by bit
+		uint32_t *line = vram;
+		uint8_t *font = &F.glyphs[(run[g] - F.first) * bytes_per_glyph];
+		for (int row = 0, mask = 1 << 7; row < F.height; row++, line += SCREEN_FB_WIDTH) {
+			for (uint32_t *pixel = line, col = 0; col < F.width ; col++, mask>>=1) {
+				if (!mask) {font++; mask = 1 << 7;}// no more mask : we exausted this byte
+				*pixel++ = (*font&mask)?colorFg:colorBg;
+			}
+			for (uint32_t *pixel = line + F.width, col = F.width; col < F.size_w ; col++)
+				*pixel++ = colorBg;// right margin
+		}
+		for (int row = F.height; row < F.size_h; row++, line += SCREEN_FB_WIDTH)
+			for (uint32_t *pixel = line, col = 0; col < F.size_w ; col++)
+				*pixel++ = colorBg;// bottom margin
+	}
+	psvDebugScreenDirty(coordX, coordY, coordX + count * F.size_w, coordY + F.size_h);
+}
+
+static int psvDebugScreenPrintable(const unsigned char *text) {
+	unsigned char t = *text;
+	if (!t || t == '\t' || t == '\n' || t == '\r' || (t == '\e' && text[1] == '['))
+		return 0;
+	return t >= F.first && t <= F.last;
+}
+
 int psvDebugScreenPuts(const char * _text) {
 	const unsigned char*text = (const unsigned char*)_text;
-	int bytes_per_glyph = (F.width * F.height) / 8;
 	sceKernelLockMutex(mutex, 1, NULL);
 	int c;
 	for (c = 0; text[c] ; c++) {
@@ -118,7 +215,7 @@ int psvDebugScreenPuts(const char * _text) {
 			coordX = 0;
 		}
 		if (coordY + F.height > SCREEN_HEIGHT) {
-			coordX = coordY = 0;
+			psvDebugScreenScroll();
 		}
 		if (t == '\n') {
 			coordX = 0;
@@ -134,20 +231,12 @@ int psvDebugScreenPuts(const char * _text) {
 			continue;
 		}else if ((t > F.last) || (t < F.first))
 			continue; // skip non printable glyph
-		uint32_t *vram = ((uint32_t*)base) + coordX + coordY * SCREEN_FB_WIDTH;
-		uint8_t *font = &F.glyphs[ (t - F.first) * bytes_per_glyph];
-		for (int row = 0, mask = 1 << 7; row < F.height; row++, vram += SCREEN_FB_WIDTH) {
-			for (uint32_t *pixel = vram, col = 0; col < F.width ; col++, mask>>=1) {
-				if (!mask) {font++; mask = 1 << 7;}// no more mask : we exausted this byte
-				*pixel++ = (*font&mask)?colorFg:colorBg;
-			}
-			for (uint32_t *pixel = vram + F.width, col = F.width; col < F.size_w ; col++)
-				*pixel++ = colorBg;// right margin
-		}
-		for (int row = F.height; row < F.size_h; row++, vram += SCREEN_FB_WIDTH)
-			for (uint32_t *pixel = vram, col = 0; col < F.size_w ; col++)
-				*pixel++ = colorBg;// bottom margin
-		coordX += F.size_w;
+		int count = 1; // glyphs that follow on the same line go in the same blit
+		while (psvDebugScreenPrintable(text + c + count) && coordX + count * F.size_w + F.width <= SCREEN_WIDTH)
+			count++;
+		psvDebugScreenBlit(text + c, count);
+		coordX += count * F.size_w;
+		c += count - 1;
 	}
 	sceKernelUnlockMutex(mutex, 1);
 	return c;
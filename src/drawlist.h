@@ -0,0 +1,319 @@
+#pragma once
+
+// Recorded draws, replayed in sort key order instead of code order. Each
+// command carries a 64-bit key
+//
+//   63..56  layer
+//   55..54  blend (DrawBlend)
+//   for opaque and additive draws
+//   53..40  program id
+//   39..24  texture id
+//   23..0   depth, front to back
+//   for alpha blended draws
+//   53..0   sequence number
+//
+// so layers are drawn in order, and within a layer draws are grouped by
+// program and texture. Alpha blending does not commute, so those draws
+// keep their recording order. Additive draws commute with each other but
+// not with alpha blended ones, so in a layer that has both, additive draws
+// take the alpha blended key too and the layer is drawn as recorded after
+// its opaque draws. The sort is stable, which keeps equal keys in
+// recording order too. Program and texture ids are handed out on first use
+// and kept across clear(), so keys of a scene stay the same every frame.
+
+#ifdef __vita__
+#include <psp2/gxm.h>
+#else
+#include "hostgxm.h"
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+#include <unordered_map>
+#include <vector>
+
+#ifdef __vita__
+#include "gxmstate.h"
+#include "vitashader.h"
+#endif
+
+namespace vitashader {
+
+struct PatchedProgram;
+
+enum DrawBlend {
+    DRAW_BLEND_OPAQUE,
+    DRAW_BLEND_ADD,     // commutative, may be reordered unless its layer has alpha
+    DRAW_BLEND_ALPHA,   // drawn in recording order within its layer
+};
+
+struct DrawCommand {
+    uint64_t key;
+    PatchedProgram *program;
+    const SceGxmTexture *texture;
+    const void *vertices;
+    const void *indices;
+    uint32_t indexCount;
+    SceGxmPrimitiveType primitive;
+    SceGxmIndexFormat indexFormat;
+};
+
+// Stable LSD radix sort of the key/index pairs, a byte per pass. Passes
+// over a byte all keys share are skipped.
+static void
+radix_sort_keys(std::vector<uint64_t> &keys, std::vector<uint32_t> &order,
+        std::vector<uint64_t> &keyScratch, std::vector<uint32_t> &orderScratch)
+{
+    size_t n = keys.size();
+    keyScratch.resize(n);
+    orderScratch.resize(n);
+
+    uint32_t counts[8][256] = {};
+    for (size_t i=0; i<n; ++i) {
+        uint64_t key = keys[i];
+        for (int pass=0; pass<8; ++pass) {
+            ++counts[pass][(key >> (pass * 8)) & 0xFF];
+        }
+    }
+
+    for (int pass=0; pass<8; ++pass) {
+        uint32_t *count = counts[pass];
+        if (n == 0 || count[(keys[0] >> (pass * 8)) & 0xFF] == n) {
+            continue;
+        }
+
+        uint32_t offset = 0;
+        for (int digit=0; digit<256; ++digit) {
+            uint32_t c = count[digit];
+            count[digit] = offset;
+            offset += c;
+        }
+
+        for (size_t i=0; i<n; ++i) {
+            uint32_t dst = count[(keys[i] >> (pass * 8)) & 0xFF]++;
+            keyScratch[dst] = keys[i];
+            orderScratch[dst] = order[i];
+        }
+        keys.swap(keyScratch);
+        order.swap(orderScratch);
+    }
+}
+
+struct DrawList {
+    static const uint32_t MAX_LAYERS = 256;
+    static const uint32_t MAX_PROGRAMS = 1 << 14;
+    static const uint32_t MAX_TEXTURES = 1 << 16;
+    static const uint32_t DEPTH_MAX = (1 << 24) - 1;
+
+    DrawList()
+        : sorted(false)
+        , mixedLayers(false)
+    {
+        memset(layerBlends, 0, sizeof(layerBlends));
+    }
+
+    // Drops the commands; program and texture ids are kept
+    void clear()
+    {
+        commands.clear();
+        keys.clear();
+        order.clear();
+        sorted = false;
+        memset(layerBlends, 0, sizeof(layerBlends));
+        mixedLayers = false;
+    }
+
+    // depth is in [0, 1], smaller is nearer; it only orders opaque and
+    // additive draws. Returns false when out of program or texture ids.
+    bool add(uint8_t layer, DrawBlend blend, PatchedProgram *program, const SceGxmTexture *texture,
+            float depth, const void *vertices, SceGxmPrimitiveType primitive,
+            SceGxmIndexFormat indexFormat, const void *indices, uint32_t indexCount)
+    {
+        uint32_t programId = id_of(programIds, program, MAX_PROGRAMS);
+        uint32_t textureId = id_of(textureIds, texture, MAX_TEXTURES);
+        if (programId == ~0u || textureId == ~0u) {
+            return false;
+        }
+
+        uint64_t key = ((uint64_t)layer << 56) | ((uint64_t)blend << 54);
+        if (blend == DRAW_BLEND_ALPHA) {
+            key |= commands.size();
+        } else {
+            key |= ((uint64_t)programId << 40) | ((uint64_t)textureId << 24) | quantize_depth(depth);
+        }
+
+        layerBlends[layer] |= 1 << blend;
+        mixedLayers |= (layerBlends[layer] & MIXED) == MIXED;
+
+        order.push_back(commands.size());
+        keys.push_back(key);
+        commands.emplace_back(DrawCommand{key, program, texture, vertices, indices, indexCount,
+                primitive, indexFormat});
+        sorted = false;
+        return true;
+    }
+
+    static uint32_t quantize_depth(float depth)
+    {
+        if (!(depth > 0.f)) {
+            return 0;
+        }
+        if (depth >= 1.f) {
+            return DEPTH_MAX;
+        }
+        return (uint32_t)(depth * DEPTH_MAX);
+    }
+
+    // Gives the additive draws of layers that also have alpha blended ones
+    // the alpha blended key, so the sort keeps them in recording order.
+    // sort() does this first.
+    void order_mixed_layers()
+    {
+        if (!mixedLayers) {
+            return;
+        }
+        for (size_t i=0; i<keys.size(); ++i) {
+            uint64_t key = keys[i];
+            uint32_t layer = key >> 56;
+            if (((key >> 54) & 3) == DRAW_BLEND_ADD && (layerBlends[layer] & MIXED) == MIXED) {
+                key = ((uint64_t)layer << 56) | ((uint64_t)DRAW_BLEND_ALPHA << 54) | order[i];
+                keys[i] = key;
+                commands[order[i]].key = key;
+            }
+        }
+        mixedLayers = false;
+    }
+
+    void sort()
+    {
+        if (!sorted) {
+            order_mixed_layers();
+            radix_sort_keys(keys, order, keyScratch, orderScratch);
+            sorted = true;
+        }
+    }
+
+    // Walks the commands in the current order (recording order until
+    // sort()) and tells the backend about each change of program, texture
+    // and vertex stream before the draw:
+    //
+    //   backend.set_program(PatchedProgram *)
+    //   backend.set_texture(const SceGxmTexture *)
+    //   backend.set_vertices(const void *)
+    //   backend.draw(const DrawCommand &)
+    template <typename Backend>
+    void replay(Backend &backend) const
+    {
+        PatchedProgram *program = nullptr;
+        const SceGxmTexture *texture = nullptr;
+        const void *vertices = nullptr;
+
+        for (uint32_t index: order) {
+            const DrawCommand &cmd = commands[index];
+            if (cmd.program != program) {
+                program = cmd.program;
+                backend.set_program(program);
+            }
+            if (cmd.texture != texture) {
+                texture = cmd.texture;
+                backend.set_texture(texture);
+            }
+            if (cmd.vertices != vertices) {
+                vertices = cmd.vertices;
+                backend.set_vertices(vertices);
+            }
+            backend.draw(cmd);
+        }
+    }
+
+    template <typename Backend>
+    void submit(Backend &backend)
+    {
+        sort();
+        replay(backend);
+    }
+
+    size_t size() const
+    {
+        return commands.size();
+    }
+
+    std::vector<DrawCommand> commands;
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> order;
+    bool sorted;
+
+    std::unordered_map<const void *, uint32_t> programIds;
+    std::unordered_map<const void *, uint32_t> textureIds;
+
+private:
+    static const uint8_t MIXED = (1 << DRAW_BLEND_ADD) | (1 << DRAW_BLEND_ALPHA);
+
+    // DrawBlend bits seen per layer since clear()
+    uint8_t layerBlends[MAX_LAYERS];
+    bool mixedLayers;
+
+    static uint32_t id_of(std::unordered_map<const void *, uint32_t> &ids, const void *object, uint32_t limit)
+    {
+        auto it = ids.find(object);
+        if (it != ids.end()) {
+            return it->second;
+        }
+        if (ids.size() == limit) {
+            return ~0u;
+        }
+        uint32_t id = ids.size();
+        ids.emplace(object, id);
+        return id;
+    }
+
+    std::vector<uint64_t> keyScratch;
+    std::vector<uint32_t> orderScratch;
+};
+
+#ifdef __vita__
+// Replays a DrawList into a GXM context through the state shadow. bind() is
+// called after each program change so the caller can set its uniforms.
+template <typename Bind>
+struct GxmDrawBackend {
+    GxmDrawBackend(GxmState &state, Bind bind)
+        : state(state)
+        , bind(bind)
+    {
+    }
+
+    void set_program(PatchedProgram *program)
+    {
+        program->use(state);
+        bind(*program);
+    }
+
+    void set_texture(const SceGxmTexture *texture)
+    {
+        state.set_fragment_texture(0, texture);
+    }
+
+    void set_vertices(const void *vertices)
+    {
+        state.set_vertex_stream(0, vertices);
+    }
+
+    void draw(const DrawCommand &cmd)
+    {
+        state.draw(cmd.primitive, cmd.indexFormat, cmd.indices, cmd.indexCount);
+    }
+
+    GxmState &state;
+    Bind bind;
+};
+
+template <typename Bind>
+static GxmDrawBackend<Bind>
+gxm_draw_backend(GxmState &state, Bind bind)
+{
+    return GxmDrawBackend<Bind>(state, bind);
+}
+#endif
+
+} // end namespace vitashader
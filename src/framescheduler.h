@@ -0,0 +1,210 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __vita__
+#include <psp2/gxm.h>
+#endif
+
+namespace vitashader {
+
+static const unsigned MAX_FRAMES_IN_FLIGHT = 3;
+
+// Lets the CPU record up to framesInFlight frames ahead of the GPU instead
+// of waiting for each frame to finish rendering. Frames get fence values
+// from an increasing counter; begin_frame() only blocks when the oldest
+// frame still in flight has to be reused.
+//
+// Timeline is the GPU side:
+//   void submit(uint32_t fence)         ends the frame, fence is signalled when it is done
+//   bool is_complete(uint32_t fence)    fence has been signalled
+//   void wait(uint32_t fence)           blocks until fence has been signalled
+// Fences complete in submission order.
+template <typename Timeline>
+struct FrameScheduler {
+    FrameScheduler(Timeline &timeline, unsigned frames_in_flight=2)
+        : timeline(timeline)
+        , framesInFlight(frames_in_flight < 1 ? 1 :
+                frames_in_flight > MAX_FRAMES_IN_FLIGHT ? MAX_FRAMES_IN_FLIGHT : frames_in_flight)
+        , nextFence(1)
+        , lastCompleted(0)
+        , frames(0)
+        , waits(0)
+    {
+    }
+
+    // Starts a frame and returns the slot (0..framesInFlight-1) of its
+    // per-frame resources; whatever the slot held last time is idle now
+    unsigned begin_frame()
+    {
+        poll();
+
+        if (in_flight() == framesInFlight) {
+            uint32_t oldest = nextFence - framesInFlight;
+            timeline.wait(oldest);
+            lastCompleted = oldest;
+            ++waits;
+            poll();
+        }
+
+        return slot();
+    }
+
+    void end_frame()
+    {
+        timeline.submit(nextFence);
+        ++nextFence;
+        ++frames;
+    }
+
+    // Waits for every submitted frame, e.g. before freeing shared resources
+    void finish()
+    {
+        if (in_flight() > 0) {
+            timeline.wait(nextFence - 1);
+            lastCompleted = nextFence - 1;
+        }
+    }
+
+    // Picks up frames that finished without blocking
+    void poll()
+    {
+        while (lastCompleted + 1 != nextFence && timeline.is_complete(lastCompleted + 1)) {
+            ++lastCompleted;
+        }
+    }
+
+    // Fence the current frame will signal, for tagging its allocations
+    uint32_t fence() const
+    {
+        return nextFence;
+    }
+
+    // Every fence up to and including this one has been signalled
+    uint32_t completed() const
+    {
+        return lastCompleted;
+    }
+
+    unsigned slot() const
+    {
+        return nextFence % framesInFlight;
+    }
+
+    unsigned in_flight() const
+    {
+        return nextFence - 1 - lastCompleted;
+    }
+
+    Timeline &timeline;
+    unsigned framesInFlight;
+    uint32_t nextFence;
+    uint32_t lastCompleted;
+
+    // Frames submitted, and how many of them had to block in begin_frame()
+    unsigned frames;
+    unsigned waits;
+};
+
+#ifdef __vita__
+// Ends scenes with a fragment notification carrying the frame's fence. Each
+// in-flight fence writes its own word of the notification region, so a
+// later frame finishing cannot overwrite the value being waited for.
+struct GxmTimeline {
+    static const unsigned WORDS = 4;
+    static_assert(WORDS > MAX_FRAMES_IN_FLIGHT, "fences in flight need distinct words");
+
+    // Uses WORDS words of the notification region starting at first_word
+    GxmTimeline(SceGxmContext *context, unsigned first_word=0)
+        : context(context)
+        , words(sceGxmGetNotificationRegion() + first_word)
+    {
+        for (unsigned i=0; i<WORDS; ++i) {
+            words[i] = 0;
+        }
+    }
+
+    // Replaces vita2d_end_drawing(), which ends the scene without notifications
+    void submit(uint32_t fence)
+    {
+        SceGxmNotification notification = notification_for(fence);
+        sceGxmEndScene(context, NULL, &notification);
+    }
+
+    bool is_complete(uint32_t fence) const
+    {
+        return words[fence % WORDS] == fence;
+    }
+
+    void wait(uint32_t fence)
+    {
+        SceGxmNotification notification = notification_for(fence);
+        sceGxmNotificationWait(&notification);
+    }
+
+    SceGxmNotification notification_for(uint32_t fence) const
+    {
+        SceGxmNotification notification;
+        notification.address = words + fence % WORDS;
+        notification.value = fence;
+        return notification;
+    }
+
+    SceGxmContext *context;
+    volatile unsigned int *words;
+};
+#endif
+
+// A GPU that runs submitted frames back to back on a virtual clock, so
+// scheduling can be measured on the host (see tools/framesim). The caller
+// advances now by its CPU time per frame and sets gpuCost before each submit.
+struct SimulatedTimeline {
+    static const unsigned WORDS = 4;
+    static_assert(WORDS > MAX_FRAMES_IN_FLIGHT, "fences in flight need distinct slots");
+
+    SimulatedTimeline()
+        : now(0.0)
+        , gpuCost(0.0)
+        , gpuFree(0.0)
+        , gpuBusy(0.0)
+        , stalled(0.0)
+    {
+        for (unsigned i=0; i<WORDS; ++i) {
+            finish[i] = 0.0;
+        }
+    }
+
+    void submit(uint32_t fence)
+    {
+        double start = (gpuFree > now) ? gpuFree : now;
+        gpuFree = start + gpuCost;
+        gpuBusy += gpuCost;
+        finish[fence % WORDS] = gpuFree;
+    }
+
+    bool is_complete(uint32_t fence) const
+    {
+        return finish[fence % WORDS] <= now;
+    }
+
+    void wait(uint32_t fence)
+    {
+        double end = finish[fence % WORDS];
+        if (end > now) {
+            stalled += end - now;
+            now = end;
+        }
+    }
+
+    double now;
+    double gpuCost;
+    double gpuFree;
+
+    // Total GPU time submitted, and CPU time spent blocked in wait()
+    double gpuBusy;
+    double stalled;
+
+    double finish[WORDS];
+};
+
+} // end namespace vitashader
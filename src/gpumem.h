@@ -0,0 +1,70 @@
+#pragma once
+
+// Memory blocks the GPU can read, mapped for GXM. On the host these are
+// plain aligned heap allocations.
+
+#include <stddef.h>
+
+#ifdef __vita__
+#include <psp2/gxm.h>
+#include <psp2/kernel/sysmem.h>
+#else
+#include <malloc.h>
+#include <stdlib.h>
+
+typedef int SceUID;
+#endif
+
+namespace vitashader {
+
+#ifdef __vita__
+static void *
+gpu_alloc(size_t size, SceUID *uid,
+        SceKernelMemBlockType type=SCE_KERNEL_MEMBLOCK_TYPE_USER_RW_UNCACHE,
+        unsigned int attribs=SCE_GXM_MEMORY_ATTRIB_READ)
+{
+    // CDRAM blocks are allocated in 256 KiB units, everything else in 4 KiB
+    size_t granularity = (type == SCE_KERNEL_MEMBLOCK_TYPE_USER_CDRAM_RW) ? 256 * 1024 : 4 * 1024;
+    size = (size + granularity - 1) & ~(granularity - 1);
+
+    *uid = sceKernelAllocMemBlock("vitashader", type, size, NULL);
+    if (*uid < 0) {
+        return nullptr;
+    }
+
+    void *mem;
+    if (sceKernelGetMemBlockBase(*uid, &mem) < 0 ||
+            sceGxmMapMemory(mem, size, (SceGxmMemoryAttribFlags)attribs) < 0) {
+        sceKernelFreeMemBlock(*uid);
+        *uid = -1;
+        return nullptr;
+    }
+
+    return mem;
+}
+
+static void
+gpu_free(SceUID uid, void *mem)
+{
+    if (uid >= 0) {
+        sceGxmUnmapMemory(mem);
+        sceKernelFreeMemBlock(uid);
+    }
+}
+#else
+static void *
+gpu_alloc(size_t size, SceUID *uid)
+{
+    void *mem = memalign(4096, size);
+    *uid = mem ? 0 : -1;
+    return mem;
+}
+
+static void
+gpu_free(SceUID, void *mem)
+{
+    free(mem);
+}
+#endif
+
+} // end namespace vitashader
@@ -0,0 +1,473 @@
+#pragma once
+
+// Capture of the GXM calls vitashader makes, for replaying a slow frame off
+// the device. Between begin_frame() and end_frame() of an armed capture,
+// the hooks in GxmState, UniformVariable and UniformBlock append each call
+// they pass on to libgxm to an in-memory stream, together with the buffer
+// contents the call refers to. save() writes the stream to a file that
+// tools/gxmreplay reads back.
+//
+//   gxm_capture().start(10);            // the next 10 frames
+//   ...
+//   gxm_capture().begin_frame();
+//   state.set_vertex_program(...);      // recorded
+//   ...
+//   if (gxm_capture().end_frame()) {
+//       gxm_capture().save("ux0:data/vitashader.vscap");
+//   }
+//
+// Only calls made through those wrappers are seen; vita2d and direct
+// sceGxm calls are not. Capturing is for the rendering thread only.
+//
+// File layout, all little endian:
+//
+//   "VSCP" u32 version
+//   records of u8 type, u32 payload size, payload
+//
+//   FRAME            u32 frame
+//   STATE            u8 call, u8 index, u32 value       GxmState::Call
+//   OBJECT           u8 call, u8 index, u32 object id   programs, streams,
+//                                                       uniform buffers
+//   TEXTURE          u8 call, u8 index, u32 controlWords[4]
+//   UNIFORM_RESERVE  u8 stage
+//   UNIFORM_WRITE    u8 stage, u32 resource index, u32 component offset,
+//                    float components[]
+//   BUFFER           u32 buffer id, u8 bytes[]
+//   DRAW             u8 primitive, u8 index size, u32 index count,
+//                    u32 index buffer id, then per captured stream
+//                    u8 stream, u32 buffer id
+//
+// Pointers become object ids in order of first use, 0 is null. Buffers are
+// stored once per distinct content and referenced by id from later draws.
+// Render state values are the raw libgxm enums of the capturing build.
+// Readers skip record types they do not know.
+
+#ifdef __vita__
+#include <psp2/gxm.h>
+#else
+#include "hostgxm.h"
+#endif
+
+#include "hash.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <unordered_map>
+#include <vector>
+
+namespace vitashader {
+
+static const uint32_t CAPTURE_VERSION = 1;
+
+enum CaptureRecord {
+    CAPTURE_FRAME = 1,
+    CAPTURE_STATE,
+    CAPTURE_OBJECT,
+    CAPTURE_TEXTURE,
+    CAPTURE_UNIFORM_RESERVE,
+    CAPTURE_UNIFORM_WRITE,
+    CAPTURE_BUFFER,
+    CAPTURE_DRAW,
+};
+
+// Portable primitive codes, as libgxm's values differ between the Vita and
+// the host stand-in
+enum CapturePrimitive {
+    CAPTURE_TRIANGLES,
+    CAPTURE_LINES,
+    CAPTURE_POINTS,
+    CAPTURE_TRIANGLE_STRIP,
+    CAPTURE_TRIANGLE_FAN,
+    CAPTURE_TRIANGLE_EDGES,
+};
+
+static const char *
+capture_primitive_name(unsigned primitive)
+{
+    static const char *const names[] = {
+        "triangles", "lines", "points", "strip", "fan", "edges",
+    };
+    return primitive < sizeof(names) / sizeof(names[0]) ? names[primitive] : "?";
+}
+
+struct GxmCapture {
+    static const unsigned MAX_STREAMS = 16;
+
+    enum Stage {
+        VERTEX,
+        FRAGMENT,
+    };
+
+    GxmCapture()
+        : recording(false)
+        , limit(32 * 1024 * 1024)
+        , remaining(0)
+        , frames(0)
+        , truncated(false)
+        , frameStart(0)
+        , recordStart(0)
+    {
+        memset(strides, 0, sizeof(strides));
+        memset(streams, 0, sizeof(streams));
+    }
+
+    // Vertices of streams with a stride are captured with each draw, up to
+    // the highest index it uses; others are only recorded by id
+    void set_stream_stride(unsigned index, uint32_t stride)
+    {
+        if (index < MAX_STREAMS) {
+            strides[index] = stride;
+        }
+    }
+
+    // Drops any earlier capture and records the next count frames
+    void start(unsigned count)
+    {
+        data.clear();
+        objects.clear();
+        buffers.clear();
+        memset(streams, 0, sizeof(streams));
+        recording = false;
+        remaining = count;
+        frames = 0;
+        truncated = false;
+
+        put("VSCP", 4);
+        put_u32(CAPTURE_VERSION);
+    }
+
+    bool armed() const
+    {
+        return remaining != 0;
+    }
+
+    void begin_frame()
+    {
+        if (remaining) {
+            recording = true;
+            frameStart = data.size();
+            begin(CAPTURE_FRAME);
+            put_u32(frames);
+            end();
+        }
+    }
+
+    // True when the last frame of the capture just ended
+    bool end_frame()
+    {
+        if (!recording) {
+            return false;
+        }
+
+        recording = false;
+        if (data.size() > limit) {
+            // The partial frame is dropped; buffers it added are not used
+            // by any earlier frame
+            data.resize(frameStart);
+            truncated = true;
+            remaining = 0;
+            printf("GXM capture over %u bytes, stopped after %u frames\n", (unsigned)limit, frames);
+            return true;
+        }
+
+        ++frames;
+        return --remaining == 0;
+    }
+
+    bool save(const char *filename) const
+    {
+        FILE *fp = fopen(filename, "wb");
+        if (!fp) {
+            printf("Could not write capture to %s\n", filename);
+            return false;
+        }
+        bool ok = fwrite(data.data(), 1, data.size(), fp) == data.size();
+        ok = (fclose(fp) == 0) && ok;
+        if (!ok) {
+            printf("Could not write capture to %s\n", filename);
+        }
+        return ok;
+    }
+
+    void state(unsigned call, unsigned index, uint32_t value)
+    {
+        begin(CAPTURE_STATE);
+        put_u8(call);
+        put_u8(index);
+        put_u32(value);
+        end();
+    }
+
+    void object(unsigned call, unsigned index, const void *pointer)
+    {
+        begin(CAPTURE_OBJECT);
+        put_u8(call);
+        put_u8(index);
+        put_u32(object_id(pointer));
+        end();
+    }
+
+    // An object call that also sets where draws read vertices from
+    void stream(unsigned call, unsigned index, const void *pointer)
+    {
+        if (index < MAX_STREAMS) {
+            streams[index] = pointer;
+        }
+        object(call, index, pointer);
+    }
+
+    void texture(unsigned call, unsigned index, const SceGxmTexture *texture)
+    {
+        begin(CAPTURE_TEXTURE);
+        put_u8(call);
+        put_u8(index);
+        if (texture) {
+            put(texture, 16);
+        } else {
+            put_zero(16);
+        }
+        end();
+    }
+
+    void uniform_reserve(Stage stage)
+    {
+        begin(CAPTURE_UNIFORM_RESERVE);
+        put_u8(stage);
+        end();
+    }
+
+    void uniform_write(Stage stage, const SceGxmProgramParameter *parameter, unsigned offset,
+            unsigned count, const float *values)
+    {
+        begin(CAPTURE_UNIFORM_WRITE);
+        put_u8(stage);
+        put_u32(parameter ? sceGxmProgramParameterGetResourceIndex(parameter) : ~0u);
+        put_u32(offset);
+        put(values, count * sizeof(float));
+        end();
+    }
+
+    void draw(SceGxmPrimitiveType primitive, SceGxmIndexFormat format, const void *indices, unsigned count)
+    {
+        uint32_t indexSize = (format == SCE_GXM_INDEX_FORMAT_U32) ? 4 : 2;
+        uint32_t indexBuffer = indices ? buffer(indices, count * indexSize) : 0;
+
+        uint32_t vertexCount = 0;
+        if (indices && count) {
+            vertexCount = max_index(indices, indexSize, count) + 1;
+        }
+
+        uint32_t vertexBuffers[MAX_STREAMS];
+        for (unsigned i=0; i<MAX_STREAMS; ++i) {
+            vertexBuffers[i] = (strides[i] && streams[i] && vertexCount) ?
+                buffer(streams[i], vertexCount * strides[i]) : 0;
+        }
+
+        begin(CAPTURE_DRAW);
+        put_u8(capture_primitive(primitive));
+        put_u8(indexSize);
+        put_u32(count);
+        put_u32(indexBuffer);
+        for (unsigned i=0; i<MAX_STREAMS; ++i) {
+            if (vertexBuffers[i]) {
+                put_u8(i);
+                put_u32(vertexBuffers[i]);
+            }
+        }
+        end();
+    }
+
+    // Checked by the hooks before anything is recorded
+    bool recording;
+
+    // Bytes kept in memory before the capture stops
+    size_t limit;
+
+    std::vector<uint8_t> data;
+    unsigned remaining;
+    unsigned frames;
+    bool truncated;
+
+private:
+    static uint8_t capture_primitive(SceGxmPrimitiveType primitive)
+    {
+        switch (primitive) {
+        case SCE_GXM_PRIMITIVE_LINES: return CAPTURE_LINES;
+        case SCE_GXM_PRIMITIVE_POINTS: return CAPTURE_POINTS;
+        case SCE_GXM_PRIMITIVE_TRIANGLE_STRIP: return CAPTURE_TRIANGLE_STRIP;
+        case SCE_GXM_PRIMITIVE_TRIANGLE_FAN: return CAPTURE_TRIANGLE_FAN;
+        case SCE_GXM_PRIMITIVE_TRIANGLE_EDGES: return CAPTURE_TRIANGLE_EDGES;
+        default: return CAPTURE_TRIANGLES;
+        }
+    }
+
+    static uint32_t max_index(const void *indices, uint32_t indexSize, unsigned count)
+    {
+        uint32_t result = 0;
+        for (unsigned i=0; i<count; ++i) {
+            uint32_t index;
+            if (indexSize == 4) {
+                index = ((const uint32_t *)indices)[i];
+            } else {
+                index = ((const uint16_t *)indices)[i];
+            }
+            if (index > result) {
+                result = index;
+            }
+        }
+        return result;
+    }
+
+    uint32_t object_id(const void *pointer)
+    {
+        if (!pointer) {
+            return 0;
+        }
+        auto it = objects.find(pointer);
+        if (it != objects.end()) {
+            return it->second;
+        }
+        uint32_t id = objects.size() + 1;
+        objects.emplace(pointer, id);
+        return id;
+    }
+
+    // Id of a buffer with these contents, writing it out on first sight
+    uint32_t buffer(const void *contents, size_t size)
+    {
+        uint64_t hash = fnv1a(&size, sizeof(size), fnv1a(contents, size));
+        auto it = buffers.find(hash);
+        if (it != buffers.end()) {
+            return it->second;
+        }
+
+        uint32_t id = buffers.size() + 1;
+        buffers.emplace(hash, id);
+        begin(CAPTURE_BUFFER);
+        put_u32(id);
+        put(contents, size);
+        end();
+        return id;
+    }
+
+    void begin(CaptureRecord type)
+    {
+        put_u8(type);
+        recordStart = data.size();
+        put_u32(0);
+    }
+
+    void end()
+    {
+        uint32_t size = data.size() - recordStart - 4;
+        memcpy(&data[recordStart], &size, 4);
+    }
+
+    void put(const void *bytes, size_t size)
+    {
+        const uint8_t *p = (const uint8_t *)bytes;
+        data.insert(data.end(), p, p + size);
+    }
+
+    void put_zero(size_t size)
+    {
+        data.resize(data.size() + size, 0);
+    }
+
+    void put_u8(uint8_t value)
+    {
+        data.push_back(value);
+    }
+
+    void put_u32(uint32_t value)
+    {
+        put(&value, 4);
+    }
+
+    uint32_t strides[MAX_STREAMS];
+    const void *streams[MAX_STREAMS];
+
+    std::unordered_map<const void *, uint32_t> objects;
+    std::unordered_map<uint64_t, uint32_t> buffers;
+    size_t frameStart;
+    size_t recordStart;
+};
+
+static GxmCapture &
+gxm_capture()
+{
+    static GxmCapture instance;
+    return instance;
+}
+
+// One record of a capture file, pointing into the loaded bytes
+struct CaptureRecordView {
+    uint8_t type;
+    uint32_t size;
+    const uint8_t *payload;
+
+    uint8_t u8(size_t offset) const
+    {
+        return offset < size ? payload[offset] : 0;
+    }
+
+    uint32_t u32(size_t offset) const
+    {
+        uint32_t value = 0;
+        if (offset + 4 <= size) {
+            memcpy(&value, payload + offset, 4);
+        }
+        return value;
+    }
+};
+
+// Splits a capture file into records; false if it is not a capture or
+// ends inside a record
+static bool
+parse_capture(const std::vector<uint8_t> &file, std::vector<CaptureRecordView> &records)
+{
+    records.clear();
+    if (file.size() < 8 || memcmp(file.data(), "VSCP", 4) != 0) {
+        return false;
+    }
+
+    uint32_t version;
+    memcpy(&version, &file[4], 4);
+    if (version != CAPTURE_VERSION) {
+        printf("Capture version %u, expected %u\n", version, CAPTURE_VERSION);
+        return false;
+    }
+
+    size_t pos = 8;
+    while (pos < file.size()) {
+        if (file.size() - pos < 5) {
+            return false;
+        }
+        CaptureRecordView record;
+        record.type = file[pos];
+        memcpy(&record.size, &file[pos + 1], 4);
+        pos += 5;
+        if (file.size() - pos < record.size) {
+            return false;
+        }
+        record.payload = file.data() + pos;
+        records.push_back(record);
+        pos += record.size;
+    }
+    return true;
+}
+
+} // end namespace vitashader
+
+#ifndef VS_CAPTURE_DISABLE
+#define VS_CAPTURE(call) \
+    do { \
+        if (vitashader::gxm_capture().recording) { \
+            vitashader::gxm_capture().call; \
+        } \
+    } while (0)
+#else
+#define VS_CAPTURE(call) do {} while (0)
+#endif
@@ -0,0 +1,305 @@
+#pragma once
+
+// Shadow of the render state vitashader sets on a GXM context. Each setter
+// compares with the last value it passed on and only calls libgxm when the
+// state actually changes, counting issued and elided calls per entry point.
+// Issued calls are also what an active GxmCapture records.
+//
+// The shadow only knows about calls made through it. Call invalidate()
+// whenever something else may have touched the context (vita2d drawing or
+// clearing, a new scene); the next set of every state then goes through.
+
+#ifdef __vita__
+#include <psp2/gxm.h>
+#else
+#include "hostgxm.h"
+#endif
+
+#include "gxmcapture.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace vitashader {
+
+struct GxmState {
+    // Units, streams and buffers beyond these are passed through unshadowed
+    static const unsigned TEXTURE_UNITS = 16;
+    static const unsigned VERTEX_STREAMS = 16;
+    static const unsigned UNIFORM_BUFFERS = SCE_GXM_MAX_UNIFORM_BUFFERS;
+
+    enum Call {
+        VERTEX_PROGRAM,
+        FRAGMENT_PROGRAM,
+        FRAGMENT_TEXTURE,
+        VERTEX_TEXTURE,
+        VERTEX_STREAM,
+        FRONT_POLYGON_MODE,
+        BACK_POLYGON_MODE,
+        CULL_MODE,
+        TWO_SIDED,
+        FRONT_DEPTH_FUNC,
+        BACK_DEPTH_FUNC,
+        FRONT_DEPTH_WRITE,
+        BACK_DEPTH_WRITE,
+        VERTEX_UNIFORM_BUFFER,
+        CALLS,
+    };
+
+    static const char *call_name(Call call)
+    {
+        static const char *const names[CALLS] = {
+            "sceGxmSetVertexProgram",
+            "sceGxmSetFragmentProgram",
+            "sceGxmSetFragmentTexture",
+            "sceGxmSetVertexTexture",
+            "sceGxmSetVertexStream",
+            "sceGxmSetFrontPolygonMode",
+            "sceGxmSetBackPolygonMode",
+            "sceGxmSetCullMode",
+            "sceGxmSetTwoSidedEnable",
+            "sceGxmSetFrontDepthFunc",
+            "sceGxmSetBackDepthFunc",
+            "sceGxmSetFrontDepthWriteEnable",
+            "sceGxmSetBackDepthWriteEnable",
+            "sceGxmSetVertexUniformBuffer",
+        };
+        return names[call];
+    }
+
+    explicit GxmState(SceGxmContext *context)
+        : context(context)
+    {
+        invalidate();
+        reset_counters();
+    }
+
+    // Forgets all shadowed state
+    void invalidate()
+    {
+        memset(known, 0, sizeof(known));
+        memset(textureKnown, 0, sizeof(textureKnown));
+        memset(streamKnown, 0, sizeof(streamKnown));
+        memset(uniformBufferKnown, 0, sizeof(uniformBufferKnown));
+    }
+
+    void reset_counters()
+    {
+        memset(issued, 0, sizeof(issued));
+        memset(elided, 0, sizeof(elided));
+        draws = 0;
+    }
+
+    void set_vertex_program(const SceGxmVertexProgram *program)
+    {
+        if (changed(VERTEX_PROGRAM, (uintptr_t)program)) {
+            sceGxmSetVertexProgram(context, program);
+            VS_CAPTURE(object(VERTEX_PROGRAM, 0, program));
+        }
+    }
+
+    void set_fragment_program(const SceGxmFragmentProgram *program)
+    {
+        if (changed(FRAGMENT_PROGRAM, (uintptr_t)program)) {
+            sceGxmSetFragmentProgram(context, program);
+            VS_CAPTURE(object(FRAGMENT_PROGRAM, 0, program));
+        }
+    }
+
+    // Textures are compared by their control words, not their address, as
+    // GXM copies them when they are set
+    void set_fragment_texture(unsigned index, const SceGxmTexture *texture)
+    {
+        if (texture_changed(FRAGMENT_TEXTURE, index, texture)) {
+            sceGxmSetFragmentTexture(context, index, texture);
+            VS_CAPTURE(texture(FRAGMENT_TEXTURE, index, texture));
+        }
+    }
+
+    void set_vertex_texture(unsigned index, const SceGxmTexture *texture)
+    {
+        if (texture_changed(VERTEX_TEXTURE, index, texture)) {
+            sceGxmSetVertexTexture(context, index, texture);
+            VS_CAPTURE(texture(VERTEX_TEXTURE, index, texture));
+        }
+    }
+
+    void set_vertex_stream(unsigned index, const void *data)
+    {
+        if (index < VERTEX_STREAMS) {
+            if (streamKnown[index] && streams[index] == data) {
+                ++elided[VERTEX_STREAM];
+                return;
+            }
+            streamKnown[index] = true;
+            streams[index] = data;
+        }
+        ++issued[VERTEX_STREAM];
+        sceGxmSetVertexStream(context, index, data);
+        VS_CAPTURE(stream(VERTEX_STREAM, index, data));
+    }
+
+    // Compared by address only: rewriting a bound buffer in place is not
+    // seen, which the per-frame ring allocations never do
+    void set_vertex_uniform_buffer(unsigned index, const void *data)
+    {
+        if (index < UNIFORM_BUFFERS) {
+            if (uniformBufferKnown[index] && uniformBuffers[index] == data) {
+                ++elided[VERTEX_UNIFORM_BUFFER];
+                return;
+            }
+            uniformBufferKnown[index] = true;
+            uniformBuffers[index] = data;
+        }
+        ++issued[VERTEX_UNIFORM_BUFFER];
+        sceGxmSetVertexUniformBuffer(context, index, data);
+        VS_CAPTURE(object(VERTEX_UNIFORM_BUFFER, index, data));
+    }
+
+    void set_front_polygon_mode(SceGxmPolygonMode mode)
+    {
+        if (changed(FRONT_POLYGON_MODE, mode)) {
+            sceGxmSetFrontPolygonMode(context, mode);
+            VS_CAPTURE(state(FRONT_POLYGON_MODE, 0, mode));
+        }
+    }
+
+    void set_back_polygon_mode(SceGxmPolygonMode mode)
+    {
+        if (changed(BACK_POLYGON_MODE, mode)) {
+            sceGxmSetBackPolygonMode(context, mode);
+            VS_CAPTURE(state(BACK_POLYGON_MODE, 0, mode));
+        }
+    }
+
+    void set_cull_mode(SceGxmCullMode mode)
+    {
+        if (changed(CULL_MODE, mode)) {
+            sceGxmSetCullMode(context, mode);
+            VS_CAPTURE(state(CULL_MODE, 0, mode));
+        }
+    }
+
+    void set_two_sided_enable(SceGxmTwoSidedMode mode)
+    {
+        if (changed(TWO_SIDED, mode)) {
+            sceGxmSetTwoSidedEnable(context, mode);
+            VS_CAPTURE(state(TWO_SIDED, 0, mode));
+        }
+    }
+
+    void set_front_depth_func(SceGxmDepthFunc func)
+    {
+        if (changed(FRONT_DEPTH_FUNC, func)) {
+            sceGxmSetFrontDepthFunc(context, func);
+            VS_CAPTURE(state(FRONT_DEPTH_FUNC, 0, func));
+        }
+    }
+
+    void set_back_depth_func(SceGxmDepthFunc func)
+    {
+        if (changed(BACK_DEPTH_FUNC, func)) {
+            sceGxmSetBackDepthFunc(context, func);
+            VS_CAPTURE(state(BACK_DEPTH_FUNC, 0, func));
+        }
+    }
+
+    void set_front_depth_write_enable(SceGxmDepthWriteMode mode)
+    {
+        if (changed(FRONT_DEPTH_WRITE, mode)) {
+            sceGxmSetFrontDepthWriteEnable(context, mode);
+            VS_CAPTURE(state(FRONT_DEPTH_WRITE, 0, mode));
+        }
+    }
+
+    void set_back_depth_write_enable(SceGxmDepthWriteMode mode)
+    {
+        if (changed(BACK_DEPTH_WRITE, mode)) {
+            sceGxmSetBackDepthWriteEnable(context, mode);
+            VS_CAPTURE(state(BACK_DEPTH_WRITE, 0, mode));
+        }
+    }
+
+    void draw(SceGxmPrimitiveType primitive, SceGxmIndexFormat format, const void *indices, unsigned count)
+    {
+        ++draws;
+        sceGxmDraw(context, primitive, format, indices, count);
+        VS_CAPTURE(draw(primitive, format, indices, count));
+    }
+
+    unsigned total_issued() const
+    {
+        unsigned total = 0;
+        for (int i=0; i<CALLS; ++i) {
+            total += issued[i];
+        }
+        return total;
+    }
+
+    unsigned total_elided() const
+    {
+        unsigned total = 0;
+        for (int i=0; i<CALLS; ++i) {
+            total += elided[i];
+        }
+        return total;
+    }
+
+    void print_stats(FILE *fp) const
+    {
+        fprintf(fp, "%-32s %10s %10s\n", "gxm call", "issued", "elided");
+        for (int i=0; i<CALLS; ++i) {
+            if (issued[i] || elided[i]) {
+                fprintf(fp, "%-32s %10u %10u\n", call_name((Call)i), issued[i], elided[i]);
+            }
+        }
+        fprintf(fp, "%-32s %10u %10u\n", "total", total_issued(), total_elided());
+        fprintf(fp, "%-32s %10u\n", "sceGxmDraw", draws);
+    }
+
+    // True if the call has to be made
+    bool changed(Call call, uintptr_t value)
+    {
+        if (known[call] && current[call] == value) {
+            ++elided[call];
+            return false;
+        }
+        known[call] = true;
+        current[call] = value;
+        ++issued[call];
+        return true;
+    }
+
+    bool texture_changed(Call call, unsigned index, const SceGxmTexture *texture)
+    {
+        int stage = (call == VERTEX_TEXTURE) ? 1 : 0;
+        if (index < TEXTURE_UNITS && texture) {
+            if (textureKnown[stage][index] && memcmp(&textures[stage][index], texture, sizeof(SceGxmTexture)) == 0) {
+                ++elided[call];
+                return false;
+            }
+            textureKnown[stage][index] = true;
+            textures[stage][index] = *texture;
+        }
+        ++issued[call];
+        return true;
+    }
+
+    SceGxmContext *context;
+
+    uintptr_t current[CALLS];
+    bool known[CALLS];
+    SceGxmTexture textures[2][TEXTURE_UNITS];
+    bool textureKnown[2][TEXTURE_UNITS];
+    const void *streams[VERTEX_STREAMS];
+    bool streamKnown[VERTEX_STREAMS];
+    const void *uniformBuffers[UNIFORM_BUFFERS];
+    bool uniformBufferKnown[UNIFORM_BUFFERS];
+
+    unsigned issued[CALLS];
+    unsigned elided[CALLS];
+    unsigned draws;
+};
+
+} // end namespace vitashader
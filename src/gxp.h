@@ -0,0 +1,261 @@
+#pragma once
+
+// Portable reader for compiled GXP shader binaries. Builds a reflection
+// index of a program's parameters with hashed lookup by name, so tools and
+// host builds can inspect shaders without libgxm and the device does not
+// have to scan parameter names linearly.
+
+#include "hash.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+namespace vitashader {
+namespace gxp {
+
+// Offsets into the program header and parameter records as this reader
+// assumes them; tools/gxpcheck holds them to compiled programs and the
+// device's own reflection of them. Offsets stored in the header are
+// relative to the field holding them.
+enum {
+    HEADER_MAGIC = 0x00,
+    HEADER_VERSION = 0x04,
+    HEADER_SIZE = 0x08,
+    HEADER_TYPE = 0x18,
+    HEADER_PARAMETER_COUNT = 0x24,
+    HEADER_PARAMETERS_OFFSET = 0x28,
+    HEADER_DEFAULT_UNIFORM_BUFFER_COUNT = 0x64,
+    HEADER_CONTAINER_COUNT = 0x90,
+    HEADER_CONTAINER_OFFSET = 0x94,
+    HEADER_END = 0xA0,
+
+    PARAMETER_NAME_OFFSET = 0x00,
+    PARAMETER_FLAGS = 0x04,
+    PARAMETER_SEMANTIC = 0x06,
+    PARAMETER_SEMANTIC_INDEX = 0x07,
+    PARAMETER_ARRAY_SIZE = 0x08,
+    PARAMETER_RESOURCE_INDEX = 0x0C,
+    PARAMETER_SIZE = 0x10,
+
+    CONTAINER_INDEX = 0x00,
+    CONTAINER_BASE_SA_OFFSET = 0x04,
+    CONTAINER_MAX_RESOURCE_INDEX = 0x06,
+    CONTAINER_SIZE = 0x08,
+};
+
+// Values of SceGxmParameterCategory
+enum Category {
+    CATEGORY_ATTRIBUTE,
+    CATEGORY_UNIFORM,
+    CATEGORY_SAMPLER,
+    CATEGORY_AUXILIARY_SURFACE,
+    CATEGORY_UNIFORM_BUFFER,
+};
+
+struct Parameter {
+    const char *name;
+    uint8_t category;
+    uint8_t type;
+    uint8_t componentCount;
+    uint8_t containerIndex;
+    uint8_t semantic;
+    uint8_t semanticIndex;
+    uint32_t arraySize;
+    uint32_t resourceIndex;
+
+    // The parameter record inside the program, usable as SceGxmProgramParameter
+    const void *record;
+};
+
+struct Container {
+    uint16_t containerIndex;
+    uint16_t baseSaOffset;
+    uint16_t maxResourceIndex;
+    uint32_t offset;
+};
+
+static uint16_t
+read16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t
+read32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+struct Reflection {
+    Reflection()
+        : data(nullptr)
+        , size(0)
+        , type(0)
+        , defaultUniformBufferCount(0)
+        , error(nullptr)
+    {
+    }
+
+    // Parses a program of at most len bytes. On failure returns false and
+    // leaves a description in error; the data must outlive the index.
+    bool parse(const void *program, size_t len)
+    {
+        const uint8_t *p = (const uint8_t *)program;
+
+        data = p;
+        parameters.clear();
+        containers.clear();
+        table.clear();
+        error = nullptr;
+
+        if (len < HEADER_END || memcmp(p + HEADER_MAGIC, "GXP\0", 4) != 0) {
+            return fail("not a GXP program");
+        }
+
+        size = read32(p + HEADER_SIZE);
+        if (size < HEADER_END || size > len) {
+            return fail("program size exceeds buffer");
+        }
+
+        type = p[HEADER_TYPE] & 1;
+        defaultUniformBufferCount = read32(p + HEADER_DEFAULT_UNIFORM_BUFFER_COUNT);
+
+        uint32_t count = read32(p + HEADER_PARAMETER_COUNT);
+        uint32_t offset = HEADER_PARAMETERS_OFFSET + read32(p + HEADER_PARAMETERS_OFFSET);
+        if (count > (size - HEADER_END) / PARAMETER_SIZE || offset > size - count * PARAMETER_SIZE) {
+            return fail("parameter table out of bounds");
+        }
+
+        parameters.reserve(count);
+        for (uint32_t i=0; i<count; ++i) {
+            uint32_t at = offset + i * PARAMETER_SIZE;
+            const uint8_t *record = p + at;
+
+            uint32_t nameAt = at + (int32_t)read32(record + PARAMETER_NAME_OFFSET);
+            if (nameAt >= size || !memchr(p + nameAt, '\0', size - nameAt)) {
+                return fail("parameter name out of bounds");
+            }
+
+            uint16_t flags = read16(record + PARAMETER_FLAGS);
+            parameters.emplace_back(Parameter{
+                    (const char *)p + nameAt,
+                    (uint8_t)(flags & 0xF),
+                    (uint8_t)((flags >> 4) & 0xF),
+                    (uint8_t)((flags >> 8) & 0xF),
+                    (uint8_t)((flags >> 12) & 0xF),
+                    record[PARAMETER_SEMANTIC],
+                    record[PARAMETER_SEMANTIC_INDEX],
+                    read32(record + PARAMETER_ARRAY_SIZE),
+                    read32(record + PARAMETER_RESOURCE_INDEX),
+                    record,
+            });
+        }
+
+        count = read32(p + HEADER_CONTAINER_COUNT);
+        offset = HEADER_CONTAINER_OFFSET + read32(p + HEADER_CONTAINER_OFFSET);
+        if (count > 0) {
+            if (count > (size - HEADER_END) / CONTAINER_SIZE || offset > size - count * CONTAINER_SIZE) {
+                return fail("container table out of bounds");
+            }
+
+            for (uint32_t i=0; i<count; ++i) {
+                uint32_t at = offset + i * CONTAINER_SIZE;
+                containers.emplace_back(Container{
+                        read16(p + at + CONTAINER_INDEX),
+                        read16(p + at + CONTAINER_BASE_SA_OFFSET),
+                        read16(p + at + CONTAINER_MAX_RESOURCE_INDEX),
+                        at,
+                });
+            }
+        }
+
+        build_table();
+        return true;
+    }
+
+    const Parameter *find(const char *name) const
+    {
+        if (table.empty()) {
+            return nullptr;
+        }
+
+        size_t mask = table.size() - 1;
+        for (size_t slot = fnv1a(name) & mask; table[slot]; slot = (slot + 1) & mask) {
+            const Parameter *parameter = &parameters[table[slot] - 1];
+            if (strcmp(parameter->name, name) == 0) {
+                return parameter;
+            }
+        }
+
+        return nullptr;
+    }
+
+    // Prints the same fields as dump_program() in main.cpp does through libgxm
+    template <typename Printf>
+    void dump(Printf print) const
+    {
+        if (error) {
+            print(" Check = failed (%s)\n", error);
+            return;
+        }
+
+        print(" Check = 0x%08x\n", 0u);
+        print(" Size = %u\n", (unsigned)size);
+        print(" Type = 0x%08x\n", (unsigned)type);
+
+        print(" Params = %u\n", (unsigned)parameters.size());
+        for (size_t i=0; i<parameters.size(); ++i) {
+            const Parameter &parameter = parameters[i];
+            print("  params[%u] = {cat=0x%08x, name=%s, semantic=0x%08x, type=0x%08x, comp=%u, asize=%u}\n",
+                    (unsigned)i,
+                    (unsigned)parameter.category,
+                    parameter.name,
+                    (unsigned)parameter.semantic,
+                    (unsigned)parameter.type,
+                    (unsigned)parameter.componentCount,
+                    (unsigned)parameter.arraySize);
+        }
+    }
+
+    bool fail(const char *message)
+    {
+        error = message;
+        parameters.clear();
+        containers.clear();
+        table.clear();
+        return false;
+    }
+
+    // Open addressing, at most half full; slots hold parameter index + 1
+    void build_table()
+    {
+        size_t slots = 4;
+        while (slots < parameters.size() * 2) {
+            slots *= 2;
+        }
+
+        table.assign(slots, 0);
+        for (size_t i=0; i<parameters.size(); ++i) {
+            size_t slot = fnv1a(parameters[i].name) & (slots - 1);
+            while (table[slot]) {
+                slot = (slot + 1) & (slots - 1);
+            }
+            table[slot] = i + 1;
+        }
+    }
+
+    const uint8_t *data;
+    uint32_t size;
+    uint8_t type;
+    uint32_t defaultUniformBufferCount;
+    const char *error;
+
+    std::vector<Parameter> parameters;
+    std::vector<Container> containers;
+    std::vector<uint32_t> table;
+};
+
+} // end namespace gxp
+} // end namespace vitashader
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace vitashader {
+
+static const uint64_t FNV1A_SEED = 0xcbf29ce484222325ull;
+
+// 64-bit FNV-1a; pass the previous result as seed to hash several fields
+static uint64_t
+fnv1a(const void *data, size_t len, uint64_t seed=FNV1A_SEED)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    uint64_t h = seed;
+    for (size_t i=0; i<len; ++i) {
+        h = (h ^ p[i]) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+static uint64_t
+fnv1a(const char *str, uint64_t seed=FNV1A_SEED)
+{
+    uint64_t h = seed;
+    while (*str) {
+        h = (h ^ (uint8_t)*str++) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+} // end namespace vitashader
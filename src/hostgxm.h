@@ -0,0 +1,503 @@
+#pragma once
+
+// Host stand-in for the parts of <psp2/gxm.h> used by vitashader, so the
+// library can be built and exercised on Linux. Objects created through the
+// patcher are dummies; every entry point bumps a counter in host_gxm().
+// Render state set on the context is kept in host_gxm().state, and with
+// recordDraws every sceGxmDraw appends a copy of it to drawStates, and
+// failVertexPrograms/failFragmentPrograms make the next patches fail.
+// Parameter lookups go through the GXP reader, so host tools pass programs
+// in GXP layout (see tools/fakegxp.h).
+
+#ifdef __vita__
+#error "hostgxm.h is for host builds only, use <psp2/gxm.h>"
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <map>
+#include <vector>
+
+#include "gxp.h"
+
+typedef enum SceGxmAttributeFormat {
+    SCE_GXM_ATTRIBUTE_FORMAT_U8,
+    SCE_GXM_ATTRIBUTE_FORMAT_U8N,
+    SCE_GXM_ATTRIBUTE_FORMAT_S8,
+    SCE_GXM_ATTRIBUTE_FORMAT_S8N,
+    SCE_GXM_ATTRIBUTE_FORMAT_U16,
+    SCE_GXM_ATTRIBUTE_FORMAT_U16N,
+    SCE_GXM_ATTRIBUTE_FORMAT_S16,
+    SCE_GXM_ATTRIBUTE_FORMAT_S16N,
+    SCE_GXM_ATTRIBUTE_FORMAT_F16,
+    SCE_GXM_ATTRIBUTE_FORMAT_F32,
+    SCE_GXM_ATTRIBUTE_FORMAT_UNTYPED,
+} SceGxmAttributeFormat;
+
+typedef enum SceGxmIndexSource {
+    SCE_GXM_INDEX_SOURCE_INDEX_16BIT    = 0x00000000,
+    SCE_GXM_INDEX_SOURCE_INDEX_32BIT    = 0x00000001,
+    SCE_GXM_INDEX_SOURCE_INSTANCE_16BIT = 0x00000002,
+    SCE_GXM_INDEX_SOURCE_INSTANCE_32BIT = 0x00000003,
+} SceGxmIndexSource;
+
+typedef enum SceGxmMultisampleMode {
+    SCE_GXM_MULTISAMPLE_NONE,
+    SCE_GXM_MULTISAMPLE_2X,
+    SCE_GXM_MULTISAMPLE_4X,
+} SceGxmMultisampleMode;
+
+typedef enum SceGxmOutputRegisterFormat {
+    SCE_GXM_OUTPUT_REGISTER_FORMAT_DECLARED,
+    SCE_GXM_OUTPUT_REGISTER_FORMAT_UCHAR4,
+    SCE_GXM_OUTPUT_REGISTER_FORMAT_CHAR4,
+    SCE_GXM_OUTPUT_REGISTER_FORMAT_USHORT2,
+    SCE_GXM_OUTPUT_REGISTER_FORMAT_SHORT2,
+    SCE_GXM_OUTPUT_REGISTER_FORMAT_HALF4,
+    SCE_GXM_OUTPUT_REGISTER_FORMAT_HALF2,
+    SCE_GXM_OUTPUT_REGISTER_FORMAT_FLOAT2,
+    SCE_GXM_OUTPUT_REGISTER_FORMAT_FLOAT,
+} SceGxmOutputRegisterFormat;
+
+typedef enum SceGxmColorMask {
+    SCE_GXM_COLOR_MASK_NONE = 0,
+    SCE_GXM_COLOR_MASK_A    = (1 << 0),
+    SCE_GXM_COLOR_MASK_R    = (1 << 1),
+    SCE_GXM_COLOR_MASK_G    = (1 << 2),
+    SCE_GXM_COLOR_MASK_B    = (1 << 3),
+    SCE_GXM_COLOR_MASK_ALL  = (SCE_GXM_COLOR_MASK_A | SCE_GXM_COLOR_MASK_B | SCE_GXM_COLOR_MASK_G | SCE_GXM_COLOR_MASK_R),
+} SceGxmColorMask;
+
+typedef enum SceGxmBlendFunc {
+    SCE_GXM_BLEND_FUNC_NONE,
+    SCE_GXM_BLEND_FUNC_ADD,
+    SCE_GXM_BLEND_FUNC_SUBTRACT,
+    SCE_GXM_BLEND_FUNC_REVERSE_SUBTRACT,
+    SCE_GXM_BLEND_FUNC_MIN,
+    SCE_GXM_BLEND_FUNC_MAX,
+} SceGxmBlendFunc;
+
+typedef enum SceGxmBlendFactor {
+    SCE_GXM_BLEND_FACTOR_ZERO,
+    SCE_GXM_BLEND_FACTOR_ONE,
+    SCE_GXM_BLEND_FACTOR_SRC_COLOR,
+    SCE_GXM_BLEND_FACTOR_ONE_MINUS_SRC_COLOR,
+    SCE_GXM_BLEND_FACTOR_SRC_ALPHA,
+    SCE_GXM_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+    SCE_GXM_BLEND_FACTOR_DST_COLOR,
+    SCE_GXM_BLEND_FACTOR_ONE_MINUS_DST_COLOR,
+    SCE_GXM_BLEND_FACTOR_DST_ALPHA,
+    SCE_GXM_BLEND_FACTOR_ONE_MINUS_DST_ALPHA,
+    SCE_GXM_BLEND_FACTOR_SRC_ALPHA_SATURATE,
+    SCE_GXM_BLEND_FACTOR_DST_ALPHA_SATURATE,
+} SceGxmBlendFactor;
+
+typedef enum SceGxmPrimitiveType {
+    SCE_GXM_PRIMITIVE_TRIANGLES,
+    SCE_GXM_PRIMITIVE_LINES,
+    SCE_GXM_PRIMITIVE_POINTS,
+    SCE_GXM_PRIMITIVE_TRIANGLE_STRIP,
+    SCE_GXM_PRIMITIVE_TRIANGLE_FAN,
+    SCE_GXM_PRIMITIVE_TRIANGLE_EDGES,
+} SceGxmPrimitiveType;
+
+typedef enum SceGxmIndexFormat {
+    SCE_GXM_INDEX_FORMAT_U16,
+    SCE_GXM_INDEX_FORMAT_U32,
+} SceGxmIndexFormat;
+
+typedef enum SceGxmPolygonMode {
+    SCE_GXM_POLYGON_MODE_TRIANGLE_FILL,
+    SCE_GXM_POLYGON_MODE_LINE,
+    SCE_GXM_POLYGON_MODE_POINT_10UL,
+    SCE_GXM_POLYGON_MODE_TRIANGLE_LINE,
+    SCE_GXM_POLYGON_MODE_TRIANGLE_POINT,
+} SceGxmPolygonMode;
+
+typedef enum SceGxmCullMode {
+    SCE_GXM_CULL_NONE,
+    SCE_GXM_CULL_CW,
+    SCE_GXM_CULL_CCW,
+} SceGxmCullMode;
+
+typedef enum SceGxmTwoSidedMode {
+    SCE_GXM_TWO_SIDED_DISABLED,
+    SCE_GXM_TWO_SIDED_ENABLED,
+} SceGxmTwoSidedMode;
+
+typedef enum SceGxmDepthFunc {
+    SCE_GXM_DEPTH_FUNC_NEVER,
+    SCE_GXM_DEPTH_FUNC_LESS,
+    SCE_GXM_DEPTH_FUNC_EQUAL,
+    SCE_GXM_DEPTH_FUNC_LESS_EQUAL,
+    SCE_GXM_DEPTH_FUNC_GREATER,
+    SCE_GXM_DEPTH_FUNC_NOT_EQUAL,
+    SCE_GXM_DEPTH_FUNC_GREATER_EQUAL,
+    SCE_GXM_DEPTH_FUNC_ALWAYS,
+} SceGxmDepthFunc;
+
+typedef enum SceGxmDepthWriteMode {
+    SCE_GXM_DEPTH_WRITE_DISABLED,
+    SCE_GXM_DEPTH_WRITE_ENABLED,
+} SceGxmDepthWriteMode;
+
+typedef enum SceGxmParameterCategory {
+    SCE_GXM_PARAMETER_CATEGORY_ATTRIBUTE,
+    SCE_GXM_PARAMETER_CATEGORY_UNIFORM,
+    SCE_GXM_PARAMETER_CATEGORY_SAMPLER,
+    SCE_GXM_PARAMETER_CATEGORY_AUXILIARY_SURFACE,
+    SCE_GXM_PARAMETER_CATEGORY_UNIFORM_BUFFER,
+} SceGxmParameterCategory;
+
+#define SCE_GXM_MAX_UNIFORM_BUFFERS 14
+
+typedef struct SceGxmBlendInfo {
+    SceGxmColorMask colorMask : 8;
+    SceGxmBlendFunc colorFunc : 4;
+    SceGxmBlendFunc alphaFunc : 4;
+    SceGxmBlendFactor colorSrc : 4;
+    SceGxmBlendFactor colorDst : 4;
+    SceGxmBlendFactor alphaSrc : 4;
+    SceGxmBlendFactor alphaDst : 4;
+} SceGxmBlendInfo;
+
+typedef struct SceGxmVertexAttribute {
+    uint16_t streamIndex;
+    uint16_t offset;
+    uint8_t format;
+    uint8_t componentCount;
+    uint16_t regIndex;
+} SceGxmVertexAttribute;
+
+typedef struct SceGxmVertexStream {
+    uint16_t stride;
+    uint16_t indexSource;
+} SceGxmVertexStream;
+
+typedef struct SceGxmTexture {
+    uint32_t controlWords[4];
+} SceGxmTexture;
+
+typedef struct SceGxmContext SceGxmContext;
+typedef struct SceGxmShaderPatcher SceGxmShaderPatcher;
+typedef struct SceGxmProgram SceGxmProgram;
+typedef struct SceGxmVertexProgram SceGxmVertexProgram;
+typedef struct SceGxmFragmentProgram SceGxmFragmentProgram;
+typedef struct SceGxmRegisteredProgram *SceGxmShaderPatcherId;
+
+// Same 16 bytes as the parameter records inside a GXP, see gxp.h
+typedef struct SceGxmProgramParameter {
+    int32_t nameOffset;
+    uint16_t flags;
+    uint8_t semantic;
+    uint8_t semanticIndex;
+    uint32_t arraySize;
+    uint32_t resourceIndex;
+} SceGxmProgramParameter;
+
+// What a draw would see; unset state is zero
+struct HostGxmState {
+    const SceGxmVertexProgram *vertexProgram;
+    const SceGxmFragmentProgram *fragmentProgram;
+    SceGxmTexture fragmentTextures[16];
+    SceGxmTexture vertexTextures[16];
+    const void *streams[16];
+    const void *vertexUniformBuffers[SCE_GXM_MAX_UNIFORM_BUFFERS];
+    int frontPolygonMode;
+    int backPolygonMode;
+    int cullMode;
+    int twoSided;
+    int frontDepthFunc;
+    int backDepthFunc;
+    int frontDepthWrite;
+    int backDepthWrite;
+
+    bool operator==(const HostGxmState &other) const
+    {
+        return memcmp(this, &other, sizeof(*this)) == 0;
+    }
+};
+
+struct HostGxm {
+    unsigned registeredPrograms;
+    unsigned vertexProgramsCreated;
+    unsigned fragmentProgramsCreated;
+    unsigned vertexProgramsReleased;
+    unsigned fragmentProgramsReleased;
+    unsigned programBinds;
+    unsigned uniformReserves;
+    unsigned uniformWrites;
+    unsigned uniformBytes;
+    unsigned stateSets;
+    unsigned draws;
+
+    // The next this many vertex or fragment program patches fail, leaving
+    // their output alone
+    unsigned failVertexPrograms;
+    unsigned failFragmentPrograms;
+
+    HostGxmState state;
+    bool recordDraws;
+    std::vector<HostGxmState> drawStates;
+
+    // Reflection of real GXP programs passed in
+    std::map<const SceGxmProgram *, vitashader::gxp::Reflection> programs;
+
+    // Backing store for dummy objects; only their addresses matter
+    uint8_t objects[4096];
+    unsigned nextObject;
+    float uniformBuffer[1024];
+};
+
+static HostGxm &
+host_gxm()
+{
+    static HostGxm gxm;
+    return gxm;
+}
+
+static void *
+host_gxm_object()
+{
+    HostGxm &gxm = host_gxm();
+    gxm.nextObject = (gxm.nextObject + 1) % sizeof(gxm.objects);
+    return gxm.objects + gxm.nextObject;
+}
+
+static int
+sceGxmProgramCheck(const SceGxmProgram *program)
+{
+    return program ? 0 : -1;
+}
+
+static unsigned int
+sceGxmProgramGetSize(const SceGxmProgram *program)
+{
+    return vitashader::gxp::read32((const uint8_t *)program + vitashader::gxp::HEADER_SIZE);
+}
+
+static int
+sceGxmShaderPatcherRegisterProgram(SceGxmShaderPatcher *, const SceGxmProgram *, SceGxmShaderPatcherId *id)
+{
+    ++host_gxm().registeredPrograms;
+    *id = (SceGxmShaderPatcherId)host_gxm_object();
+    return 0;
+}
+
+static int
+sceGxmShaderPatcherUnregisterProgram(SceGxmShaderPatcher *, SceGxmShaderPatcherId)
+{
+    --host_gxm().registeredPrograms;
+    return 0;
+}
+
+static int
+sceGxmShaderPatcherCreateVertexProgram(SceGxmShaderPatcher *, SceGxmShaderPatcherId,
+        const SceGxmVertexAttribute *, unsigned int, const SceGxmVertexStream *, unsigned int,
+        SceGxmVertexProgram **out)
+{
+    HostGxm &gxm = host_gxm();
+    if (gxm.failVertexPrograms) {
+        --gxm.failVertexPrograms;
+        return -1;
+    }
+    ++gxm.vertexProgramsCreated;
+    *out = (SceGxmVertexProgram *)host_gxm_object();
+    return 0;
+}
+
+static int
+sceGxmShaderPatcherCreateFragmentProgram(SceGxmShaderPatcher *, SceGxmShaderPatcherId,
+        SceGxmOutputRegisterFormat, SceGxmMultisampleMode, const SceGxmBlendInfo *,
+        const SceGxmProgram *, SceGxmFragmentProgram **out)
+{
+    HostGxm &gxm = host_gxm();
+    if (gxm.failFragmentPrograms) {
+        --gxm.failFragmentPrograms;
+        return -1;
+    }
+    ++gxm.fragmentProgramsCreated;
+    *out = (SceGxmFragmentProgram *)host_gxm_object();
+    return 0;
+}
+
+static int
+sceGxmShaderPatcherReleaseVertexProgram(SceGxmShaderPatcher *, SceGxmVertexProgram *)
+{
+    ++host_gxm().vertexProgramsReleased;
+    return 0;
+}
+
+static int
+sceGxmShaderPatcherReleaseFragmentProgram(SceGxmShaderPatcher *, SceGxmFragmentProgram *)
+{
+    ++host_gxm().fragmentProgramsReleased;
+    return 0;
+}
+
+static void
+sceGxmSetVertexProgram(SceGxmContext *, const SceGxmVertexProgram *program)
+{
+    ++host_gxm().programBinds;
+    host_gxm().state.vertexProgram = program;
+}
+
+static void
+sceGxmSetFragmentProgram(SceGxmContext *, const SceGxmFragmentProgram *program)
+{
+    ++host_gxm().programBinds;
+    host_gxm().state.fragmentProgram = program;
+}
+
+static int
+sceGxmSetFragmentTexture(SceGxmContext *, unsigned int index, const SceGxmTexture *texture)
+{
+    HostGxm &gxm = host_gxm();
+    ++gxm.stateSets;
+    if (index >= 16 || !texture) {
+        return -1;
+    }
+    gxm.state.fragmentTextures[index] = *texture;
+    return 0;
+}
+
+static int
+sceGxmSetVertexTexture(SceGxmContext *, unsigned int index, const SceGxmTexture *texture)
+{
+    HostGxm &gxm = host_gxm();
+    ++gxm.stateSets;
+    if (index >= 16 || !texture) {
+        return -1;
+    }
+    gxm.state.vertexTextures[index] = *texture;
+    return 0;
+}
+
+static int
+sceGxmSetVertexStream(SceGxmContext *, unsigned int index, const void *data)
+{
+    HostGxm &gxm = host_gxm();
+    ++gxm.stateSets;
+    if (index >= 16) {
+        return -1;
+    }
+    gxm.state.streams[index] = data;
+    return 0;
+}
+
+static int
+sceGxmSetVertexUniformBuffer(SceGxmContext *, unsigned int bufferIndex, const void *bufferData)
+{
+    HostGxm &gxm = host_gxm();
+    ++gxm.stateSets;
+    if (bufferIndex >= SCE_GXM_MAX_UNIFORM_BUFFERS) {
+        return -1;
+    }
+    gxm.state.vertexUniformBuffers[bufferIndex] = bufferData;
+    return 0;
+}
+
+#define HOST_GXM_STATE_SETTER(function, type, field) \
+    static void function(SceGxmContext *, type value) \
+    { \
+        ++host_gxm().stateSets; \
+        host_gxm().state.field = value; \
+    }
+
+HOST_GXM_STATE_SETTER(sceGxmSetFrontPolygonMode, SceGxmPolygonMode, frontPolygonMode)
+HOST_GXM_STATE_SETTER(sceGxmSetBackPolygonMode, SceGxmPolygonMode, backPolygonMode)
+HOST_GXM_STATE_SETTER(sceGxmSetCullMode, SceGxmCullMode, cullMode)
+HOST_GXM_STATE_SETTER(sceGxmSetTwoSidedEnable, SceGxmTwoSidedMode, twoSided)
+HOST_GXM_STATE_SETTER(sceGxmSetFrontDepthFunc, SceGxmDepthFunc, frontDepthFunc)
+HOST_GXM_STATE_SETTER(sceGxmSetBackDepthFunc, SceGxmDepthFunc, backDepthFunc)
+HOST_GXM_STATE_SETTER(sceGxmSetFrontDepthWriteEnable, SceGxmDepthWriteMode, frontDepthWrite)
+HOST_GXM_STATE_SETTER(sceGxmSetBackDepthWriteEnable, SceGxmDepthWriteMode, backDepthWrite)
+
+#undef HOST_GXM_STATE_SETTER
+
+static int
+sceGxmDraw(SceGxmContext *, SceGxmPrimitiveType, SceGxmIndexFormat, const void *, unsigned int)
+{
+    HostGxm &gxm = host_gxm();
+    ++gxm.draws;
+    if (gxm.recordDraws) {
+        gxm.drawStates.push_back(gxm.state);
+    }
+    return 0;
+}
+
+static const SceGxmProgramParameter *
+sceGxmProgramFindParameterByName(const SceGxmProgram *program, const char *name)
+{
+    HostGxm &gxm = host_gxm();
+
+    vitashader::gxp::Reflection &reflection = gxm.programs[program];
+    if (!reflection.data) {
+        reflection.parse(program, sceGxmProgramGetSize(program));
+    }
+    const vitashader::gxp::Parameter *parameter = reflection.find(name);
+    return parameter ? (const SceGxmProgramParameter *)parameter->record : nullptr;
+}
+
+static unsigned int
+sceGxmProgramParameterGetResourceIndex(const SceGxmProgramParameter *parameter)
+{
+    return parameter->resourceIndex;
+}
+
+// Decoded from the flags as in gxp::Reflection::parse()
+static SceGxmParameterCategory
+sceGxmProgramParameterGetCategory(const SceGxmProgramParameter *parameter)
+{
+    return (SceGxmParameterCategory)(parameter->flags & 0xF);
+}
+
+static unsigned int
+sceGxmProgramParameterGetComponentCount(const SceGxmProgramParameter *parameter)
+{
+    return (parameter->flags >> 8) & 0xF;
+}
+
+static unsigned int
+sceGxmProgramParameterGetContainerIndex(const SceGxmProgramParameter *parameter)
+{
+    return (parameter->flags >> 12) & 0xF;
+}
+
+static unsigned int
+sceGxmProgramParameterGetArraySize(const SceGxmProgramParameter *parameter)
+{
+    return parameter->arraySize;
+}
+
+static int
+sceGxmReserveVertexDefaultUniformBuffer(SceGxmContext *, void **buffer)
+{
+    ++host_gxm().uniformReserves;
+    *buffer = host_gxm().uniformBuffer;
+    return 0;
+}
+
+static int
+sceGxmReserveFragmentDefaultUniformBuffer(SceGxmContext *, void **buffer)
+{
+    ++host_gxm().uniformReserves;
+    *buffer = host_gxm().uniformBuffer;
+    return 0;
+}
+
+static int
+sceGxmSetUniformDataF(void *buffer, const SceGxmProgramParameter *parameter,
+        unsigned int componentOffset, unsigned int componentCount, const float *data)
+{
+    HostGxm &gxm = host_gxm();
+    unsigned int offset = parameter->resourceIndex + componentOffset;
+    if (offset + componentCount <= sizeof(gxm.uniformBuffer) / sizeof(float)) {
+        memcpy((float *)buffer + offset, data, componentCount * sizeof(float));
+    }
+    ++gxm.uniformWrites;
+    gxm.uniformBytes += componentCount * sizeof(float);
+    return 0;
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+// Per-string parameters, so strings of different colors and positions can
+// share one draw. Each string takes a slot holding its color and transform.
+// TextBatch tags the string's quads with the slot, the packed vertices
+// carry it, and the INSTANCE_PARAMS variant of sphere_v uses it to index
+// uInstances, an array in a vertex uniform buffer.
+//
+//   InstanceBuffer instances;
+//   instances.reflect(program.find_vertex_parameter("uInstances"));
+//   ...
+//   instances.clear();
+//   uint16_t slot;
+//   if (instances.add(InstanceParams{{1.f, 0.5f, 0.f, 1.f}, {x, y, 1.f, 1.f}}, &slot)) {
+//       batch.set_instance(slot);
+//       batch.add(font, "Score", 0.f, 0.f, 1.f);
+//   }
+//   ...
+//   instances.bind(state, instances.upload(ring));
+//
+// Slot 0 always holds the identity, so quads added without a slot draw as
+// they would without instances. The transform applies to glyph positions
+// before uTransform: xy is an offset and zw a scale, with z also narrowing
+// the SDF border as a larger glyph scale would.
+
+#ifdef __vita__
+#include <psp2/gxm.h>
+#else
+#include "hostgxm.h"
+#endif
+
+#include "gxmstate.h"
+#include "ringalloc.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+namespace vitashader {
+
+struct InstanceParams {
+    float color[4];      // multiplies uColor
+    float transform[4];  // offset x y, scale x y
+};
+
+// float4 elements per slot in uInstances
+static const unsigned INSTANCE_FLOAT4S = 2;
+
+static_assert(sizeof(InstanceParams) == INSTANCE_FLOAT4S * 4 * sizeof(float), "InstanceParams is two float4s");
+
+struct InstanceBuffer {
+    InstanceBuffer()
+        : bufferIndex(0)
+        , offset(0)
+        , capacity(0)
+    {
+        clear();
+    }
+
+    // Takes the buffer index, offset and slot count from the program's
+    // uInstances. Fails for a program without it (a variant without
+    // INSTANCE_PARAMS) and for arrays not declared in a BUFFER, after
+    // which add() only refuses.
+    bool reflect(const SceGxmProgramParameter *parameter)
+    {
+        capacity = 0;
+        if (!parameter || sceGxmProgramParameterGetCategory(parameter) != SCE_GXM_PARAMETER_CATEGORY_UNIFORM) {
+            return false;
+        }
+
+        unsigned index = sceGxmProgramParameterGetContainerIndex(parameter);
+        if (index >= SCE_GXM_MAX_UNIFORM_BUFFERS) {
+            printf("Instance parameters are not in a uniform buffer\n");
+            return false;
+        }
+
+        bufferIndex = index;
+        offset = sceGxmProgramParameterGetResourceIndex(parameter);
+        unsigned floats = sceGxmProgramParameterGetArraySize(parameter) *
+            sceGxmProgramParameterGetComponentCount(parameter);
+        capacity = floats / (INSTANCE_FLOAT4S * 4);
+
+        // Slots have to fit GlyphVertex::instance
+        if (capacity > 0x10000) {
+            capacity = 0x10000;
+        }
+        return capacity > 0;
+    }
+
+    // Drops all slots but the identity in slot 0
+    void clear()
+    {
+        params.assign(1, InstanceParams{{1.f, 1.f, 1.f, 1.f}, {0.f, 0.f, 1.f, 1.f}});
+    }
+
+    // False once the program's array is full
+    bool add(const InstanceParams &instance, uint16_t *slot)
+    {
+        if (params.size() >= capacity) {
+            return false;
+        }
+        *slot = (uint16_t)params.size();
+        params.push_back(instance);
+        return true;
+    }
+
+    size_t size() const
+    {
+        return params.size();
+    }
+
+    // Size of the buffer up to the last slot in use
+    size_t bytes() const
+    {
+        return offset * sizeof(float) + params.size() * sizeof(InstanceParams);
+    }
+
+    // Writes the slots where the program reads them; anything before the
+    // array in the buffer is zeroed
+    void pack(void *out) const
+    {
+        memset(out, 0, offset * sizeof(float));
+        memcpy((float *)out + offset, params.data(), params.size() * sizeof(InstanceParams));
+    }
+
+    // Packs into the frame's ring; nullptr if there is no memory
+    void *upload(RingAllocator &ring) const
+    {
+        void *data = ring.alloc(bytes(), 16);
+        if (!data) {
+            printf("Out of ring memory for %u instances\n", (unsigned)params.size());
+            return nullptr;
+        }
+        pack(data);
+        return data;
+    }
+
+    void bind(GxmState &state, const void *data) const
+    {
+        if (data) {
+            state.set_vertex_uniform_buffer(bufferIndex, data);
+        }
+    }
+
+    unsigned bufferIndex;
+
+    // Floats before the array in its buffer
+    unsigned offset;
+    size_t capacity;
+    std::vector<InstanceParams> params;
+};
+
+} // end namespace vitashader
@@ -0,0 +1,225 @@
+#pragma once
+
+// Fork-join job system with a deque per worker and work stealing. The
+// thread that creates it is worker 0 and the only one that submits; it
+// runs jobs itself while it waits, the other workers are threads that
+// sleep when there is nothing to take.
+//
+//   JobSystem jobs(3);
+//   jobs.parallel_for(count, 16, [&](uint32_t begin, uint32_t end, unsigned worker) {
+//       ...
+//   });
+//
+// A range job larger than its grain splits in half before it runs, pushing
+// the upper half onto the running worker's deque. Owners pop their newest
+// job, thieves take the oldest, which is the largest half left.
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vitashader {
+
+struct JobSystem {
+    typedef void (*Function)(void *data, uint32_t begin, uint32_t end, unsigned worker);
+
+    struct Job {
+        Function function;
+        void *data;
+        uint32_t begin;
+        uint32_t end;
+        uint32_t grain;
+        std::atomic<uint32_t> *pending;
+    };
+
+    struct Worker {
+        Worker()
+            : executed(0)
+            , stolen(0)
+        {
+        }
+
+        std::mutex mutex;
+        std::deque<Job> jobs;
+
+        // Jobs run by and stolen by this worker
+        std::atomic<uint32_t> executed;
+        std::atomic<uint32_t> stolen;
+    };
+
+    // workers includes the calling thread; 0 means one per hardware thread
+    explicit JobSystem(unsigned workers=0)
+        : queued(0)
+        , stopping(false)
+    {
+        if (workers == 0) {
+            workers = std::thread::hardware_concurrency();
+        }
+        if (workers == 0) {
+            workers = 1;
+        }
+
+        for (unsigned i=0; i<workers; ++i) {
+            queues.emplace_back(new Worker());
+        }
+        for (unsigned i=1; i<workers; ++i) {
+            threads.emplace_back([this, i] { worker_main(i); });
+        }
+    }
+
+    ~JobSystem()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wakeup.notify_all();
+        for (auto &thread: threads) {
+            thread.join();
+        }
+    }
+
+    JobSystem(const JobSystem &) = delete;
+
+    unsigned worker_count() const
+    {
+        return queues.size();
+    }
+
+    // Calls f(begin, end, worker) over [0, count) in ranges of at most
+    // grain and returns when all of them are done. Only worker 0 may call
+    // this, and not from inside a job.
+    template <typename F>
+    void parallel_for(uint32_t count, uint32_t grain, const F &f)
+    {
+        if (count == 0) {
+            return;
+        }
+
+        std::atomic<uint32_t> pending(1);
+        push(0, Job{&call<F>, (void *)&f, 0, count, grain ? grain : 1, &pending});
+        wait(pending);
+    }
+
+    void reset_counters()
+    {
+        for (auto &worker: queues) {
+            worker->executed.store(0, std::memory_order_relaxed);
+            worker->stolen.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    std::vector<std::unique_ptr<Worker>> queues;
+
+private:
+    template <typename F>
+    static void call(void *data, uint32_t begin, uint32_t end, unsigned worker)
+    {
+        (*(const F *)data)(begin, end, worker);
+    }
+
+    void push(unsigned worker, const Job &job)
+    {
+        {
+            // Counted first and under the sleep mutex, so a worker that just
+            // found nothing cannot miss it and the count never drops below
+            // the jobs in the deques
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            queued.fetch_add(1, std::memory_order_relaxed);
+        }
+        {
+            std::lock_guard<std::mutex> lock(queues[worker]->mutex);
+            queues[worker]->jobs.push_back(job);
+        }
+        wakeup.notify_one();
+    }
+
+    bool pop(unsigned worker, Job &job)
+    {
+        Worker &own = *queues[worker];
+        {
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.jobs.empty()) {
+                job = own.jobs.back();
+                own.jobs.pop_back();
+                queued.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+
+        for (size_t i=1; i<queues.size(); ++i) {
+            Worker &victim = *queues[(worker + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.jobs.empty()) {
+                job = victim.jobs.front();
+                victim.jobs.pop_front();
+                queued.fetch_sub(1, std::memory_order_relaxed);
+                own.stolen.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void run(unsigned worker, Job job)
+    {
+        while (job.end - job.begin > job.grain) {
+            uint32_t mid = job.begin + (job.end - job.begin) / 2;
+            Job upper = job;
+            upper.begin = mid;
+            job.end = mid;
+            job.pending->fetch_add(1, std::memory_order_relaxed);
+            push(worker, upper);
+        }
+
+        job.function(job.data, job.begin, job.end, worker);
+        queues[worker]->executed.fetch_add(1, std::memory_order_relaxed);
+        job.pending->fetch_sub(1, std::memory_order_release);
+    }
+
+    void wait(std::atomic<uint32_t> &pending)
+    {
+        Job job;
+        while (pending.load(std::memory_order_acquire) != 0) {
+            if (pop(0, job)) {
+                run(0, job);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void worker_main(unsigned worker)
+    {
+        Job job;
+        for (;;) {
+            if (pop(worker, job)) {
+                run(worker, job);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wakeup.wait(lock, [this] {
+                return stopping || queued.load(std::memory_order_relaxed) != 0;
+            });
+            if (stopping) {
+                return;
+            }
+        }
+    }
+
+    std::vector<std::thread> threads;
+
+    std::mutex sleepMutex;
+    std::condition_variable wakeup;
+    std::atomic<uint32_t> queued;
+    bool stopping;
+};
+
+} // end namespace vitashader
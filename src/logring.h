@@ -0,0 +1,293 @@
+#pragma once
+
+// Asynchronous log: any thread posts messages into a bounded lock-free ring
+// (Vyukov's MPMC queue), a background thread renders them to the debug
+// screen and optionally a file. Posting never blocks; when the ring is full
+// the message is dropped and counted.
+//
+//   LogRing log;
+//   log.start([](const char *text, size_t) { psvDebugScreenPuts(text); });
+//   log.print("frame %d\n", idx);          // formatted on the caller
+//   log.post("frame %d took %f\n", idx, ms);  // arguments copied, formatted later
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <new>
+#include <thread>
+#include <type_traits>
+
+namespace vitashader {
+
+// Arguments of a deferred message, copied into the ring and expanded back
+// into a snprintf call on the consumer
+template <typename... Args>
+struct LogArgs;
+
+template <>
+struct LogArgs<> {
+    template <typename... Done>
+    int format(char *out, size_t size, const char *format, Done... done) const
+    {
+        return snprintf(out, size, format, done...);
+    }
+};
+
+template <typename T, typename... Rest>
+struct LogArgs<T, Rest...> {
+    LogArgs(T head, Rest... rest)
+        : head(head)
+        , tail(rest...)
+    {
+    }
+
+    template <typename... Done>
+    int format(char *out, size_t size, const char *format, Done... done) const
+    {
+        return tail.format(out, size, format, done..., head);
+    }
+
+    T head;
+    LogArgs<Rest...> tail;
+};
+
+struct LogRing {
+    // Bytes of text (including the NUL) or deferred arguments per message
+    static const size_t PAYLOAD_SIZE = 224;
+
+    typedef std::function<void(const char *text, size_t length)> Sink;
+    typedef int (*Formatter)(const char *format, const void *args, char *out, size_t size);
+
+    struct Cell {
+        std::atomic<uint32_t> sequence;
+        uint32_t length;
+        const char *format;
+        Formatter formatter;
+        alignas(8) char payload[PAYLOAD_SIZE];
+    };
+
+    // capacity is rounded up to a power of two
+    LogRing(size_t capacity=256)
+        : mask(0)
+        , enqueuePos(0)
+        , dequeuePos(0)
+        , file(nullptr)
+        , running(false)
+        , posted(0)
+        , dropped(0)
+        , truncated(0)
+        , written(0)
+    {
+        size_t n = 2;
+        while (n < capacity) {
+            n *= 2;
+        }
+        mask = n - 1;
+
+        cells.reset(new Cell[n]);
+        for (size_t i=0; i<n; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~LogRing()
+    {
+        stop();
+    }
+
+    LogRing(const LogRing &) = delete;
+
+    // Formats on the calling thread straight into the ring
+    __attribute__((__format__ (__printf__, 2, 3)))
+    bool print(const char *format, ...)
+    {
+        va_list args;
+        va_start(args, format);
+        bool ok = vprint(format, args);
+        va_end(args);
+        return ok;
+    }
+
+    bool vprint(const char *format, va_list args)
+    {
+        Cell *cell;
+        uint32_t pos;
+        if (!claim(cell, pos)) {
+            return false;
+        }
+
+        int len = vsnprintf(cell->payload, PAYLOAD_SIZE, format, args);
+        if (len < 0) {
+            len = 0;
+            cell->payload[0] = '\0';
+        } else if ((size_t)len >= PAYLOAD_SIZE) {
+            len = PAYLOAD_SIZE - 1;
+            truncated.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        cell->length = len;
+        cell->format = nullptr;
+        cell->formatter = nullptr;
+        publish(cell, pos);
+        return true;
+    }
+
+    // Copies the arguments and leaves formatting to the consumer. format and
+    // any string arguments must outlive the message (e.g. literals).
+    template <typename... Args>
+    bool post(const char *format, Args... args)
+    {
+        typedef LogArgs<Args...> Packed;
+        static_assert(sizeof(Packed) <= PAYLOAD_SIZE, "Too many log arguments");
+        static_assert(std::is_trivially_destructible<Packed>::value, "Log arguments must be plain values");
+
+        Cell *cell;
+        uint32_t pos;
+        if (!claim(cell, pos)) {
+            return false;
+        }
+
+        new (cell->payload) Packed(args...);
+        cell->length = 0;
+        cell->format = format;
+        cell->formatter = &format_packed<Packed>;
+        publish(cell, pos);
+        return true;
+    }
+
+    // Starts the consumer thread; file, if given, receives a copy of all
+    // output and stays owned by the caller
+    void start(Sink sink, FILE *file=nullptr)
+    {
+        stop();
+        this->sink = sink;
+        this->file = file;
+        running.store(true, std::memory_order_release);
+        consumer = std::thread([this]() { run(); });
+    }
+
+    // Writes what is left and joins the consumer
+    void stop()
+    {
+        if (consumer.joinable()) {
+            running.store(false, std::memory_order_release);
+            consumer.join();
+        }
+    }
+
+    // Writes all published messages to the sinks, returns how many. Called
+    // by the consumer thread; without one it can be called directly.
+    size_t drain()
+    {
+        size_t count = 0;
+        char text[1024];
+
+        for (;;) {
+            uint32_t pos = dequeuePos.load(std::memory_order_relaxed);
+            Cell *cell = &cells[pos & mask];
+            uint32_t seq = cell->sequence.load(std::memory_order_acquire);
+            int32_t diff = (int32_t)(seq - (pos + 1));
+
+            if (diff < 0) {
+                break;
+            }
+            if (diff > 0 || !dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                continue;
+            }
+
+            const char *out = cell->payload;
+            size_t len = cell->length;
+            if (cell->formatter) {
+                int n = cell->formatter(cell->format, cell->payload, text, sizeof(text));
+                len = (n < 0) ? 0 : ((size_t)n >= sizeof(text)) ? sizeof(text) - 1 : n;
+                out = text;
+            }
+
+            if (sink) {
+                sink(out, len);
+            }
+            if (file) {
+                fwrite(out, 1, len, file);
+            }
+
+            cell->sequence.store(pos + mask + 1, std::memory_order_release);
+            ++count;
+        }
+
+        if (count) {
+            written.fetch_add(count, std::memory_order_relaxed);
+            if (file) {
+                fflush(file);
+            }
+        }
+        return count;
+    }
+
+    void run()
+    {
+        while (running.load(std::memory_order_acquire)) {
+            if (!drain()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        drain();
+    }
+
+    bool claim(Cell *&cell, uint32_t &pos)
+    {
+        pos = enqueuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells[pos & mask];
+            uint32_t seq = cell->sequence.load(std::memory_order_acquire);
+            int32_t diff = (int32_t)(seq - pos);
+
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    return true;
+                }
+            } else if (diff < 0) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void publish(Cell *cell, uint32_t pos)
+    {
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        posted.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    template <typename Packed>
+    static int format_packed(const char *format, const void *args, char *out, size_t size)
+    {
+        return ((const Packed *)args)->format(out, size, format);
+    }
+
+    std::unique_ptr<Cell[]> cells;
+    uint32_t mask;
+    std::atomic<uint32_t> enqueuePos;
+    std::atomic<uint32_t> dequeuePos;
+
+    Sink sink;
+    FILE *file;
+    std::thread consumer;
+    std::atomic<bool> running;
+
+    // Messages queued, rejected because the ring was full, cut to
+    // PAYLOAD_SIZE, and handed to the sinks
+    std::atomic<uint32_t> posted;
+    std::atomic<uint32_t> dropped;
+    std::atomic<uint32_t> truncated;
+    std::atomic<uint32_t> written;
+};
+
+} // end namespace vitashader
@@ -7,26 +7,30 @@
 
 #include "vita2d.h"
 #include "vitashader.h"
+#include "textbatch.h"
+#include "drawlist.h"
+#include "gxmcapture.h"
+#include "instancebuffer.h"
+#include "shaderarchive.h"
+#include "framescheduler.h"
+#include "gpumem.h"
+#include "logring.h"
+#include "profiler.h"
+#include "quadindices.h"
+#include "ringalloc.h"
+#include "sdffont.h"
+#include "textcache.h"
+#include "texturefile.h"
 
 #include "debugScreen.h"
 
-#define printf psvDebugScreenPrintf
+// Output is queued here and drawn to the debug screen by a background thread
+static vitashader::LogRing log_ring;
 
-SceGxmProgram *
-load_program(const char *filename)
-{
-    FILE *fp = fopen(filename, "rb");
-    printf("%s = %p\n", filename, fp);
-    fseek(fp, 0, SEEK_END);
-    size_t len = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
-    SceGxmProgram *buf = (SceGxmProgram *)malloc(len);
-    fread(buf, len, 1, fp);
-    return buf;
-}
+#define printf(...) log_ring.print(__VA_ARGS__)
 
 void
-dump_program(SceGxmProgram *program)
+dump_program(const SceGxmProgram *program)
 {
     printf(" Check = 0x%08x\n", sceGxmProgramCheck(program));
     printf(" Size = %u\n", sceGxmProgramGetSize(program));
@@ -47,20 +51,30 @@ dump_program(SceGxmProgram *program)
     }
 }
 
-struct Vertex {
-    float x;
-    float y;
-    float z;
-    float u;
-    float v;
-};
-
 int main(int argc, char *argv[]) {
 	psvDebugScreenInit();
+
+        FILE *log_file = fopen("ux0:data/vitashader.log", "w");
+        log_ring.start([](const char *text, size_t) { psvDebugScreenPuts(text); }, log_file);
+
 	printf("Hello, world!\n");
 
-        SceGxmProgram *sphere_v = load_program("app0:/sphere_v.gxp");
-        SceGxmProgram *sphere_f = load_program("app0:/sphere_f.gxp");
+        vitashader::ShaderArchive shaders;
+        if (!shaders.open("app0:/shaders.gxa")) {
+            printf("Could not load app0:/shaders.gxa: %s\n", shaders.error);
+            sceKernelDelayThread(5*1000000);
+            sceKernelExitProcess(0);
+            return 1;
+        }
+
+        const SceGxmProgram *sphere_v = (const SceGxmProgram *)shaders.find("sphere_v");
+        const SceGxmProgram *sphere_f = (const SceGxmProgram *)shaders.find("sphere_f");
+        if (!sphere_v || !sphere_f) {
+            printf("Shader archive is missing sphere_v/sphere_f\n");
+            sceKernelDelayThread(5*1000000);
+            sceKernelExitProcess(0);
+            return 1;
+        }
 
         printf("Vertex Shader:\n");
         dump_program(sphere_v);
@@ -77,22 +91,67 @@ int main(int argc, char *argv[]) {
 
         vita2d_init();
 
-        vita2d_texture *texture = vita2d_load_PNG_file("app0:/stb_font_SourceSansProSemiBold.png");
-        vita2d_texture_set_filters(texture, SCE_GXM_TEXTURE_FILTER_LINEAR, SCE_GXM_TEXTURE_FILTER_LINEAR);
+        // Converted by tools/texconv at build time, so no PNG decode here;
+        // the PNG stays as a fallback
+        vitashader::TextureFile font_texture;
+        vita2d_texture *texture = nullptr;
+        {
+            VS_PROFILE_ZONE("load_font_texture");
+            if (!font_texture.open("app0:/stb_font_SourceSansProSemiBold.vtex")) {
+                printf("Could not load app0:/stb_font_SourceSansProSemiBold.vtex: %s\n", font_texture.error);
+                texture = vita2d_load_PNG_file("app0:/stb_font_SourceSansProSemiBold.png");
+                vita2d_texture_set_filters(texture, SCE_GXM_TEXTURE_FILTER_LINEAR, SCE_GXM_TEXTURE_FILTER_LINEAR);
+            }
+        }
+
+        // U8 distance field from tools/sdfgen, rendered by FreeType at build time
+        vitashader::SdfAtlas sdf;
+        bool have_sdf = sdf.open("app0:/font.sdf");
+        if (!have_sdf) {
+            printf("No app0:/font.sdf (%s), drawing the PNG atlas only\n", sdf.error);
+        }
 
         SceGxmContext *gxmContext = vita2d_get_context();
         SceGxmShaderPatcher *shader_patcher = vita2d_get_shader_patcher();
 
         {
-            vitashader::ShaderProgram program(gxmContext, shader_patcher, sphere_v, sphere_f);
+            // Drop shadow only; the outline and vertex color code is not in this variant.
+            // Glyphs are uploaded as 12-byte GlyphVertex if the archive has the packed variant,
+            // and each label gets its own color from an instance buffer if it has that too.
+            vitashader::ShaderVariants sphere(gxmContext, shader_patcher, shaders, "sphere_v", "sphere_f");
+            uint32_t features = vitashader::SHADER_FEATURE_SHADOW | vitashader::SHADER_FEATURE_PACKED_VERTEX |
+                vitashader::SHADER_FEATURE_INSTANCE_PARAMS;
+            vitashader::ShaderProgram *variant = sphere.get(features);
+            if (!variant) {
+                features = 0;
+                variant = sphere.get(features);
+            }
+            vitashader::ShaderProgram &program = *variant;
+
+            uint32_t vertex_features = sphere.vertexVariants.resolve(features);
+            bool packed_vertices = vertex_features & vitashader::SHADER_FEATURE_PACKED_VERTEX;
+            bool instanced = packed_vertices && (vertex_features & vitashader::SHADER_FEATURE_INSTANCE_PARAMS);
+            if (instanced) {
+                static const char *const attribute_names[] = { "aPosition", "aTexCoord", "aScale", "aInstance", };
+                program.set_layout<vitashader::VertexTraits<vitashader::GlyphVertex>::InstancedLayout>(attribute_names);
+            } else if (packed_vertices) {
+                static const char *const attribute_names[] = { "aPosition", "aTexCoord", "aScale", };
+                program.set_layout<vitashader::VertexTraits<vitashader::GlyphVertex>::Layout>(attribute_names);
+            } else {
+                static const char *const attribute_names[] = { "aPosition", "aTexCoord", };
+                program.set_layout<vitashader::VertexTraits<vitashader::Vertex>::Layout>(attribute_names);
+            }
 
-            program.add_attribute("aPosition", 3, SCE_GXM_ATTRIBUTE_FORMAT_F32);
-            program.add_attribute("aTexCoord", 2, SCE_GXM_ATTRIBUTE_FORMAT_F32);
+            vitashader::UniformBlock uniforms(program);
+            auto uColor = uniforms.add_vertex("uColor", 4);
+            auto uTransform = uniforms.add_vertex("uTransform", 4);
+            auto uProjection = uniforms.add_vertex("uProjection", 16);
+            auto uShadowOffset = uniforms.add_fragment("uShadowOffset", 2);
 
-            auto uColor = program.get_vertex_uniform("uColor");
-            auto uTransform = program.get_vertex_uniform("uTransform");
-            auto uProjection = program.get_vertex_uniform("uProjection");
-            auto uShadowOffset = program.get_fragment_uniform("uShadowOffset");
+            uniforms.set_matrix(uProjection, glm::ortho(0.f, 960.f, 544.f, 0.f));
+
+            float shadow_offset[] = { 1.f / 512.f, 1.f / 512.f };
+            uniforms.set_float(uShadowOffset, shadow_offset, 2);
 
             static const SceGxmBlendInfo blend_info = {
                 .colorMask = SCE_GXM_COLOR_MASK_ALL,
@@ -104,37 +163,107 @@ int main(int argc, char *argv[]) {
                 .alphaDst  = SCE_GXM_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
             };
 
-            auto pprogram = program.create(SCE_GXM_MULTISAMPLE_NONE, &blend_info);
+            vitashader::PatchedProgram *pprogram = program.get(SCE_GXM_MULTISAMPLE_NONE, &blend_info);
+            if (!pprogram) {
+                printf("Could not patch sphere_v/sphere_f\n");
+                sceKernelDelayThread(5*1000000);
+                sceKernelExitProcess(0);
+                return 1;
+            }
+
+            vitashader::Font atlas;
+            atlas.texture = texture ? &texture->gxm_tex : &font_texture.texture;
+
+            vitashader::Font sdf_font;
+            if (have_sdf) {
+                sdf.load_font(sdf_font);
+            }
+
+            vitashader::TextBatch batch;
+            batch.set_packed(packed_vertices);
+
+            vitashader::InstanceBuffer instances;
+            if (instanced && !instances.reflect(program.find_vertex_parameter("uInstances"))) {
+                printf("No uInstances in the instanced variant\n");
+            }
+            vitashader::DrawList draw_list;
+            // Static labels are laid out once, then only expanded every frame
+            vitashader::TextCache text_cache(64 * 1024);
+            vitashader::QuadIndexBuffer quad_indices;
+
+            const size_t ring_size = 1024 * 1024;
+            SceUID ring_uid;
+            void *ring_memory = vitashader::gpu_alloc(ring_size, &ring_uid);
+            vitashader::RingAllocator ring(ring_memory, ring_memory ? ring_size : 0);
+
+            vitashader::GxmState gxm_state(gxmContext);
+            vitashader::GxmCapture &capture = vitashader::gxm_capture();
+            capture.set_stream_stride(0, batch.vertex_stride());
+
+            vitashader::GxmTimeline timeline(gxmContext);
+            vitashader::FrameScheduler<vitashader::GxmTimeline> scheduler(timeline, 2);
 
             int idx = 0;
 
             float dx = 0.f, dy = 0.f;
             float sx = 1.f, sy = 1.f;
 
+            unsigned int old_buttons = 0;
+
             while (1) {
+                VS_PROFILE_ZONE("frame");
+
                 sceCtrlPeekBufferPositive(0, &pad, 1);
+                unsigned int pressed = pad.buttons & ~old_buttons;
+                old_buttons = pad.buttons;
 
                 if (pad.buttons & SCE_CTRL_START) {
                     break;
                 }
 
+                if (pressed & SCE_CTRL_TRIANGLE) {
+                    // Open in chrome://tracing or ui.perfetto.dev
+                    vitashader::profiler().write_chrome_trace("ux0:data/vitashader_trace.json");
+
+                    FILE *fp = fopen("ux0:data/vitashader_stats.txt", "w");
+                    if (fp) {
+                        vitashader::profiler().print_stats(fp);
+                        fprintf(fp, "\n");
+                        gxm_state.print_stats(fp);
+                        fclose(fp);
+                    }
+                }
+
+                if ((pressed & SCE_CTRL_SQUARE) && !capture.armed()) {
+                    // Read back with tools/gxmreplay
+                    capture.start(10);
+                }
+
                 if (pad.buttons & SCE_CTRL_SELECT) {
                     dx = dy = 0.f;
                     sx = sy = 1.f;
                 }
 
-                vita2d_set_clear_color(RGBA8(0x40, 0x40, 0x40, 0xFF));
-                vita2d_start_drawing();
-                vita2d_clear_screen();
+                // Blocks only while both frames in flight are still rendering
+                {
+                    VS_PROFILE_ZONE("wait_frame");
+                    scheduler.begin_frame();
+                }
+                ring.retire(scheduler.completed());
+
+                {
+                    VS_PROFILE_ZONE("start_drawing");
+                    vita2d_set_clear_color(RGBA8(0x40, 0x40, 0x40, 0xFF));
+                    vita2d_start_drawing();
+                    vita2d_clear_screen();
+                    // vita2d sets its own programs, textures and streams
+                    gxm_state.invalidate();
+                }
 
-                int n = 4;
-                Vertex *vertices = (Vertex *)vita2d_pool_memalign(n * sizeof(Vertex), sizeof(Vertex));
+                // After the invalidate, so every frame captures all the state it uses
+                capture.begin_frame();
 
-                Vertex *v = vertices;
-                v->x = 0.f; v->y = 0.f; ++v;
-                v->x = 0.f; v->y = 1.f; ++v;
-                v->x = 1.f; v->y = 0.f; ++v;
-                v->x = 1.f; v->y = 1.f; ++v;
+                ring.begin_frame(scheduler.fence());
 
                 float lxf = ((int)pad.lx - 127) / 127.f;
                 float lyf = ((int)pad.ly - 127) / 127.f;
@@ -154,57 +283,88 @@ int main(int argc, char *argv[]) {
                     sy *= 1.f + 0.2f * ryf;
                 }
 
-                for (int i=0; i<n; ++i) {
-                    vertices[i].u = vertices[i].x;
-                    vertices[i].v = vertices[i].y;
-                    vertices[i].x = vertices[i].x * 900.f;
-                    vertices[i].y = vertices[i].y * 900.f;
-                    vertices[i].z = (sx + sy) / 2.f;
+                float scale = (sx + sy) / 2.f;
+                batch.clear();
+                batch.set_program(pprogram);
+                batch.set_instance(0);
+                instances.clear();
+                batch.add_quad(atlas, 0.f, 0.f, 900.f, 900.f, 0.f, 0.f, 1.f, 1.f, scale);
+                if (have_sdf) {
+                    // Still one draw for both labels: their colors come from instance slots
+                    uint16_t slot;
+                    if (instances.add(vitashader::InstanceParams{{1.f, 0.8f, 0.3f, 1.f}, {0.f, 0.f, 1.f, 1.f}}, &slot)) {
+                        batch.set_instance(slot);
+                    }
+                    text_cache.add(batch, sdf_font, "Hello from the SDF atlas", 20.f, 480.f, 1.f);
+                    if (instances.add(vitashader::InstanceParams{{0.6f, 1.f, 0.6f, 1.f}, {0.f, 0.f, 1.f, 1.f}}, &slot)) {
+                        batch.set_instance(slot);
+                    }
+                    text_cache.add(batch, sdf_font, "Laid out once and kept in the text cache", 20.f, 520.f,
+                            0.75f, 400.f);
                 }
 
-                uint16_t *indices = (uint16_t *)vita2d_pool_memalign(n * sizeof(uint16_t), sizeof(uint16_t));
-                indices[0] = 0;
-                indices[1] = 1;
-                indices[2] = 2;
-                indices[3] = 3;
-
-                pprogram.use(gxmContext);
-
-                sceGxmSetBackPolygonMode(gxmContext, SCE_GXM_POLYGON_MODE_TRIANGLE_FILL);
-
-                float color[] = { 0.5f, 1.f, 1.f, 1.0f, };
-                color[1] = (idx % 100) / 100.f;
-                uColor.set_float(color, 4);
-
-                float transform[] = {
-                    dx, dy,
-                    sx, sy,
-                };
-                uTransform.set_float(transform, 4);
+                // Text is alpha blended, so its runs keep their order within the layer
+                draw_list.clear();
+                batch.record(draw_list, ring, quad_indices, 0, vitashader::DRAW_BLEND_ALPHA, 0.f);
+                if (instanced) {
+                    instances.bind(gxm_state, instances.upload(ring));
+                }
 
-                float shadow_offset[] = { 1.f / 512.f, 1.f / 512.f };
-                uShadowOffset.set_float(shadow_offset, 2);
+                {
+                    VS_PROFILE_ZONE("draw");
+                    auto backend = vitashader::gxm_draw_backend(gxm_state, [&](vitashader::PatchedProgram &) {
+                        VS_PROFILE_ZONE("uniforms");
+                        gxm_state.set_back_polygon_mode(SCE_GXM_POLYGON_MODE_TRIANGLE_FILL);
+
+                        float color[] = { 0.5f, 1.f, 1.f, 1.0f, };
+                        color[1] = (idx % 100) / 100.f;
+                        uniforms.set_float(uColor, color, 4);
+
+                        float transform[] = {
+                            dx, dy,
+                            sx, sy,
+                        };
+                        uniforms.set_float(uTransform, transform, 4);
+
+                        // vita2d_clear_screen() replaced the default uniform buffers
+                        uniforms.invalidate();
+                        uniforms.flush();
+                    });
+                    draw_list.submit(backend);
+                }
 
-                uProjection.set_float(glm::value_ptr(glm::ortho(0.f, 960.f, 544.f, 0.f)), 16);
+                if (capture.end_frame()) {
+                    capture.save("ux0:data/vitashader.vscap");
+                }
 
-                sceGxmSetFragmentTexture(gxmContext, 0, &texture->gxm_tex);
-                sceGxmSetVertexStream(gxmContext, 0, vertices);
-                sceGxmDraw(gxmContext, SCE_GXM_PRIMITIVE_TRIANGLE_STRIP, SCE_GXM_INDEX_FORMAT_U16, indices, n);
+                ring.end_frame();
 
-                vita2d_wait_rendering_done();
-                vita2d_end_drawing();
-                vita2d_swap_buffers();
+                {
+                    VS_PROFILE_ZONE("swap");
+                    // Ends the scene in place of vita2d_end_drawing()
+                    scheduler.end_frame();
+                    vita2d_swap_buffers();
+                }
 
                 ++idx;
             }
+
+            scheduler.finish();
+            vitashader::gpu_free(ring_uid, ring_memory);
         }
 
         vita2d_wait_rendering_done();
-        vita2d_free_texture(texture);
+        if (texture) {
+            vita2d_free_texture(texture);
+        }
+        font_texture.release();
+        sdf.release();
         vita2d_fini();
 
-        free(sphere_f);
-        free(sphere_v);
+        log_ring.stop();
+        if (log_file) {
+            fclose(log_file);
+        }
 
         sceKernelExitProcess(0);
         return 0;
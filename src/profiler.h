@@ -0,0 +1,315 @@
+#pragma once
+
+// Scoped-zone CPU profiler. Each thread records begin/end times into its own
+// ring of events without locking; readers take rolling statistics per zone
+// or export everything as Chrome trace JSON (chrome://tracing, Perfetto).
+//
+//   {
+//       VS_PROFILE_ZONE("draw");
+//       batch.draw(...);
+//   }
+//
+// Times come from a pluggable clock in microseconds, so recording and
+// export can be driven by a fake clock on the host.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifdef __vita__
+#include <psp2/kernel/processmgr.h>
+#else
+#include <chrono>
+#endif
+
+namespace vitashader {
+
+typedef uint64_t (*ProfileClock)();
+
+static uint64_t
+profile_clock_default()
+{
+#ifdef __vita__
+    return sceKernelGetProcessTimeWide();
+#else
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+struct ProfileEvent {
+    uint64_t begin;
+    uint64_t end;
+    uint32_t zone;
+    uint32_t reserved;
+};
+
+// Events of one thread. Only the owning thread writes; readers copy events
+// and then check written again to drop the ones overwritten meanwhile.
+struct ProfileThread {
+    static const uint32_t CAPACITY = 4096;
+
+    ProfileThread(uint32_t id)
+        : id(id)
+        , written(0)
+    {
+    }
+
+    void record(uint32_t zone, uint64_t begin, uint64_t end)
+    {
+        uint32_t n = written.load(std::memory_order_relaxed);
+        events[n % CAPACITY] = ProfileEvent{begin, end, zone, 0};
+        written.store(n + 1, std::memory_order_release);
+    }
+
+    // Appends the last CAPACITY - 1 events, oldest first
+    void copy(std::vector<ProfileEvent> &out) const
+    {
+        uint32_t end = written.load(std::memory_order_acquire);
+        // The slot after the newest may be being overwritten right now
+        uint32_t begin = (end >= CAPACITY) ? end - CAPACITY + 1 : 0;
+        size_t first = out.size();
+
+        for (uint32_t i=begin; i<end; ++i) {
+            out.push_back(events[i % CAPACITY]);
+        }
+
+        // Slots the writer may have reused while they were copied
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint32_t now = written.load(std::memory_order_relaxed);
+        uint32_t stale = (now - begin >= CAPACITY) ? now - begin - CAPACITY + 1 : 0;
+        stale = std::min(stale, end - begin);
+        out.erase(out.begin() + first, out.begin() + first + stale);
+    }
+
+    uint32_t id;
+    std::atomic<uint32_t> written;
+    ProfileEvent events[CAPACITY];
+};
+
+struct ZoneStats {
+    uint32_t count;
+    uint64_t min;
+    uint64_t avg;
+    uint64_t p99;
+    uint64_t max;
+};
+
+struct Profiler {
+    static const unsigned MAX_ZONES = 256;
+
+    // Number of most recent events per zone the statistics are taken over
+    static const unsigned STATS_WINDOW = 128;
+
+    Profiler()
+        : clock(profile_clock_default)
+        , zoneCount(0)
+    {
+    }
+
+    // Returns the id for name, registering it on first use. Called once per
+    // zone site by VS_PROFILE_ZONE; the same name always gets the same id.
+    uint32_t register_zone(const char *name)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        unsigned count = zoneCount.load(std::memory_order_relaxed);
+        for (unsigned i=0; i<count; ++i) {
+            if (strcmp(zoneNames[i], name) == 0) {
+                return i;
+            }
+        }
+
+        if (count == MAX_ZONES) {
+            printf("Too many profile zones, merging %s into %s\n", name, zoneNames[count - 1]);
+            return count - 1;
+        }
+
+        zoneNames[count] = name;
+        zoneCount.store(count + 1, std::memory_order_release);
+        return count;
+    }
+
+    const char *zone_name(uint32_t zone) const
+    {
+        return (zone < zone_count()) ? zoneNames[zone] : "?";
+    }
+
+    unsigned zone_count() const
+    {
+        return zoneCount.load(std::memory_order_acquire);
+    }
+
+    // The calling thread's buffer, created on its first event
+    ProfileThread &thread()
+    {
+        static thread_local ProfileThread *current = nullptr;
+        if (!current) {
+            std::lock_guard<std::mutex> lock(mutex);
+            threads.emplace_back(new ProfileThread(threads.size()));
+            current = threads.back().get();
+        }
+        return *current;
+    }
+
+    uint64_t now() const
+    {
+        return clock();
+    }
+
+    void record(uint32_t zone, uint64_t begin, uint64_t end)
+    {
+        thread().record(zone, begin, end);
+    }
+
+    // Events of all threads, each thread's oldest first
+    std::vector<ProfileEvent> collect(std::vector<uint32_t> *thread_ids=nullptr)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        std::vector<ProfileEvent> events;
+        for (auto &t: threads) {
+            t->copy(events);
+            if (thread_ids) {
+                thread_ids->resize(events.size(), t->id);
+            }
+        }
+        return events;
+    }
+
+    // Min, average, 99th percentile and max duration of the zone's last
+    // STATS_WINDOW events across all threads
+    ZoneStats stats(uint32_t zone)
+    {
+        std::vector<ProfileEvent> events = collect();
+        events.erase(std::remove_if(events.begin(), events.end(),
+                    [zone](const ProfileEvent &e) { return e.zone != zone; }), events.end());
+
+        // Newest first by end time, threads are interleaved
+        size_t window = std::min<size_t>(events.size(), STATS_WINDOW);
+        std::partial_sort(events.begin(), events.begin() + window, events.end(),
+                [](const ProfileEvent &a, const ProfileEvent &b) { return a.end > b.end; });
+
+        std::vector<uint64_t> durations;
+        for (size_t i=0; i<window; ++i) {
+            durations.push_back(events[i].end - events[i].begin);
+        }
+
+        ZoneStats result = {0, 0, 0, 0, 0};
+        if (durations.empty()) {
+            return result;
+        }
+
+        std::sort(durations.begin(), durations.end());
+
+        uint64_t sum = 0;
+        for (uint64_t d: durations) {
+            sum += d;
+        }
+
+        size_t n = durations.size();
+        result.count = n;
+        result.min = durations.front();
+        result.avg = sum / n;
+        result.p99 = durations[(n * 99 + 99) / 100 - 1];
+        result.max = durations.back();
+        return result;
+    }
+
+    void print_stats(FILE *fp)
+    {
+        fprintf(fp, "%-20s %6s %8s %8s %8s %8s\n", "zone (us)", "count", "min", "avg", "p99", "max");
+        for (unsigned i=0; i<zone_count(); ++i) {
+            ZoneStats s = stats(i);
+            fprintf(fp, "%-20s %6u %8llu %8llu %8llu %8llu\n", zoneNames[i], s.count,
+                    (unsigned long long)s.min, (unsigned long long)s.avg,
+                    (unsigned long long)s.p99, (unsigned long long)s.max);
+        }
+    }
+
+    // Writes all recorded events as complete ("X") events of the Chrome
+    // trace event format; timestamps are in microseconds as it expects
+    bool write_chrome_trace(FILE *fp)
+    {
+        std::vector<uint32_t> ids;
+        std::vector<ProfileEvent> events = collect(&ids);
+
+        fprintf(fp, "{\"traceEvents\":[");
+        for (size_t i=0; i<events.size(); ++i) {
+            const ProfileEvent &event = events[i];
+            fprintf(fp, "%s\n{\"name\":\"", i ? "," : "");
+            for (const char *c = zone_name(event.zone); *c; ++c) {
+                if (*c == '"' || *c == '\\') {
+                    fputc('\\', fp);
+                }
+                fputc(*c, fp);
+            }
+            fprintf(fp, "\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%llu,\"dur\":%llu}",
+                    ids[i], (unsigned long long)event.begin,
+                    (unsigned long long)(event.end - event.begin));
+        }
+        fprintf(fp, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+        return !ferror(fp);
+    }
+
+    bool write_chrome_trace(const char *filename)
+    {
+        FILE *fp = fopen(filename, "w");
+        if (!fp) {
+            return false;
+        }
+        bool ok = write_chrome_trace(fp);
+        return (fclose(fp) == 0) && ok;
+    }
+
+    // Set before recording starts, e.g. to a fake clock in host tools
+    ProfileClock clock;
+
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ProfileThread>> threads;
+    const char *zoneNames[MAX_ZONES];
+    std::atomic<unsigned> zoneCount;
+};
+
+static Profiler &
+profiler()
+{
+    static Profiler instance;
+    return instance;
+}
+
+struct ProfileScope {
+    ProfileScope(uint32_t zone)
+        : zone(zone)
+        , begin(profiler().now())
+    {
+    }
+
+    ~ProfileScope()
+    {
+        profiler().record(zone, begin, profiler().now());
+    }
+
+    uint32_t zone;
+    uint64_t begin;
+};
+
+} // end namespace vitashader
+
+#define VS_PROFILE_CONCAT2(a, b) a##b
+#define VS_PROFILE_CONCAT(a, b) VS_PROFILE_CONCAT2(a, b)
+
+#ifndef VS_PROFILE_DISABLE
+#define VS_PROFILE_ZONE(name) \
+    static const uint32_t VS_PROFILE_CONCAT(vsProfileZone, __LINE__) = vitashader::profiler().register_zone(name); \
+    vitashader::ProfileScope VS_PROFILE_CONCAT(vsProfileScope, __LINE__)(VS_PROFILE_CONCAT(vsProfileZone, __LINE__))
+#else
+#define VS_PROFILE_ZONE(name) do {} while (0)
+#endif
@@ -0,0 +1,124 @@
+#pragma once
+
+// Expands glyph rectangles into the four vertices of a TextBatch quad.
+// Every path computes origin + rect * scale as a separate multiply and add,
+// so the NEON and SSE kernels match the scalar reference bit for bit.
+
+#include "vertex.h"
+
+#include <stddef.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define VS_QUADGEN_NEON
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define VS_QUADGEN_SSE
+#endif
+
+namespace vitashader {
+
+// Quad in layout units plus its atlas rectangle; the members of each half
+// are contiguous so they load as one 4-lane vector
+struct QuadSource {
+    float x0, y0, x1, y1;
+    float s0, t0, s1, t1;
+};
+
+static void
+expand_quads_scalar(const QuadSource *src, size_t count, float ox, float oy, float scale, float z, Vertex *out)
+{
+    for (size_t i=0; i<count; ++i, ++src, out += 4) {
+        float x0 = src->x0 * scale;
+        float y0 = src->y0 * scale;
+        float x1 = src->x1 * scale;
+        float y1 = src->y1 * scale;
+        x0 = x0 + ox;
+        y0 = y0 + oy;
+        x1 = x1 + ox;
+        y1 = y1 + oy;
+
+        out[0] = Vertex{x0, y0, z, src->s0, src->t0};
+        out[1] = Vertex{x0, y1, z, src->s0, src->t1};
+        out[2] = Vertex{x1, y0, z, src->s1, src->t0};
+        out[3] = Vertex{x1, y1, z, src->s1, src->t1};
+    }
+}
+
+// Output of one quad is 20 floats, stored as five 4-lane vectors:
+//   X0 Y0 z  s0 | t0 X0 Y1 z | s0 t1 X1 Y0 | z s1 t0 X1 | Y1 z s1 t1
+
+#if defined(VS_QUADGEN_NEON)
+static void
+expand_quads_neon(const QuadSource *src, size_t count, float ox, float oy, float scale, float z, Vertex *out)
+{
+    const float32x4_t vscale = vdupq_n_f32(scale);
+    const float32x4_t vorigin = vcombine_f32(vset_lane_f32(oy, vdup_n_f32(ox), 1),
+            vset_lane_f32(oy, vdup_n_f32(ox), 1));
+    const float32x2_t zz = vdup_n_f32(z);
+    float *dst = (float *)out;
+
+    for (size_t i=0; i<count; ++i, ++src, dst += 20) {
+        float32x4_t p = vaddq_f32(vmulq_f32(vld1q_f32(&src->x0), vscale), vorigin);
+        float32x4_t t = vld1q_f32(&src->s0);
+
+        float32x2_t plo = vget_low_f32(p);   // X0 Y0
+        float32x2_t phi = vget_high_f32(p);  // X1 Y1
+        float32x2_t tlo = vget_low_f32(t);   // s0 t0
+        float32x2_t thi = vget_high_f32(t);  // s1 t1
+
+        float32x2_t y1z = vext_f32(phi, zz, 1);
+
+        vst1q_f32(dst + 0, vcombine_f32(plo, vext_f32(zz, tlo, 1)));
+        vst1q_f32(dst + 4, vcombine_f32(vext_f32(tlo, plo, 1), y1z));
+        vst1q_f32(dst + 8, vcombine_f32(vset_lane_f32(vget_lane_f32(thi, 1), tlo, 1),
+                    vset_lane_f32(vget_lane_f32(plo, 1), phi, 1)));
+        vst1q_f32(dst + 12, vcombine_f32(vext_f32(zz, thi, 1), vext_f32(tlo, phi, 1)));
+        vst1q_f32(dst + 16, vcombine_f32(y1z, thi));
+    }
+}
+#endif
+
+#if defined(VS_QUADGEN_SSE)
+static void
+expand_quads_sse(const QuadSource *src, size_t count, float ox, float oy, float scale, float z, Vertex *out)
+{
+    const __m128 vscale = _mm_set1_ps(scale);
+    const __m128 vorigin = _mm_setr_ps(ox, oy, ox, oy);
+    const __m128 vz = _mm_set1_ps(z);
+    float *dst = (float *)out;
+
+    for (size_t i=0; i<count; ++i, ++src, dst += 20) {
+        __m128 p = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&src->x0), vscale), vorigin);
+        __m128 t = _mm_loadu_ps(&src->s0);
+
+        __m128 zzs0 = _mm_shuffle_ps(vz, t, _MM_SHUFFLE(0, 0, 0, 0));   // z  z  s0 s0
+        __m128 t0x0 = _mm_shuffle_ps(t, p, _MM_SHUFFLE(0, 0, 1, 1));    // t0 t0 X0 X0
+        __m128 y1z = _mm_shuffle_ps(p, vz, _MM_SHUFFLE(0, 0, 3, 3));    // Y1 Y1 z  z
+        __m128 zzs1 = _mm_shuffle_ps(vz, t, _MM_SHUFFLE(2, 2, 0, 0));   // z  z  s1 s1
+        __m128 t0x1 = _mm_shuffle_ps(t, p, _MM_SHUFFLE(2, 2, 1, 1));    // t0 t0 X1 X1
+
+        _mm_storeu_ps(dst + 0, _mm_shuffle_ps(p, zzs0, _MM_SHUFFLE(2, 0, 1, 0)));
+        _mm_storeu_ps(dst + 4, _mm_shuffle_ps(t0x0, y1z, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm_storeu_ps(dst + 8, _mm_shuffle_ps(t, p, _MM_SHUFFLE(1, 2, 3, 0)));
+        _mm_storeu_ps(dst + 12, _mm_shuffle_ps(zzs1, t0x1, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm_storeu_ps(dst + 16, _mm_shuffle_ps(y1z, t, _MM_SHUFFLE(3, 2, 2, 0)));
+    }
+}
+#endif
+
+// Writes 4 * count vertices to out: positions are (ox, oy) + rect * scale,
+// z is passed through for the SDF border in sphere_v
+static void
+expand_quads(const QuadSource *src, size_t count, float ox, float oy, float scale, float z, Vertex *out)
+{
+#if defined(VS_QUADGEN_NEON)
+    expand_quads_neon(src, count, ox, oy, scale, z, out);
+#elif defined(VS_QUADGEN_SSE)
+    expand_quads_sse(src, count, ox, oy, scale, z, out);
+#else
+    expand_quads_scalar(src, count, ox, oy, scale, z, out);
+#endif
+}
+
+} // end namespace vitashader
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "gpumem.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+namespace vitashader {
+
+// Static U16 index buffer shared by all quad draws. Quad k uses vertices
+// 4k..4k+3 in strip order (0,0) (0,1) (1,0) (1,1), as TextBatch emits them.
+// Indices are written once when the buffer grows, never per frame.
+struct QuadIndexBuffer {
+    // Quads addressable with 16-bit indices from a single base vertex
+    static const uint32_t MAX_QUADS = 65536 / 4;
+
+    enum Mode {
+        // Two triangles per quad, 6 indices each
+        TRIANGLES,
+        // One strip with the quads joined by degenerate triangles, 6n - 2
+        // indices; GXM has no primitive restart index
+        STRIP,
+    };
+
+    QuadIndexBuffer(Mode mode=TRIANGLES)
+        : mode(mode)
+        , indices(nullptr)
+        , uid(-1)
+        , capacity(0)
+        , rebuilds(0)
+        , bytesWritten(0)
+    {
+    }
+
+    ~QuadIndexBuffer()
+    {
+        for (auto &block: retired) {
+            gpu_free(block.uid, block.memory);
+        }
+        if (indices) {
+            gpu_free(uid, indices);
+        }
+    }
+
+    QuadIndexBuffer(const QuadIndexBuffer &) = delete;
+
+    // Makes sure at least quads quads can be drawn, growing in powers of two.
+    // Replaced buffers are kept until destruction since the GPU may still
+    // be reading them.
+    bool reserve(uint32_t quads)
+    {
+        if (quads <= capacity) {
+            return true;
+        }
+        if (quads > MAX_QUADS) {
+            return false;
+        }
+
+        uint32_t grown = capacity ? capacity : 256;
+        while (grown < quads) {
+            grown *= 2;
+        }
+        if (grown > MAX_QUADS) {
+            grown = MAX_QUADS;
+        }
+
+        size_t bytes = index_count(mode, grown) * sizeof(uint16_t);
+        SceUID newUid;
+        uint16_t *newIndices = (uint16_t *)gpu_alloc(bytes, &newUid);
+        if (!newIndices) {
+            return false;
+        }
+
+        fill(mode, newIndices, grown);
+
+        if (indices) {
+            retired.emplace_back(Block{uid, indices});
+        }
+        indices = newIndices;
+        uid = newUid;
+        capacity = grown;
+
+        ++rebuilds;
+        bytesWritten += bytes;
+        return true;
+    }
+
+    uint32_t count(uint32_t quads) const
+    {
+        return index_count(mode, quads);
+    }
+
+    static uint32_t index_count(Mode mode, uint32_t quads)
+    {
+        if (quads == 0) {
+            return 0;
+        }
+        return (mode == TRIANGLES) ? quads * 6 : quads * 6 - 2;
+    }
+
+    static void fill(Mode mode, uint16_t *out, uint32_t quads)
+    {
+        for (uint32_t i=0; i<quads; ++i) {
+            uint16_t base = i * 4;
+            if (mode == TRIANGLES) {
+                *out++ = base + 0;
+                *out++ = base + 1;
+                *out++ = base + 2;
+                *out++ = base + 1;
+                *out++ = base + 3;
+                *out++ = base + 2;
+            } else {
+                if (i > 0) {
+                    // Repeat the last index and the next first index; adding
+                    // an even count keeps the winding of the following quad
+                    *out++ = base - 1;
+                    *out++ = base;
+                }
+                *out++ = base + 0;
+                *out++ = base + 1;
+                *out++ = base + 2;
+                *out++ = base + 3;
+            }
+        }
+    }
+
+#ifdef __vita__
+    SceGxmPrimitiveType primitive() const
+    {
+        return (mode == TRIANGLES) ? SCE_GXM_PRIMITIVE_TRIANGLES : SCE_GXM_PRIMITIVE_TRIANGLE_STRIP;
+    }
+#endif
+
+    struct Block {
+        SceUID uid;
+        void *memory;
+    };
+
+    Mode mode;
+    uint16_t *indices;
+    SceUID uid;
+    uint32_t capacity;
+    std::vector<Block> retired;
+
+    unsigned rebuilds;
+    size_t bytesWritten;
+};
+
+} // end namespace vitashader
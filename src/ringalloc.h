@@ -0,0 +1,181 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace vitashader {
+
+// Hands out transient, aligned allocations for a frame's vertex and index
+// data from one block of GPU-visible memory. Each frame is tagged with the
+// fence value its rendering will signal; its region is only reused once
+// retire() has been told that fence passed. The allocator never waits
+// itself: alloc() returns nullptr when the ring is full.
+struct RingAllocator {
+    static const unsigned MAX_FRAMES = 8;
+
+    struct Frame {
+        uint32_t fence;
+        size_t end;
+        size_t bytes;
+    };
+
+    RingAllocator(void *base, size_t capacity)
+        : base((uint8_t *)base)
+        , capacity(capacity)
+        , head(0)
+        , tail(0)
+        , used(0)
+        , frameStart(0)
+        , frameFence(0)
+        , inFrame(false)
+        , firstFrame(0)
+        , frameCount(0)
+        , frameBytes(0)
+        , frameHighWater(0)
+        , usedHighWater(0)
+        , failedAllocs(0)
+    {
+    }
+
+    // Starts a frame whose allocations are released once fence has passed.
+    // Fails if MAX_FRAMES frames are still waiting to be retired.
+    bool begin_frame(uint32_t fence)
+    {
+        if (inFrame || frameCount == MAX_FRAMES) {
+            return false;
+        }
+
+        inFrame = true;
+        frameFence = fence;
+        frameStart = used;
+        return true;
+    }
+
+    void *alloc(size_t size, size_t alignment)
+    {
+        if (!inFrame) {
+            return nullptr;
+        }
+
+        size_t start = align(head, alignment);
+        size_t end = start + size;
+        size_t consumed;
+
+        if (used == 0) {
+            // Nothing in flight, restart at the beginning for the largest run.
+            // Frames still queued allocated nothing, so they all end at head
+            // and move with it; left alone, retiring one would put tail back
+            // at the old offset, behind memory handed out since.
+            for (unsigned i=0; i<frameCount; ++i) {
+                frames[(firstFrame + i) % MAX_FRAMES].end = 0;
+            }
+            head = tail = 0;
+            start = 0;
+            end = size;
+            consumed = end;
+            if (end > capacity) {
+                ++failedAllocs;
+                return nullptr;
+            }
+        } else if (head > tail) {
+            if (end <= capacity) {
+                consumed = end - head;
+            } else if (size <= tail) {
+                // Skip the rest of the block and wrap around
+                consumed = capacity - head + size;
+                start = 0;
+                end = size;
+            } else {
+                ++failedAllocs;
+                return nullptr;
+            }
+        } else {
+            if (end > tail) {
+                ++failedAllocs;
+                return nullptr;
+            }
+            consumed = end - head;
+        }
+
+        head = end;
+        used += consumed;
+
+        if (used > usedHighWater) {
+            usedHighWater = used;
+        }
+
+        return base + start;
+    }
+
+    template <typename T>
+    T *alloc_array(size_t count)
+    {
+        return (T *)alloc(count * sizeof(T), alignof(T));
+    }
+
+    void end_frame()
+    {
+        if (!inFrame) {
+            return;
+        }
+
+        frameBytes = used - frameStart;
+        if (frameBytes > frameHighWater) {
+            frameHighWater = frameBytes;
+        }
+
+        frames[(firstFrame + frameCount) % MAX_FRAMES] = Frame{frameFence, head, frameBytes};
+        ++frameCount;
+        inFrame = false;
+    }
+
+    // Releases every frame whose fence is at or before completed
+    void retire(uint32_t completed)
+    {
+        while (frameCount > 0) {
+            Frame &frame = frames[firstFrame];
+            if ((int32_t)(completed - frame.fence) < 0) {
+                break;
+            }
+
+            tail = frame.end;
+            used -= frame.bytes;
+            firstFrame = (firstFrame + 1) % MAX_FRAMES;
+            --frameCount;
+        }
+    }
+
+    unsigned frames_in_flight() const
+    {
+        return frameCount;
+    }
+
+    static size_t align(size_t offset, size_t alignment)
+    {
+        return (offset + alignment - 1) & ~(alignment - 1);
+    }
+
+    uint8_t *base;
+    size_t capacity;
+
+    size_t head;
+    size_t tail;
+    size_t used;
+
+    size_t frameStart;
+    uint32_t frameFence;
+    bool inFrame;
+
+    Frame frames[MAX_FRAMES];
+    unsigned firstFrame;
+    unsigned frameCount;
+
+    // Bytes (including alignment and wrap padding) used by the last frame,
+    // the most any frame has used, and the most ever in flight at once
+    size_t frameBytes;
+    size_t frameHighWater;
+    size_t usedHighWater;
+    unsigned failedAllocs;
+};
+
+} // end namespace vitashader
@@ -0,0 +1,209 @@
+#pragma once
+
+// Signed distance field font atlas built by tools/sdfgen: one 8-bit channel
+// per texel instead of the RGBA8 texture vita2d makes from the PNG atlas,
+// since sphere_f only reads the distance. Texels are 255 * (0.5 - d / (2 *
+// spread)) for a distance d in texels from the outline, negative inside, so
+// the outline sits at 0.5 where sphere_f puts its alpha border.
+//
+// Layout, all offsets from the start of the file and little endian:
+//   SdfHeader
+//   SdfGlyph[glyphCount]   codepoints firstChar, firstChar + 1, ...
+//   texels, width * height bytes at pixelsOffset, aligned to SDF_ALIGNMENT
+//
+// The header and glyph table are read into the heap, the texels straight
+// into GPU memory where they are used as a linear U8 texture as they are.
+
+#include "gpumem.h"
+#include "textbatch.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#ifdef __vita__
+#include <psp2/gxm.h>
+#endif
+
+namespace vitashader {
+
+static const uint32_t SDF_MAGIC = 0x46445356; // "VSDF"
+static const uint32_t SDF_VERSION = 1;
+static const uint32_t SDF_ALIGNMENT = 16;
+
+struct SdfHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint16_t width;         // a multiple of 8, the stride of a linear GXM texture
+    uint16_t height;
+    uint32_t firstChar;
+    uint32_t glyphCount;
+    uint32_t glyphsOffset;
+    uint32_t pixelsOffset;
+    uint32_t size;
+    float fontSize;         // pixel height the glyphs were rendered for
+    float spread;           // distance in texels mapped to 0 and 255
+    float lineHeight;
+    uint32_t reserved;
+};
+
+// The rect of a glyph in the atlas, padded by the spread, and where it goes
+// relative to the pen at the top left of the line, all in texels. An empty
+// rect (e.g. the space) has no quad but still advances the pen.
+struct SdfGlyph {
+    uint16_t x, y;
+    uint16_t width, height;
+    int16_t left, top;
+    int32_t advance;        // 26.6 fixed point
+};
+
+struct SdfAtlas {
+    SdfAtlas()
+        : pixels(nullptr)
+        , uid(-1)
+        , error(nullptr)
+    {
+        memset(&header, 0, sizeof(header));
+    }
+
+    ~SdfAtlas()
+    {
+        release();
+    }
+
+    SdfAtlas(const SdfAtlas &) = delete;
+
+    bool open(const char *filename)
+    {
+        release();
+
+        FILE *fp = fopen(filename, "rb");
+        if (!fp) {
+            return fail("cannot open file");
+        }
+
+        fseek(fp, 0, SEEK_END);
+        long len = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+
+        if (len < (long)sizeof(SdfHeader) || fread(&header, sizeof(header), 1, fp) != 1) {
+            fclose(fp);
+            return fail("file too small");
+        }
+
+        if (!validate(len)) {
+            fclose(fp);
+            return false;
+        }
+
+        glyphs.resize(header.glyphCount);
+        size_t bytes = (size_t)header.width * header.height;
+
+#ifdef __vita__
+        pixels = (uint8_t *)gpu_alloc(bytes, &uid, SCE_KERNEL_MEMBLOCK_TYPE_USER_CDRAM_RW);
+#else
+        pixels = (uint8_t *)gpu_alloc(bytes, &uid);
+#endif
+
+        bool ok = pixels &&
+            fseek(fp, header.glyphsOffset, SEEK_SET) == 0 &&
+            fread(glyphs.data(), sizeof(SdfGlyph), glyphs.size(), fp) == glyphs.size() &&
+            fseek(fp, header.pixelsOffset, SEEK_SET) == 0 &&
+            fread(pixels, 1, bytes, fp) == bytes;
+        fclose(fp);
+
+        if (!ok) {
+            release();
+            return fail("read failed");
+        }
+
+        for (auto &g: glyphs) {
+            if (g.x + g.width > header.width || g.y + g.height > header.height) {
+                release();
+                return fail("bad glyph");
+            }
+        }
+
+#ifdef __vita__
+        sceGxmTextureInitLinear(&texture, pixels, SCE_GXM_TEXTURE_FORMAT_U8_RRRR,
+                header.width, header.height, 0);
+        sceGxmTextureSetMinFilter(&texture, SCE_GXM_TEXTURE_FILTER_LINEAR);
+        sceGxmTextureSetMagFilter(&texture, SCE_GXM_TEXTURE_FILTER_LINEAR);
+        sceGxmTextureSetUAddrMode(&texture, SCE_GXM_TEXTURE_ADDR_CLAMP);
+        sceGxmTextureSetVAddrMode(&texture, SCE_GXM_TEXTURE_ADDR_CLAMP);
+#endif
+
+        return true;
+    }
+
+    bool validate(long len)
+    {
+        if (header.magic != SDF_MAGIC || header.version != SDF_VERSION || header.size != (uint64_t)len) {
+            return fail("bad header");
+        }
+
+        if (header.width == 0 || header.width % 8 != 0 || header.height == 0 ||
+                !(header.spread > 0.f) || !(header.fontSize > 0.f) ||
+                header.glyphsOffset + (uint64_t)header.glyphCount * sizeof(SdfGlyph) > header.size ||
+                header.pixelsOffset % SDF_ALIGNMENT != 0 ||
+                header.pixelsOffset + (uint64_t)header.width * header.height > header.size) {
+            return fail("bad layout");
+        }
+
+        return true;
+    }
+
+    // Fills font's glyph table for drawing with this atlas; the atlas has to
+    // outlive the font
+    void load_font(Font &font) const
+    {
+        float sx = 1.f / header.width;
+        float sy = 1.f / header.height;
+
+        font.first = header.firstChar;
+        font.lineHeight = header.lineHeight;
+        font.glyphs.resize(glyphs.size());
+#ifdef __vita__
+        font.texture = &texture;
+#endif
+
+        for (size_t i=0; i<glyphs.size(); ++i) {
+            const SdfGlyph &g = glyphs[i];
+            font.glyphs[i] = Glyph{
+                g.x * sx, g.y * sy, (g.x + g.width) * sx, (g.y + g.height) * sy,
+                (float)g.left, (float)g.top, (float)(g.left + g.width), (float)(g.top + g.height),
+                g.advance / 64.f,
+            };
+        }
+    }
+
+    // The texture memory is only freed here, after the GPU is done with it
+    void release()
+    {
+        if (pixels) {
+            gpu_free(uid, pixels);
+        }
+        pixels = nullptr;
+        uid = -1;
+        glyphs.clear();
+    }
+
+    bool fail(const char *message)
+    {
+        error = message;
+        return false;
+    }
+
+    SdfHeader header;
+    std::vector<SdfGlyph> glyphs;
+    uint8_t *pixels;
+    SceUID uid;
+#ifdef __vita__
+    SceGxmTexture texture;
+#endif
+    const char *error;
+};
+
+} // end namespace vitashader
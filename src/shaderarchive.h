@@ -0,0 +1,251 @@
+#pragma once
+
+// All compiled shaders of the app packed into one file, built by
+// tools/gxpack. The file is read with a single fread into one aligned
+// allocation and programs are handed out as pointers into it.
+//
+// Layout, all offsets from the start of the file and little endian:
+//   ArchiveHeader
+//   ArchiveEntry[count]
+//   uint32_t table[tableSlots]   open addressing on the name hash, entry + 1
+//   names, NUL terminated
+//   program data, each aligned to ARCHIVE_ALIGNMENT
+
+#include "hash.h"
+
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+namespace vitashader {
+
+static const uint32_t ARCHIVE_MAGIC = 0x41475356; // "VSGA"
+static const uint32_t ARCHIVE_VERSION = 1;
+static const uint32_t ARCHIVE_ALIGNMENT = 16;
+
+struct ArchiveHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t tableSlots;
+    uint32_t entriesOffset;
+    uint32_t tableOffset;
+    uint32_t namesOffset;
+    uint32_t size;
+};
+
+struct ArchiveEntry {
+    uint64_t hash;
+    uint32_t nameOffset;
+    uint32_t dataOffset;
+    uint32_t size;
+    uint32_t reserved;
+};
+
+struct ShaderArchive {
+    ShaderArchive()
+        : data(nullptr)
+        , size(0)
+        , header(nullptr)
+        , entries(nullptr)
+        , table(nullptr)
+        , error(nullptr)
+    {
+    }
+
+    ~ShaderArchive()
+    {
+        free(data);
+    }
+
+    ShaderArchive(const ShaderArchive &) = delete;
+
+    bool open(const char *filename)
+    {
+        FILE *fp = fopen(filename, "rb");
+        if (!fp) {
+            return fail("cannot open file");
+        }
+
+        fseek(fp, 0, SEEK_END);
+        long len = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+
+        if (len < (long)sizeof(ArchiveHeader)) {
+            fclose(fp);
+            return fail("file too small");
+        }
+
+        free(data);
+        data = (uint8_t *)memalign(ARCHIVE_ALIGNMENT, len);
+        size = len;
+
+        bool ok = data && fread(data, size, 1, fp) == 1;
+        fclose(fp);
+
+        if (!ok) {
+            return fail("read failed");
+        }
+
+        return validate();
+    }
+
+    bool validate()
+    {
+        header = (const ArchiveHeader *)data;
+        if (header->magic != ARCHIVE_MAGIC || header->version != ARCHIVE_VERSION || header->size != size) {
+            return fail("bad header");
+        }
+
+        uint32_t slots = header->tableSlots;
+        if (slots == 0 || (slots & (slots - 1)) != 0 || header->count >= slots ||
+                header->entriesOffset + (uint64_t)header->count * sizeof(ArchiveEntry) > size ||
+                header->tableOffset + (uint64_t)slots * sizeof(uint32_t) > size ||
+                header->namesOffset > size ||
+                header->entriesOffset % alignof(ArchiveEntry) != 0 ||
+                header->tableOffset % sizeof(uint32_t) != 0) {
+            return fail("bad table");
+        }
+
+        entries = (const ArchiveEntry *)(data + header->entriesOffset);
+        table = (const uint32_t *)(data + header->tableOffset);
+
+        for (uint32_t i=0; i<header->count; ++i) {
+            const ArchiveEntry &entry = entries[i];
+            if (entry.nameOffset < header->namesOffset || entry.nameOffset >= size ||
+                    !memchr(data + entry.nameOffset, '\0', size - entry.nameOffset) ||
+                    entry.dataOffset % ARCHIVE_ALIGNMENT != 0 ||
+                    entry.dataOffset + (uint64_t)entry.size > size) {
+                return fail("bad entry");
+            }
+        }
+
+        for (uint32_t i=0; i<slots; ++i) {
+            if (table[i] > header->count) {
+                return fail("bad table");
+            }
+        }
+
+        return true;
+    }
+
+    // Returns the program stored under name (the source file name without
+    // extension, e.g. "sphere_v"), or nullptr
+    const void *find(const char *name, uint32_t *out_size=nullptr) const
+    {
+        if (!table) {
+            return nullptr;
+        }
+
+        uint64_t hash = fnv1a(name);
+        uint32_t mask = header->tableSlots - 1;
+
+        for (uint32_t slot = hash & mask; table[slot]; slot = (slot + 1) & mask) {
+            const ArchiveEntry &entry = entries[table[slot] - 1];
+            if (entry.hash == hash && strcmp((const char *)data + entry.nameOffset, name) == 0) {
+                if (out_size) {
+                    *out_size = entry.size;
+                }
+                return data + entry.dataOffset;
+            }
+        }
+
+        return nullptr;
+    }
+
+    bool fail(const char *message)
+    {
+        error = message;
+        header = nullptr;
+        entries = nullptr;
+        table = nullptr;
+        return false;
+    }
+
+    uint8_t *data;
+    size_t size;
+    const ArchiveHeader *header;
+    const ArchiveEntry *entries;
+    const uint32_t *table;
+    const char *error;
+};
+
+static uint32_t
+archive_align(uint32_t offset)
+{
+    return (offset + ARCHIVE_ALIGNMENT - 1) & ~(ARCHIVE_ALIGNMENT - 1);
+}
+
+// Lays out an archive holding programs[i] under names[i], which have to be
+// unique; used by tools/gxpack and the benchmarks
+static std::vector<uint8_t>
+build_archive(const std::vector<std::string> &names, const std::vector<std::vector<uint8_t>> &programs)
+{
+    uint32_t count = names.size();
+    uint32_t slots = 4;
+    while (slots < count * 2) {
+        slots *= 2;
+    }
+
+    ArchiveHeader header;
+    header.magic = ARCHIVE_MAGIC;
+    header.version = ARCHIVE_VERSION;
+    header.count = count;
+    header.tableSlots = slots;
+    header.entriesOffset = sizeof(ArchiveHeader);
+    header.tableOffset = header.entriesOffset + count * sizeof(ArchiveEntry);
+    header.namesOffset = header.tableOffset + slots * sizeof(uint32_t);
+
+    std::vector<ArchiveEntry> entries(count);
+    std::vector<uint32_t> table(slots, 0);
+
+    uint32_t offset = header.namesOffset;
+    for (uint32_t i=0; i<count; ++i) {
+        entries[i].hash = fnv1a(names[i].c_str());
+        entries[i].nameOffset = offset;
+        entries[i].reserved = 0;
+        offset += names[i].size() + 1;
+
+        uint32_t slot = entries[i].hash & (slots - 1);
+        while (table[slot]) {
+            slot = (slot + 1) & (slots - 1);
+        }
+        table[slot] = i + 1;
+    }
+
+    for (uint32_t i=0; i<count; ++i) {
+        offset = archive_align(offset);
+        entries[i].dataOffset = offset;
+        entries[i].size = programs[i].size();
+        offset += programs[i].size();
+    }
+    header.size = archive_align(offset);
+
+    std::vector<uint8_t> archive(header.size, 0);
+    memcpy(archive.data(), &header, sizeof(header));
+    memcpy(archive.data() + header.entriesOffset, entries.data(), count * sizeof(ArchiveEntry));
+    memcpy(archive.data() + header.tableOffset, table.data(), slots * sizeof(uint32_t));
+    for (uint32_t i=0; i<count; ++i) {
+        memcpy(archive.data() + entries[i].nameOffset, names[i].c_str(), names[i].size() + 1);
+        memcpy(archive.data() + entries[i].dataOffset, programs[i].data(), programs[i].size());
+    }
+    return archive;
+}
+
+static bool
+write_archive(const char *filename, const std::vector<uint8_t> &archive)
+{
+    FILE *fp = fopen(filename, "wb");
+    if (!fp) {
+        return false;
+    }
+    bool ok = fwrite(archive.data(), archive.size(), 1, fp) == 1;
+    return (fclose(fp) == 0) && ok;
+}
+
+} // end namespace vitashader
@@ -0,0 +1,157 @@
+#pragma once
+
+// Compile-time feature variants of the .cg programs. A source declares the
+// features it can compile out on a comment line
+//
+//   // features: SHADOW OUTLINE
+//
+// and tools/cgvariants generates one program per subset of them, with the
+// feature names #defined. The variant with features A and B of sphere_f is
+// stored as "sphere_f+A+B", names in bit order; the one without any keeps
+// the plain name. Feature bits are global, so a single mask selects the
+// variant of both stages; bits a stage does not declare are ignored for it.
+
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+namespace vitashader {
+
+enum ShaderFeature {
+    SHADER_FEATURE_SHADOW       = 1 << 0,   // drop shadow, a second distance fetch
+    SHADER_FEATURE_OUTLINE      = 1 << 1,   // outline band of uOutline color and width
+    SHADER_FEATURE_VERTEX_COLOR = 1 << 2,   // per-vertex aColor, multiplied by uColor
+    SHADER_FEATURE_PACKED_VERTEX = 1 << 3,  // GlyphVertex input instead of Vertex
+    SHADER_FEATURE_INSTANCE_PARAMS = 1 << 4, // per-string color and transform from an InstanceBuffer
+};
+
+static const char *const SHADER_FEATURE_NAMES[] = {
+    "SHADOW",
+    "OUTLINE",
+    "VERTEX_COLOR",
+    "PACKED_VERTEX",
+    "INSTANCE_PARAMS",
+};
+
+static const uint32_t SHADER_FEATURE_COUNT = sizeof(SHADER_FEATURE_NAMES) / sizeof(SHADER_FEATURE_NAMES[0]);
+
+// 0 for unknown names
+static uint32_t
+shader_feature_bit(const char *name, size_t len)
+{
+    for (uint32_t i=0; i<SHADER_FEATURE_COUNT; ++i) {
+        if (strlen(SHADER_FEATURE_NAMES[i]) == len && memcmp(SHADER_FEATURE_NAMES[i], name, len) == 0) {
+            return 1u << i;
+        }
+    }
+    return 0;
+}
+
+// Reads the "// features:" line of a source into a mask; no such line
+// means no variants. Fails on unknown or repeated names.
+static bool
+parse_shader_features(const char *source, uint32_t *mask, std::string *error)
+{
+    static const char tag[] = "// features:";
+
+    *mask = 0;
+    const char *line = source;
+    while (line && strncmp(line, tag, sizeof(tag) - 1) != 0) {
+        line = strchr(line, '\n');
+        line = line ? line + 1 : nullptr;
+    }
+    if (!line) {
+        return true;
+    }
+
+    const char *p = line + sizeof(tag) - 1;
+    for (;;) {
+        while (*p == ' ' || *p == '\t') {
+            ++p;
+        }
+        const char *end = p;
+        while (*end && *end != ' ' && *end != '\t' && *end != '\r' && *end != '\n') {
+            ++end;
+        }
+        if (end == p) {
+            return true;
+        }
+
+        uint32_t bit = shader_feature_bit(p, end - p);
+        if (!bit || (*mask & bit)) {
+            *error = std::string(bit ? "repeated feature " : "unknown feature ") + std::string(p, end - p);
+            return false;
+        }
+        *mask |= bit;
+        p = end;
+    }
+}
+
+// Every subset of declared, starting with 0
+static std::vector<uint32_t>
+shader_variant_masks(uint32_t declared)
+{
+    std::vector<uint32_t> masks;
+    uint32_t subset = 0;
+    do {
+        masks.push_back(subset);
+        subset = (subset - declared) & declared;
+    } while (subset);
+    return masks;
+}
+
+static std::string
+shader_variant_name(const std::string &base, uint32_t mask)
+{
+    std::string name = base;
+    for (uint32_t i=0; i<SHADER_FEATURE_COUNT; ++i) {
+        if (mask & (1u << i)) {
+            name += '+';
+            name += SHADER_FEATURE_NAMES[i];
+        }
+    }
+    return name;
+}
+
+// The variants of one program that are available at runtime
+struct ShaderVariantSet {
+    ShaderVariantSet()
+        : supported(0)
+    {
+    }
+
+    // Looks for the single-feature variants of base with exists(name); the
+    // generator always builds every subset of what a source declares
+    template <typename Exists>
+    bool probe(const char *base, Exists exists)
+    {
+        this->base = base;
+        supported = 0;
+        if (!exists(this->base.c_str())) {
+            return false;
+        }
+        for (uint32_t i=0; i<SHADER_FEATURE_COUNT; ++i) {
+            if (exists(shader_variant_name(this->base, 1u << i).c_str())) {
+                supported |= 1u << i;
+            }
+        }
+        return true;
+    }
+
+    uint32_t resolve(uint32_t features) const
+    {
+        return features & supported;
+    }
+
+    std::string name(uint32_t features) const
+    {
+        return shader_variant_name(base, resolve(features));
+    }
+
+    std::string base;
+    uint32_t supported;
+};
+
+} // end namespace vitashader
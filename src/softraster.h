@@ -0,0 +1,426 @@
+#pragma once
+
+// CPU implementation of the sphere_v/sphere_f pipeline: the same vertex
+// transform and SDF text fragment math, rasterizing TextBatch quads into an
+// RGBA8 buffer four pixels at a time. Used as a host throughput baseline,
+// for golden images and for offline text rendering.
+//
+// Matches the device setup in main.cpp: bilinear filtering with clamped
+// coordinates, UCHAR4 output and SRC_ALPHA / ONE_MINUS_SRC_ALPHA blending
+// of color and alpha. Vertices are assumed to have w == 1 after the
+// projection (orthographic), so varyings are interpolated linearly.
+
+#include "vertex.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define VS_SOFTRASTER_NEON
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define VS_SOFTRASTER_SSE
+#endif
+
+namespace vitashader {
+
+// Four float lanes with the handful of operations the shaders need.
+// Comparisons return all-ones or all-zeros lanes for select().
+struct SoftF4 {
+#if defined(VS_SOFTRASTER_NEON)
+    float32x4_t v;
+    static SoftF4 make(float32x4_t v) { SoftF4 r; r.v = v; return r; }
+    static SoftF4 set(float a) { return make(vdupq_n_f32(a)); }
+    static SoftF4 load(const float *p) { return make(vld1q_f32(p)); }
+    void store(float *p) const { vst1q_f32(p, v); }
+    SoftF4 operator+(SoftF4 b) const { return make(vaddq_f32(v, b.v)); }
+    SoftF4 operator-(SoftF4 b) const { return make(vsubq_f32(v, b.v)); }
+    SoftF4 operator*(SoftF4 b) const { return make(vmulq_f32(v, b.v)); }
+    static SoftF4 min(SoftF4 a, SoftF4 b) { return make(vminq_f32(a.v, b.v)); }
+    static SoftF4 max(SoftF4 a, SoftF4 b) { return make(vmaxq_f32(a.v, b.v)); }
+    static SoftF4 reciprocal(SoftF4 a)
+    {
+        // No vector divide on ARMv7, refine the estimate twice
+        float32x4_t r = vrecpeq_f32(a.v);
+        r = vmulq_f32(vrecpsq_f32(a.v, r), r);
+        r = vmulq_f32(vrecpsq_f32(a.v, r), r);
+        return make(r);
+    }
+    static SoftF4 greater(SoftF4 a, SoftF4 b) { return make(vreinterpretq_f32_u32(vcgtq_f32(a.v, b.v))); }
+    static SoftF4 greater_equal(SoftF4 a, SoftF4 b) { return make(vreinterpretq_f32_u32(vcgeq_f32(a.v, b.v))); }
+    static SoftF4 mask_and(SoftF4 a, SoftF4 b)
+    {
+        return make(vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a.v), vreinterpretq_u32_f32(b.v))));
+    }
+    static SoftF4 select(SoftF4 mask, SoftF4 a, SoftF4 b)
+    {
+        return make(vbslq_f32(vreinterpretq_u32_f32(mask.v), a.v, b.v));
+    }
+    unsigned bits() const
+    {
+        uint32x4_t m = vshrq_n_u32(vreinterpretq_u32_f32(v), 31);
+        return vgetq_lane_u32(m, 0) | (vgetq_lane_u32(m, 1) << 1) |
+            (vgetq_lane_u32(m, 2) << 2) | (vgetq_lane_u32(m, 3) << 3);
+    }
+#elif defined(VS_SOFTRASTER_SSE)
+    __m128 v;
+    static SoftF4 make(__m128 v) { SoftF4 r; r.v = v; return r; }
+    static SoftF4 set(float a) { return make(_mm_set1_ps(a)); }
+    static SoftF4 load(const float *p) { return make(_mm_loadu_ps(p)); }
+    void store(float *p) const { _mm_storeu_ps(p, v); }
+    SoftF4 operator+(SoftF4 b) const { return make(_mm_add_ps(v, b.v)); }
+    SoftF4 operator-(SoftF4 b) const { return make(_mm_sub_ps(v, b.v)); }
+    SoftF4 operator*(SoftF4 b) const { return make(_mm_mul_ps(v, b.v)); }
+    static SoftF4 min(SoftF4 a, SoftF4 b) { return make(_mm_min_ps(a.v, b.v)); }
+    static SoftF4 max(SoftF4 a, SoftF4 b) { return make(_mm_max_ps(a.v, b.v)); }
+    static SoftF4 reciprocal(SoftF4 a) { return make(_mm_div_ps(_mm_set1_ps(1.f), a.v)); }
+    static SoftF4 greater(SoftF4 a, SoftF4 b) { return make(_mm_cmpgt_ps(a.v, b.v)); }
+    static SoftF4 greater_equal(SoftF4 a, SoftF4 b) { return make(_mm_cmpge_ps(a.v, b.v)); }
+    static SoftF4 mask_and(SoftF4 a, SoftF4 b) { return make(_mm_and_ps(a.v, b.v)); }
+    static SoftF4 select(SoftF4 mask, SoftF4 a, SoftF4 b)
+    {
+        return make(_mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)));
+    }
+    unsigned bits() const { return _mm_movemask_ps(v); }
+#else
+    float v[4];
+    static SoftF4 set(float a) { SoftF4 r; for (int i=0; i<4; ++i) r.v[i] = a; return r; }
+    static SoftF4 load(const float *p) { SoftF4 r; memcpy(r.v, p, sizeof(r.v)); return r; }
+    void store(float *p) const { memcpy(p, v, sizeof(v)); }
+    SoftF4 operator+(SoftF4 b) const { SoftF4 r; for (int i=0; i<4; ++i) r.v[i] = v[i] + b.v[i]; return r; }
+    SoftF4 operator-(SoftF4 b) const { SoftF4 r; for (int i=0; i<4; ++i) r.v[i] = v[i] - b.v[i]; return r; }
+    SoftF4 operator*(SoftF4 b) const { SoftF4 r; for (int i=0; i<4; ++i) r.v[i] = v[i] * b.v[i]; return r; }
+    static SoftF4 min(SoftF4 a, SoftF4 b) { SoftF4 r; for (int i=0; i<4; ++i) r.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i]; return r; }
+    static SoftF4 max(SoftF4 a, SoftF4 b) { SoftF4 r; for (int i=0; i<4; ++i) r.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i]; return r; }
+    static SoftF4 reciprocal(SoftF4 a) { SoftF4 r; for (int i=0; i<4; ++i) r.v[i] = 1.f / a.v[i]; return r; }
+    static SoftF4 from_mask(bool m[4]) { SoftF4 r; for (int i=0; i<4; ++i) { uint32_t b = m[i] ? ~0u : 0u; memcpy(&r.v[i], &b, 4); } return r; }
+    static SoftF4 greater(SoftF4 a, SoftF4 b) { bool m[4]; for (int i=0; i<4; ++i) m[i] = a.v[i] > b.v[i]; return from_mask(m); }
+    static SoftF4 greater_equal(SoftF4 a, SoftF4 b) { bool m[4]; for (int i=0; i<4; ++i) m[i] = a.v[i] >= b.v[i]; return from_mask(m); }
+    static SoftF4 mask_and(SoftF4 a, SoftF4 b) { bool m[4]; for (int i=0; i<4; ++i) m[i] = a.bit(i) && b.bit(i); return from_mask(m); }
+    static SoftF4 select(SoftF4 mask, SoftF4 a, SoftF4 b) { SoftF4 r; for (int i=0; i<4; ++i) r.v[i] = mask.bit(i) ? a.v[i] : b.v[i]; return r; }
+    bool bit(int i) const { uint32_t b; memcpy(&b, &v[i], 4); return b != 0; }
+    unsigned bits() const { unsigned r = 0; for (int i=0; i<4; ++i) r |= bit(i) << i; return r; }
+#endif
+
+    static SoftF4 clamp01(SoftF4 a)
+    {
+        return min(max(a, set(0.f)), set(1.f));
+    }
+
+    // Cg smoothstep(e0, e1, x), given 1 / (e1 - e0)
+    static SoftF4 smoothstep(SoftF4 e0, SoftF4 inv_range, SoftF4 x)
+    {
+        SoftF4 t = clamp01((x - e0) * inv_range);
+        return t * t * (set(3.f) - set(2.f) * t);
+    }
+};
+
+// One channel of a texture, e.g. the alpha byte of RGBA8 texels
+// (data = pixels + 3, texelBytes = 4) or a U8 atlas (texelBytes = 1)
+struct SoftTexture {
+    const uint8_t *data;
+    int width;
+    int height;
+    int pitch;
+    int texelBytes;
+
+    // Bilinear fetch at normalized coordinates, texel centers at +0.5,
+    // coordinates clamped to the edge
+    float sample(float u, float v) const
+    {
+        float x = u * width - 0.5f;
+        float y = v * height - 0.5f;
+        float fx = floorf(x);
+        float fy = floorf(y);
+        float ax = x - fx;
+        float ay = y - fy;
+
+        int x0 = clamp((int)fx, width);
+        int x1 = clamp((int)fx + 1, width);
+        int y0 = clamp((int)fy, height);
+        int y1 = clamp((int)fy + 1, height);
+
+        const uint8_t *r0 = data + y0 * pitch;
+        const uint8_t *r1 = data + y1 * pitch;
+        float t00 = r0[x0 * texelBytes], t10 = r0[x1 * texelBytes];
+        float t01 = r1[x0 * texelBytes], t11 = r1[x1 * texelBytes];
+
+        float top = t00 + (t10 - t00) * ax;
+        float bottom = t01 + (t11 - t01) * ax;
+        return (top + (bottom - top) * ay) * (1.f / 255.f);
+    }
+
+    SoftF4 sample(SoftF4 u, SoftF4 v) const
+    {
+        float us[4], vs[4], out[4];
+        u.store(us);
+        v.store(vs);
+        for (int i=0; i<4; ++i) {
+            out[i] = sample(us[i], vs[i]);
+        }
+        return SoftF4::load(out);
+    }
+
+    static int clamp(int i, int size)
+    {
+        return (i < 0) ? 0 : (i >= size) ? size - 1 : i;
+    }
+};
+
+// The uniforms of sphere_v and sphere_f, with uProjection as the 16 floats
+// UniformBlock::set_matrix() uploads (column-major glm order)
+struct SoftUniforms {
+    float color[4];
+    float transform[4];
+    float projection[16];
+    float shadowOffset[2];
+};
+
+struct SoftTarget {
+    // RGBA8 pixels, bytes in R G B A order like SCE_GXM_COLOR_FORMAT_A8B8G8R8
+    uint32_t *pixels;
+    int width;
+    int height;
+    // In pixels
+    int stride;
+};
+
+struct SoftRasterizer {
+    // Outputs of sphere_v in window coordinates
+    struct Varyings {
+        float x, y;
+        float u, v;
+        float border0, border1;
+    };
+
+    // Edge function of p -> q, (q.x - p.x) * (y - p.y) - (q.y - p.y) * (x - p.x);
+    // divided by the triangle area it is the barycentric of the opposite vertex
+    struct Edge {
+        float a, b, c;
+        bool topLeft;
+
+        SoftF4 eval(SoftF4 x, float y) const
+        {
+            return SoftF4::set(a) * x + SoftF4::set(b * y + c);
+        }
+
+        // Pixels exactly on an edge belong to top and left edges only
+        SoftF4 covers(SoftF4 w, SoftF4 zero) const
+        {
+            return topLeft ? SoftF4::greater_equal(w, zero) : SoftF4::greater(w, zero);
+        }
+    };
+
+    static Edge edge(const Varyings &p, const Varyings &q)
+    {
+        Edge e;
+        e.a = -(q.y - p.y);
+        e.b = q.x - p.x;
+        e.c = (q.y - p.y) * p.x - (q.x - p.x) * p.y;
+        e.topLeft = (q.y == p.y && q.x < p.x) || (q.y > p.y);
+        return e;
+    }
+
+    struct Plane {
+        float base, d1, d2;
+
+        SoftF4 at(SoftF4 l1, SoftF4 l2) const
+        {
+            return SoftF4::set(base) + SoftF4::set(d1) * l1 + SoftF4::set(d2) * l2;
+        }
+    };
+
+    static Plane plane(float a, float b, float c)
+    {
+        return Plane{a, b - a, c - a};
+    }
+
+    SoftRasterizer(const SoftTarget &target)
+        : target(target)
+        , triangles(0)
+        , fragments(0)
+    {
+    }
+
+    void clear(uint32_t rgba)
+    {
+        for (int y=0; y<target.height; ++y) {
+            uint32_t *row = target.pixels + y * target.stride;
+            for (int x=0; x<target.width; ++x) {
+                row[x] = rgba;
+            }
+        }
+    }
+
+    // sphere_v: scale and offset by uTransform, project, border from z
+    Varyings vertex(const Vertex &in, const SoftUniforms &u) const
+    {
+        float px = in.x * u.transform[2] + u.transform[0];
+        float py = in.y * u.transform[3] + u.transform[1];
+
+        const float *m = u.projection;
+        float cx = m[0] * px + m[4] * py + m[8] * 0.5f + m[12];
+        float cy = m[1] * px + m[5] * py + m[9] * 0.5f + m[13];
+        float cw = m[3] * px + m[7] * py + m[11] * 0.5f + m[15];
+
+        // Viewport as set up by vita2d: NDC y = +1 is the top row
+        Varyings out;
+        out.x = (cx / cw + 1.f) * 0.5f * target.width;
+        out.y = (1.f - cy / cw) * 0.5f * target.height;
+        out.u = in.u;
+        out.v = in.v;
+
+        float e = 0.05f / in.z;
+        out.border0 = 0.5f - e;
+        out.border1 = 0.5f + e;
+        return out;
+    }
+
+    // Draws quads as emitted by TextBatch, two triangles each in the order
+    // of QuadIndexBuffer::TRIANGLES
+    void draw_quads(const Vertex *vertices, uint32_t quads, const SoftTexture &texture, const SoftUniforms &uniforms)
+    {
+        for (uint32_t q=0; q<quads; ++q, vertices += 4) {
+            Varyings v[4];
+            for (int i=0; i<4; ++i) {
+                v[i] = vertex(vertices[i], uniforms);
+            }
+            triangle(v[0], v[1], v[2], texture, uniforms);
+            triangle(v[1], v[3], v[2], texture, uniforms);
+        }
+    }
+
+    void triangle(const Varyings &a, const Varyings &b, const Varyings &c,
+            const SoftTexture &texture, const SoftUniforms &uniforms)
+    {
+        float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+        if (area == 0.f) {
+            return;
+        }
+
+        // Both windings are drawn (the back polygon mode is fill)
+        const Varyings *v0 = &a, *v1 = &b, *v2 = &c;
+        if (area < 0.f) {
+            std::swap(v1, v2);
+            area = -area;
+        }
+
+        int minX = (int)floorf(std::min(std::min(v0->x, v1->x), v2->x));
+        int maxX = (int)ceilf(std::max(std::max(v0->x, v1->x), v2->x));
+        int minY = (int)floorf(std::min(std::min(v0->y, v1->y), v2->y));
+        int maxY = (int)ceilf(std::max(std::max(v0->y, v1->y), v2->y));
+        minX = std::max(minX, 0);
+        minY = std::max(minY, 0);
+        maxX = std::min(maxX, target.width);
+        maxY = std::min(maxY, target.height);
+        if (minX >= maxX || minY >= maxY) {
+            return;
+        }
+
+        ++triangles;
+
+        Edge e0 = edge(*v1, *v2);
+        Edge e1 = edge(*v2, *v0);
+        Edge e2 = edge(*v0, *v1);
+        SoftF4 invArea = SoftF4::set(1.f / area);
+
+        // Attributes as a + l1 * (b - a) + l2 * (c - a), l1/l2 from e1/e2
+        Plane u = plane(v0->u, v1->u, v2->u);
+        Plane v = plane(v0->v, v1->v, v2->v);
+        Plane b0 = plane(v0->border0, v1->border0, v2->border0);
+        Plane b1 = plane(v0->border1, v1->border1, v2->border1);
+
+        static const float offsets[4] = { 0.f, 1.f, 2.f, 3.f };
+        const SoftF4 lane = SoftF4::load(offsets);
+        const SoftF4 zero = SoftF4::set(0.f);
+
+        for (int y=minY; y<maxY; ++y) {
+            float py = y + 0.5f;
+            uint32_t *row = target.pixels + y * target.stride;
+
+            for (int x=minX; x<maxX; x += 4) {
+                SoftF4 px = SoftF4::set(x + 0.5f) + lane;
+                SoftF4 w0 = e0.eval(px, py);
+                SoftF4 w1 = e1.eval(px, py);
+                SoftF4 w2 = e2.eval(px, py);
+
+                SoftF4 inside = SoftF4::mask_and(SoftF4::mask_and(
+                            e0.covers(w0, zero), e1.covers(w1, zero)), e2.covers(w2, zero));
+                unsigned mask = inside.bits();
+                if (maxX - x < 4) {
+                    mask &= (1u << (maxX - x)) - 1;
+                }
+                if (!mask) {
+                    continue;
+                }
+
+                shade(row + x, mask, w1 * invArea, w2 * invArea, u, v, b0, b1, texture, uniforms);
+            }
+        }
+    }
+
+    // sphere_f for four pixels, then blending into dst for the lanes in mask
+    void shade(uint32_t *dst, unsigned mask, SoftF4 l1, SoftF4 l2,
+            const Plane &pu, const Plane &pv, const Plane &pb0, const Plane &pb1,
+            const SoftTexture &texture, const SoftUniforms &uniforms)
+    {
+        SoftF4 u = pu.at(l1, l2);
+        SoftF4 v = pv.at(l1, l2);
+        SoftF4 border0 = pb0.at(l1, l2);
+        SoftF4 border1 = pb1.at(l1, l2);
+        SoftF4 invRange = SoftF4::reciprocal(border1 - border0);
+
+        SoftF4 dist = texture.sample(u, v);
+        SoftF4 alpha = SoftF4::smoothstep(border0, invRange, dist);
+
+        SoftF4 shadow = texture.sample(u - SoftF4::set(uniforms.shadowOffset[0]),
+                v - SoftF4::set(uniforms.shadowOffset[1]));
+        SoftF4 alpha2 = SoftF4::set(0.3f) * SoftF4::smoothstep(border0, invRange, shadow);
+
+        SoftF4 inShadow = SoftF4::greater(alpha2, alpha);
+        SoftF4 zero = SoftF4::set(0.f);
+        float r[4], g[4], b[4], a[4];
+        SoftF4::select(inShadow, zero, SoftF4::set(uniforms.color[0])).store(r);
+        SoftF4::select(inShadow, zero, SoftF4::set(uniforms.color[1])).store(g);
+        SoftF4::select(inShadow, zero, SoftF4::set(uniforms.color[2])).store(b);
+        (SoftF4::set(uniforms.color[3]) * SoftF4::max(alpha, alpha2)).store(a);
+
+        for (int i=0; i<4; ++i) {
+            if (mask & (1u << i)) {
+                dst[i] = blend(dst[i], r[i], g[i], b[i], a[i]);
+                ++fragments;
+            }
+        }
+    }
+
+    // UCHAR4 output, then SRC_ALPHA / ONE_MINUS_SRC_ALPHA on all channels
+    static uint32_t blend(uint32_t dst, float r, float g, float b, float a)
+    {
+        uint32_t src[4] = { to_unorm8(r), to_unorm8(g), to_unorm8(b), to_unorm8(a) };
+        uint32_t sa = src[3];
+        uint32_t out = 0;
+        for (int i=0; i<4; ++i) {
+            uint32_t d = (dst >> (i * 8)) & 0xFF;
+            uint32_t c = (src[i] * sa + d * (255 - sa) + 127) / 255;
+            out |= c << (i * 8);
+        }
+        return out;
+    }
+
+    static uint32_t to_unorm8(float f)
+    {
+        f = (f < 0.f) ? 0.f : (f > 1.f) ? 1.f : f;
+        return (uint32_t)(f * 255.f + 0.5f);
+    }
+
+    SoftTarget target;
+
+    unsigned triangles;
+    size_t fragments;
+};
+
+} // end namespace vitashader
@@ -0,0 +1,422 @@
+#pragma once
+
+#include "jobsystem.h"
+#include "quadgen.h"
+#include "vertex.h"
+#include "vertexpack.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include "quadindices.h"
+#include "ringalloc.h"
+
+#ifdef __vita__
+#include <psp2/gxm.h>
+#include <functional>
+
+#include "drawlist.h"
+#include "gxmstate.h"
+#include "vitashader.h"
+#else
+struct SceGxmTexture;
+#endif
+
+namespace vitashader {
+
+struct PatchedProgram;
+
+// Mirrors the floating point half of stb_font's stb_fontchar: texture
+// coordinates in atlas space and the quad relative to the pen position.
+struct Glyph {
+    float s0, t0, s1, t1;
+    float x0, y0, x1, y1;
+    float advance;
+};
+
+struct Font {
+    Font()
+        : texture(nullptr)
+        , first(0)
+        , lineHeight(0.f)
+    {
+    }
+
+    // Fills the glyph table from the arrays generated by stb_font
+    // (e.g. stb_font_SourceSansProSemiBold()), which start at codepoint 32.
+    template <typename StbFontChar>
+    void load_stb(const StbFontChar *chars, int count, int first_char, float line_height)
+    {
+        first = first_char;
+        lineHeight = line_height;
+        glyphs.resize(count);
+        for (int i=0; i<count; ++i) {
+            const StbFontChar &c = chars[i];
+            glyphs[i] = Glyph{c.s0f, c.t0f, c.s1f, c.t1f, c.x0f, c.y0f, c.x1f, c.y1f, c.advance};
+        }
+    }
+
+    const Glyph *find(uint32_t codepoint) const
+    {
+        uint32_t index = codepoint - first;
+        return (codepoint >= (uint32_t)first && index < glyphs.size()) ? &glyphs[index] : nullptr;
+    }
+
+    const SceGxmTexture *texture;
+    int first;
+    float lineHeight;
+    std::vector<Glyph> glyphs;
+};
+
+static uint32_t
+utf8_next(const char *&text)
+{
+    const unsigned char *s = (const unsigned char *)text;
+    uint32_t c = *s++;
+    int extra = 0;
+
+    if (c >= 0xF0) { c &= 0x07; extra = 3; }
+    else if (c >= 0xE0) { c &= 0x0F; extra = 2; }
+    else if (c >= 0xC0) { c &= 0x1F; extra = 1; }
+    else if (c >= 0x80) { c = 0xFFFD; }
+
+    while (extra-- && (*s & 0xC0) == 0x80) {
+        c = (c << 6) | (*s++ & 0x3F);
+    }
+
+    text = (const char *)s;
+    return c;
+}
+
+// Appends the glyph rectangles of one line of UTF-8 text, up to '\n' or
+// the end, with the pen starting at (0, penY). With a maxWidth, a glyph
+// reaching past it moves the words after the last space to a new line,
+// advancing penY; a single word wider than that is not broken. Returns the
+// text after the '\n', or nullptr at the end.
+static const char *
+layout_paragraph(const Font &font, const char *text, float maxWidth, float &penY, std::vector<QuadSource> &out)
+{
+    float penX = 0.f;
+    size_t lineStart = out.size();
+    size_t breakQuad = 0;
+    const char *breakText = nullptr;
+
+    while (*text && *text != '\n') {
+        uint32_t c = utf8_next(text);
+
+        const Glyph *g = font.find(c);
+        if (!g) {
+            continue;
+        }
+
+        if (c == ' ') {
+            breakQuad = out.size() + 1;
+            breakText = text;
+        } else if (maxWidth > 0.f && penX + g->x1 > maxWidth && breakText && breakQuad > lineStart) {
+            // Lay the rest out again from the start of the next line
+            out.resize(breakQuad);
+            text = breakText;
+            breakText = nullptr;
+            lineStart = out.size();
+            penX = 0.f;
+            penY += font.lineHeight;
+            continue;
+        }
+
+        out.emplace_back(QuadSource{
+                penX + g->x0, penY + g->y0, penX + g->x1, penY + g->y1,
+                g->s0, g->t0, g->s1, g->t1});
+        penX += g->advance;
+    }
+
+    return *text ? text + 1 : nullptr;
+}
+
+// Glyph rectangles of UTF-8 text relative to its pen start, in font units;
+// '\n' starts a new line and codepoints without a glyph are skipped. Lines
+// wrap at maxWidth if it is given, see layout_paragraph().
+static void
+layout_glyphs(const Font &font, const char *text, std::vector<QuadSource> &out, float maxWidth=0.f)
+{
+    float penY = 0.f;
+
+    out.clear();
+    while ((text = layout_paragraph(font, text, maxWidth, penY, out))) {
+        penY += font.lineHeight;
+    }
+}
+
+// Quads layout_glyphs() makes of text
+static uint32_t
+count_glyphs(const Font &font, const char *text)
+{
+    uint32_t count = 0;
+    while (*text) {
+        uint32_t c = utf8_next(text);
+        if (c != '\n' && font.find(c)) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+// A string for TextBatch::add_parallel(), laid out like TextBatch::add()
+struct TextItem {
+    const Font *font;
+    const char *text;
+    float x, y;
+    float scale;
+};
+
+// Collects the glyph quads of a whole frame into one vertex stream. Quads are
+// grouped into runs that share a program and a font texture, so each run
+// becomes a single sceGxmDraw. Building the batch does not touch GXM.
+struct TextBatch {
+    // Quads that can be addressed with 16-bit indices from a run's base vertex
+    static const uint32_t MAX_QUADS_PER_RUN = 65536 / 4;
+
+    // Of the vertex streams in the ring, whatever the vertex format; the
+    // 2 of GlyphVertex's shorts is not enough for the GPU's vertex fetch
+    static const size_t VERTEX_ALIGNMENT = 16;
+
+    struct Run {
+        PatchedProgram *program;
+        const Font *font;
+        uint32_t firstVertex;
+        uint32_t quadCount;
+    };
+
+    TextBatch()
+        : program(nullptr)
+        , instance(0)
+        , packed(false)
+    {
+    }
+
+    void clear()
+    {
+        vertices.clear();
+        quadInstances.clear();
+        runs.clear();
+    }
+
+    void set_program(PatchedProgram *program)
+    {
+        this->program = program;
+    }
+
+    // InstanceBuffer slot of the quads added from now on. Slots do not
+    // split runs; only packed vertices carry them to the GPU.
+    void set_instance(uint16_t slot)
+    {
+        instance = slot;
+    }
+
+    // Uploads GlyphVertex instead of Vertex, 48 rather than 80 bytes a
+    // glyph; the programs must then be PACKED_VERTEX variants of sphere_v.
+    // The batch itself keeps full floats either way, so packing costs CPU
+    // time per glyph where the float upload is a memcpy: worth it when the
+    // GPU's vertex fetch is the bottleneck, not the CPU.
+    void set_packed(bool packed)
+    {
+        this->packed = packed;
+    }
+
+    uint32_t vertex_stride() const
+    {
+        return packed ? sizeof(GlyphVertex) : sizeof(Vertex);
+    }
+
+    // Lays out UTF-8 text with its pen starting at (x, y); '\n' starts a new line,
+    // as do words reaching past wrapWidth pixels from x if it is given.
+    // The glyph scale also goes into z, where sphere_v derives the SDF border.
+    void add(const Font &font, const char *text, float x, float y, float scale, float wrapWidth=0.f)
+    {
+        layout_glyphs(font, text, sources, wrapWidth / scale);
+        add_quads(font, sources.data(), sources.size(), x, y, scale, scale);
+    }
+
+    void add_quad(const Font &font, float x0, float y0, float x1, float y1,
+            float s0, float t0, float s1, float t1, float z)
+    {
+        QuadSource quad{x0, y0, x1, y1, s0, t0, s1, t1};
+        add_quads(font, &quad, 1, 0.f, 0.f, 1.f, z);
+    }
+
+    // Appends count quads placed at (ox, oy) + rect * scale, see expand_quads()
+    void add_quads(const Font &font, const QuadSource *quads, size_t count,
+            float ox, float oy, float scale, float z)
+    {
+        size_t first = append_quads(font, count);
+        expand_quads(quads, count, ox, oy, scale, z, vertices.data() + first);
+    }
+
+    // Same as add() for each item in turn, with the layout spread over the
+    // workers. The glyphs are counted first, so the runs and each item's
+    // slice of the vertices are known before the jobs fill them in.
+    void add_parallel(JobSystem &jobs, const TextItem *items, size_t count, uint32_t grain=32)
+    {
+        itemQuads.resize(count);
+        jobs.parallel_for(count, grain, [&](uint32_t begin, uint32_t end, unsigned) {
+            for (uint32_t i=begin; i<end; ++i) {
+                itemQuads[i] = count_glyphs(*items[i].font, items[i].text);
+            }
+        });
+
+        for (size_t i=0; i<count; ++i) {
+            itemQuads[i] = append_quads(*items[i].font, itemQuads[i]);
+        }
+
+        workerSources.resize(jobs.worker_count());
+        jobs.parallel_for(count, grain, [&](uint32_t begin, uint32_t end, unsigned worker) {
+            std::vector<QuadSource> &scratch = workerSources[worker];
+            for (uint32_t i=begin; i<end; ++i) {
+                const TextItem &item = items[i];
+                layout_glyphs(*item.font, item.text, scratch);
+                expand_quads(scratch.data(), scratch.size(), item.x, item.y, item.scale, item.scale,
+                        vertices.data() + itemQuads[i]);
+            }
+        });
+    }
+
+    // Grows the runs and vertices by count quads of the current program and
+    // font, returning the first of their vertices for the caller to fill
+    size_t append_quads(const Font &font, size_t count)
+    {
+        size_t first = vertices.size();
+        size_t total = count;
+        while (count > 0) {
+            Run *run = runs.empty() ? nullptr : &runs.back();
+            if (!run || run->program != program || run->font != &font || run->quadCount == MAX_QUADS_PER_RUN) {
+                runs.emplace_back(Run{program, &font, (uint32_t)(first + (total - count) * 4), 0});
+                run = &runs.back();
+            }
+
+            uint32_t n = MAX_QUADS_PER_RUN - run->quadCount;
+            if (n > count) {
+                n = count;
+            }
+
+            run->quadCount += n;
+            count -= n;
+        }
+        vertices.resize(first + total * 4);
+        quadInstances.resize(first / 4 + total, instance);
+        return first;
+    }
+
+    size_t glyph_count() const
+    {
+        return vertices.size() / 4;
+    }
+
+#ifdef __vita__
+    // Uploads the vertices into the frame's ring and issues one draw per run,
+    // indexed from the shared quad index buffer. bind() is called after each
+    // program switch so the caller can set that program's uniforms. State
+    // goes through the shadow, so repeated textures and programs are elided.
+    void draw(GxmState &state, RingAllocator &ring, QuadIndexBuffer &quads,
+            const std::function<void(PatchedProgram &)> &bind)
+    {
+        uint8_t *gpuVertices = upload(ring, quads);
+        if (!gpuVertices) {
+            return;
+        }
+
+        PatchedProgram *boundProgram = nullptr;
+
+        for (auto &run: runs) {
+            if (run.program != boundProgram) {
+                boundProgram = run.program;
+                boundProgram->use(state);
+                bind(*boundProgram);
+            }
+            state.set_fragment_texture(0, run.font->texture);
+            state.set_vertex_stream(0, gpuVertices + run.firstVertex * vertex_stride());
+            state.draw(quads.primitive(), SCE_GXM_INDEX_FORMAT_U16,
+                    quads.indices, quads.count(run.quadCount));
+        }
+    }
+
+    // Uploads like draw(), but appends the runs to list instead of drawing
+    void record(DrawList &list, RingAllocator &ring, QuadIndexBuffer &quads,
+            uint8_t layer, DrawBlend blend, float depth)
+    {
+        uint8_t *gpuVertices = upload(ring, quads);
+        if (!gpuVertices) {
+            return;
+        }
+
+        for (auto &run: runs) {
+            if (!list.add(layer, blend, run.program, run.font->texture, depth,
+                        gpuVertices + run.firstVertex * vertex_stride(), quads.primitive(), SCE_GXM_INDEX_FORMAT_U16,
+                        quads.indices, quads.count(run.quadCount))) {
+                printf("Out of draw list ids\n");
+                return;
+            }
+        }
+    }
+
+#endif
+
+    // Copies or packs the vertices into the ring and grows the quad indices
+    // to the longest run; nullptr if there is nothing to draw or no memory
+    uint8_t *upload(RingAllocator &ring, QuadIndexBuffer &quads)
+    {
+        if (runs.empty()) {
+            return nullptr;
+        }
+
+        uint32_t maxQuads = 0;
+        for (auto &run: runs) {
+            if (run.quadCount > maxQuads) {
+                maxQuads = run.quadCount;
+            }
+        }
+
+        if (!quads.reserve(maxQuads)) {
+            printf("Could not grow quad indices to %u quads\n", (unsigned)maxQuads);
+            return nullptr;
+        }
+
+        if (packed) {
+            GlyphVertex *gpuVertices = (GlyphVertex *)ring.alloc(vertices.size() * sizeof(GlyphVertex),
+                    VERTEX_ALIGNMENT);
+            if (!gpuVertices) {
+                printf("Out of ring memory for %u glyphs\n", (unsigned)glyph_count());
+                return nullptr;
+            }
+            pack_glyph_vertices(vertices.data(), vertices.size(), quadInstances.data(), gpuVertices);
+            return (uint8_t *)gpuVertices;
+        }
+
+        Vertex *gpuVertices = (Vertex *)ring.alloc(vertices.size() * sizeof(Vertex), VERTEX_ALIGNMENT);
+        if (!gpuVertices) {
+            printf("Out of ring memory for %u glyphs\n", (unsigned)glyph_count());
+            return nullptr;
+        }
+
+        memcpy(gpuVertices, vertices.data(), vertices.size() * sizeof(Vertex));
+        return (uint8_t *)gpuVertices;
+    }
+
+    PatchedProgram *program;
+    uint16_t instance;
+    bool packed;
+    std::vector<Vertex> vertices;
+
+    // The slot of each quad
+    std::vector<uint16_t> quadInstances;
+    std::vector<Run> runs;
+
+    // Scratch records of the string being laid out by add(), per worker for
+    // add_parallel(), and each item's glyph count and then first vertex
+    std::vector<QuadSource> sources;
+    std::vector<std::vector<QuadSource>> workerSources;
+    std::vector<size_t> itemQuads;
+};
+
+} // end namespace vitashader
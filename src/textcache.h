@@ -0,0 +1,370 @@
+#pragma once
+
+// Glyph layout of recently drawn text, so static labels are not laid out
+// again every frame.
+//
+//   TextCache cache(256 * 1024);
+//   ...
+//   batch.clear();
+//   cache.add(batch, font, "Score", 20.f, 40.f, 1.f);
+//
+// Text is cached per line, as written: each part between '\n's is an entry
+// keyed by its bytes, font, scale, wrap width and the pen y it starts at.
+// Entries hold the line's glyph rectangles, and a hit expands them at the
+// label's position just as TextBatch::add() would, minus the UTF-8
+// decoding, glyph lookups and wrapping. Editing one line of a longer string
+// only lays that line out again, along with lines below it if its wrapped
+// height changed.
+//
+// Entries sit in one array, with their text and quads in two shared pools,
+// and are found through an open addressing table: a hit is a hash of the
+// line, a probe or two and a compare, with no allocation. Over the budget
+// in bytes, the least recently used entries are dropped in one pass down to
+// 3/4 of it. A miss costs more than add() would (the line is laid out,
+// kept and later evicted), so a cache that evicts while missing more than
+// about one lookup in seven is slower than none. While that goes on, add()
+// passes text straight on to TextBatch::add() but for one call in
+// BYPASS_SAMPLE, whose misses are laid out without being kept, and
+// thrashing costs within about 3% of add().
+
+#include "hash.h"
+#include "quadgen.h"
+#include "textbatch.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace vitashader {
+
+struct TextCache {
+    // Lookups per window of the bypass: a window with evictions and fewer
+    // than BYPASS_HIT_PERCENT hits starts it, and it lasts until
+    // BYPASS_EXIT_PERCENT of a window's lookups hit, or BYPASS_WINDOWS
+    // windows. Calls sampled while bypassing still look up the cache, which
+    // measures the hit rate, but add nothing to it; the full window after a
+    // bypass runs out refills it, and bypasses again if it still thrashes.
+    static const unsigned WINDOW = 256;
+    static const unsigned BYPASS_HIT_PERCENT = 85;
+    static const unsigned BYPASS_EXIT_PERCENT = 95;
+    static const unsigned BYPASS_SAMPLE = 32;
+    static const unsigned BYPASS_WINDOWS = 16;
+
+    struct Entry {
+        uint64_t hash;
+        const Font *font;
+        float scale;
+        float wrapWidth;
+        float penY;
+
+        // Pen y after the entry's last wrapped line
+        float endPenY;
+        uint32_t textOffset;
+        uint32_t textLength;
+        uint32_t firstQuad;
+        uint32_t quadCount;
+        uint64_t lastUse;
+    };
+
+    explicit TextCache(size_t budget)
+        : budget(budget)
+        , bytes(0)
+        , bypassing(false)
+        , clock(0)
+        , bypassWindows(0)
+        , windowLookups(0)
+        , windowHits(0)
+        , windowEvictions(0)
+        , sampleState(0x9E3779B9u)
+    {
+        reset_counters();
+    }
+
+    // Appends text to the batch like batch.add(font, text, x, y, scale, wrapWidth)
+    void add(TextBatch &batch, const Font &font, const char *text, float x, float y, float scale,
+            float wrapWidth=0.f)
+    {
+        if (bypassing && !sample()) {
+            ++bypassed;
+            batch.add(font, text, x, y, scale, wrapWidth);
+            return;
+        }
+
+        float penY = 0.f;
+        for (;;) {
+            // Hashes the line while looking for its end
+            uint64_t hash = FNV1A_SEED;
+            const char *end = text;
+            while (*end && *end != '\n') {
+                hash = (hash ^ (uint8_t)*end++) * 0x100000001b3ull;
+            }
+
+            hash = key_hash(hash, font, scale, wrapWidth, penY);
+            const Entry *entry = find(hash, font, text, end - text, scale, wrapWidth, penY);
+            if (!entry) {
+                entry = bypassing ? lay_out(font, text, scale, wrapWidth, penY)
+                    : insert(hash, font, text, end - text, scale, wrapWidth, penY);
+            }
+
+            const QuadSource *source = entry == &scratch ? scratchQuads.data() : quads.data() + entry->firstQuad;
+            size_t first = batch.append_quads(font, entry->quadCount);
+            expand_quads(source, entry->quadCount, x, y, scale, scale, batch.vertices.data() + first);
+            penY = entry->endPenY;
+
+            if (!*end) {
+                break;
+            }
+            penY += font.lineHeight;
+            text = end + 1;
+        }
+    }
+
+    // Drops every entry, e.g. after a font is reloaded
+    void clear()
+    {
+        entries.clear();
+        quads.clear();
+        texts.clear();
+        slots.clear();
+        bytes = 0;
+    }
+
+    void reset_counters()
+    {
+        hits = 0;
+        misses = 0;
+        evictions = 0;
+        bypassed = 0;
+        quadsReused = 0;
+        quadsBuilt = 0;
+    }
+
+    float hit_rate() const
+    {
+        return (hits + misses) ? (float)hits / (hits + misses) : 0.f;
+    }
+
+    size_t size() const
+    {
+        return entries.size();
+    }
+
+    static size_t entry_bytes(const Entry &entry)
+    {
+        return sizeof(Entry) + entry.textLength + entry.quadCount * sizeof(QuadSource);
+    }
+
+    std::vector<Entry> entries;
+    std::vector<QuadSource> quads;
+    std::vector<char> texts;
+
+    // Entry index + 1 per slot, 0 when empty; at most half full
+    std::vector<uint32_t> slots;
+
+    size_t budget;
+    size_t bytes;
+    bool bypassing;
+
+    unsigned hits;
+    unsigned misses;
+    unsigned evictions;
+
+    // add() calls passed on to TextBatch::add() while bypassing
+    unsigned bypassed;
+    uint64_t quadsReused;
+    uint64_t quadsBuilt;
+
+private:
+    // The rest of the key goes in a word at a time
+    static uint64_t key_hash(uint64_t textHash, const Font &font, float scale, float wrapWidth, float penY)
+    {
+        uint32_t bits[3];
+        memcpy(&bits[0], &scale, 4);
+        memcpy(&bits[1], &wrapWidth, 4);
+        memcpy(&bits[2], &penY, 4);
+
+        uint64_t h = (textHash ^ (uint64_t)(uintptr_t)&font) * 0x100000001b3ull;
+        for (uint32_t word: bits) {
+            h = (h ^ word) * 0x100000001b3ull;
+        }
+        return h ^ (h >> 32);
+    }
+
+    Entry *find(uint64_t hash, const Font &font, const char *text, size_t length, float scale, float wrapWidth,
+            float penY)
+    {
+        Entry *found = nullptr;
+        if (!slots.empty()) {
+            size_t mask = slots.size() - 1;
+            for (size_t i=hash & mask; slots[i]; i=(i + 1) & mask) {
+                Entry &entry = entries[slots[i] - 1];
+                if (entry.hash == hash && entry.font == &font && entry.scale == scale &&
+                        entry.wrapWidth == wrapWidth && entry.penY == penY && entry.textLength == length &&
+                        memcmp(texts.data() + entry.textOffset, text, length) == 0) {
+                    found = &entry;
+                    break;
+                }
+            }
+        }
+
+        if (found) {
+            found->lastUse = ++clock;
+            ++hits;
+            ++windowHits;
+            quadsReused += found->quadCount;
+        } else {
+            ++misses;
+        }
+
+        if (++windowLookups == WINDOW) {
+            if (bypassing) {
+                bypassing = windowHits * 100 < WINDOW * BYPASS_EXIT_PERCENT && ++bypassWindows < BYPASS_WINDOWS;
+            } else {
+                bypassing = windowEvictions > 0 && windowHits * 100 < WINDOW * BYPASS_HIT_PERCENT;
+                bypassWindows = 0;
+            }
+            windowLookups = 0;
+            windowHits = 0;
+            windowEvictions = 0;
+        }
+        return found;
+    }
+
+    // One call in BYPASS_SAMPLE, at random so the sampled labels differ
+    // from frame to frame
+    bool sample()
+    {
+        sampleState ^= sampleState << 13;
+        sampleState ^= sampleState >> 17;
+        sampleState ^= sampleState << 5;
+        return sampleState % BYPASS_SAMPLE == 0;
+    }
+
+    const Entry *insert(uint64_t hash, const Font &font, const char *text, size_t length, float scale,
+            float wrapWidth, float penY)
+    {
+        Entry entry;
+        entry.hash = hash;
+        entry.font = &font;
+        entry.scale = scale;
+        entry.wrapWidth = wrapWidth;
+        entry.penY = penY;
+        entry.endPenY = penY;
+        entry.textOffset = texts.size();
+        entry.textLength = length;
+        entry.firstQuad = quads.size();
+        entry.lastUse = ++clock;
+
+        texts.insert(texts.end(), text, text + length);
+        layout_paragraph(font, text, wrapWidth / scale, entry.endPenY, quads);
+        entry.quadCount = quads.size() - entry.firstQuad;
+        quadsBuilt += entry.quadCount;
+
+        entries.push_back(entry);
+        bytes += entry_bytes(entry);
+        if (bytes > budget) {
+            evict();
+        } else if (entries.size() * 2 > slots.size()) {
+            rebuild_slots();
+        } else {
+            insert_slot(entries.size() - 1);
+        }
+
+        // Eviction keeps the order of what is left, the newest last
+        return &entries.back();
+    }
+
+    // A miss while bypassing, laid out for this call only: keeping it would
+    // cost an insert and, over the budget, an eviction pass
+    const Entry *lay_out(const Font &font, const char *text, float scale, float wrapWidth, float penY)
+    {
+        scratch.endPenY = penY;
+        scratchQuads.clear();
+        layout_paragraph(font, text, wrapWidth / scale, scratch.endPenY, scratchQuads);
+        scratch.quadCount = scratchQuads.size();
+        quadsBuilt += scratch.quadCount;
+        return &scratch;
+    }
+
+    void insert_slot(size_t index)
+    {
+        size_t mask = slots.size() - 1;
+        size_t i = entries[index].hash & mask;
+        while (slots[i]) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = index + 1;
+    }
+
+    void rebuild_slots()
+    {
+        size_t size = 16;
+        while (size < entries.size() * 2) {
+            size *= 2;
+        }
+        slots.assign(size, 0);
+        for (size_t i=0; i<entries.size(); ++i) {
+            insert_slot(i);
+        }
+    }
+
+    // Drops the least recently used entries down to 3/4 of the budget,
+    // never the newest one, and packs the pools behind what is left
+    void evict()
+    {
+        order.resize(entries.size());
+        for (size_t i=0; i<order.size(); ++i) {
+            order[i] = std::make_pair(entries[i].lastUse, entry_bytes(entries[i]));
+        }
+        std::sort(order.begin(), order.end());
+
+        size_t target = budget / 4 * 3;
+        uint64_t cut = 0;
+        for (size_t i=0; i + 1<order.size() && bytes > target; ++i) {
+            cut = order[i].first;
+            bytes -= order[i].second;
+            ++evictions;
+            ++windowEvictions;
+        }
+
+        keptQuads.clear();
+        keptTexts.clear();
+        size_t kept = 0;
+        for (const Entry &entry: entries) {
+            if (entry.lastUse <= cut) {
+                continue;
+            }
+            Entry moved = entry;
+            moved.firstQuad = keptQuads.size();
+            moved.textOffset = keptTexts.size();
+            keptQuads.insert(keptQuads.end(), quads.begin() + entry.firstQuad,
+                    quads.begin() + entry.firstQuad + entry.quadCount);
+            keptTexts.insert(keptTexts.end(), texts.begin() + entry.textOffset,
+                    texts.begin() + entry.textOffset + entry.textLength);
+            entries[kept++] = moved;
+        }
+        entries.resize(kept);
+        quads.swap(keptQuads);
+        texts.swap(keptTexts);
+        rebuild_slots();
+    }
+
+    uint64_t clock;
+    unsigned bypassWindows;
+    unsigned windowLookups;
+    unsigned windowHits;
+    unsigned windowEvictions;
+    uint32_t sampleState;
+
+    Entry scratch;
+    std::vector<QuadSource> scratchQuads;
+
+    std::vector<std::pair<uint64_t, size_t>> order;
+    std::vector<QuadSource> keptQuads;
+    std::vector<char> keptTexts;
+};
+
+} // end namespace vitashader
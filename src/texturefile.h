@@ -0,0 +1,257 @@
+#pragma once
+
+// Textures converted offline by tools/texconv into the layout GXM samples
+// from, so loading is a single fread into GPU memory with no decode or
+// swizzling at startup.
+//
+// Layout, all offsets from the start of the file and little endian:
+//   TextureHeader
+//   texel data at dataOffset, aligned to TEXTURE_ALIGNMENT: the mip levels
+//   from the largest down, back to back at mipOffsets (relative to
+//   dataOffset) as GXM expects them for the texture's layout
+
+#include "gpumem.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __vita__
+#include <psp2/gxm.h>
+#endif
+
+namespace vitashader {
+
+static const uint32_t TEXTURE_MAGIC = 0x58545356; // "VSTX"
+static const uint32_t TEXTURE_VERSION = 1;
+static const uint32_t TEXTURE_ALIGNMENT = 16;
+static const uint32_t TEXTURE_MAX_MIPS = 13;
+
+enum TextureFormat {
+    TEXTURE_FORMAT_U8,          // one channel, sampled as RRRR
+    TEXTURE_FORMAT_RGBA8,       // R, G, B, A bytes
+    TEXTURE_FORMAT_COUNT,
+};
+
+enum TextureLayout {
+    TEXTURE_LAYOUT_LINEAR,      // rows padded to a multiple of 8 texels
+    TEXTURE_LAYOUT_SWIZZLED,    // Morton order, power of two sizes only
+    TEXTURE_LAYOUT_COUNT,
+};
+
+struct TextureHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t format;
+    uint32_t layout;
+    uint16_t width;
+    uint16_t height;
+    uint16_t mipCount;
+    uint16_t reserved;
+    uint32_t dataOffset;
+    uint32_t dataSize;
+    uint32_t size;
+    uint32_t mipOffsets[TEXTURE_MAX_MIPS];
+};
+
+static uint32_t
+texture_bytes_per_texel(uint32_t format)
+{
+    return (format == TEXTURE_FORMAT_RGBA8) ? 4 : 1;
+}
+
+// Bytes per row of a mip level; linear rows are padded to 8 texels
+static uint32_t
+texture_stride(uint32_t format, uint32_t layout, uint32_t width)
+{
+    if (layout == TEXTURE_LAYOUT_LINEAR) {
+        width = (width + 7) & ~7u;
+    }
+    return width * texture_bytes_per_texel(format);
+}
+
+static uint32_t
+texture_mip_size(uint32_t size, uint32_t level)
+{
+    size >>= level;
+    return size ? size : 1;
+}
+
+static uint32_t
+texture_level_bytes(uint32_t format, uint32_t layout, uint32_t width, uint32_t height, uint32_t level)
+{
+    return texture_stride(format, layout, texture_mip_size(width, level)) * texture_mip_size(height, level);
+}
+
+// Position of texel (x, y) in a swizzled level: x and y bits interleaved,
+// x in the even bits, over the square the smaller side allows; the
+// remaining high bits of the longer side go on top
+static uint32_t
+texture_swizzle_index(uint32_t x, uint32_t y, uint32_t width, uint32_t height)
+{
+    uint32_t side = (width < height) ? width : height;
+    uint32_t index = 0;
+    uint32_t bits = 0;
+
+    for (uint32_t bit=1; bit<side; bit<<=1, bits+=2) {
+        if (x & bit) {
+            index |= 1u << bits;
+        }
+        if (y & bit) {
+            index |= 2u << bits;
+        }
+    }
+
+    uint32_t rest = (width > height) ? x : y;
+    return index | ((rest & ~(side - 1)) << (bits / 2));
+}
+
+struct TextureFile {
+    TextureFile()
+        : data(nullptr)
+        , size(0)
+        , uid(-1)
+        , header(nullptr)
+        , error(nullptr)
+    {
+    }
+
+    ~TextureFile()
+    {
+        release();
+    }
+
+    TextureFile(const TextureFile &) = delete;
+
+    // The whole file goes into GPU memory with one read; the header stays
+    // in front of the texels
+    bool open(const char *filename)
+    {
+        release();
+
+        FILE *fp = fopen(filename, "rb");
+        if (!fp) {
+            return fail("cannot open file");
+        }
+
+        fseek(fp, 0, SEEK_END);
+        long len = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+
+        if (len < (long)sizeof(TextureHeader)) {
+            fclose(fp);
+            return fail("file too small");
+        }
+
+#ifdef __vita__
+        data = (uint8_t *)gpu_alloc(len, &uid, SCE_KERNEL_MEMBLOCK_TYPE_USER_CDRAM_RW);
+#else
+        data = (uint8_t *)gpu_alloc(len, &uid);
+#endif
+        size = len;
+
+        bool ok = data && fread(data, size, 1, fp) == 1;
+        fclose(fp);
+
+        if (!ok) {
+            release();
+            return fail("read failed");
+        }
+
+        if (!validate()) {
+            release();
+            return false;
+        }
+
+#ifdef __vita__
+        static const SceGxmTextureFormat formats[TEXTURE_FORMAT_COUNT] = {
+            SCE_GXM_TEXTURE_FORMAT_U8_RRRR,
+            SCE_GXM_TEXTURE_FORMAT_U8U8U8U8_ABGR,
+        };
+
+        SceGxmTextureFormat format = formats[header->format];
+        if (header->layout == TEXTURE_LAYOUT_SWIZZLED) {
+            sceGxmTextureInitSwizzled(&texture, texels(), format, header->width, header->height, header->mipCount);
+        } else {
+            sceGxmTextureInitLinear(&texture, texels(), format, header->width, header->height, header->mipCount);
+        }
+        sceGxmTextureSetMinFilter(&texture, SCE_GXM_TEXTURE_FILTER_LINEAR);
+        sceGxmTextureSetMagFilter(&texture, SCE_GXM_TEXTURE_FILTER_LINEAR);
+        if (header->mipCount > 1) {
+            sceGxmTextureSetMipFilter(&texture, SCE_GXM_TEXTURE_MIP_FILTER_ENABLED);
+        }
+#endif
+
+        return true;
+    }
+
+    bool validate()
+    {
+        header = (const TextureHeader *)data;
+        if (header->magic != TEXTURE_MAGIC || header->version != TEXTURE_VERSION || header->size != size) {
+            return fail("bad header");
+        }
+
+        if (header->format >= TEXTURE_FORMAT_COUNT || header->layout >= TEXTURE_LAYOUT_COUNT ||
+                header->width == 0 || header->height == 0 ||
+                header->mipCount == 0 || header->mipCount > TEXTURE_MAX_MIPS) {
+            return fail("bad format");
+        }
+
+        bool pot = (header->width & (header->width - 1)) == 0 && (header->height & (header->height - 1)) == 0;
+        if (header->layout == TEXTURE_LAYOUT_SWIZZLED && !pot) {
+            return fail("swizzled texture is not a power of two");
+        }
+
+        // Levels have to sit exactly where GXM computes them
+        uint32_t offset = 0;
+        for (uint32_t i=0; i<header->mipCount; ++i) {
+            if (header->mipOffsets[i] != offset) {
+                return fail("bad mip offset");
+            }
+            offset += texture_level_bytes(header->format, header->layout, header->width, header->height, i);
+        }
+
+        if (header->dataOffset % TEXTURE_ALIGNMENT != 0 || header->dataSize != offset ||
+                header->dataOffset + (uint64_t)header->dataSize > size) {
+            return fail("bad data");
+        }
+
+        return true;
+    }
+
+    const uint8_t *texels(uint32_t level=0) const
+    {
+        return data + header->dataOffset + header->mipOffsets[level];
+    }
+
+    // The memory is only freed here, after the GPU is done with the texture
+    void release()
+    {
+        if (data) {
+            gpu_free(uid, data);
+        }
+        data = nullptr;
+        size = 0;
+        uid = -1;
+        header = nullptr;
+    }
+
+    bool fail(const char *message)
+    {
+        error = message;
+        header = nullptr;
+        return false;
+    }
+
+    uint8_t *data;
+    size_t size;
+    SceUID uid;
+    const TextureHeader *header;
+#ifdef __vita__
+    SceGxmTexture texture;
+#endif
+    const char *error;
+};
+
+} // end namespace vitashader
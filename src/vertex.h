@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace vitashader {
+
+struct Vertex {
+    float x;
+    float y;
+    float z;
+    float u;
+    float v;
+};
+
+// Vertex with the same contents packed into 12 bytes, written by
+// pack_glyph_vertices() for the PACKED_VERTEX variant of sphere_v: the
+// position in GLYPH_POSITION_UNITS per pixel, atlas coordinates as
+// normalized 16-bit and the glyph scale as a half float. The last short
+// pads to 4 bytes and holds the string's slot in an InstanceBuffer.
+struct GlyphVertex {
+    int16_t x;
+    int16_t y;
+    uint16_t u;
+    uint16_t v;
+    uint16_t scale;
+    uint16_t instance;
+};
+
+} // end namespace vitashader
@@ -0,0 +1,240 @@
+#pragma once
+
+#ifdef __vita__
+#include <psp2/gxm.h>
+#else
+#include "hostgxm.h"
+#endif
+
+#include "vertex.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <type_traits>
+
+namespace vitashader {
+
+static constexpr size_t
+attribute_format_to_size(SceGxmAttributeFormat format)
+{
+    return (format == SCE_GXM_ATTRIBUTE_FORMAT_U8 || format == SCE_GXM_ATTRIBUTE_FORMAT_U8N ||
+            format == SCE_GXM_ATTRIBUTE_FORMAT_S8 || format == SCE_GXM_ATTRIBUTE_FORMAT_S8N) ? 1 :
+        (format == SCE_GXM_ATTRIBUTE_FORMAT_U16 || format == SCE_GXM_ATTRIBUTE_FORMAT_U16N ||
+         format == SCE_GXM_ATTRIBUTE_FORMAT_S16 || format == SCE_GXM_ATTRIBUTE_FORMAT_S16N ||
+         format == SCE_GXM_ATTRIBUTE_FORMAT_F16) ? 2 :
+        // F32 and UNTYPED (32-bit components passed through unconverted)
+        4;
+}
+
+namespace layout {
+
+template <unsigned... I>
+struct Indices {
+};
+
+template <unsigned N, unsigned... I>
+struct MakeIndices : MakeIndices<N - 1, N - 1, I...> {
+};
+
+template <unsigned... I>
+struct MakeIndices<0, I...> {
+    typedef Indices<I...> type;
+};
+
+static constexpr bool
+all()
+{
+    return true;
+}
+
+template <typename... B>
+static constexpr bool
+all(bool first, B... rest)
+{
+    return first && all(rest...);
+}
+
+static constexpr unsigned
+sum()
+{
+    return 0;
+}
+
+template <typename... U>
+static constexpr unsigned
+sum(unsigned first, U... rest)
+{
+    return first + sum(rest...);
+}
+
+template <typename... A>
+struct Ordered {
+    static constexpr bool value = true;
+};
+
+template <typename A, typename B, typename... Rest>
+struct Ordered<A, B, Rest...> {
+    static constexpr bool value = A::offset + A::size <= B::offset && Ordered<B, Rest...>::value;
+};
+
+} // end namespace layout
+
+// One attribute inside a vertex struct, usually declared with VS_ATTRIBUTE()
+template <size_t Offset, SceGxmAttributeFormat Format, unsigned Components>
+struct Attribute {
+    static_assert(Components >= 1 && Components <= 4, "Attributes have 1 to 4 components");
+    static_assert(Offset % attribute_format_to_size(Format) == 0, "Attribute is not aligned to its component size");
+
+    static constexpr uint16_t offset = Offset;
+    static constexpr SceGxmAttributeFormat format = Format;
+    static constexpr uint8_t components = Components;
+    static constexpr uint16_t size = Components * attribute_format_to_size(Format);
+};
+
+#define VS_ATTRIBUTE(vertex, member, format, components) \
+    vitashader::Attribute<offsetof(vertex, member), SCE_GXM_ATTRIBUTE_FORMAT_ ## format, components>
+
+// A vertex stream fed from an array of V; attributes are listed in memory order
+template <uint16_t Index, SceGxmIndexSource Source, typename V, typename... A>
+struct StreamLayout {
+    static_assert(sizeof(V) <= 0xFFFF, "Vertex is too large for a GXM stream");
+    static_assert(layout::all((A::offset + A::size <= sizeof(V))...), "Attribute extends past the end of the vertex");
+    static_assert(layout::Ordered<A...>::value, "Attributes overlap or are not listed in memory order");
+
+    typedef V vertex_type;
+
+    static constexpr uint16_t index = Index;
+    static constexpr unsigned count = sizeof...(A);
+
+    static constexpr SceGxmVertexStream gxm_stream()
+    {
+        return SceGxmVertexStream{ (uint16_t)sizeof(V), (uint16_t)Source };
+    }
+
+    static constexpr SceGxmVertexAttribute gxm_attribute(unsigned i)
+    {
+        return attribute<A...>(i);
+    }
+
+    template <typename First, typename... Rest>
+    static constexpr typename std::enable_if<sizeof...(Rest) == 0, SceGxmVertexAttribute>::type
+    attribute(unsigned)
+    {
+        return SceGxmVertexAttribute{ Index, First::offset, First::format, First::components, 0 };
+    }
+
+    template <typename First, typename... Rest>
+    static constexpr typename std::enable_if<sizeof...(Rest) != 0, SceGxmVertexAttribute>::type
+    attribute(unsigned i)
+    {
+        return i == 0 ? attribute<First>(0) : attribute<Rest...>(i - 1);
+    }
+};
+
+template <uint16_t Index, typename V, typename... A>
+using Stream = StreamLayout<Index, SCE_GXM_INDEX_SOURCE_INDEX_16BIT, V, A...>;
+
+template <uint16_t Index, typename V, typename... A>
+using InstanceStream = StreamLayout<Index, SCE_GXM_INDEX_SOURCE_INSTANCE_16BIT, V, A...>;
+
+// Complete vertex input of a program: the GXM attribute and stream arrays are
+// constant data computed by the compiler. Register indices are left at 0 and
+// filled in from the program's parameters by ShaderProgram::set_layout().
+template <typename... S>
+struct VertexLayout {
+    typedef typename layout::MakeIndices<sizeof...(S)>::type StreamIndices;
+    typedef typename layout::MakeIndices<layout::sum(S::count...)>::type AttributeIndices;
+
+    static constexpr unsigned streamCount = sizeof...(S);
+    static constexpr unsigned attributeCount = layout::sum(S::count...);
+
+    static_assert(streamCount > 0, "Layout needs at least one stream");
+
+    template <unsigned... I>
+    static constexpr bool streams_in_order(layout::Indices<I...>)
+    {
+        return layout::all((S::index == I)...);
+    }
+
+    static_assert(streams_in_order(StreamIndices()), "Streams must be numbered 0..n-1 in order");
+
+    template <typename First, typename... Rest>
+    static constexpr typename std::enable_if<sizeof...(Rest) == 0, SceGxmVertexAttribute>::type
+    attribute(unsigned i)
+    {
+        return First::gxm_attribute(i);
+    }
+
+    template <typename First, typename... Rest>
+    static constexpr typename std::enable_if<sizeof...(Rest) != 0, SceGxmVertexAttribute>::type
+    attribute(unsigned i)
+    {
+        return i < First::count ? First::gxm_attribute(i) : attribute<Rest...>(i - First::count);
+    }
+
+    template <unsigned... I>
+    struct Arrays {
+        static constexpr SceGxmVertexAttribute attributes[] = { attribute<S...>(I)... };
+    };
+
+    template <unsigned... I>
+    static constexpr Arrays<I...> arrays(layout::Indices<I...>)
+    {
+        return Arrays<I...>();
+    }
+
+    typedef decltype(arrays(AttributeIndices())) AttributeArrays;
+
+    static constexpr SceGxmVertexStream streams[] = { S::gxm_stream()... };
+
+    static const SceGxmVertexAttribute *attributes()
+    {
+        return AttributeArrays::attributes;
+    }
+};
+
+template <typename... S>
+constexpr SceGxmVertexStream VertexLayout<S...>::streams[];
+
+template <typename... S>
+template <unsigned... I>
+constexpr SceGxmVertexAttribute VertexLayout<S...>::Arrays<I...>::attributes[];
+
+// Specialised for each vertex struct to describe how a program reads it
+template <typename V>
+struct VertexTraits;
+
+template <>
+struct VertexTraits<Vertex> {
+    typedef VertexLayout<
+        Stream<0, Vertex,
+            VS_ATTRIBUTE(Vertex, x, F32, 3),
+            VS_ATTRIBUTE(Vertex, u, F32, 2)>
+    > Layout;
+};
+
+static_assert(VertexTraits<Vertex>::Layout::streams[0].stride == 20, "Vertex is five floats");
+
+template <>
+struct VertexTraits<GlyphVertex> {
+    typedef VertexLayout<
+        Stream<0, GlyphVertex,
+            VS_ATTRIBUTE(GlyphVertex, x, S16, 2),
+            VS_ATTRIBUTE(GlyphVertex, u, U16N, 2),
+            VS_ATTRIBUTE(GlyphVertex, scale, F16, 1)>
+    > Layout;
+
+    // For the INSTANCE_PARAMS variant, which also reads the instance slot
+    typedef VertexLayout<
+        Stream<0, GlyphVertex,
+            VS_ATTRIBUTE(GlyphVertex, x, S16, 2),
+            VS_ATTRIBUTE(GlyphVertex, u, U16N, 2),
+            VS_ATTRIBUTE(GlyphVertex, scale, F16, 1),
+            VS_ATTRIBUTE(GlyphVertex, instance, U16, 1)>
+    > InstancedLayout;
+};
+
+static_assert(VertexTraits<GlyphVertex>::Layout::streams[0].stride == 12, "GlyphVertex is six shorts");
+
+} // end namespace vitashader
@@ -0,0 +1,277 @@
+#pragma once
+
+// Quantization to the compact GXM attribute formats, and packing of text
+// vertices into GlyphVertex. Each quantize_*() rounds to the nearest
+// representable value, ties to even, and clamps to the format's range
+// (NaN goes to the bottom of it); the matching
+// dequantize_*() is the conversion the vertex fetch applies, so the
+// difference between the two is the error the shader sees.
+//
+//   F16   half float, round to nearest even
+//   U16N  0..65535 read as v / 65535
+//   S16N  -32767..32767 read as v / 32767 (-32768 reads as -1 too)
+//   U8N   0..255 read as v / 255
+//   S16   integer, here in fixed point units of 1 / GLYPH_POSITION_UNITS
+
+#include "vertex.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define VS_VERTEXPACK_NEON
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define VS_VERTEXPACK_SSE
+#endif
+
+namespace vitashader {
+
+// Subpixel steps per pixel of GlyphVertex positions, which reach +-4096 px;
+// sphere_v scales them back by the same constant
+static const float GLYPH_POSITION_UNITS = 8.f;
+
+static uint16_t
+quantize_f16(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, 4);
+    uint32_t sign = (bits >> 16) & 0x8000;
+    bits &= 0x7FFFFFFF;
+
+    // 2^16 and up is past the largest half (65504) even after rounding
+    if (bits >= (127 + 16) << 23) {
+        return sign | (bits > 0x7F800000 ? 0x7E00 : 0x7C00);
+    }
+
+    // Below 2^-14 the result is a subnormal: adding 0.5 lines its mantissa
+    // up with the float's low bits and the FPU does the rounding
+    if (bits < (127 - 14) << 23) {
+        const uint32_t magicBits = (127 - 1) << 23;
+        float magic, f;
+        memcpy(&magic, &magicBits, 4);
+        memcpy(&f, &bits, 4);
+        f += magic;
+        memcpy(&bits, &f, 4);
+        return sign | (uint16_t)(bits - magicBits);
+    }
+
+    // Rebias the exponent and round the 13 dropped mantissa bits to even;
+    // a carry out of the mantissa correctly bumps the exponent
+    uint32_t odd = (bits >> 13) & 1;
+    bits += ((uint32_t)(15 - 127) << 23) + 0xFFF + odd;
+    return sign | (uint16_t)(bits >> 13);
+}
+
+static float
+dequantize_f16(uint16_t half)
+{
+    uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1F;
+    uint32_t mantissa = half & 0x3FF;
+
+    float value;
+    if (exponent == 0) {
+        value = mantissa * (1.f / 16777216.f);
+        return sign ? -value : value;
+    }
+
+    uint32_t bits = sign | (mantissa << 13) | (exponent == 31 ? 0x7F800000 : (exponent + 127 - 15) << 23);
+    memcpy(&value, &bits, 4);
+    return value;
+}
+
+// Adding 1.5 * 2^23 leaves no bits for a fraction, so the FPU rounds to
+// nearest even, as the NEON and SSE packers do; |value| < 2^22
+static const float ROUND_MAGIC = 12582912.f;
+
+static int32_t
+round_to_int(float value)
+{
+    return (int32_t)((value + ROUND_MAGIC) - ROUND_MAGIC);
+}
+
+static float
+clamp_float(float value, float lo, float hi)
+{
+    // Written so NaN ends up at lo
+    return value > lo ? (value < hi ? value : hi) : lo;
+}
+
+static uint16_t
+quantize_u16n(float value)
+{
+    return (uint16_t)round_to_int(clamp_float(value, 0.f, 1.f) * 65535.f);
+}
+
+static float
+dequantize_u16n(uint16_t value)
+{
+    return value * (1.f / 65535.f);
+}
+
+static int16_t
+quantize_s16n(float value)
+{
+    return (int16_t)round_to_int(clamp_float(value, -1.f, 1.f) * 32767.f);
+}
+
+static float
+dequantize_s16n(int16_t value)
+{
+    float f = value * (1.f / 32767.f);
+    return f < -1.f ? -1.f : f;
+}
+
+static uint8_t
+quantize_u8n(float value)
+{
+    return (uint8_t)round_to_int(clamp_float(value, 0.f, 1.f) * 255.f);
+}
+
+static float
+dequantize_u8n(uint8_t value)
+{
+    return value * (1.f / 255.f);
+}
+
+// Fixed point with units steps per unit of value
+static int16_t
+quantize_s16(float value, float units)
+{
+    return (int16_t)round_to_int(clamp_float(value * units, -32768.f, 32767.f));
+}
+
+static float
+dequantize_s16(int16_t value, float units)
+{
+    return value / units;
+}
+
+// The vertex sphere_v sees for a packed one
+static Vertex
+unpack_glyph_vertex(const GlyphVertex &vertex)
+{
+    return Vertex{
+        dequantize_s16(vertex.x, GLYPH_POSITION_UNITS),
+        dequantize_s16(vertex.y, GLYPH_POSITION_UNITS),
+        dequantize_f16(vertex.scale),
+        dequantize_u16n(vertex.u),
+        dequantize_u16n(vertex.v),
+    };
+}
+
+// The glyph scale is the same for a whole quad or string, so its half is
+// only converted again when the float changes
+static uint16_t
+pack_scale(float z, uint32_t &lastBits, uint16_t &lastHalf)
+{
+    uint32_t bits;
+    memcpy(&bits, &z, 4);
+    if (bits != lastBits) {
+        lastBits = bits;
+        lastHalf = quantize_f16(z);
+    }
+    return lastHalf;
+}
+
+// quadInstances holds one InstanceBuffer slot per quad, or is null for 0
+static void
+pack_glyph_vertices_scalar(const Vertex *src, size_t count, const uint16_t *quadInstances, GlyphVertex *out)
+{
+    uint32_t lastBits = 0;
+    uint16_t lastHalf = 0;
+    for (size_t i=0; i<count; ++i) {
+        const Vertex &v = src[i];
+        out[i] = GlyphVertex{
+            quantize_s16(v.x, GLYPH_POSITION_UNITS),
+            quantize_s16(v.y, GLYPH_POSITION_UNITS),
+            quantize_u16n(v.u),
+            quantize_u16n(v.v),
+            pack_scale(v.z, lastBits, lastHalf),
+            quadInstances ? quadInstances[i / 4] : (uint16_t)0,
+        };
+    }
+}
+
+// x y u v of a vertex go through one 4-lane multiply, clamp and round:
+//   x * 8  y * 8  u * 65535  v * 65535
+
+#if defined(VS_VERTEXPACK_NEON)
+static void
+pack_glyph_vertices_neon(const Vertex *src, size_t count, const uint16_t *quadInstances, GlyphVertex *out)
+{
+    static const float units[] = { GLYPH_POSITION_UNITS, GLYPH_POSITION_UNITS, 65535.f, 65535.f };
+    static const float lows[] = { -32768.f, -32768.f, 0.f, 0.f };
+    static const float highs[] = { 32767.f, 32767.f, 65535.f, 65535.f };
+    const float32x4_t vunits = vld1q_f32(units);
+    const float32x4_t lo = vld1q_f32(lows);
+    const float32x4_t hi = vld1q_f32(highs);
+    const float32x4_t magic = vdupq_n_f32(ROUND_MAGIC);
+    uint32_t lastBits = 0;
+    uint16_t lastHalf = 0;
+
+    for (size_t i=0; i<count; ++i) {
+        const float *s = &src[i].x;
+        float32x4_t v = vmulq_f32(vcombine_f32(vld1_f32(s), vld1_f32(s + 3)), vunits);
+
+        // vmaxq would keep NaN, the select sends it to lo like clamp_float()
+        v = vminq_f32(vbslq_f32(vcgtq_f32(v, lo), v, lo), hi);
+        int32x4_t n = vcvtq_s32_f32(vsubq_f32(vaddq_f32(v, magic), magic));
+
+        // Narrowing keeps the low 16 bits, which are the U16N bits for u v
+        vst1_s16((int16_t *)&out[i], vmovn_s32(n));
+        out[i].scale = pack_scale(src[i].z, lastBits, lastHalf);
+        out[i].instance = quadInstances ? quadInstances[i / 4] : 0;
+    }
+}
+#endif
+
+#if defined(VS_VERTEXPACK_SSE)
+static void
+pack_glyph_vertices_sse(const Vertex *src, size_t count, const uint16_t *quadInstances, GlyphVertex *out)
+{
+    const __m128 units = _mm_setr_ps(GLYPH_POSITION_UNITS, GLYPH_POSITION_UNITS, 65535.f, 65535.f);
+    const __m128 lo = _mm_setr_ps(-32768.f, -32768.f, 0.f, 0.f);
+    const __m128 hi = _mm_setr_ps(32767.f, 32767.f, 65535.f, 65535.f);
+    const __m128 magic = _mm_set1_ps(ROUND_MAGIC);
+
+    // packs saturates to signed 16 bits, so u v are moved down by 32768
+    // first and have their top bit flipped back after
+    const __m128i bias = _mm_setr_epi32(0, 0, 32768, 32768);
+    const __m128i flip = _mm_setr_epi16(0, 0, (short)0x8000, (short)0x8000, 0, 0, 0, 0);
+    uint32_t lastBits = 0;
+    uint16_t lastHalf = 0;
+
+    for (size_t i=0; i<count; ++i) {
+        const float *s = &src[i].x;
+        __m128 v = _mm_shuffle_ps(_mm_loadu_ps(s), _mm_loadu_ps(s + 1), _MM_SHUFFLE(3, 2, 1, 0));
+        v = _mm_mul_ps(v, units);
+
+        // maxps returns its second operand for NaN, so NaN becomes lo
+        v = _mm_min_ps(_mm_max_ps(v, lo), hi);
+        __m128i n = _mm_cvttps_epi32(_mm_sub_ps(_mm_add_ps(v, magic), magic));
+        n = _mm_xor_si128(_mm_packs_epi32(_mm_sub_epi32(n, bias), n), flip);
+
+        _mm_storel_epi64((__m128i *)&out[i], n);
+        out[i].scale = pack_scale(src[i].z, lastBits, lastHalf);
+        out[i].instance = quadInstances ? quadInstances[i / 4] : 0;
+    }
+}
+#endif
+
+static void
+pack_glyph_vertices(const Vertex *src, size_t count, const uint16_t *quadInstances, GlyphVertex *out)
+{
+#if defined(VS_VERTEXPACK_NEON)
+    pack_glyph_vertices_neon(src, count, quadInstances, out);
+#elif defined(VS_VERTEXPACK_SSE)
+    pack_glyph_vertices_sse(src, count, quadInstances, out);
+#else
+    pack_glyph_vertices_scalar(src, count, quadInstances, out);
+#endif
+}
+
+} // end namespace vitashader
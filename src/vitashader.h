@@ -1,11 +1,33 @@
 #pragma once
 
+#ifdef __vita__
 #include <psp2/gxm.h>
-
+#else
+#include "hostgxm.h"
+#endif
+
+#include "gxmcapture.h"
+#include "gxmstate.h"
+#include "gxp.h"
+#include "hash.h"
+#include "shaderarchive.h"
+#include "shadervariant.h"
+#include "vertexlayout.h"
+
+#include <string.h>
+
+// Host builds without glm (e.g. tools/vsbench) define VITASHADER_NO_GLM,
+// which only drops the set_matrix()/set_vector() conveniences
+#ifndef VITASHADER_NO_GLM
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#endif
 
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace vitashader {
@@ -14,7 +36,7 @@ struct PatchedProgram {
     PatchedProgram(SceGxmShaderPatcher *patcher,
             SceGxmVertexProgram *vertexProgram,
             SceGxmFragmentProgram *fragmentProgram)
-        : shaderPatcher(shaderPatcher)
+        : shaderPatcher(patcher)
         , vertexProgram(vertexProgram)
         , fragmentProgram(fragmentProgram)
     {
@@ -33,19 +55,31 @@ struct PatchedProgram {
     PatchedProgram(const PatchedProgram &) = delete;
 
     PatchedProgram(PatchedProgram &&other)
-        : vertexProgram(other.vertexProgram)
+        : shaderPatcher(other.shaderPatcher)
+        , vertexProgram(other.vertexProgram)
         , fragmentProgram(other.fragmentProgram)
     {
         other.vertexProgram = nullptr;
         other.fragmentProgram = nullptr;
     }
 
+    bool valid() const
+    {
+        return vertexProgram && fragmentProgram;
+    }
+
     void use(SceGxmContext *context)
     {
         sceGxmSetVertexProgram(context, vertexProgram);
         sceGxmSetFragmentProgram(context, fragmentProgram);
     }
 
+    void use(GxmState &state)
+    {
+        state.set_vertex_program(vertexProgram);
+        state.set_fragment_program(fragmentProgram);
+    }
+
     SceGxmShaderPatcher *shaderPatcher;
     SceGxmVertexProgram *vertexProgram;
     SceGxmFragmentProgram *fragmentProgram;
@@ -64,19 +98,6 @@ struct VertexAttribute {
     SceGxmAttributeFormat format;
 };
 
-static size_t
-attribute_format_to_size(SceGxmAttributeFormat format)
-{
-    switch (format) {
-        case SCE_GXM_ATTRIBUTE_FORMAT_F32:
-            return 4;
-        case SCE_GXM_ATTRIBUTE_FORMAT_U8N:
-            return 1;
-        default:
-            return -1;
-    }
-}
-
 struct UniformVariable {
     UniformVariable(SceGxmContext *context, const SceGxmProgramParameter *parameter, bool isVertex)
         : context(context)
@@ -85,6 +106,7 @@ struct UniformVariable {
     {
     }
 
+#ifndef VITASHADER_NO_GLM
     void set_matrix(const glm::mat4 &matrix) {
         set_float(glm::value_ptr(matrix), 16);
     }
@@ -92,6 +114,7 @@ struct UniformVariable {
     void set_vector(const glm::vec4 &vector) {
         set_float(glm::value_ptr(vector), 4);
     }
+#endif
 
     void set_float(const float *value, size_t components) {
         void *buffer;
@@ -101,6 +124,9 @@ struct UniformVariable {
             sceGxmReserveFragmentDefaultUniformBuffer(context, &buffer);
         }
         sceGxmSetUniformDataF(buffer, parameter, 0, components, value);
+        VS_CAPTURE(uniform_reserve(isVertex ? GxmCapture::VERTEX : GxmCapture::FRAGMENT));
+        VS_CAPTURE(uniform_write(isVertex ? GxmCapture::VERTEX : GxmCapture::FRAGMENT, parameter, 0,
+                components, value));
     }
 
     SceGxmContext *context;
@@ -108,6 +134,72 @@ struct UniformVariable {
     bool isVertex;
 };
 
+// Everything besides the registered programs that goes into patching a
+// vertex/fragment program pair. The layout arrays are only pointed to: a
+// key looked up points at the program's current layout, a key in the
+// cache at the copy kept with its patched program.
+struct ProgramKey {
+    ProgramKey(uint64_t layoutHash, const SceGxmVertexAttribute *attributes, size_t attributeCount,
+            const SceGxmVertexStream *streams, size_t streamCount, SceGxmMultisampleMode msaa,
+            const SceGxmBlendInfo *blend_info, SceGxmOutputRegisterFormat outputFormat)
+        : layoutHash(layoutHash)
+        , attributes(attributes)
+        , streams(streams)
+        , attributeCount(attributeCount)
+        , streamCount(streamCount)
+        , msaa(msaa)
+        , outputFormat(outputFormat)
+        , hasBlend(blend_info != nullptr)
+        , blend{}
+    {
+        if (blend_info) {
+            // Copied field by field, the struct is a bitfield with padding
+            blend[0] = blend_info->colorMask;
+            blend[1] = blend_info->colorFunc;
+            blend[2] = blend_info->alphaFunc;
+            blend[3] = blend_info->colorSrc;
+            blend[4] = blend_info->colorDst;
+            blend[5] = blend_info->alphaSrc;
+            blend[6] = blend_info->alphaDst;
+        }
+
+        uint8_t state[] = { this->msaa, this->outputFormat, hasBlend, };
+        hash = fnv1a(&layoutHash, sizeof(layoutHash));
+        hash = fnv1a(state, sizeof(state), hash);
+        hash = fnv1a(blend, sizeof(blend), hash);
+    }
+
+    // The layouts are compared in full once the hashes match, so layouts
+    // whose hashes collide get programs of their own
+    bool operator==(const ProgramKey &other) const
+    {
+        return layoutHash == other.layoutHash && msaa == other.msaa &&
+            outputFormat == other.outputFormat && hasBlend == other.hasBlend &&
+            memcmp(blend, other.blend, sizeof(blend)) == 0 &&
+            attributeCount == other.attributeCount && streamCount == other.streamCount &&
+            memcmp(attributes, other.attributes, attributeCount * sizeof(SceGxmVertexAttribute)) == 0 &&
+            memcmp(streams, other.streams, streamCount * sizeof(SceGxmVertexStream)) == 0;
+    }
+
+    uint64_t hash;
+    uint64_t layoutHash;
+    const SceGxmVertexAttribute *attributes;
+    const SceGxmVertexStream *streams;
+    uint32_t attributeCount;
+    uint32_t streamCount;
+    uint8_t msaa;
+    uint8_t outputFormat;
+    uint8_t hasBlend;
+    uint8_t blend[7];
+};
+
+struct ProgramKeyHash {
+    size_t operator()(const ProgramKey &key) const
+    {
+        return (size_t)key.hash;
+    }
+};
+
 struct ShaderProgram {
     ShaderProgram(SceGxmContext *context, SceGxmShaderPatcher *shaderPatcher,
             const SceGxmProgram *vertexProgram, const SceGxmProgram *fragmentProgram)
@@ -115,13 +207,16 @@ struct ShaderProgram {
         , shaderPatcher(shaderPatcher)
         , vertexProgram(vertexProgram)
         , fragmentProgram(fragmentProgram)
+        , ownsRegistrations(true)
+        , layoutHash(0)
+        , layoutDirty(true)
+        , cacheHits(0)
+        , cacheMisses(0)
+        , cacheFailures(0)
     {
-        int err;
+        check_and_reflect();
 
-        err = sceGxmProgramCheck(vertexProgram);
-        if (err != 0) { printf("Failure when checking vertex program\n"); }
-        err = sceGxmProgramCheck(fragmentProgram);
-        if (err != 0) { printf("Failure when checking fragment program\n"); }
+        int err;
 
         err = sceGxmShaderPatcherRegisterProgram(shaderPatcher, vertexProgram, &vertexProgramId);
         if (err != 0) { printf("Failure when registering vertex program\n"); }
@@ -129,50 +224,180 @@ struct ShaderProgram {
         if (err != 0) { printf("Failure when registering fragment program\n"); }
     }
 
+    // Uses registrations made elsewhere (see ShaderVariants), which have to
+    // outlive this object
+    ShaderProgram(SceGxmContext *context, SceGxmShaderPatcher *shaderPatcher,
+            const SceGxmProgram *vertexProgram, const SceGxmProgram *fragmentProgram,
+            SceGxmShaderPatcherId vertexProgramId, SceGxmShaderPatcherId fragmentProgramId)
+        : context(context)
+        , shaderPatcher(shaderPatcher)
+        , vertexProgram(vertexProgram)
+        , fragmentProgram(fragmentProgram)
+        , vertexProgramId(vertexProgramId)
+        , fragmentProgramId(fragmentProgramId)
+        , ownsRegistrations(false)
+        , layoutHash(0)
+        , layoutDirty(true)
+        , cacheHits(0)
+        , cacheMisses(0)
+        , cacheFailures(0)
+    {
+        check_and_reflect();
+    }
+
     ~ShaderProgram()
     {
-        sceGxmShaderPatcherUnregisterProgram(shaderPatcher, fragmentProgramId);
-        sceGxmShaderPatcherUnregisterProgram(shaderPatcher, vertexProgramId);
+        // Patched programs have to be released before their registrations
+        programCache.clear();
+
+        if (ownsRegistrations) {
+            sceGxmShaderPatcherUnregisterProgram(shaderPatcher, fragmentProgramId);
+            sceGxmShaderPatcherUnregisterProgram(shaderPatcher, vertexProgramId);
+        }
+    }
+
+    ShaderProgram(const ShaderProgram &) = delete;
+
+    void check_and_reflect()
+    {
+        int err;
+
+        err = sceGxmProgramCheck(vertexProgram);
+        if (err != 0) { printf("Failure when checking vertex program\n"); }
+        err = sceGxmProgramCheck(fragmentProgram);
+        if (err != 0) { printf("Failure when checking fragment program\n"); }
+
+        if (!vertexReflection.parse(vertexProgram, sceGxmProgramGetSize(vertexProgram))) {
+            printf("Vertex program reflection: %s\n", vertexReflection.error);
+        }
+        if (!fragmentReflection.parse(fragmentProgram, sceGxmProgramGetSize(fragmentProgram))) {
+            printf("Fragment program reflection: %s\n", fragmentReflection.error);
+        }
     }
 
     void add_attribute(const char *name, uint8_t components, SceGxmAttributeFormat format)
     {
         attributes.emplace_back(name, components, format);
+        layoutDirty = true;
+    }
+
+    // Takes the attribute and stream arrays from a compile-time VertexLayout;
+    // names lists the vertex program's input for each attribute in order.
+    // Attributes the program does not have are dropped, as GXM cannot patch
+    // them; returns false if any was.
+    template <typename Layout, size_t N>
+    bool set_layout(const char *const (&names)[N])
+    {
+        static_assert(N == Layout::attributeCount, "Need one attribute name per layout attribute");
+
+        attributes.clear();
+        gxmAttributes.clear();
+        gxmStreams.assign(Layout::streams, Layout::streams + Layout::streamCount);
+
+        bool complete = true;
+        layoutHash = FNV1A_SEED;
+        for (size_t i=0; i<N; ++i) {
+            const SceGxmProgramParameter *param = find_vertex_parameter(names[i]);
+            if (!param) {
+                printf("Vertex program has no attribute %s, dropped\n", names[i]);
+                complete = false;
+                continue;
+            }
+            gxmAttributes.push_back(Layout::attributes()[i]);
+            gxmAttributes.back().regIndex = sceGxmProgramParameterGetResourceIndex(param);
+
+            layoutHash = fnv1a(names[i], layoutHash);
+        }
+        layoutHash = fnv1a(gxmAttributes.data(), gxmAttributes.size() * sizeof(SceGxmVertexAttribute), layoutHash);
+        layoutHash = fnv1a(gxmStreams.data(), gxmStreams.size() * sizeof(SceGxmVertexStream), layoutHash);
+
+        layoutDirty = false;
+        return complete;
+    }
+
+    // Hashed lookup in the reflection index, falling back to libgxm's
+    // linear search if the program could not be indexed
+    static const SceGxmProgramParameter *
+    find_parameter(const gxp::Reflection &reflection, const SceGxmProgram *program, const char *name)
+    {
+        const gxp::Parameter *parameter = reflection.find(name);
+        if (parameter) {
+            return (const SceGxmProgramParameter *)parameter->record;
+        }
+        return sceGxmProgramFindParameterByName(program, name);
+    }
+
+    const SceGxmProgramParameter *find_vertex_parameter(const char *name) const
+    {
+        return find_parameter(vertexReflection, vertexProgram, name);
+    }
+
+    const SceGxmProgramParameter *find_fragment_parameter(const char *name) const
+    {
+        return find_parameter(fragmentReflection, fragmentProgram, name);
     }
 
     UniformVariable get_vertex_uniform(const char *name)
     {
-        return UniformVariable(context, sceGxmProgramFindParameterByName(vertexProgram, name), true);
+        return UniformVariable(context, find_vertex_parameter(name), true);
     }
 
     UniformVariable get_fragment_uniform(const char *name)
     {
-        return UniformVariable(context, sceGxmProgramFindParameterByName(fragmentProgram, name), false);
+        return UniformVariable(context, find_fragment_parameter(name), false);
     }
 
-    PatchedProgram create(SceGxmMultisampleMode msaa, const SceGxmBlendInfo *blend_info)
+    // Resolves attribute registers and the stream layout once, not per create()
+    void build_layout()
     {
-        SceGxmVertexProgram *outVertexProgram;
-        SceGxmFragmentProgram *outFragmentProgram;
+        if (!layoutDirty) {
+            return;
+        }
 
         uint16_t offset = 0;
-        std::vector<SceGxmVertexAttribute> gxmAttributes;
+        gxmAttributes.clear();
+        layoutHash = FNV1A_SEED;
 
         for (auto &attribute: attributes) {
-            const SceGxmProgramParameter *param =
-                sceGxmProgramFindParameterByName(vertexProgram, attribute.name);
-            uint16_t index = sceGxmProgramParameterGetResourceIndex(param);
-
-            gxmAttributes.emplace_back(SceGxmVertexAttribute{0, offset, attribute.format,
-                    attribute.components, index});
-
-            offset += attribute.components * attribute_format_to_size(attribute.format);
+            // Compact formats after odd-sized ones start at their component size
+            uint16_t size = attribute_format_to_size(attribute.format);
+            offset = (offset + size - 1) & ~(size - 1);
+
+            // An attribute the program does not have still takes its place
+            // in the vertex, but is not patched
+            const SceGxmProgramParameter *param = find_vertex_parameter(attribute.name);
+            if (param) {
+                gxmAttributes.emplace_back(SceGxmVertexAttribute{0, offset, attribute.format,
+                        attribute.components, (uint16_t)sceGxmProgramParameterGetResourceIndex(param)});
+
+                layoutHash = fnv1a(attribute.name, layoutHash);
+                layoutHash = fnv1a(&gxmAttributes.back(), sizeof(SceGxmVertexAttribute), layoutHash);
+            } else {
+                printf("Vertex program has no attribute %s, dropped\n", attribute.name);
+            }
+
+            offset += attribute.components * size;
         }
 
-        uint16_t stride = offset;
-        std::vector<SceGxmVertexStream> gxmStreams = {
+        // Rounded up to 4 bytes like any vertex struct with a float in it;
+        // structs of only 16-bit members need a pad to match (see GlyphVertex)
+        uint16_t stride = (offset + 3) & ~3;
+        gxmStreams = {
             { stride, SCE_GXM_INDEX_SOURCE_INDEX_16BIT, },
         };
+        layoutHash = fnv1a(&stride, sizeof(stride), layoutHash);
+
+        layoutDirty = false;
+    }
+
+    // On failure both programs of the result are null (see valid())
+    PatchedProgram create(SceGxmMultisampleMode msaa, const SceGxmBlendInfo *blend_info,
+            SceGxmOutputRegisterFormat output_format=SCE_GXM_OUTPUT_REGISTER_FORMAT_UCHAR4)
+    {
+        SceGxmVertexProgram *outVertexProgram = nullptr;
+        SceGxmFragmentProgram *outFragmentProgram = nullptr;
+
+        build_layout();
 
         int err;
 
@@ -184,29 +409,309 @@ struct ShaderProgram {
                 gxmStreams.size(),
                 &outVertexProgram);
 
-        if (err != 0) { printf("Could not create vertex program\n"); }
+        if (err != 0) {
+            printf("Could not create vertex program\n");
+            return PatchedProgram(shaderPatcher, nullptr, nullptr);
+        }
 
         err = sceGxmShaderPatcherCreateFragmentProgram(shaderPatcher,
                 fragmentProgramId,
-                SCE_GXM_OUTPUT_REGISTER_FORMAT_UCHAR4,
+                output_format,
                 msaa,
                 blend_info,
                 vertexProgram,
                 &outFragmentProgram);
 
-        if (err != 0) { printf("Could not create fragment program\n"); }
+        if (err != 0) {
+            printf("Could not create fragment program\n");
+            sceGxmShaderPatcherReleaseVertexProgram(shaderPatcher, outVertexProgram);
+            return PatchedProgram(shaderPatcher, nullptr, nullptr);
+        }
 
         return PatchedProgram(shaderPatcher, outVertexProgram, outFragmentProgram);
     }
 
+    // Like create(), but patched programs are kept and shared between callers
+    // asking for the same layout, MSAA mode, blend state and output format.
+    // The returned program stays valid for the lifetime of this object.
+    // Returns nullptr if patching failed; failures are not cached, so the
+    // next get() tries again.
+    PatchedProgram *get(SceGxmMultisampleMode msaa, const SceGxmBlendInfo *blend_info,
+            SceGxmOutputRegisterFormat output_format=SCE_GXM_OUTPUT_REGISTER_FORMAT_UCHAR4)
+    {
+        build_layout();
+
+        ProgramKey key(layoutHash, gxmAttributes.data(), gxmAttributes.size(), gxmStreams.data(),
+                gxmStreams.size(), msaa, blend_info, output_format);
+        auto it = programCache.find(key);
+        if (it != programCache.end()) {
+            ++cacheHits;
+            return &it->second->program;
+        }
+
+        PatchedProgram program = create(msaa, blend_info, output_format);
+        if (!program.valid()) {
+            ++cacheFailures;
+            return nullptr;
+        }
+
+        ++cacheMisses;
+        std::unique_ptr<CachedProgram> cached(new CachedProgram{gxmAttributes, gxmStreams, std::move(program)});
+        key.attributes = cached->attributes.data();
+        key.streams = cached->streams.data();
+        PatchedProgram *result = &cached->program;
+        programCache.emplace(key, std::move(cached));
+        return result;
+    }
+
+    // A patched program with the layout it was patched for, which its key
+    // points to
+    struct CachedProgram {
+        std::vector<SceGxmVertexAttribute> attributes;
+        std::vector<SceGxmVertexStream> streams;
+        PatchedProgram program;
+    };
+
     SceGxmContext *context;
     SceGxmShaderPatcher *shaderPatcher;
     const SceGxmProgram *vertexProgram;
     const SceGxmProgram *fragmentProgram;
     SceGxmShaderPatcherId vertexProgramId;
     SceGxmShaderPatcherId fragmentProgramId;
+    bool ownsRegistrations;
+    gxp::Reflection vertexReflection;
+    gxp::Reflection fragmentReflection;
 
     std::vector<VertexAttribute> attributes;
+
+    std::vector<SceGxmVertexAttribute> gxmAttributes;
+    std::vector<SceGxmVertexStream> gxmStreams;
+    uint64_t layoutHash;
+    bool layoutDirty;
+
+    std::unordered_map<ProgramKey, std::unique_ptr<CachedProgram>, ProgramKeyHash> programCache;
+    unsigned cacheHits;
+    unsigned cacheMisses;
+
+    // get() calls whose program could not be patched
+    unsigned cacheFailures;
+};
+
+// The feature variants (see shadervariant.h) of a vertex/fragment program
+// pair in a shader archive. A ShaderProgram is made per distinct pair on
+// first use, and each program is registered with the patcher only once
+// however many pairs share it. Pick the variant at setup and keep the
+// reference; the features left out are not in the programs at all.
+struct ShaderVariants {
+    ShaderVariants(SceGxmContext *context, SceGxmShaderPatcher *shaderPatcher,
+            const ShaderArchive &archive, const char *vertexName, const char *fragmentName)
+        : context(context)
+        , shaderPatcher(shaderPatcher)
+        , archive(&archive)
+    {
+        auto exists = [&archive](const char *name) { return archive.find(name) != nullptr; };
+        if (!vertexVariants.probe(vertexName, exists)) {
+            printf("Shader archive has no %s\n", vertexName);
+        }
+        if (!fragmentVariants.probe(fragmentName, exists)) {
+            printf("Shader archive has no %s\n", fragmentName);
+        }
+    }
+
+    ~ShaderVariants()
+    {
+        programs.clear();
+        for (auto &registration: registrations) {
+            sceGxmShaderPatcherUnregisterProgram(shaderPatcher, registration.second);
+        }
+    }
+
+    ShaderVariants(const ShaderVariants &) = delete;
+
+    // features is a mask of ShaderFeature bits; bits neither program
+    // declares are ignored. Returns nullptr if the variant is missing.
+    ShaderProgram *get(uint32_t features)
+    {
+        uint32_t key = vertexVariants.resolve(features) | fragmentVariants.resolve(features);
+        auto it = programs.find(key);
+        if (it != programs.end()) {
+            return it->second.get();
+        }
+
+        std::string vertexName = vertexVariants.name(key);
+        std::string fragmentName = fragmentVariants.name(key);
+        const SceGxmProgram *vertexProgram = (const SceGxmProgram *)archive->find(vertexName.c_str());
+        const SceGxmProgram *fragmentProgram = (const SceGxmProgram *)archive->find(fragmentName.c_str());
+        if (!vertexProgram || !fragmentProgram) {
+            printf("Shader archive is missing %s/%s\n", vertexName.c_str(), fragmentName.c_str());
+            return nullptr;
+        }
+
+        SceGxmShaderPatcherId vertexId, fragmentId;
+        if (!register_program(vertexProgram, &vertexId) || !register_program(fragmentProgram, &fragmentId)) {
+            return nullptr;
+        }
+
+        std::unique_ptr<ShaderProgram> program(new ShaderProgram(context, shaderPatcher,
+                    vertexProgram, fragmentProgram, vertexId, fragmentId));
+        ShaderProgram *result = program.get();
+        programs.emplace(key, std::move(program));
+        return result;
+    }
+
+    bool register_program(const SceGxmProgram *program, SceGxmShaderPatcherId *id)
+    {
+        auto it = registrations.find(program);
+        if (it != registrations.end()) {
+            *id = it->second;
+            return true;
+        }
+
+        if (sceGxmShaderPatcherRegisterProgram(shaderPatcher, program, id) != 0) {
+            printf("Failure when registering program\n");
+            return false;
+        }
+        registrations.emplace(program, *id);
+        return true;
+    }
+
+    SceGxmContext *context;
+    SceGxmShaderPatcher *shaderPatcher;
+    const ShaderArchive *archive;
+    ShaderVariantSet vertexVariants;
+    ShaderVariantSet fragmentVariants;
+
+    std::unordered_map<const SceGxmProgram *, SceGxmShaderPatcherId> registrations;
+    std::unordered_map<uint32_t, std::unique_ptr<ShaderProgram>> programs;
+};
+
+// CPU shadow of a program's vertex and fragment default uniforms. Setting a
+// value only marks its stage dirty when the value actually changes; flush()
+// then reserves one default uniform buffer per dirty stage and writes that
+// stage's values into it. Clean stages are not reserved at all, so GXM keeps
+// using the buffer of the previous draw. Call invalidate() after binding the
+// program, as other programs drawn in between replace the current buffers.
+struct UniformBlock {
+    typedef size_t Handle;
+
+    // Returned for names the program does not have; setting it does nothing
+    static const Handle INVALID = (Handle)-1;
+
+    enum Stage {
+        VERTEX,
+        FRAGMENT,
+        STAGES,
+    };
+
+    struct Uniform {
+        const SceGxmProgramParameter *parameter;
+        Stage stage;
+        uint32_t offset;
+        uint32_t components;
+    };
+
+    UniformBlock(ShaderProgram &program)
+        : context(program.context)
+        , program(&program)
+        , dirty{true, true}
+        , reserves(0)
+        , bytesWritten(0)
+    {
+    }
+
+    Handle add_vertex(const char *name, size_t components)
+    {
+        return add(program->find_vertex_parameter(name), VERTEX, components);
+    }
+
+    Handle add_fragment(const char *name, size_t components)
+    {
+        return add(program->find_fragment_parameter(name), FRAGMENT, components);
+    }
+
+#ifndef VITASHADER_NO_GLM
+    void set_matrix(Handle handle, const glm::mat4 &matrix) {
+        set_float(handle, glm::value_ptr(matrix), 16);
+    }
+
+    void set_vector(Handle handle, const glm::vec4 &vector) {
+        set_float(handle, glm::value_ptr(vector), 4);
+    }
+#endif
+
+    void set_float(Handle handle, const float *value, size_t components)
+    {
+        if (handle == INVALID) {
+            return;
+        }
+
+        Uniform &uniform = uniforms[handle];
+        size_t size = std::min<size_t>(components, uniform.components) * sizeof(float);
+        float *shadow = values.data() + uniform.offset;
+
+        if (memcmp(shadow, value, size) != 0) {
+            memcpy(shadow, value, size);
+            dirty[uniform.stage] = true;
+        }
+    }
+
+    void invalidate()
+    {
+        dirty[VERTEX] = dirty[FRAGMENT] = true;
+    }
+
+    void flush()
+    {
+        for (int stage=0; stage<STAGES; ++stage) {
+            if (!dirty[stage]) {
+                continue;
+            }
+
+            void *buffer;
+            if (stage == VERTEX) {
+                sceGxmReserveVertexDefaultUniformBuffer(context, &buffer);
+            } else {
+                sceGxmReserveFragmentDefaultUniformBuffer(context, &buffer);
+            }
+            ++reserves;
+            VS_CAPTURE(uniform_reserve((GxmCapture::Stage)stage));
+
+            for (auto &uniform: uniforms) {
+                if (uniform.stage == stage) {
+                    sceGxmSetUniformDataF(buffer, uniform.parameter, 0, uniform.components,
+                            values.data() + uniform.offset);
+                    bytesWritten += uniform.components * sizeof(float);
+                    VS_CAPTURE(uniform_write((GxmCapture::Stage)stage, uniform.parameter, 0, uniform.components,
+                            values.data() + uniform.offset));
+                }
+            }
+
+            dirty[stage] = false;
+        }
+    }
+
+    Handle add(const SceGxmProgramParameter *parameter, Stage stage, size_t components)
+    {
+        if (!parameter) {
+            printf("Unknown uniform added to block\n");
+            return INVALID;
+        }
+
+        uniforms.emplace_back(Uniform{parameter, stage, (uint32_t)values.size(), (uint32_t)components});
+        values.resize(values.size() + components, 0.f);
+        dirty[stage] = true;
+        return uniforms.size() - 1;
+    }
+
+    SceGxmContext *context;
+    ShaderProgram *program;
+
+    std::vector<Uniform> uniforms;
+    std::vector<float> values;
+    bool dirty[STAGES];
+
+    unsigned reserves;
+    unsigned bytesWritten;
 };
 
 } // end namespace vitashader
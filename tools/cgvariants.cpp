@@ -0,0 +1,133 @@
+// Expands the feature declarations of .cg sources (see shadervariant.h) into
+// one source per variant and a makefile fragment that compiles them.
+//
+//   cgvariants -o variants.mk program_v.cg program_f.cg...
+//
+// The variant sources start with a #define per feature followed by the
+// original text. The fragment sets VARIANT_PROGRAMS to every .gxp to build,
+// including the plain ones, which the makefile's pattern rules compile.
+
+#include "shadervariant.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+using namespace vitashader;
+
+static bool
+read_file(const char *filename, std::string &text)
+{
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        return false;
+    }
+
+    char buffer[4096];
+    size_t len;
+    text.clear();
+    while ((len = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+        text.append(buffer, len);
+    }
+
+    bool ok = !ferror(fp);
+    fclose(fp);
+    return ok;
+}
+
+static bool
+write_file(const std::string &filename, const std::string &text)
+{
+    FILE *fp = fopen(filename.c_str(), "wb");
+    if (!fp) {
+        return false;
+    }
+    bool ok = fwrite(text.data(), 1, text.size(), fp) == text.size();
+    return (fclose(fp) == 0) && ok;
+}
+
+// Only rewrites the file when it changes, so make does not rebuild
+// variants of untouched sources
+static bool
+update_file(const std::string &filename, const std::string &text)
+{
+    std::string old;
+    if (read_file(filename.c_str(), old) && old == text) {
+        return true;
+    }
+    return write_file(filename, text);
+}
+
+int
+main(int argc, char *argv[])
+{
+    if (argc < 4 || strcmp(argv[1], "-o") != 0) {
+        fprintf(stderr, "Usage: %s -o variants.mk program.cg...\n", argv[0]);
+        return 1;
+    }
+
+    std::string programs;
+    std::string rules;
+
+    for (int i=3; i<argc; ++i) {
+        std::string source = argv[i];
+        std::string base = source.substr(0, source.rfind('.'));
+
+        const char *stage = nullptr;
+        if (base.size() > 2 && base.compare(base.size() - 2, 2, "_v") == 0) {
+            stage = "--vertex";
+        } else if (base.size() > 2 && base.compare(base.size() - 2, 2, "_f") == 0) {
+            stage = "--fragment";
+        } else {
+            fprintf(stderr, "%s: name has to end in _v or _f\n", argv[i]);
+            return 1;
+        }
+
+        std::string text;
+        if (!read_file(argv[i], text)) {
+            fprintf(stderr, "%s: cannot read\n", argv[i]);
+            return 1;
+        }
+
+        uint32_t declared;
+        std::string error;
+        if (!parse_shader_features(text.c_str(), &declared, &error)) {
+            fprintf(stderr, "%s: %s\n", argv[i], error.c_str());
+            return 1;
+        }
+
+        for (uint32_t mask: shader_variant_masks(declared)) {
+            std::string name = shader_variant_name(base, mask);
+            programs += " " + name + ".gxp";
+            if (mask == 0) {
+                continue;
+            }
+
+            std::string variant;
+            for (uint32_t f=0; f<SHADER_FEATURE_COUNT; ++f) {
+                if (mask & (1u << f)) {
+                    variant += std::string("#define ") + SHADER_FEATURE_NAMES[f] + "\n";
+                }
+            }
+            variant += "#line 1 \"" + source + "\"\n" + text;
+
+            if (!update_file(name + ".cg", variant)) {
+                fprintf(stderr, "%s.cg: cannot write\n", name.c_str());
+                return 1;
+            }
+
+            rules += "\n" + name + ".gxp: " + name + ".cg " + source + "\n\t$(SHACC) " + stage + " $< $@\n";
+        }
+    }
+
+    std::string makefile = "# Generated by tools/cgvariants, do not edit\n\nVARIANT_PROGRAMS :=" +
+        programs + "\n" + rules;
+    if (!write_file(argv[2], makefile)) {
+        fprintf(stderr, "%s: cannot write\n", argv[2]);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+// Failure counting for the host checks: check() reports each failed
+// condition on stderr, and main() returns failures ? 1 : 0.
+
+#include <stdio.h>
+
+static int failures = 0;
+
+static void
+check(bool ok, const char *what)
+{
+    if (!ok) {
+        fprintf(stderr, "FAILED: %s\n", what);
+        ++failures;
+    }
+}
@@ -0,0 +1,264 @@
+// Checks and times the sorted draw list of drawlist.h against a mock backend
+// that counts program, texture and vertex stream changes.
+//
+//   drawsort [draws] [iterations]
+//
+// A UI-like frame interleaves opaque panels, additive glows and alpha
+// blended text over several layers, programs and textures. The radix sort
+// has to match std::stable_sort on the keys, keep layers and alpha blended
+// draws in recording order and replay every draw once. Additive draws may
+// only be grouped in layers without alpha blended ones. The state changes
+// of replaying in recording and in sorted order are reported, followed by
+// the cost of sorting and replaying.
+
+#include "check.h"
+#include "drawlist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+using namespace vitashader;
+
+struct MockBackend {
+    MockBackend()
+        : programChanges(0)
+        , textureChanges(0)
+        , streamChanges(0)
+    {
+    }
+
+    void set_program(PatchedProgram *)
+    {
+        ++programChanges;
+    }
+
+    void set_texture(const SceGxmTexture *)
+    {
+        ++textureChanges;
+    }
+
+    void set_vertices(const void *)
+    {
+        ++streamChanges;
+    }
+
+    void draw(const DrawCommand &cmd)
+    {
+        drawn.push_back(&cmd);
+    }
+
+    unsigned programChanges;
+    unsigned textureChanges;
+    unsigned streamChanges;
+    std::vector<const DrawCommand *> drawn;
+};
+
+// Only counts, for timing the replay loop itself
+struct NullBackend {
+    NullBackend()
+        : calls(0)
+    {
+    }
+
+    void set_program(PatchedProgram *) { ++calls; }
+    void set_texture(const SceGxmTexture *) { ++calls; }
+    void set_vertices(const void *) { ++calls; }
+    void draw(const DrawCommand &) { ++calls; }
+
+    unsigned calls;
+};
+
+static const int PROGRAMS = 6;
+static const int TEXTURES = 24;
+
+static PatchedProgram *
+fake_program(int i)
+{
+    static char programs[PROGRAMS];
+    return (PatchedProgram *)&programs[i];
+}
+
+static const SceGxmTexture *
+fake_texture(int i)
+{
+    static SceGxmTexture textures[TEXTURES];
+    return &textures[i];
+}
+
+// Widgets of a few draws each; the widget's layer, program and texture are
+// shared by its draws, like a panel with its label and icon
+static void
+record_frame(DrawList &list, unsigned draws, unsigned seed)
+{
+    static char vertices[4096];
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> depth(0.f, 1.f);
+
+    list.clear();
+    while (list.size() < draws) {
+        uint8_t layer = rng() % 4;
+        for (int part=0; part<3 && list.size() < draws; ++part) {
+            DrawBlend blend = (DrawBlend)(part == 2 ? DRAW_BLEND_ALPHA : rng() % 2);
+            int program = part * 2 + rng() % 2;
+            int texture = (part == 2) ? rng() % 2 : 2 + rng() % (TEXTURES - 2);
+            list.add(layer, blend, fake_program(program), fake_texture(texture), depth(rng),
+                    &vertices[rng() % 64 * 64], SCE_GXM_PRIMITIVE_TRIANGLES, SCE_GXM_INDEX_FORMAT_U16,
+                    nullptr, 6 * (1 + rng() % 16));
+        }
+    }
+}
+
+// A glow, a label over it and a glow over the label, next to a layer of
+// glows alone: additive draws in the first layer must stay in recording
+// order around the alpha blended ones, those in the second may be grouped
+static void
+check_mixed_layers()
+{
+    static char vertices[64];
+    DrawList list;
+    struct {
+        uint8_t layer;
+        DrawBlend blend;
+        int program;
+        int texture;
+        float depth;
+    } draws[] = {
+        { 0, DRAW_BLEND_ADD, 0, 2, 0.5f },
+        { 0, DRAW_BLEND_ALPHA, 4, 0, 0.f },
+        { 0, DRAW_BLEND_ADD, 1, 3, 0.1f },
+        { 0, DRAW_BLEND_OPAQUE, 2, 4, 0.9f },
+        { 0, DRAW_BLEND_ALPHA, 4, 1, 0.f },
+        { 1, DRAW_BLEND_ADD, 1, 3, 0.5f },
+        { 1, DRAW_BLEND_ADD, 0, 2, 0.5f },
+        { 1, DRAW_BLEND_ADD, 1, 3, 0.1f },
+    };
+    for (const auto &d: draws) {
+        list.add(d.layer, d.blend, fake_program(d.program), fake_texture(d.texture), d.depth, vertices,
+                SCE_GXM_PRIMITIVE_TRIANGLES, SCE_GXM_INDEX_FORMAT_U16, nullptr, 6);
+    }
+    list.sort();
+
+    // The opaque draw first, then the rest of layer 0 as recorded; layer 1
+    // grouped by program with the nearer of its two equal draws first
+    static const uint32_t expected[] = { 3, 0, 1, 2, 4, 6, 7, 5 };
+    check(std::equal(list.order.begin(), list.order.end(), expected) && list.order.size() == 8,
+            "additive draws keep recording order in layers with alpha blended draws");
+
+    list.clear();
+    list.add(0, DRAW_BLEND_ADD, fake_program(1), fake_texture(3), 0.f, vertices, SCE_GXM_PRIMITIVE_TRIANGLES,
+            SCE_GXM_INDEX_FORMAT_U16, nullptr, 6);
+    list.add(0, DRAW_BLEND_ADD, fake_program(0), fake_texture(2), 0.f, vertices, SCE_GXM_PRIMITIVE_TRIANGLES,
+            SCE_GXM_INDEX_FORMAT_U16, nullptr, 6);
+    list.sort();
+    check(list.order[0] == 1 && list.order[1] == 0, "additive draws grouped again after clear()");
+}
+
+static double
+seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int
+main(int argc, char *argv[])
+{
+    unsigned draws = (argc > 1) ? atoi(argv[1]) : 2000;
+    unsigned iterations = (argc > 2) ? atoi(argv[2]) : 200;
+
+    check(DrawList::quantize_depth(-1.f) == 0 && DrawList::quantize_depth(0.f) == 0, "depth clamped at 0");
+    check(DrawList::quantize_depth(2.f) == DrawList::DEPTH_MAX, "depth clamped at 1");
+    check(DrawList::quantize_depth(0.25f) < DrawList::quantize_depth(0.5f), "depth increases");
+
+    check_mixed_layers();
+
+    DrawList list;
+    record_frame(list, draws, 1);
+    list.order_mixed_layers();
+    std::vector<uint64_t> expected = list.keys;
+    std::stable_sort(expected.begin(), expected.end());
+
+    MockBackend before;
+    list.replay(before);
+
+    list.sort();
+    check(list.keys == expected, "radix sort matches the key order");
+
+    MockBackend after;
+    list.replay(after);
+
+    check(before.drawn.size() == draws && after.drawn.size() == draws, "every draw replayed");
+    std::vector<const DrawCommand *> a = before.drawn;
+    std::vector<const DrawCommand *> b = after.drawn;
+    std::sort(a.begin(), a.end());
+    std::sort(b.begin(), b.end());
+    check(a == b, "each draw replayed once");
+
+    bool stable = true;
+    bool layered = true;
+    bool alphaOrdered = true;
+    for (size_t i=1; i<list.order.size(); ++i) {
+        const DrawCommand &prev = list.commands[list.order[i - 1]];
+        const DrawCommand &cur = list.commands[list.order[i]];
+        if (prev.key == cur.key && list.order[i - 1] > list.order[i]) {
+            stable = false;
+        }
+        if ((prev.key >> 56) > (cur.key >> 56)) {
+            layered = false;
+        }
+        if ((prev.key >> 56) == (cur.key >> 56) && ((prev.key >> 54) & 3) == DRAW_BLEND_ALPHA &&
+                ((cur.key >> 54) & 3) == DRAW_BLEND_ALPHA && list.order[i - 1] > list.order[i]) {
+            alphaOrdered = false;
+        }
+    }
+    check(stable, "equal keys keep recording order");
+    check(layered, "layers in order");
+    check(alphaOrdered, "alpha blended draws keep recording order");
+
+    // Ids survive clear(), so the same scene gets the same keys next frame
+    record_frame(list, draws, 1);
+    check(list.programIds.size() == (size_t)PROGRAMS && list.textureIds.size() == (size_t)TEXTURES,
+            "ids kept across frames");
+    list.sort();
+    check(list.keys == expected, "same keys every frame");
+
+    printf("%u draws over 4 layers, %d programs, %d textures\n", draws, PROGRAMS, TEXTURES);
+    printf("%-18s %10s %10s %10s\n", "replay", "programs", "textures", "streams");
+    printf("%-18s %10u %10u %10u\n", "recording order", before.programChanges, before.textureChanges,
+            before.streamChanges);
+    printf("%-18s %10u %10u %10u\n", "sorted", after.programChanges, after.textureChanges,
+            after.streamChanges);
+    check(after.programChanges < before.programChanges && after.textureChanges < before.textureChanges,
+            "sorting saves program and texture changes");
+
+    double sortTime = 0.0;
+    double replayTime = 0.0;
+    unsigned calls = 0;
+    for (unsigned i=0; i<iterations; ++i) {
+        record_frame(list, draws, 1 + i % 8);
+
+        auto start = std::chrono::steady_clock::now();
+        list.sort();
+        sortTime += seconds_since(start);
+
+        NullBackend backend;
+        start = std::chrono::steady_clock::now();
+        list.replay(backend);
+        replayTime += seconds_since(start);
+        calls += backend.calls;
+    }
+
+    printf("\nsort   %8.2f us/frame, %6.2f ns/draw\n", sortTime / iterations * 1e6,
+            sortTime / iterations / draws * 1e9);
+    printf("replay %8.2f us/frame, %6.2f ns/draw (%u backend calls)\n", replayTime / iterations * 1e6,
+            replayTime / iterations / draws * 1e9, calls / iterations);
+
+    if (!failures) {
+        printf("\nsorted replay: ok\n");
+    }
+    return failures ? 1 : 0;
+}
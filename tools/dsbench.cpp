@@ -0,0 +1,129 @@
+// Runs debugScreen.h against its host framebuffer (the static base array):
+// compares the output of fixed scripts with golden hashes, checks scrolling
+// and dirty rectangles, then measures glyphs per second.
+//
+//   dsbench [iterations]
+
+#define NO_psvDebugScreenInit
+#include "check.h"
+#include "debugScreen.h"
+#include "hash.h"
+
+#include <stdlib.h>
+
+#include <chrono>
+
+// Framebuffer hash after draw_script(), as rendered by the original
+// bit-by-bit implementation
+static const uint64_t GOLDEN_SCRIPT = 0x24fdde8b0263cfedull;
+
+static uint64_t
+screen_hash()
+{
+    return vitashader::fnv1a((const void *)base, sizeof(base));
+}
+
+static void
+reset_screen()
+{
+    psvDebugScreenPuts("\e[0m\e[2J\e[H");
+}
+
+// Colors, tabs, carriage returns, line clears, wrapping and every glyph,
+// all within the first screen so it does not depend on scrolling
+static void
+draw_script()
+{
+    reset_screen();
+    psvDebugScreenPuts("Vertex Shader:\n Check = 0x00000000\n Size = 1234\n");
+    psvDebugScreenPuts("\e[31mred\e[32mgreen\e[0m\t\ttab\e[44m blue bg \e[0m\n");
+    psvDebugScreenPuts("\e[38;5;208morange \e[48;2;10;20;30mtruecolor\e[0m\n");
+    psvDebugScreenPuts("\e[1mbright\e[0m overwritten\rOVER\n");
+    psvDebugScreenPuts("erase to end\e[10D\e[K\n");
+    for (int i=0; i<3; ++i) {
+        psvDebugScreenPuts("a long line that has to wrap around the right edge of the screen ");
+    }
+    psvDebugScreenPuts("\n");
+    char all[2] = {0, 0};
+    for (int c=1; c<256; ++c) {
+        if (c == '\t' || c == '\n' || c == '\r' || c == '\e') {
+            continue;
+        }
+        all[0] = c;
+        psvDebugScreenPuts(all);
+    }
+    psvDebugScreenPuts("\n\e[5;20Hpositioned\e[s\e[20;1Hsaved\e[urestored\n");
+}
+
+static void
+print_lines(int first, int last, bool final_newline)
+{
+    char line[64];
+    for (int i=first; i<=last; ++i) {
+        snprintf(line, sizeof(line), "\e[3%dmline %03d\e[0m of the scroll test%s",
+                1 + i % 7, i, (i < last || final_newline) ? "\n" : "");
+        psvDebugScreenPuts(line);
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    int iterations = (argc > 1) ? atoi(argv[1]) : 200;
+
+    psvDebugScreenInit();
+
+    draw_script();
+    check(screen_hash() == GOLDEN_SCRIPT, "script matches golden output");
+
+    // 200 lines scroll the screen until lines 132..199 fill all 68 rows,
+    // which must look the same as printing just those from the top
+    int rows = SCREEN_HEIGHT / psvDebugScreenFont.size_h;
+    reset_screen();
+    print_lines(0, 199, true);
+    uint64_t scrolled = screen_hash();
+    reset_screen();
+    print_lines(200 - rows, 199, false);
+    check(scrolled == screen_hash(), "scrolling moves whole lines up");
+
+    int x, y, w, h;
+    psvDebugScreenTakeDirty(&x, &y, &w, &h);
+    check(!psvDebugScreenTakeDirty(&x, &y, &w, &h), "dirty rect cleared");
+    psvDebugScreenPuts("\e[3;5Hab");
+    check(psvDebugScreenTakeDirty(&x, &y, &w, &h) && x == 32 && y == 16 && w == 16 && h == 8,
+            "dirty rect covers drawn glyphs");
+
+    if (failures) {
+        return 1;
+    }
+    printf("golden output and scrolling: ok\n");
+
+    // A screen of dump_program() style lines, redrawn from the top, then
+    // the same text scrolling
+    char text[4096];
+    size_t len = 0;
+    int glyphs = 0;
+    for (int i=0; i<60; ++i) {
+        int n = snprintf(text + len, sizeof(text) - len,
+                "  params[%d] = {cat=0x%08x, name=uParam%d, type=0x%08x}\n", i, i & 3, i, i * 7);
+        glyphs += n - 1;
+        len += n;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i=0; i<iterations; ++i) {
+        psvDebugScreenPuts("\e[H");
+        psvDebugScreenPuts(text);
+    }
+    double redraw = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (int i=0; i<iterations; ++i) {
+        psvDebugScreenPuts(text);
+    }
+    double scroll = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("redraw: %.1f Mglyphs/s\n", glyphs * (double)iterations / redraw / 1e6);
+    printf("scroll: %.1f Mglyphs/s (%d lines scrolled each)\n", glyphs * (double)iterations / scroll / 1e6, 60);
+    return 0;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+// A font of printable ASCII with made-up metrics, enough for layout, for
+// host tools that have no font file: glyphs width to width + 4 pixels wide
+// in a 16x8 atlas grid, advancing a pixel past their width.
+
+#include "textbatch.h"
+
+static void
+make_font(vitashader::Font &font, float width=8.f)
+{
+    font.first = 32;
+    font.lineHeight = 20.f;
+    font.glyphs.resize(95);
+    for (int i=0; i<95; ++i) {
+        float s = (i % 16) / 16.f;
+        float t = (i / 16) / 8.f;
+        float w = width + (i % 5);
+        font.glyphs[i] = vitashader::Glyph{s, t, s + 1.f / 16.f, t + 1.f / 8.f, 0.f, -14.f, w, 4.f, w + 1.f};
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+// Made-up GXP programs in the layout gxp.h reads, for host tools that need
+// a ShaderProgram when no shader compiler runs: a header and one record per
+// parameter, which hostgxm.h and gxp::Reflection take like a real program.
+
+#include "gxp.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+// containerIndex and arraySize may be left out, for 0 and 1
+struct FakeParameter {
+    const char *name;
+    vitashader::gxp::Category category;
+    uint8_t components;
+    uint32_t resourceIndex;
+    uint8_t containerIndex;
+    uint32_t arraySize;
+};
+
+static void
+put32(std::vector<uint8_t> &out, size_t at, uint32_t value)
+{
+    out[at] = value;
+    out[at + 1] = value >> 8;
+    out[at + 2] = value >> 16;
+    out[at + 3] = value >> 24;
+}
+
+static std::vector<uint8_t>
+make_program(bool fragment, const std::vector<FakeParameter> &parameters)
+{
+    using namespace vitashader;
+
+    size_t recordsAt = gxp::HEADER_END;
+    size_t namesAt = recordsAt + parameters.size() * gxp::PARAMETER_SIZE;
+
+    std::vector<uint8_t> program(namesAt);
+    memcpy(&program[gxp::HEADER_MAGIC], "GXP\0", 4);
+    program[gxp::HEADER_TYPE] = fragment ? 1 : 0;
+    put32(program, gxp::HEADER_PARAMETER_COUNT, parameters.size());
+    put32(program, gxp::HEADER_PARAMETERS_OFFSET, recordsAt - gxp::HEADER_PARAMETERS_OFFSET);
+    put32(program, gxp::HEADER_DEFAULT_UNIFORM_BUFFER_COUNT, 1);
+
+    for (size_t i=0; i<parameters.size(); ++i) {
+        const FakeParameter &parameter = parameters[i];
+        size_t record = recordsAt + i * gxp::PARAMETER_SIZE;
+        put32(program, record + gxp::PARAMETER_NAME_OFFSET, program.size() - record);
+        uint16_t flags = parameter.category | (parameter.components << 8) | (parameter.containerIndex << 12);
+        program[record + gxp::PARAMETER_FLAGS] = flags;
+        program[record + gxp::PARAMETER_FLAGS + 1] = flags >> 8;
+        put32(program, record + gxp::PARAMETER_ARRAY_SIZE, parameter.arraySize ? parameter.arraySize : 1);
+        put32(program, record + gxp::PARAMETER_RESOURCE_INDEX, parameter.resourceIndex);
+        program.insert(program.end(), parameter.name, parameter.name + strlen(parameter.name) + 1);
+    }
+
+    program.resize((program.size() + 15) & ~15);
+    put32(program, gxp::HEADER_SIZE, program.size());
+    return program;
+}
@@ -0,0 +1,57 @@
+// Runs FrameScheduler against a simulated GPU and compares frame rates for
+// 1 (fully serialized, like waiting for rendering every frame), 2 and 3
+// frames in flight. Frame costs vary randomly by up to +-jitter percent.
+//
+//   framesim [cpu_ms] [gpu_ms] [jitter_percent] [frames]
+
+#include "framescheduler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace vitashader;
+
+static double
+vary(double cost, double jitter)
+{
+    return cost * (1.0 + jitter * (2.0 * rand() / RAND_MAX - 1.0));
+}
+
+int
+main(int argc, char *argv[])
+{
+    double cpu = (argc > 1) ? atof(argv[1]) : 10.0;
+    double gpu = (argc > 2) ? atof(argv[2]) : 12.0;
+    double jitter = ((argc > 3) ? atof(argv[3]) : 30.0) / 100.0;
+    unsigned count = (argc > 4) ? strtoul(argv[4], nullptr, 0) : 10000;
+    if (cpu < 0.0 || gpu < 0.0 || jitter < 0.0 || jitter > 1.0 || count == 0) {
+        fprintf(stderr, "Usage: %s [cpu_ms] [gpu_ms] [jitter_percent] [frames]\n", argv[0]);
+        return 1;
+    }
+
+    printf("cpu %.2f ms, gpu %.2f ms, jitter %.0f%%, %u frames\n", cpu, gpu, jitter * 100.0, count);
+
+    for (unsigned n=1; n<=MAX_FRAMES_IN_FLIGHT; ++n) {
+        srand(1);
+
+        SimulatedTimeline timeline;
+        FrameScheduler<SimulatedTimeline> scheduler(timeline, n);
+
+        for (unsigned i=0; i<count; ++i) {
+            scheduler.begin_frame();
+            timeline.now += vary(cpu, jitter);
+            timeline.gpuCost = vary(gpu, jitter);
+            scheduler.end_frame();
+        }
+        scheduler.finish();
+
+        double total = timeline.now;
+        printf("%u in flight: %7.2f fps, gpu busy %5.1f%%, cpu blocked %5.1f%%, %u waits\n",
+                n, count * 1000.0 / total,
+                100.0 * timeline.gpuBusy / total,
+                100.0 * timeline.stalled / total,
+                scheduler.waits);
+    }
+
+    return 0;
+}
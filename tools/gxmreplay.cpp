@@ -0,0 +1,563 @@
+// Reads GXM captures written by gxmcapture.h and reports what each frame
+// asked of libgxm, or diffs two captures frame by frame.
+//
+//   gxmreplay capture.vscap            per-frame and per-call report
+//   gxmreplay -d before.vscap after.vscap
+//
+// Per frame it reports the calls made, how many of them changed state, the
+// uniform reserves and bytes written, the bytes of the vertex and index
+// buffers its draws read and the draws with their index counts. The diff
+// prints every metric that differs and the first call where the frames
+// part ways; it exits with 1 when the captures differ, like diff(1).
+//
+// Without arguments it runs its own check: a few frames are driven through
+// GxmState and UniformVariable on the host stand-in, captured, saved, read
+// back and compared with what the stand-in counted.
+
+#include "check.h"
+#include "fakegxp.h"
+#include "gxmcapture.h"
+#include "gxmstate.h"
+#include "vitashader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using namespace vitashader;
+
+struct FrameStats {
+    FrameStats()
+        : frame(0)
+        , calls(0)
+        , stateChanges(0)
+        , reserves(0)
+        , uniformBytes(0)
+        , vertexBytes(0)
+        , indexBytes(0)
+        , draws(0)
+        , indices(0)
+        , minIndices(0)
+        , maxIndices(0)
+        , firstRecord(0)
+        , endRecord(0)
+    {
+        memset(perCall, 0, sizeof(perCall));
+    }
+
+    uint32_t frame;
+    unsigned calls;
+    unsigned stateChanges;
+    unsigned perCall[GxmState::CALLS];
+    unsigned reserves;
+    uint64_t uniformBytes;
+    uint64_t vertexBytes;
+    uint64_t indexBytes;
+    unsigned draws;
+    uint64_t indices;
+    unsigned minIndices;
+    unsigned maxIndices;
+
+    // Records of the frame, BUFFER records included
+    size_t firstRecord;
+    size_t endRecord;
+};
+
+struct Capture {
+    bool load(const char *filename)
+    {
+        FILE *fp = fopen(filename, "rb");
+        if (!fp) {
+            fprintf(stderr, "Could not open %s\n", filename);
+            return false;
+        }
+        fseek(fp, 0, SEEK_END);
+        long size = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+        file.resize(size > 0 ? size : 0);
+        bool ok = fread(file.data(), 1, file.size(), fp) == file.size();
+        fclose(fp);
+
+        if (!ok || !parse_capture(file, records)) {
+            fprintf(stderr, "%s is not a complete capture\n", filename);
+            return false;
+        }
+        replay();
+        return true;
+    }
+
+    // Walks the records once, splitting them into frames
+    void replay()
+    {
+        frames.clear();
+        buffers.clear();
+        for (size_t i=0; i<records.size(); ++i) {
+            const CaptureRecordView &record = records[i];
+            if (record.type == CAPTURE_BUFFER) {
+                buffers[record.u32(0)] = record;
+            }
+            if (record.type == CAPTURE_FRAME) {
+                if (!frames.empty()) {
+                    frames.back().endRecord = i;
+                }
+                frames.push_back(FrameStats());
+                frames.back().frame = record.u32(0);
+                frames.back().firstRecord = i + 1;
+                frameBuffers.clear();
+                continue;
+            }
+            if (frames.empty()) {
+                continue;
+            }
+            account(frames.back(), record);
+        }
+        if (!frames.empty()) {
+            frames.back().endRecord = records.size();
+        }
+    }
+
+    void account(FrameStats &stats, const CaptureRecordView &record)
+    {
+        switch (record.type) {
+        case CAPTURE_STATE:
+        case CAPTURE_OBJECT:
+        case CAPTURE_TEXTURE:
+            ++stats.calls;
+            ++stats.stateChanges;
+            if (record.u8(0) < GxmState::CALLS) {
+                ++stats.perCall[record.u8(0)];
+            }
+            break;
+        case CAPTURE_UNIFORM_RESERVE:
+            ++stats.calls;
+            ++stats.reserves;
+            break;
+        case CAPTURE_UNIFORM_WRITE:
+            ++stats.calls;
+            stats.uniformBytes += record.size - 9;
+            break;
+        case CAPTURE_DRAW: {
+            ++stats.calls;
+            unsigned count = record.u32(2);
+            stats.indices += count;
+            stats.minIndices = stats.draws ? std::min(stats.minIndices, count) : count;
+            stats.maxIndices = std::max(stats.maxIndices, count);
+            ++stats.draws;
+
+            // Each buffer counts once per frame, however many draws read it
+            stats.indexBytes += frame_buffer_size(record.u32(6));
+            for (uint32_t offset=10; offset + 5 <= record.size; offset += 5) {
+                stats.vertexBytes += frame_buffer_size(record.u32(offset + 1));
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    uint32_t frame_buffer_size(uint32_t id)
+    {
+        if (id == 0 || !frameBuffers.insert(id).second) {
+            return 0;
+        }
+        auto it = buffers.find(id);
+        return it != buffers.end() ? it->second.size - 4 : 0;
+    }
+
+    // Contents of a buffer, so draws of two captures compare by what they
+    // read rather than by id
+    uint64_t buffer_hash(uint32_t id) const
+    {
+        auto it = buffers.find(id);
+        if (it == buffers.end()) {
+            return 0;
+        }
+        return fnv1a(it->second.payload + 4, it->second.size - 4);
+    }
+
+    std::vector<uint8_t> file;
+    std::vector<CaptureRecordView> records;
+    std::vector<FrameStats> frames;
+    std::unordered_map<uint32_t, CaptureRecordView> buffers;
+    std::unordered_set<uint32_t> frameBuffers;
+};
+
+static std::string
+describe(const CaptureRecordView &record)
+{
+    char text[128];
+    unsigned call = record.u8(0);
+    const char *name = call < GxmState::CALLS ? GxmState::call_name((GxmState::Call)call) : "?";
+    const char *stage = record.u8(0) ? "fragment" : "vertex";
+
+    switch (record.type) {
+    case CAPTURE_STATE:
+        snprintf(text, sizeof(text), "%s(%u)", name, record.u32(2));
+        break;
+    case CAPTURE_OBJECT:
+        snprintf(text, sizeof(text), "%s(%u, object %u)", name, record.u8(1), record.u32(2));
+        break;
+    case CAPTURE_TEXTURE:
+        snprintf(text, sizeof(text), "%s(%u, %08x %08x %08x %08x)", name, record.u8(1),
+                record.u32(2), record.u32(6), record.u32(10), record.u32(14));
+        break;
+    case CAPTURE_UNIFORM_RESERVE:
+        snprintf(text, sizeof(text), "reserve %s uniforms", stage);
+        break;
+    case CAPTURE_UNIFORM_WRITE:
+        snprintf(text, sizeof(text), "write %u %s uniform floats at %u", (record.size - 9) / 4, stage,
+                record.u32(1) + record.u32(5));
+        break;
+    case CAPTURE_DRAW:
+        snprintf(text, sizeof(text), "draw %u %s, %u-byte indices", record.u32(2),
+                capture_primitive_name(record.u8(0)), record.u8(1));
+        break;
+    default:
+        snprintf(text, sizeof(text), "record type %u", record.type);
+        break;
+    }
+    return text;
+}
+
+// Draws compare by the contents of the buffers they read, everything else
+// byte for byte
+static bool
+same_call(const Capture &a, const CaptureRecordView &x, const Capture &b, const CaptureRecordView &y)
+{
+    if (x.type != y.type || x.size != y.size) {
+        return false;
+    }
+    if (x.type != CAPTURE_DRAW) {
+        return memcmp(x.payload, y.payload, x.size) == 0;
+    }
+    if (memcmp(x.payload, y.payload, 6) != 0 || a.buffer_hash(x.u32(6)) != b.buffer_hash(y.u32(6))) {
+        return false;
+    }
+    for (uint32_t offset=10; offset + 5 <= x.size; offset += 5) {
+        if (x.u8(offset) != y.u8(offset) || a.buffer_hash(x.u32(offset + 1)) != b.buffer_hash(y.u32(offset + 1))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static std::vector<size_t>
+frame_calls(const Capture &capture, const FrameStats &stats)
+{
+    std::vector<size_t> calls;
+    for (size_t i=stats.firstRecord; i<stats.endRecord; ++i) {
+        if (capture.records[i].type != CAPTURE_BUFFER) {
+            calls.push_back(i);
+        }
+    }
+    return calls;
+}
+
+static void
+print_report(const Capture &capture)
+{
+    printf("%zu frames, %zu records, %zu buffers, %zu bytes\n\n", capture.frames.size(),
+            capture.records.size(), capture.buffers.size(), capture.file.size());
+    printf("%6s %7s %7s %8s %10s %10s %10s %6s %8s %13s\n", "frame", "calls", "state", "reserves",
+            "uniform B", "vertex B", "index B", "draws", "indices", "min/avg/max");
+
+    FrameStats total;
+    for (const FrameStats &f: capture.frames) {
+        unsigned avg = f.draws ? (unsigned)(f.indices / f.draws) : 0;
+        printf("%6u %7u %7u %8u %10llu %10llu %10llu %6u %8llu %4u/%4u/%4u\n", f.frame, f.calls,
+                f.stateChanges, f.reserves, (unsigned long long)f.uniformBytes,
+                (unsigned long long)f.vertexBytes, (unsigned long long)f.indexBytes, f.draws,
+                (unsigned long long)f.indices, f.minIndices, avg, f.maxIndices);
+        for (int i=0; i<GxmState::CALLS; ++i) {
+            total.perCall[i] += f.perCall[i];
+        }
+    }
+
+    printf("\n%-32s %10s\n", "gxm call", "issued");
+    for (int i=0; i<GxmState::CALLS; ++i) {
+        if (total.perCall[i]) {
+            printf("%-32s %10u\n", GxmState::call_name((GxmState::Call)i), total.perCall[i]);
+        }
+    }
+}
+
+// Returns true if the captures differ
+static bool
+print_diff(const Capture &a, const Capture &b)
+{
+    bool differ = a.frames.size() != b.frames.size();
+    if (differ) {
+        printf("frames: %zu vs %zu\n", a.frames.size(), b.frames.size());
+    }
+
+    size_t frames = std::min(a.frames.size(), b.frames.size());
+    for (size_t i=0; i<frames; ++i) {
+        const FrameStats &x = a.frames[i];
+        const FrameStats &y = b.frames[i];
+
+        struct Metric {
+            const char *name;
+            unsigned long long a;
+            unsigned long long b;
+        } metrics[] = {
+            { "calls", x.calls, y.calls },
+            { "state changes", x.stateChanges, y.stateChanges },
+            { "uniform reserves", x.reserves, y.reserves },
+            { "uniform bytes", x.uniformBytes, y.uniformBytes },
+            { "vertex bytes", x.vertexBytes, y.vertexBytes },
+            { "index bytes", x.indexBytes, y.indexBytes },
+            { "draws", x.draws, y.draws },
+            { "indices", x.indices, y.indices },
+        };
+
+        bool header = false;
+        for (auto &metric: metrics) {
+            if (metric.a != metric.b) {
+                if (!header) {
+                    printf("frame %zu\n", i);
+                    header = true;
+                }
+                printf("  %-18s %10llu %10llu %+10lld\n", metric.name, metric.a, metric.b,
+                        (long long)(metric.b - metric.a));
+            }
+        }
+
+        std::vector<size_t> xs = frame_calls(a, x);
+        std::vector<size_t> ys = frame_calls(b, y);
+        size_t n = std::min(xs.size(), ys.size());
+        size_t first = 0;
+        while (first < n && same_call(a, a.records[xs[first]], b, b.records[ys[first]])) {
+            ++first;
+        }
+        if (first < n || xs.size() != ys.size()) {
+            if (!header) {
+                printf("frame %zu\n", i);
+                header = true;
+            }
+            std::string before = first < xs.size() ? describe(a.records[xs[first]]) : "(end of frame)";
+            std::string after = first < ys.size() ? describe(b.records[ys[first]]) : "(end of frame)";
+            printf("  first difference at call %zu\n", first);
+            printf("    - %s\n", before.c_str());
+            printf("    + %s\n", after.c_str());
+            if (before == after) {
+                printf("    (buffer contents differ)\n");
+            }
+        }
+        differ = differ || header;
+    }
+
+    if (!differ) {
+        printf("captures match\n");
+    }
+    return differ;
+}
+
+// The self check: a frame is a couple of programs, two textures, a stream
+// of quads and a few uniforms; frame 1 moves a uniform, frame 2 changes
+// texture and draws fewer quads
+static const unsigned QUADS = 8;
+
+struct SelfCheckScene {
+    SelfCheckScene()
+        : state((SceGxmContext *)nullptr)
+    {
+        uint16_t *p = indices;
+        for (uint16_t q=0; q<QUADS; ++q) {
+            uint16_t v = q * 4;
+            uint16_t quad[6] = { v, (uint16_t)(v + 1), (uint16_t)(v + 2), (uint16_t)(v + 2),
+                (uint16_t)(v + 1), (uint16_t)(v + 3) };
+            memcpy(p, quad, sizeof(quad));
+            p += 6;
+        }
+        for (unsigned i=0; i<QUADS * 4 * 5; ++i) {
+            vertices[i] = (float)i;
+        }
+        memset(textures, 0, sizeof(textures));
+        textures[0].controlWords[0] = 0x1000;
+        textures[1].controlWords[0] = 0x2000;
+
+        static const std::vector<uint8_t> program = make_program(false, {
+            { "uColor", gxp::CATEGORY_UNIFORM, 4, 0 },
+            { "uTransform", gxp::CATEGORY_UNIFORM, 4, 4 },
+        });
+        color = sceGxmProgramFindParameterByName((const SceGxmProgram *)program.data(), "uColor");
+        transform = sceGxmProgramFindParameterByName((const SceGxmProgram *)program.data(), "uTransform");
+    }
+
+    void frame(unsigned index)
+    {
+        state.invalidate();
+        gxm_capture().begin_frame();
+
+        UniformVariable uColor(nullptr, color, false);
+        UniformVariable uTransform(nullptr, transform, true);
+        float rgba[4] = { 1.f, 0.5f, 0.25f, 1.f };
+        float xform[4] = { index == 1 ? 10.f : 0.f, 0.f, 1.f, 1.f };
+
+        unsigned quads = (index == 2) ? QUADS / 2 : QUADS;
+        for (int pass=0; pass<2; ++pass) {
+            state.set_vertex_program((const SceGxmVertexProgram *)&programs[pass]);
+            state.set_fragment_program((const SceGxmFragmentProgram *)&programs[pass]);
+            state.set_back_polygon_mode(SCE_GXM_POLYGON_MODE_TRIANGLE_FILL);
+            state.set_fragment_texture(0, &textures[index == 2 ? 1 : 0]);
+            state.set_vertex_stream(0, vertices);
+            uTransform.set_float(xform, 4);
+            uColor.set_float(rgba, 4);
+            state.draw(SCE_GXM_PRIMITIVE_TRIANGLES, SCE_GXM_INDEX_FORMAT_U16, indices, quads * 6);
+        }
+
+        gxm_capture().end_frame();
+    }
+
+    GxmState state;
+    char programs[2];
+    SceGxmTexture textures[2];
+    uint16_t indices[QUADS * 6];
+    float vertices[QUADS * 4 * 5];
+    const SceGxmProgramParameter *color;
+    const SceGxmProgramParameter *transform;
+};
+
+static bool
+save_and_load(const char *path, Capture &capture)
+{
+    return gxm_capture().save(path) && capture.load(path);
+}
+
+static void
+self_check()
+{
+    char path[] = "/tmp/gxmreplay-XXXXXX";
+    int fd = mkstemp(path);
+    check(fd >= 0, "temporary file");
+    if (fd < 0) {
+        return;
+    }
+    close(fd);
+
+    GxmCapture &capture = gxm_capture();
+    capture.set_stream_stride(0, 5 * sizeof(float));
+    SelfCheckScene scene;
+
+    // Not armed: nothing is recorded
+    scene.frame(0);
+    check(capture.data.empty() && !capture.recording, "idle capture records nothing");
+
+    HostGxm &gxm = host_gxm();
+    gxm = HostGxm();
+    capture.start(3);
+    bool done = false;
+    for (unsigned i=0; i<3; ++i) {
+        check(!done, "capture ends after its last frame");
+        scene.frame(i);
+        done = !capture.armed();
+    }
+    check(done && capture.frames == 3, "three frames captured");
+
+    Capture a;
+    check(save_and_load(path, a), "capture reads back");
+    check(a.frames.size() == 3, "three frames read back");
+
+    unsigned stateChanges = 0;
+    unsigned reserves = 0;
+    uint64_t uniformBytes = 0;
+    unsigned draws = 0;
+    for (const FrameStats &f: a.frames) {
+        stateChanges += f.stateChanges;
+        reserves += f.reserves;
+        uniformBytes += f.uniformBytes;
+        draws += f.draws;
+    }
+    check(stateChanges == gxm.stateSets + gxm.programBinds, "state changes match the calls made");
+    check(reserves == gxm.uniformReserves && uniformBytes == gxm.uniformBytes, "uniforms match");
+    check(draws == gxm.draws && draws == 6, "draws match");
+
+    if (a.frames.size() == 3) {
+        const FrameStats &f = a.frames[0];
+        // Both passes share the quad buffers; the second only sets programs
+        check(f.stateChanges == 5 + 2, "second pass elides shared state");
+        check(f.vertexBytes == sizeof(scene.vertices), "vertices up to the highest index");
+        check(f.indexBytes == sizeof(scene.indices), "indices counted once per frame");
+        check(f.minIndices == QUADS * 6 && f.maxIndices == QUADS * 6, "draw sizes");
+        check(a.frames[2].indexBytes == sizeof(scene.indices) / 2, "smaller draw reads fewer indices");
+    }
+    // The 4 distinct index and vertex buffers of frames 0 and 2 and nothing more
+    check(a.buffers.size() == 4, "buffers stored once per content");
+
+    Capture same;
+    check(same.load(path), "capture reads back twice");
+    check(!print_diff(a, same), "a capture matches itself");
+
+    // Frame 1 alone, moved: the transform write differs first
+    capture.start(1);
+    scene.frame(1);
+    Capture b;
+    check(save_and_load(path, b), "second capture reads back");
+    check(b.frames.size() == 1, "one frame captured");
+    if (b.frames.size() == 1 && a.frames.size() == 3) {
+        std::vector<size_t> xs = frame_calls(a, a.frames[0]);
+        std::vector<size_t> ys = frame_calls(b, b.frames[0]);
+        size_t first = 0;
+        while (first < xs.size() && first < ys.size() &&
+                same_call(a, a.records[xs[first]], b, b.records[ys[first]])) {
+            ++first;
+        }
+        check(first < xs.size() && a.records[xs[first]].type == CAPTURE_UNIFORM_WRITE,
+                "diff finds the moved uniform");
+    }
+
+    // Over the limit, the frame in progress is dropped
+    capture.start(2);
+    capture.limit = 64;
+    scene.frame(0);
+    check(capture.truncated && capture.frames == 0 && !capture.armed(), "capture stops at its limit");
+    Capture c;
+    check(save_and_load(path, c) && c.frames.empty(), "truncated capture has no partial frame");
+    capture.limit = 32 * 1024 * 1024;
+
+    unlink(path);
+
+    printf("\n");
+    print_report(a);
+    if (!failures) {
+        printf("\ncapture and replay: ok\n");
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    if (argc == 1) {
+        self_check();
+        return failures ? 1 : 0;
+    }
+
+    if (argc == 4 && strcmp(argv[1], "-d") == 0) {
+        Capture a;
+        Capture b;
+        if (!a.load(argv[2]) || !b.load(argv[3])) {
+            return 2;
+        }
+        return print_diff(a, b) ? 1 : 0;
+    }
+
+    if (argc == 2 && argv[1][0] != '-') {
+        Capture capture;
+        if (!capture.load(argv[1])) {
+            return 2;
+        }
+        print_report(capture);
+        return 0;
+    }
+
+    fprintf(stderr, "usage: %s [capture.vscap | -d a.vscap b.vscap]\n", argv[0]);
+    return 2;
+}
@@ -0,0 +1,315 @@
+// Checks that GxmState (gxmstate.h) only drops calls that do not change
+// what a draw sees, using the recording GXM stand-in of hostgxm.h.
+//
+//   gxmstatecheck [steps]
+//
+// A random script of state changes and draws is played twice, once straight
+// into the stand-in and once through GxmState; the state captured at every
+// draw has to be identical. The script also touches the context behind the
+// shadow's back, followed by invalidate() as main.cpp does after vita2d.
+// A frame shaped like the sample's text batch then reports the saved calls.
+
+#include "check.h"
+#include "gxmstate.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <random>
+#include <vector>
+
+using namespace vitashader;
+
+enum StepKind {
+    STEP_VERTEX_PROGRAM,
+    STEP_FRAGMENT_PROGRAM,
+    STEP_FRAGMENT_TEXTURE,
+    STEP_VERTEX_TEXTURE,
+    STEP_VERTEX_STREAM,
+    STEP_POLYGON_MODE,
+    STEP_CULL_MODE,
+    STEP_TWO_SIDED,
+    STEP_DEPTH_FUNC,
+    STEP_DEPTH_WRITE,
+    STEP_UNIFORM_BUFFER,
+    STEP_DRAW,
+    STEP_EXTERNAL,
+    STEP_KINDS,
+};
+
+struct Step {
+    int kind;
+    unsigned index;
+    int value;
+    bool back;
+};
+
+// Small value ranges, so most sets repeat the current state
+static std::vector<Step>
+make_script(unsigned steps, unsigned seed)
+{
+    std::mt19937 rng(seed);
+    std::vector<Step> script(steps);
+    for (auto &step: script) {
+        step.kind = rng() % STEP_KINDS;
+        step.index = (rng() % 8 == 0) ? 16 + rng() % 2 : rng() % 3;
+        step.value = rng() % 3;
+        step.back = rng() & 1;
+    }
+    return script;
+}
+
+static SceGxmVertexProgram *vertexPrograms[3];
+static SceGxmFragmentProgram *fragmentPrograms[3];
+static SceGxmTexture textures[3];
+static char streamData[3][16];
+static float uniformData[3][8];
+
+static void
+play_direct(SceGxmContext *context, const Step &step)
+{
+    switch (step.kind) {
+        case STEP_VERTEX_PROGRAM:
+            sceGxmSetVertexProgram(context, vertexPrograms[step.value]);
+            break;
+        case STEP_FRAGMENT_PROGRAM:
+            sceGxmSetFragmentProgram(context, fragmentPrograms[step.value]);
+            break;
+        case STEP_FRAGMENT_TEXTURE:
+            sceGxmSetFragmentTexture(context, step.index, &textures[step.value]);
+            break;
+        case STEP_VERTEX_TEXTURE:
+            sceGxmSetVertexTexture(context, step.index, &textures[step.value]);
+            break;
+        case STEP_VERTEX_STREAM:
+            sceGxmSetVertexStream(context, step.index, streamData[step.value]);
+            break;
+        case STEP_POLYGON_MODE:
+            if (step.back) {
+                sceGxmSetBackPolygonMode(context, (SceGxmPolygonMode)step.value);
+            } else {
+                sceGxmSetFrontPolygonMode(context, (SceGxmPolygonMode)step.value);
+            }
+            break;
+        case STEP_CULL_MODE:
+            sceGxmSetCullMode(context, (SceGxmCullMode)step.value);
+            break;
+        case STEP_TWO_SIDED:
+            sceGxmSetTwoSidedEnable(context, (SceGxmTwoSidedMode)(step.value & 1));
+            break;
+        case STEP_DEPTH_FUNC:
+            if (step.back) {
+                sceGxmSetBackDepthFunc(context, (SceGxmDepthFunc)step.value);
+            } else {
+                sceGxmSetFrontDepthFunc(context, (SceGxmDepthFunc)step.value);
+            }
+            break;
+        case STEP_DEPTH_WRITE:
+            if (step.back) {
+                sceGxmSetBackDepthWriteEnable(context, (SceGxmDepthWriteMode)(step.value & 1));
+            } else {
+                sceGxmSetFrontDepthWriteEnable(context, (SceGxmDepthWriteMode)(step.value & 1));
+            }
+            break;
+        case STEP_UNIFORM_BUFFER:
+            sceGxmSetVertexUniformBuffer(context, step.index, uniformData[step.value]);
+            break;
+        case STEP_DRAW:
+            sceGxmDraw(context, SCE_GXM_PRIMITIVE_TRIANGLES, SCE_GXM_INDEX_FORMAT_U16, nullptr, 6);
+            break;
+    }
+}
+
+static void
+play_shadowed(GxmState &state, const Step &step)
+{
+    switch (step.kind) {
+        case STEP_VERTEX_PROGRAM:
+            state.set_vertex_program(vertexPrograms[step.value]);
+            break;
+        case STEP_FRAGMENT_PROGRAM:
+            state.set_fragment_program(fragmentPrograms[step.value]);
+            break;
+        case STEP_FRAGMENT_TEXTURE:
+            state.set_fragment_texture(step.index, &textures[step.value]);
+            break;
+        case STEP_VERTEX_TEXTURE:
+            state.set_vertex_texture(step.index, &textures[step.value]);
+            break;
+        case STEP_VERTEX_STREAM:
+            state.set_vertex_stream(step.index, streamData[step.value]);
+            break;
+        case STEP_POLYGON_MODE:
+            if (step.back) {
+                state.set_back_polygon_mode((SceGxmPolygonMode)step.value);
+            } else {
+                state.set_front_polygon_mode((SceGxmPolygonMode)step.value);
+            }
+            break;
+        case STEP_CULL_MODE:
+            state.set_cull_mode((SceGxmCullMode)step.value);
+            break;
+        case STEP_TWO_SIDED:
+            state.set_two_sided_enable((SceGxmTwoSidedMode)(step.value & 1));
+            break;
+        case STEP_DEPTH_FUNC:
+            if (step.back) {
+                state.set_back_depth_func((SceGxmDepthFunc)step.value);
+            } else {
+                state.set_front_depth_func((SceGxmDepthFunc)step.value);
+            }
+            break;
+        case STEP_DEPTH_WRITE:
+            if (step.back) {
+                state.set_back_depth_write_enable((SceGxmDepthWriteMode)(step.value & 1));
+            } else {
+                state.set_front_depth_write_enable((SceGxmDepthWriteMode)(step.value & 1));
+            }
+            break;
+        case STEP_UNIFORM_BUFFER:
+            state.set_vertex_uniform_buffer(step.index, uniformData[step.value]);
+            break;
+        case STEP_DRAW:
+            state.draw(SCE_GXM_PRIMITIVE_TRIANGLES, SCE_GXM_INDEX_FORMAT_U16, nullptr, 6);
+            break;
+    }
+}
+
+// What vita2d does between our batches: its own program, texture and stream
+static void
+play_external(SceGxmContext *context)
+{
+    static char vita2dVertices[16];
+    SceGxmTexture vita2dTexture = {{ 0xdead, 0xbeef, 0, 0 }};
+    sceGxmSetVertexProgram(context, (const SceGxmVertexProgram *)vita2dVertices);
+    sceGxmSetFragmentTexture(context, 0, &vita2dTexture);
+    sceGxmSetVertexStream(context, 0, vita2dVertices);
+    sceGxmSetBackPolygonMode(context, SCE_GXM_POLYGON_MODE_LINE);
+}
+
+static void
+reset_host()
+{
+    HostGxm &gxm = host_gxm();
+    gxm.state = HostGxmState();
+    gxm.drawStates.clear();
+    gxm.recordDraws = true;
+    gxm.stateSets = 0;
+    gxm.programBinds = 0;
+    gxm.draws = 0;
+}
+
+static unsigned
+host_calls()
+{
+    return host_gxm().stateSets + host_gxm().programBinds;
+}
+
+int
+main(int argc, char *argv[])
+{
+    unsigned steps = (argc > 1) ? atoi(argv[1]) : 20000;
+    SceGxmContext *context = nullptr;
+
+    static char dummy[6];
+    for (int i=0; i<3; ++i) {
+        vertexPrograms[i] = (SceGxmVertexProgram *)&dummy[i];
+        fragmentPrograms[i] = (SceGxmFragmentProgram *)&dummy[3 + i];
+        textures[i].controlWords[0] = 0x1000 + i;
+    }
+
+    // Textures are copied when set, so equal control words count as the same
+    SceGxmTexture copy = textures[1];
+    {
+        reset_host();
+        GxmState state(context);
+        state.set_fragment_texture(0, &textures[1]);
+        state.set_fragment_texture(0, &copy);
+        state.set_fragment_texture(1, &copy);
+        check(state.issued[GxmState::FRAGMENT_TEXTURE] == 2 && state.elided[GxmState::FRAGMENT_TEXTURE] == 1,
+                "texture compared by value per unit");
+        state.set_vertex_texture(0, &copy);
+        check(state.issued[GxmState::VERTEX_TEXTURE] == 1, "vertex and fragment units are separate");
+
+        state.set_cull_mode(SCE_GXM_CULL_NONE);
+        check(state.issued[GxmState::CULL_MODE] == 1, "first set is issued even if it matches the default");
+        state.set_cull_mode(SCE_GXM_CULL_NONE);
+        state.invalidate();
+        state.set_cull_mode(SCE_GXM_CULL_NONE);
+        check(state.issued[GxmState::CULL_MODE] == 2 && state.elided[GxmState::CULL_MODE] == 1,
+                "invalidate forgets the shadow");
+
+        state.set_vertex_stream(20, streamData[0]);
+        state.set_vertex_stream(20, streamData[0]);
+        check(state.issued[GxmState::VERTEX_STREAM] == 2, "out of range streams pass through");
+        check(host_calls() == state.total_issued(), "issued count matches the calls made");
+    }
+
+    unsigned directCalls = 0;
+    std::vector<HostGxmState> expected;
+    std::vector<Step> script = make_script(steps, 1234);
+
+    reset_host();
+    for (auto &step: script) {
+        if (step.kind == STEP_EXTERNAL) {
+            play_external(context);
+        } else {
+            play_direct(context, step);
+        }
+    }
+    expected.swap(host_gxm().drawStates);
+    directCalls = host_calls();
+
+    reset_host();
+    GxmState state(context);
+    unsigned externalCalls = 0;
+    for (auto &step: script) {
+        if (step.kind == STEP_EXTERNAL) {
+            unsigned before = host_calls();
+            play_external(context);
+            externalCalls += host_calls() - before;
+            state.invalidate();
+        } else {
+            play_shadowed(state, step);
+        }
+    }
+
+    check(host_gxm().drawStates.size() == expected.size(), "same number of draws");
+    check(host_gxm().drawStates == expected, "every draw sees the same state");
+    check(host_calls() - externalCalls == state.total_issued(), "issued count matches the calls made");
+    check(state.total_issued() + state.total_elided() + externalCalls == directCalls, "every set is issued or elided");
+    check(state.total_elided() > 0, "random script has redundant sets");
+
+    printf("random script, %u steps, %u draws: %u sets issued, %u elided\n",
+            steps, state.draws, state.total_issued(), state.total_elided());
+
+    // The sample's frame: vita2d clears, then a few text runs per program
+    // and font, each binding its program, texture, stream and fill mode
+    reset_host();
+    state.invalidate();
+    state.reset_counters();
+    SceGxmTexture atlas = textures[0];
+    SceGxmTexture sdf = textures[1];
+    const unsigned frames = 60;
+    for (unsigned frame=0; frame<frames; ++frame) {
+        play_external(context);
+        state.invalidate();
+        const SceGxmTexture *fonts[] = { &atlas, &sdf, &sdf, &sdf };
+        for (unsigned run=0; run<4; ++run) {
+            state.set_vertex_program(vertexPrograms[0]);
+            state.set_fragment_program(fragmentPrograms[run == 0 ? 0 : 1]);
+            state.set_back_polygon_mode(SCE_GXM_POLYGON_MODE_TRIANGLE_FILL);
+            state.set_fragment_texture(0, fonts[run]);
+            state.set_vertex_stream(0, streamData[run % 3]);
+            state.draw(SCE_GXM_PRIMITIVE_TRIANGLES, SCE_GXM_INDEX_FORMAT_U16, nullptr, 6);
+        }
+    }
+
+    printf("\n%u text frames:\n", frames);
+    state.print_stats(stdout);
+
+    if (!failures) {
+        printf("\nshadowed state matches direct state: ok\n");
+    }
+    return failures ? 1 : 0;
+}
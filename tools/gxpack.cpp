@@ -0,0 +1,92 @@
+// Packs compiled GXP programs into one shader archive (see shaderarchive.h).
+// Each program is stored under its file name without directory and extension.
+
+#include "gxp.h"
+#include "shaderarchive.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+using namespace vitashader;
+
+static bool
+read_file(const char *filename, std::vector<uint8_t> &data)
+{
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        return false;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    long len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    data.resize(len > 0 ? len : 0);
+    bool ok = len >= 0 && fread(data.data(), 1, data.size(), fp) == data.size();
+    fclose(fp);
+    return ok;
+}
+
+static std::string
+program_name(const char *filename)
+{
+    std::string name = filename;
+
+    size_t slash = name.find_last_of('/');
+    if (slash != std::string::npos) {
+        name = name.substr(slash + 1);
+    }
+
+    size_t dot = name.find_last_of('.');
+    if (dot != std::string::npos) {
+        name = name.substr(0, dot);
+    }
+
+    return name;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s archive.gxa program.gxp...\n", argv[0]);
+        return 1;
+    }
+
+    uint32_t count = argc - 2;
+    std::vector<std::string> names;
+    std::vector<std::vector<uint8_t>> programs(count);
+
+    for (uint32_t i=0; i<count; ++i) {
+        const char *filename = argv[i + 2];
+        if (!read_file(filename, programs[i])) {
+            fprintf(stderr, "%s: cannot read\n", filename);
+            return 1;
+        }
+
+        gxp::Reflection reflection;
+        if (!reflection.parse(programs[i].data(), programs[i].size())) {
+            fprintf(stderr, "%s: %s\n", filename, reflection.error);
+            return 1;
+        }
+
+        names.push_back(program_name(filename));
+        for (uint32_t j=0; j<i; ++j) {
+            if (names[j] == names[i]) {
+                fprintf(stderr, "%s: duplicate program name %s\n", filename, names[i].c_str());
+                return 1;
+            }
+        }
+    }
+
+    std::vector<uint8_t> archive = build_archive(names, programs);
+    if (!write_archive(argv[1], archive)) {
+        fprintf(stderr, "%s: cannot write\n", argv[1]);
+        return 1;
+    }
+
+    printf("%s: %u programs, %u bytes\n", argv[1], count, (unsigned)archive.size());
+    return 0;
+}
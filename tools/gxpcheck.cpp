@@ -0,0 +1,281 @@
+// Checks the GXP reader of gxp.h against a fixture program with the
+// parameters of the PACKED_VERTEX+INSTANCE_PARAMS variant of sphere_v, its
+// bounds checks against corrupted copies of it, and optionally against
+// compiled programs.
+//
+//   gxpcheck [program.gxp [expected.txt]]...
+//
+// The fixture's bytes follow the layout gxp.h assumes. It is hand-assembled
+// rather than shacc output, so it only checks the reader against that
+// assumption: its parsed names, categories, component counts, array sizes,
+// resource indices and container indices have to match the table below,
+// and dump() has to print the text gxpdump shows for it.
+//
+// What holds the layout to the real thing is programs compiled by shacc,
+// as `make gxpcheck` passes sphere_v.gxp and sphere_f.gxp. Each has to parse
+// to its file size, with parameters that are each found by name. Given an
+// expected.txt, dump() has to print it exactly:
+// that is what dump_program() printed for the same program on the device,
+// taken from the lines under "Vertex Shader:" or "Fragment Shader:" in
+// ux0:data/vitashader.log and kept in tools/gxpexpected/.
+
+#include "check.h"
+#include "gxp.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+using namespace vitashader;
+
+static const uint8_t fixture[] = {
+    // Header: magic, version, size, vertex type, 8 parameters at +0x78,
+    // one default uniform buffer, 2 containers at +0x8c
+    0x47, 0x58, 0x50, 0x00, 0x01, 0x05, 0x00, 0x00, 0x80, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00, 0x78, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x02, 0x00, 0x00, 0x00, 0x8c, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    // Parameter records: name offset, flags (category, type, components,
+    // container), semantic, semantic index, array size, resource index
+    0x90, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x8a, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00,
+    0x84, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00,
+    0x7b, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x0c, 0x00, 0x00, 0x00,
+    0x75, 0x00, 0x00, 0x00, 0x01, 0x04, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x70, 0x00, 0x00, 0x00, 0x01, 0xe4, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x67, 0x00, 0x00, 0x00, 0x01, 0xe4, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00,
+    0x62, 0x00, 0x00, 0x00, 0x01, 0xe4, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00,
+    // Containers: index, unused, base SA offset, max resource index
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x0e, 0x00, 0x00, 0x00, 0x00, 0x00, 0x18, 0x00,
+    // Names
+    0x61, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x00, 0x61, 0x54, 0x65, 0x78, 0x43, 0x6f,
+    0x6f, 0x72, 0x64, 0x00, 0x61, 0x53, 0x63, 0x61, 0x6c, 0x65, 0x00, 0x61, 0x49, 0x6e, 0x73, 0x74,
+    0x61, 0x6e, 0x63, 0x65, 0x00, 0x75, 0x49, 0x6e, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x73, 0x00,
+    0x75, 0x43, 0x6f, 0x6c, 0x6f, 0x72, 0x00, 0x75, 0x54, 0x72, 0x61, 0x6e, 0x73, 0x66, 0x6f, 0x72,
+    0x6d, 0x00, 0x75, 0x50, 0x72, 0x6f, 0x6a, 0x65, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x00, 0x00, 0x00,
+};
+
+struct Expected {
+    const char *name;
+    uint8_t category;
+    uint8_t componentCount;
+    uint8_t containerIndex;
+    uint32_t arraySize;
+    uint32_t resourceIndex;
+};
+
+static const Expected expected[] = {
+    {"aPosition", gxp::CATEGORY_ATTRIBUTE, 2, 0, 1, 0},
+    {"aTexCoord", gxp::CATEGORY_ATTRIBUTE, 2, 0, 1, 4},
+    {"aScale", gxp::CATEGORY_ATTRIBUTE, 1, 0, 1, 8},
+    {"aInstance", gxp::CATEGORY_ATTRIBUTE, 1, 0, 1, 12},
+    {"uInstances", gxp::CATEGORY_UNIFORM, 4, 0, 512, 0},
+    {"uColor", gxp::CATEGORY_UNIFORM, 4, 14, 1, 0},
+    {"uTransform", gxp::CATEGORY_UNIFORM, 4, 14, 1, 4},
+    {"uProjection", gxp::CATEGORY_UNIFORM, 4, 14, 4, 8},
+};
+
+static const char expectedDump[] =
+    " Check = 0x00000000\n"
+    " Size = 384\n"
+    " Type = 0x00000000\n"
+    " Params = 8\n"
+    "  params[0] = {cat=0x00000000, name=aPosition, semantic=0x00000000, type=0x00000000, comp=2, asize=1}\n"
+    "  params[1] = {cat=0x00000000, name=aTexCoord, semantic=0x00000000, type=0x00000000, comp=2, asize=1}\n"
+    "  params[2] = {cat=0x00000000, name=aScale, semantic=0x00000000, type=0x00000000, comp=1, asize=1}\n"
+    "  params[3] = {cat=0x00000000, name=aInstance, semantic=0x00000000, type=0x00000000, comp=1, asize=1}\n"
+    "  params[4] = {cat=0x00000001, name=uInstances, semantic=0x00000000, type=0x00000000, comp=4, asize=512}\n"
+    "  params[5] = {cat=0x00000001, name=uColor, semantic=0x00000000, type=0x00000000, comp=4, asize=1}\n"
+    "  params[6] = {cat=0x00000001, name=uTransform, semantic=0x00000000, type=0x00000000, comp=4, asize=1}\n"
+    "  params[7] = {cat=0x00000001, name=uProjection, semantic=0x00000000, type=0x00000000, comp=4, asize=4}\n";
+
+static std::string dumped;
+
+static int
+capture(const char *format, ...)
+{
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    dumped += line;
+    return n;
+}
+
+static void
+check_fixture()
+{
+    gxp::Reflection reflection;
+    check(reflection.parse(fixture, sizeof(fixture)), "fixture parses");
+    check(reflection.size == sizeof(fixture) && reflection.type == 0 && reflection.defaultUniformBufferCount == 1,
+            "header fields");
+
+    size_t count = sizeof(expected) / sizeof(expected[0]);
+    check(reflection.parameters.size() == count, "parameter count");
+    for (size_t i=0; i<count && i<reflection.parameters.size(); ++i) {
+        const gxp::Parameter &parameter = reflection.parameters[i];
+        const Expected &e = expected[i];
+        char what[64];
+        snprintf(what, sizeof(what), "parameter %s", e.name);
+        check(strcmp(parameter.name, e.name) == 0 && parameter.category == e.category &&
+                parameter.componentCount == e.componentCount && parameter.containerIndex == e.containerIndex &&
+                parameter.arraySize == e.arraySize && parameter.resourceIndex == e.resourceIndex &&
+                parameter.record == fixture + gxp::HEADER_END + i * gxp::PARAMETER_SIZE, what);
+        check(reflection.find(e.name) == &parameter, "find() returns each parameter");
+    }
+    check(!reflection.find("uMissing") && !reflection.find("") && !reflection.find("aPositio"),
+            "find() misses unknown names");
+
+    check(reflection.containers.size() == 2 &&
+            reflection.containers[0].containerIndex == 0 && reflection.containers[0].maxResourceIndex == 1024 &&
+            reflection.containers[0].offset == 0x120 &&
+            reflection.containers[1].containerIndex == 14 && reflection.containers[1].maxResourceIndex == 24 &&
+            reflection.containers[1].offset == 0x128, "containers");
+
+    dumped.clear();
+    reflection.dump(capture);
+    check(dumped == expectedDump, "dump() output");
+    if (dumped != expectedDump) {
+        fprintf(stderr, "%s", dumped.c_str());
+    }
+}
+
+static void
+put32(std::vector<uint8_t> &data, size_t at, uint32_t value)
+{
+    memcpy(&data[at], &value, 4);
+}
+
+// A copy of the fixture with one field overwritten has to be rejected
+static void
+check_corrupted(const char *what, size_t at, uint32_t value, size_t len=sizeof(fixture))
+{
+    std::vector<uint8_t> data(fixture, fixture + sizeof(fixture));
+    put32(data, at, value);
+
+    // Padding at the end that is not zero, for names running into it
+    put32(data, sizeof(fixture) - 4, 0x78787878);
+
+    gxp::Reflection reflection;
+    bool parsed = reflection.parse(data.data(), len);
+    check(!parsed && reflection.error && reflection.parameters.empty() && !reflection.find("uColor"), what);
+}
+
+static bool
+read_file(const char *filename, std::vector<uint8_t> &data)
+{
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        return false;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    long len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    data.resize(len > 0 ? len : 0);
+    bool ok = len >= 0 && fread(data.data(), 1, data.size(), fp) == data.size();
+    fclose(fp);
+    return ok;
+}
+
+static bool
+ends_with(const char *text, const char *suffix)
+{
+    size_t n = strlen(text), m = strlen(suffix);
+    return n >= m && strcmp(text + n - m, suffix) == 0;
+}
+
+// A compiled program, and the device's dump of it if given
+static void
+check_program(const char *filename, const char *expectedFile)
+{
+    char what[256];
+    std::vector<uint8_t> data;
+    if (!read_file(filename, data)) {
+        snprintf(what, sizeof(what), "%s: cannot read", filename);
+        check(false, what);
+        return;
+    }
+
+    gxp::Reflection reflection;
+    bool parsed = reflection.parse(data.data(), data.size());
+    snprintf(what, sizeof(what), "%s: parses (%s)", filename, reflection.error ? reflection.error : "ok");
+    check(parsed, what);
+    if (!parsed) {
+        return;
+    }
+    snprintf(what, sizeof(what), "%s: size %u of a %u byte file", filename, (unsigned)reflection.size,
+            (unsigned)data.size());
+    check(reflection.size == data.size(), what);
+
+    bool found = !reflection.parameters.empty();
+    for (const gxp::Parameter &parameter: reflection.parameters) {
+        found &= reflection.find(parameter.name) == &parameter;
+    }
+    snprintf(what, sizeof(what), "%s: has parameters, each found by name", filename);
+    check(found, what);
+
+    if (expectedFile) {
+        std::vector<uint8_t> expectedText;
+        snprintf(what, sizeof(what), "%s: cannot read", expectedFile);
+        check(read_file(expectedFile, expectedText), what);
+
+        dumped.clear();
+        reflection.dump(capture);
+        snprintf(what, sizeof(what), "%s: dump() matches %s", filename, expectedFile);
+        bool same = dumped == std::string(expectedText.begin(), expectedText.end());
+        check(same, what);
+        if (!same) {
+            fprintf(stderr, "%s", dumped.c_str());
+        }
+    }
+
+    printf("%s: %u parameters, %u containers%s\n", filename, (unsigned)reflection.parameters.size(),
+            (unsigned)reflection.containers.size(), expectedFile ? ", dump as on the device" : "");
+}
+
+int
+main(int argc, char *argv[])
+{
+    for (int i=1; i<argc; ++i) {
+        if (!ends_with(argv[i], ".gxp")) {
+            fprintf(stderr, "Usage: %s [program.gxp [expected.txt]]...\n", argv[0]);
+            return 1;
+        }
+        const char *expectedFile = i + 1 < argc && !ends_with(argv[i + 1], ".gxp") ? argv[i + 1] : nullptr;
+        check_program(argv[i], expectedFile);
+        i += expectedFile ? 1 : 0;
+    }
+
+    check_fixture();
+
+    check_corrupted("bad magic rejected", gxp::HEADER_MAGIC, 0x00505848);
+    check_corrupted("truncated buffer rejected", gxp::HEADER_SIZE, sizeof(fixture), sizeof(fixture) - 16);
+    check_corrupted("size below the header rejected", gxp::HEADER_SIZE, gxp::HEADER_END - 1);
+    check_corrupted("parameter count past the end rejected", gxp::HEADER_PARAMETER_COUNT, 100);
+    check_corrupted("parameter table past the end rejected", gxp::HEADER_PARAMETERS_OFFSET, 0x150);
+    check_corrupted("name past the end rejected", gxp::HEADER_END + gxp::PARAMETER_NAME_OFFSET, 0x1000);
+    check_corrupted("name without a terminator rejected", gxp::HEADER_END + gxp::PARAMETER_NAME_OFFSET,
+            sizeof(fixture) - gxp::HEADER_END - 4);
+    check_corrupted("container table past the end rejected", gxp::HEADER_CONTAINER_OFFSET, 0x100);
+
+    gxp::Reflection reflection;
+    check(!reflection.parse(fixture, gxp::HEADER_END - 1), "buffer shorter than a header rejected");
+
+    printf("%u parameters and %u containers as expected\n", (unsigned)(sizeof(expected) / sizeof(expected[0])), 2u);
+    if (!failures) {
+        printf("\ngxp reader: ok\n");
+    }
+    return failures ? 1 : 0;
+}
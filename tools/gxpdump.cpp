@@ -0,0 +1,69 @@
+// Prints the reflection of compiled GXP programs on the host, in the same
+// format as dump_program() on the device.
+
+#include "gxp.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+static bool
+read_file(const char *filename, std::vector<uint8_t> &data)
+{
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        return false;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    long len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    data.resize(len > 0 ? len : 0);
+    bool ok = len >= 0 && fread(data.data(), 1, data.size(), fp) == data.size();
+    fclose(fp);
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s program.gxp...\n", argv[0]);
+        return 1;
+    }
+
+    int result = 0;
+
+    for (int i=1; i<argc; ++i) {
+        std::vector<uint8_t> data;
+        if (!read_file(argv[i], data)) {
+            fprintf(stderr, "%s: cannot read\n", argv[i]);
+            result = 1;
+            continue;
+        }
+
+        vitashader::gxp::Reflection reflection;
+        if (!reflection.parse(data.data(), data.size())) {
+            fprintf(stderr, "%s: %s\n", argv[i], reflection.error);
+            result = 1;
+            continue;
+        }
+
+        printf("%s:\n", argv[i]);
+        reflection.dump(printf);
+
+        for (auto &container: reflection.containers) {
+            printf("  container[%u] = {offset=0x%x, base_sa=%u, max_resource=%u}\n",
+                    container.containerIndex, container.offset,
+                    container.baseSaOffset, container.maxResourceIndex);
+        }
+        for (auto &parameter: reflection.parameters) {
+            printf("  %s: resource=%u container=%u semantic_index=%u\n",
+                    parameter.name, parameter.resourceIndex,
+                    parameter.containerIndex, parameter.semanticIndex);
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,216 @@
+// Checks instancebuffer.h with the GXM stand-in of hostgxm.h: reflection of
+// uInstances, the packed buffer and what the INSTANCE_PARAMS variant of
+// sphere_v reads from it for each vertex.
+//
+//   instancecheck [strings]
+//
+// A screen of strings, each with its own color, offset and scale, is built
+// twice: at the origin with one instance slot per string, and the old way
+// with the position and scale baked into the vertices. Each packed vertex
+// then goes through the shader's fetch from the uploaded buffer. It has to
+// land within the packing error of its baked twin and get its string's
+// color. The instanced screen has to stay a single run, where per-string
+// uniforms would need a draw per string.
+
+#include "check.h"
+#include "fakefont.h"
+#include "fakegxp.h"
+#include "instancebuffer.h"
+#include "gxmstate.h"
+#include "ringalloc.h"
+#include "textbatch.h"
+#include "vertexpack.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+using namespace vitashader;
+
+// The uniforms below in one program, read back through gxp::Reflection
+static const SceGxmProgramParameter *
+fake_parameter(const char *name)
+{
+    static const std::vector<uint8_t> program = make_program(false, {
+        { "aInstance", gxp::CATEGORY_ATTRIBUTE, 1, 0 },
+        { "uDefault", gxp::CATEGORY_UNIFORM, 4, 0, 14, 512 },
+        { "uInstances", gxp::CATEGORY_UNIFORM, 4, 0, 0, 512 },
+        { "uShifted", gxp::CATEGORY_UNIFORM, 4, 8, 3, 64 },
+    });
+    return sceGxmProgramFindParameterByName((const SceGxmProgram *)program.data(), name);
+}
+
+static void
+check_reflection()
+{
+    InstanceBuffer instances;
+    uint16_t slot;
+
+    check(!instances.reflect(nullptr) && instances.capacity == 0, "no parameter");
+    check(!instances.add(InstanceParams{}, &slot), "no slots without a reflected array");
+    check(!instances.reflect(fake_parameter("aInstance")),
+            "attributes rejected");
+    check(!instances.reflect(fake_parameter("uDefault")),
+            "arrays in the default uniform buffer rejected");
+
+    // As sphere_v declares it: float4 uInstances[2 * 256] : BUFFER[0]
+    check(instances.reflect(fake_parameter("uInstances")) &&
+            instances.bufferIndex == 0 && instances.offset == 0 && instances.capacity == 256,
+            "uInstances gives 256 slots in buffer 0");
+
+    bool added = true;
+    for (unsigned i=1; i<256; ++i) {
+        added &= instances.add(InstanceParams{}, &slot) && slot == i;
+    }
+    check(added, "slots 1 to 255 follow the identity slot");
+    check(!instances.add(InstanceParams{}, &slot), "full array refuses more slots");
+    instances.clear();
+    check(instances.size() == 1 && instances.add(InstanceParams{}, &slot) && slot == 1, "clear() keeps slot 0");
+
+    // An array behind other uniforms in the buffer
+    InstanceBuffer shifted;
+    check(shifted.reflect(fake_parameter("uShifted")) &&
+            shifted.bufferIndex == 3 && shifted.offset == 8 && shifted.capacity == 32,
+            "array at an offset in buffer 3");
+    shifted.add(InstanceParams{{0.1f, 0.2f, 0.3f, 0.4f}, {5.f, 6.f, 7.f, 8.f}}, &slot);
+
+    std::vector<float> buffer(shifted.bytes() / sizeof(float), -1.f);
+    check(buffer.size() == 8 + 2 * 8, "bytes() covers the offset and both slots");
+    shifted.pack(buffer.data());
+    const float expected[] = {
+        0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f,
+        1.f, 1.f, 1.f, 1.f, 0.f, 0.f, 1.f, 1.f,
+        0.1f, 0.2f, 0.3f, 0.4f, 5.f, 6.f, 7.f, 8.f,
+    };
+    check(memcmp(buffer.data(), expected, sizeof(expected)) == 0, "pack() layout");
+}
+
+// What the INSTANCE_PARAMS variant of sphere_v computes before uTransform
+static Vertex
+shade(const GlyphVertex &vertex, const float *buffer, unsigned offset, const float **color)
+{
+    Vertex v = unpack_glyph_vertex(vertex);
+    const float *slot = buffer + offset + vertex.instance * INSTANCE_FLOAT4S * 4;
+    const float *transform = slot + 4;
+    *color = slot;
+    return Vertex{v.x * transform[2] + transform[0], v.y * transform[3] + transform[1], v.z * transform[2], v.u, v.v};
+}
+
+int
+main(int argc, char *argv[])
+{
+    int strings = argc > 1 ? atoi(argv[1]) : 200;
+    if (strings < 1 || strings > 255) {
+        fprintf(stderr, "strings must be 1 to 255\n");
+        return 1;
+    }
+
+    check_reflection();
+
+    Font font;
+    make_font(font);
+
+    InstanceBuffer instances;
+    instances.reflect(fake_parameter("uInstances"));
+
+    TextBatch instanced, baked;
+    instanced.set_packed(true);
+    baked.set_packed(true);
+
+    // A quad without a slot, like the atlas quad of main.cpp
+    instanced.add_quad(font, 0.f, 0.f, 900.f, 900.f, 0.f, 0.f, 1.f, 1.f, 1.f);
+    baked.add_quad(font, 0.f, 0.f, 900.f, 900.f, 0.f, 0.f, 1.f, 1.f, 1.f);
+
+    std::vector<InstanceParams> params;
+    std::vector<size_t> firstQuad;
+    unsigned seed = 7;
+    for (int i=0; i<strings; ++i) {
+        seed = seed * 1103515245u + 12345u;
+        float scale = 0.75f + (seed >> 16) % 4 * 0.25f;
+        float x = 4.f + (i % 4) * 240.f + (seed >> 8) % 8 * 0.37f;
+        float y = 20.f + (i / 4) % 26 * 20.f;
+        float color[4] = { (seed >> 4) % 256 / 255.f, (seed >> 12) % 256 / 255.f, (seed >> 20) % 256 / 255.f, 1.f };
+
+        char text[64];
+        snprintf(text, sizeof(text), "String %d scores %u", i, (seed >> 3) % 100000);
+
+        InstanceParams p = {{ color[0], color[1], color[2], color[3] }, { x, y, scale, scale }};
+        uint16_t slot = 0;
+        check(instances.add(p, &slot), "slot per string");
+        params.push_back(p);
+        firstQuad.push_back(instanced.glyph_count());
+
+        instanced.set_instance(slot);
+        instanced.add(font, text, 0.f, 0.f, 1.f);
+        baked.add(font, text, x, y, scale);
+    }
+
+    check(instanced.glyph_count() == baked.glyph_count() && instanced.quadInstances.size() == instanced.glyph_count(),
+            "one slot per quad");
+    check(instanced.runs.size() == 1, "differently styled strings stay one run");
+
+    // The upload TextBatch does on the device, and the instance buffer
+    // through the ring and the shadowed state
+    size_t vertexCount = instanced.vertices.size();
+    std::vector<GlyphVertex> packed(vertexCount), bakedPacked(vertexCount);
+    pack_glyph_vertices(instanced.vertices.data(), vertexCount, instanced.quadInstances.data(), packed.data());
+    pack_glyph_vertices(baked.vertices.data(), vertexCount, baked.quadInstances.data(), bakedPacked.data());
+
+    std::vector<uint8_t> memory(256 * 1024);
+    RingAllocator ring(memory.data(), memory.size());
+    ring.begin_frame(1);
+
+    GxmState state(nullptr);
+    const float *buffer = (const float *)instances.upload(ring);
+    check(buffer != nullptr, "instance upload");
+    if (!buffer) {
+        return 1;
+    }
+    instances.bind(state, buffer);
+    instances.bind(state, buffer);
+    check(host_gxm().state.vertexUniformBuffers[0] == buffer, "buffer bound at its index");
+    check(state.issued[GxmState::VERTEX_UNIFORM_BUFFER] == 1 && state.elided[GxmState::VERTEX_UNIFORM_BUFFER] == 1,
+            "repeated bind elided");
+
+    float positionMax = 0.f;
+    bool sameRest = true, sameColor = true, identity = true;
+    size_t string = 0;
+    for (size_t i=0; i<vertexCount; ++i) {
+        const float *color;
+        Vertex v = shade(packed[i], buffer, instances.offset, &color);
+        Vertex b = unpack_glyph_vertex(bakedPacked[i]);
+
+        size_t quad = i / 4;
+        if (quad < firstQuad[0]) {
+            identity &= memcmp(&v, &b, sizeof(Vertex)) == 0 && color[0] == 1.f && color[3] == 1.f;
+            continue;
+        }
+        while (string + 1 < firstQuad.size() && quad >= firstQuad[string + 1]) {
+            ++string;
+        }
+
+        // Packing rounds the local position, which the scale then grows
+        float error = std::max(fabsf(v.x - b.x), fabsf(v.y - b.y)) / params[string].transform[2];
+        positionMax = std::max(positionMax, error);
+        sameRest &= fabsf(v.z - b.z) <= 1e-3f * b.z && v.u == b.u && v.v == b.v;
+        sameColor &= memcmp(color, params[string].color, sizeof(params[string].color)) == 0;
+    }
+    check(identity, "quads without a slot draw as before");
+    check(positionMax <= 1.f / GLYPH_POSITION_UNITS + 1e-3f, "instanced positions within packing error of baked ones");
+    check(sameRest, "instanced uv and glyph scale match baked ones");
+    check(sameColor, "every vertex gets its string's color");
+
+    printf("%d strings, %u glyphs: %u draw with %u bytes of instance data, where uniforms per string need %d draws\n",
+            strings, (unsigned)instanced.glyph_count(), (unsigned)instanced.runs.size(), (unsigned)instances.bytes(),
+            strings + 1);
+    printf("instanced position vs baked: max %.4f px before the string's scale\n", positionMax);
+
+    if (!failures) {
+        printf("\ninstance parameters: ok\n");
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,203 @@
+// Checks jobsystem.h and TextBatch::add_parallel(), then times batch
+// building with 1 to N workers.
+//
+//   jobbench [max_workers] [strings]
+//
+// parallel_for has to call every index exactly once for any count, grain
+// and worker count, also over many back to back calls that let the workers
+// fall asleep in between. add_parallel() has to produce the same vertices
+// and runs as add() in a loop. Build the tools/jobbench-tsan variant
+// (make tsan) to run the same checks under ThreadSanitizer.
+
+#include "check.h"
+#include "fakefont.h"
+#include "jobsystem.h"
+#include "textbatch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace vitashader;
+
+static bool
+covers_once(JobSystem &jobs, uint32_t count, uint32_t grain)
+{
+    std::vector<uint8_t> hits(count);
+    std::atomic<bool> bad(false);
+    jobs.parallel_for(count, grain, [&](uint32_t begin, uint32_t end, unsigned worker) {
+        if (end - begin > grain || worker >= jobs.worker_count()) {
+            bad = true;
+        }
+        for (uint32_t i=begin; i<end; ++i) {
+            ++hits[i];
+        }
+    });
+
+    for (uint32_t i=0; i<count; ++i) {
+        if (hits[i] != 1) {
+            return false;
+        }
+    }
+    return !bad;
+}
+
+static std::vector<std::string>
+make_strings(size_t count)
+{
+    static const char *const words[] = {
+        "Score", "lives", "the quick brown fox", "jumps over", "the lazy dog", "12345",
+        "Options", "Resume\ngame", "H\xC3\xA9llo", "\xE2\x82\xAC 9.99", "  ", "",
+    };
+    const size_t nwords = sizeof(words) / sizeof(words[0]);
+
+    std::vector<std::string> strings(count);
+    unsigned seed = 7;
+    for (auto &s: strings) {
+        int parts = 1 + seed % 6;
+        for (int i=0; i<parts; ++i) {
+            seed = seed * 1103515245u + 12345u;
+            s += words[(seed >> 16) % nwords];
+            s += ' ';
+        }
+    }
+    return strings;
+}
+
+static std::vector<TextItem>
+make_items(const std::vector<std::string> &strings, const Font *fonts)
+{
+    std::vector<TextItem> items(strings.size());
+    for (size_t i=0; i<strings.size(); ++i) {
+        // Fonts change in stretches, so runs are long but not single
+        const Font *font = &fonts[(i / 37) % 2];
+        items[i] = TextItem{font, strings[i].c_str(), (float)(i % 40) * 24.f, (float)(i / 40) * 22.f,
+                0.75f + (i % 3) * 0.25f};
+    }
+    return items;
+}
+
+static bool
+same_batch(const TextBatch &a, const TextBatch &b)
+{
+    if (a.vertices.size() != b.vertices.size() || a.runs.size() != b.runs.size()) {
+        return false;
+    }
+    for (size_t i=0; i<a.runs.size(); ++i) {
+        const TextBatch::Run &x = a.runs[i];
+        const TextBatch::Run &y = b.runs[i];
+        if (x.program != y.program || x.font != y.font || x.firstVertex != y.firstVertex ||
+                x.quadCount != y.quadCount) {
+            return false;
+        }
+    }
+    return a.vertices.empty() ||
+        memcmp(a.vertices.data(), b.vertices.data(), a.vertices.size() * sizeof(Vertex)) == 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    unsigned hardware = std::thread::hardware_concurrency();
+    unsigned maxWorkers = (argc > 1) ? atoi(argv[1]) : (hardware > 4 ? hardware : 4);
+    size_t stringCount = (argc > 2) ? atoi(argv[2]) : 4000;
+
+    const uint32_t counts[] = { 0, 1, 7, 1000, 100000 };
+    const uint32_t grains[] = { 1, 16, 1000 };
+    for (unsigned workers=1; workers<=4; ++workers) {
+        JobSystem jobs(workers);
+        check(jobs.worker_count() == workers, "worker count");
+        for (uint32_t count: counts) {
+            for (uint32_t grain: grains) {
+                check(covers_once(jobs, count, grain), "every index exactly once");
+            }
+        }
+
+        bool repeated = true;
+        for (int i=0; i<2000 && repeated; ++i) {
+            repeated = covers_once(jobs, 1 + i % 64, 4);
+        }
+        check(repeated, "back to back calls");
+    }
+
+    Font fonts[2];
+    make_font(fonts[0], 9.f);
+    make_font(fonts[1], 12.f);
+    std::vector<std::string> strings = make_strings(stringCount);
+    std::vector<TextItem> items = make_items(strings, fonts);
+    PatchedProgram *program = (PatchedProgram *)&fonts[0];
+
+    TextBatch serial;
+    serial.set_program(program);
+    serial.add_quad(fonts[0], 0.f, 0.f, 900.f, 900.f, 0.f, 0.f, 1.f, 1.f, 1.f);
+    for (auto &item: items) {
+        serial.add(*item.font, item.text, item.x, item.y, item.scale);
+    }
+
+    for (unsigned workers=1; workers<=4; ++workers) {
+        JobSystem jobs(workers);
+        TextBatch parallel;
+        parallel.set_program(program);
+        parallel.add_quad(fonts[0], 0.f, 0.f, 900.f, 900.f, 0.f, 0.f, 1.f, 1.f, 1.f);
+        parallel.add_parallel(jobs, items.data(), items.size());
+        check(same_batch(serial, parallel), "add_parallel matches add");
+
+        parallel.clear();
+        parallel.add_parallel(jobs, items.data(), 0);
+        check(parallel.vertices.empty() && parallel.runs.empty(), "no items, no quads");
+    }
+
+    printf("%zu strings, %zu glyphs, %zu runs\n\n", items.size(), serial.glyph_count(), serial.runs.size());
+
+    // Building the batch is the whole cost measured; the batch is cleared
+    // and refilled like every frame
+    const int iterations = 50;
+    double serialTime = 0.0;
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (int i=0; i<iterations; ++i) {
+            serial.clear();
+            for (auto &item: items) {
+                serial.add(*item.font, item.text, item.x, item.y, item.scale);
+            }
+        }
+        serialTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / iterations;
+    }
+    printf("%-10s %10s %8s %8s\n", "workers", "ms/frame", "speedup", "steals");
+    printf("%-10s %10.3f %8s %8s\n", "add()", serialTime * 1e3, "1.00", "-");
+
+    for (unsigned workers=1; workers<=maxWorkers; ++workers) {
+        JobSystem jobs(workers);
+        TextBatch batch;
+        batch.set_program(program);
+        batch.add_parallel(jobs, items.data(), items.size());
+        jobs.reset_counters();
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i=0; i<iterations; ++i) {
+            batch.clear();
+            batch.add_parallel(jobs, items.data(), items.size());
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / iterations;
+
+        unsigned steals = 0;
+        for (auto &worker: jobs.queues) {
+            steals += worker->stolen.load();
+        }
+        printf("%-10u %10.3f %8.2f %8u\n", workers, seconds * 1e3, serialTime / seconds, steals / iterations);
+    }
+    if (hardware < maxWorkers) {
+        printf("(%u hardware threads)\n", hardware);
+    }
+
+    if (!failures) {
+        printf("\njob system and parallel batch building: ok\n");
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,121 @@
+// Stress test for logring.h: producer threads post formatted and deferred
+// messages while the consumer thread drains them. Checks that every message
+// is either delivered intact and in per-thread order or counted as dropped.
+//
+//   logstress [threads] [messages_per_thread]
+
+#include "check.h"
+#include "logring.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace vitashader;
+
+static void
+produce(LogRing &log, unsigned thread, unsigned count)
+{
+    for (unsigned i=0; i<count; ++i) {
+        if (i & 1) {
+            log.post("t%u m%u deferred %.1f %s\n", thread, i, i * 0.5, "arg");
+        } else {
+            log.print("t%u m%u printed %.1f %s\n", thread, i, i * 0.5, "arg");
+        }
+    }
+}
+
+static void
+run(unsigned threads, unsigned count, size_t capacity, bool expect_drops)
+{
+    LogRing log(capacity);
+
+    std::vector<unsigned> next(threads, 0);
+    unsigned received = 0;
+    unsigned corrupt = 0;
+    unsigned reordered = 0;
+    size_t bytes = 0;
+
+    FILE *file = tmpfile();
+
+    // The consumer is the only caller of the sink, so no locking here
+    log.start([&](const char *text, size_t length) {
+        unsigned t, m;
+        double f;
+        char kind[16], arg[8];
+        if (sscanf(text, "t%u m%u %15s %lf %7s", &t, &m, kind, &f, arg) != 5 || t >= threads ||
+                f != m * 0.5 || strcmp(arg, "arg") != 0 || text[length - 1] != '\n' ||
+                strcmp(kind, (m & 1) ? "deferred" : "printed") != 0) {
+            ++corrupt;
+            return;
+        }
+        if (m < next[t]) {
+            ++reordered;
+        }
+        next[t] = m + 1;
+        ++received;
+        bytes += length;
+    }, file);
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> producers;
+    for (unsigned t=0; t<threads; ++t) {
+        producers.emplace_back(produce, std::ref(log), t, count);
+    }
+    for (auto &p: producers) {
+        p.join();
+    }
+    log.stop();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    long fileBytes = file ? ftell(file) : -1;
+    if (file) {
+        fclose(file);
+    }
+
+    unsigned total = threads * count;
+    check(corrupt == 0, "messages delivered intact");
+    check(reordered == 0, "per-thread order kept");
+    check(received == log.written, "written counter");
+    check(log.posted == log.written, "every posted message written");
+    check(received + log.dropped == total, "delivered + dropped == sent");
+    check(log.truncated == 0, "no truncation");
+    check(fileBytes == (long)bytes, "file sink got the same output");
+    if (expect_drops) {
+        check(log.dropped > 0, "full ring drops");
+    }
+
+    printf("%u threads, ring %u: %u sent, %u written, %u dropped, %.2f M msg/s\n",
+            threads, (unsigned)capacity, total, received, (unsigned)log.dropped, total / seconds / 1e6);
+}
+
+int
+main(int argc, char *argv[])
+{
+    unsigned threads = (argc > 1) ? atoi(argv[1]) : 4;
+    unsigned count = (argc > 2) ? atoi(argv[2]) : 100000;
+    if (threads == 0 || count == 0) {
+        fprintf(stderr, "Usage: %s [threads] [messages_per_thread]\n", argv[0]);
+        return 1;
+    }
+
+    run(threads, count, 1 << 16, false);
+    run(threads, count, 16, true);
+
+    // Long output is cut to the payload and counted
+    LogRing log(4);
+    std::string longText(LogRing::PAYLOAD_SIZE * 2, 'x');
+    size_t length = 0;
+    log.print("%s", longText.c_str());
+    log.sink = [&](const char *, size_t len) { length = len; };
+    log.drain();
+    check(log.truncated == 1 && length == LogRing::PAYLOAD_SIZE - 1, "truncation counted");
+
+    return failures ? 1 : 0;
+}
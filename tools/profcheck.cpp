@@ -0,0 +1,124 @@
+// Exercises profiler.h on the host with a fake clock: several threads record
+// nested zones of known length, then the rolling statistics are checked and
+// the Chrome trace is written. Exits non-zero if a check fails.
+//
+//   profcheck [trace.json]
+
+#include "check.h"
+#include "profiler.h"
+
+#include <stdio.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace vitashader;
+
+// Each thread advances its own fake time; the clock reads the calling thread's
+static thread_local uint64_t fake_time = 0;
+
+static uint64_t
+fake_clock()
+{
+    return fake_time;
+}
+
+static void
+work(unsigned thread, unsigned frames)
+{
+    fake_time = thread * 1000000ull;
+
+    for (unsigned i=0; i<frames; ++i) {
+        VS_PROFILE_ZONE("frame");
+        fake_time += 10;
+        {
+            VS_PROFILE_ZONE("draw");
+            // 1..100 us, so each window of 100 frames has a known spread
+            fake_time += 1 + i % 100;
+        }
+        fake_time += 5;
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    const char *trace = (argc > 1) ? argv[1] : "profcheck.json";
+
+    Profiler &p = profiler();
+    p.clock = fake_clock;
+
+    // More frames than a thread's ring holds, so old events get dropped
+    const unsigned threads = 4;
+    const unsigned frames = ProfileThread::CAPACITY;
+
+    std::vector<std::thread> workers;
+    for (unsigned t=0; t<threads; ++t) {
+        workers.emplace_back(work, t, frames);
+    }
+    for (auto &w: workers) {
+        w.join();
+    }
+
+    uint32_t draw = p.register_zone("draw");
+    uint32_t frame = p.register_zone("frame");
+    check(p.zone_count() == 2, "zones registered once per name");
+
+    std::vector<uint32_t> ids;
+    std::vector<ProfileEvent> events = p.collect(&ids);
+    check(events.size() == threads * (ProfileThread::CAPACITY - 1), "ring keeps the newest events");
+    check(ids.size() == events.size(), "thread id per event");
+
+    bool nested = true;
+    for (size_t i=0; i + 1<events.size(); ++i) {
+        if (events[i].zone == draw && ids[i + 1] == ids[i]) {
+            const ProfileEvent &outer = events[i + 1];
+            nested = nested && outer.zone == frame &&
+                outer.begin + 10 == events[i].begin && events[i].end + 5 == outer.end;
+        }
+    }
+    check(nested, "draw nested in frame");
+
+    // Every thread records the same sequence; its last 128 draws take 69..100
+    // and 1..96 us, so the nearest-rank p99 (127th of 128) is 99
+    ZoneStats s = p.stats(draw);
+    check(s.count == Profiler::STATS_WINDOW, "stats window");
+    check(s.min == 1 && s.max == 100, "draw min/max");
+    check(s.p99 == 99, "draw p99");
+
+    std::vector<uint64_t> window;
+    for (unsigned i=frames - Profiler::STATS_WINDOW; i<frames; ++i) {
+        window.push_back(1 + i % 100);
+    }
+    uint64_t sum = 0;
+    for (uint64_t d: window) {
+        sum += d;
+    }
+    check(s.avg == sum / window.size(), "draw avg");
+
+    ZoneStats f = p.stats(frame);
+    check(f.min == s.min + 15 && f.max == s.max + 15, "frame min/max");
+
+    p.print_stats(stdout);
+
+    check(p.write_chrome_trace(trace), "trace written");
+
+    FILE *fp = fopen(trace, "r");
+    unsigned complete = 0;
+    if (fp) {
+        char line[256];
+        while (fgets(line, sizeof(line), fp)) {
+            complete += strstr(line, "\"ph\":\"X\"") != nullptr;
+        }
+        fclose(fp);
+    }
+    check(complete == events.size(), "one trace event per recorded zone");
+
+    if (failures) {
+        return 1;
+    }
+
+    printf("%u events from %u threads written to %s\n", (unsigned)events.size(), threads, trace);
+    return 0;
+}
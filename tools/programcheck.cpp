@@ -0,0 +1,351 @@
+// Checks ShaderProgram and UniformBlock (vitashader.h) with the GXM stand-in
+// of hostgxm.h, on made-up programs with the parameters of sphere_v and
+// sphere_f:
+//
+//   programcheck [frames]
+//
+// Vertex layouts, from VertexLayout types through set_layout() and from
+// add_attribute() through build_layout(), have to give the attribute and
+// stream arrays GXM is patched with: offsets, formats, strides, streams and
+// the program's registers, for every attribute format and across streams.
+// Attributes the program does not have are dropped. ShaderProgram::get()
+// has to patch once per distinct layout, MSAA mode,
+// blend state and output format and hit its cache after that, also for
+// layouts whose hashes collide. A failed patch gives nullptr, releases the
+// half that was made and is not cached. UniformBlock has to reserve one default
+// uniform buffer per stage whose values changed since the last flush and
+// none otherwise, over a run of frames that change the vertex stage, the
+// fragment stage, both or neither.
+
+#include "check.h"
+#include "fakegxp.h"
+#include "vitashader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+using namespace vitashader;
+
+static const std::vector<uint8_t> vertexProgram = make_program(false, {
+    {"aPosition", gxp::CATEGORY_ATTRIBUTE, 3, 0},
+    {"aTexCoord", gxp::CATEGORY_ATTRIBUTE, 2, 4},
+    {"aColor", gxp::CATEGORY_ATTRIBUTE, 4, 8},
+    {"aScale", gxp::CATEGORY_ATTRIBUTE, 1, 12},
+    {"aInstance", gxp::CATEGORY_ATTRIBUTE, 1, 16},
+    {"aOffset", gxp::CATEGORY_ATTRIBUTE, 2, 20},
+    {"uColor", gxp::CATEGORY_UNIFORM, 4, 0},
+    {"uTransform", gxp::CATEGORY_UNIFORM, 4, 4},
+    {"uProjection", gxp::CATEGORY_UNIFORM, 16, 8},
+});
+
+static const std::vector<uint8_t> fragmentProgram = make_program(true, {
+    {"uTexture", gxp::CATEGORY_SAMPLER, 1, 0},
+    {"uShadowOffset", gxp::CATEGORY_UNIFORM, 2, 0},
+    {"uOutline", gxp::CATEGORY_UNIFORM, 4, 4},
+});
+
+static bool
+same_attribute(const SceGxmVertexAttribute &a, uint16_t stream, uint16_t offset, SceGxmAttributeFormat format,
+        uint8_t components, uint16_t regIndex)
+{
+    return a.streamIndex == stream && a.offset == offset && a.format == format && a.componentCount == components &&
+        a.regIndex == regIndex;
+}
+
+// Per-vertex positions in one stream, per-instance offset and color in another
+struct Position {
+    float x, y, z;
+};
+
+struct Placement {
+    float offset[2];
+    uint8_t color[4];
+    uint16_t slot;
+};
+
+typedef VertexLayout<
+    Stream<0, Position,
+        VS_ATTRIBUTE(Position, x, F32, 3)>,
+    InstanceStream<1, Placement,
+        VS_ATTRIBUTE(Placement, offset, F32, 2),
+        VS_ATTRIBUTE(Placement, color, U8N, 4),
+        VS_ATTRIBUTE(Placement, slot, U16, 1)>
+> PlacementLayout;
+
+static void
+check_layouts()
+{
+    ShaderProgram program(nullptr, nullptr, (const SceGxmProgram *)vertexProgram.data(),
+            (const SceGxmProgram *)fragmentProgram.data());
+
+    static const unsigned sizes[] = { 1, 1, 1, 1, 2, 2, 2, 2, 2, 4, 4 };
+    bool sized = true;
+    for (unsigned format=SCE_GXM_ATTRIBUTE_FORMAT_U8; format<=SCE_GXM_ATTRIBUTE_FORMAT_UNTYPED; ++format) {
+        sized &= attribute_format_to_size((SceGxmAttributeFormat)format) == sizes[format];
+    }
+    check(sized, "size of every attribute format");
+
+    static const char *const vertexNames[] = { "aPosition", "aTexCoord", };
+    check(program.set_layout<VertexTraits<Vertex>::Layout>(vertexNames), "Vertex layout complete");
+    check(program.gxmAttributes.size() == 2 && program.gxmStreams.size() == 1 &&
+            same_attribute(program.gxmAttributes[0], 0, 0, SCE_GXM_ATTRIBUTE_FORMAT_F32, 3, 0) &&
+            same_attribute(program.gxmAttributes[1], 0, 12, SCE_GXM_ATTRIBUTE_FORMAT_F32, 2, 4) &&
+            program.gxmStreams[0].stride == 20 && program.gxmStreams[0].indexSource == SCE_GXM_INDEX_SOURCE_INDEX_16BIT,
+            "Vertex layout arrays");
+
+    static const char *const glyphNames[] = { "aPosition", "aTexCoord", "aScale", "aInstance", };
+    check(program.set_layout<VertexTraits<GlyphVertex>::InstancedLayout>(glyphNames), "GlyphVertex layout complete");
+    check(program.gxmAttributes.size() == 4 && program.gxmStreams[0].stride == 12 &&
+            same_attribute(program.gxmAttributes[0], 0, 0, SCE_GXM_ATTRIBUTE_FORMAT_S16, 2, 0) &&
+            same_attribute(program.gxmAttributes[1], 0, 4, SCE_GXM_ATTRIBUTE_FORMAT_U16N, 2, 4) &&
+            same_attribute(program.gxmAttributes[2], 0, 8, SCE_GXM_ATTRIBUTE_FORMAT_F16, 1, 12) &&
+            same_attribute(program.gxmAttributes[3], 0, 10, SCE_GXM_ATTRIBUTE_FORMAT_U16, 1, 16),
+            "GlyphVertex layout arrays");
+
+    static const char *const placementNames[] = { "aPosition", "aOffset", "aColor", "aInstance", };
+    check(program.set_layout<PlacementLayout>(placementNames), "two-stream layout complete");
+    check(program.gxmAttributes.size() == 4 && program.gxmStreams.size() == 2 &&
+            same_attribute(program.gxmAttributes[0], 0, 0, SCE_GXM_ATTRIBUTE_FORMAT_F32, 3, 0) &&
+            same_attribute(program.gxmAttributes[1], 1, 0, SCE_GXM_ATTRIBUTE_FORMAT_F32, 2, 20) &&
+            same_attribute(program.gxmAttributes[2], 1, 8, SCE_GXM_ATTRIBUTE_FORMAT_U8N, 4, 8) &&
+            same_attribute(program.gxmAttributes[3], 1, 12, SCE_GXM_ATTRIBUTE_FORMAT_U16, 1, 16) &&
+            program.gxmStreams[0].stride == sizeof(Position) &&
+            program.gxmStreams[0].indexSource == SCE_GXM_INDEX_SOURCE_INDEX_16BIT &&
+            program.gxmStreams[1].stride == sizeof(Placement) &&
+            program.gxmStreams[1].indexSource == SCE_GXM_INDEX_SOURCE_INSTANCE_16BIT,
+            "two-stream layout arrays");
+    uint64_t placementHash = program.layoutHash;
+
+    // aInstance as in a variant without INSTANCE_PARAMS
+    static const char *const missingNames[] = { "aPosition", "aOffset", "aColor", "aMissing", };
+    check(!program.set_layout<PlacementLayout>(missingNames), "missing attribute reported");
+    check(program.gxmAttributes.size() == 3 && program.gxmStreams.size() == 2 &&
+            same_attribute(program.gxmAttributes[2], 1, 8, SCE_GXM_ATTRIBUTE_FORMAT_U8N, 4, 8) &&
+            program.layoutHash != placementHash, "missing attribute dropped, the rest kept");
+
+    // One attribute of each format through build_layout(), which aligns
+    // each to its component size
+    program.attributes.clear();
+    for (unsigned format=SCE_GXM_ATTRIBUTE_FORMAT_U8; format<=SCE_GXM_ATTRIBUTE_FORMAT_UNTYPED; ++format) {
+        program.add_attribute(format % 2 ? "aColor" : "aOffset", 1 + format % 3, (SceGxmAttributeFormat)format);
+    }
+    program.build_layout();
+    bool placed = program.gxmAttributes.size() == 11;
+    uint16_t offset = 0;
+    for (unsigned format=0; placed && format<11; ++format) {
+        unsigned size = sizes[format];
+        offset = (offset + size - 1) & ~(size - 1);
+        placed &= same_attribute(program.gxmAttributes[format], 0, offset, (SceGxmAttributeFormat)format,
+                1 + format % 3, format % 2 ? 8 : 20);
+        offset += (1 + format % 3) * size;
+    }
+    check(placed, "every format placed at its component alignment");
+    check(program.gxmStreams.size() == 1 && program.gxmStreams[0].stride == ((offset + 3) & ~3),
+            "stride rounded up to 4 bytes");
+
+    // A missing attribute keeps its bytes in the vertex
+    program.attributes.clear();
+    program.add_attribute("aPosition", 3, SCE_GXM_ATTRIBUTE_FORMAT_F32);
+    program.add_attribute("aMissing", 4, SCE_GXM_ATTRIBUTE_FORMAT_U8N);
+    program.add_attribute("aTexCoord", 2, SCE_GXM_ATTRIBUTE_FORMAT_F32);
+    program.build_layout();
+    check(program.gxmAttributes.size() == 2 &&
+            same_attribute(program.gxmAttributes[1], 0, 16, SCE_GXM_ATTRIBUTE_FORMAT_F32, 2, 4) &&
+            program.gxmStreams[0].stride == 24, "missing attribute skipped in place");
+
+    printf("layouts: %u attribute formats, two-stream layout of %u and %u bytes\n",
+            (unsigned)(sizeof(sizes) / sizeof(sizes[0])), (unsigned)sizeof(Position), (unsigned)sizeof(Placement));
+}
+
+static void
+add_sphere_layout(ShaderProgram &program, bool color)
+{
+    program.attributes.clear();
+    program.add_attribute("aPosition", 3, SCE_GXM_ATTRIBUTE_FORMAT_F32);
+    program.add_attribute("aTexCoord", 2, SCE_GXM_ATTRIBUTE_FORMAT_F32);
+    if (color) {
+        program.add_attribute("aColor", 4, SCE_GXM_ATTRIBUTE_FORMAT_U8N);
+    }
+}
+
+static void
+check_program_cache()
+{
+    ShaderProgram program(nullptr, nullptr, (const SceGxmProgram *)vertexProgram.data(),
+            (const SceGxmProgram *)fragmentProgram.data());
+
+    static const SceGxmBlendInfo alpha = {
+        SCE_GXM_COLOR_MASK_ALL, SCE_GXM_BLEND_FUNC_ADD, SCE_GXM_BLEND_FUNC_ADD,
+        SCE_GXM_BLEND_FACTOR_SRC_ALPHA, SCE_GXM_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+        SCE_GXM_BLEND_FACTOR_SRC_ALPHA, SCE_GXM_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+    };
+    SceGxmBlendInfo additive = alpha;
+    additive.colorDst = SCE_GXM_BLEND_FACTOR_ONE;
+    SceGxmBlendInfo alphaCopy = alpha;
+
+    HostGxm &gxm = host_gxm();
+    unsigned created = gxm.vertexProgramsCreated;
+    unsigned hits = 0, misses = 0;
+    bool counted = true;
+    auto get = [&](SceGxmMultisampleMode msaa, const SceGxmBlendInfo *blend, SceGxmOutputRegisterFormat format,
+            bool hit) -> PatchedProgram * {
+        PatchedProgram *patched = program.get(msaa, blend, format);
+        hits += hit;
+        misses += !hit;
+        counted &= program.cacheHits == hits && program.cacheMisses == misses;
+        return patched;
+    };
+
+    const SceGxmMultisampleMode none = SCE_GXM_MULTISAMPLE_NONE, msaa4x = SCE_GXM_MULTISAMPLE_4X;
+    const SceGxmOutputRegisterFormat uchar4 = SCE_GXM_OUTPUT_REGISTER_FORMAT_UCHAR4;
+    const SceGxmOutputRegisterFormat half4 = SCE_GXM_OUTPUT_REGISTER_FORMAT_HALF4;
+
+    add_sphere_layout(program, false);
+    PatchedProgram *first = get(none, nullptr, uchar4, false);
+    check(get(none, nullptr, uchar4, true) == first, "repeated key returns the cached program");
+    check(get(msaa4x, nullptr, uchar4, false) != first, "MSAA mode is part of the key");
+    get(msaa4x, nullptr, uchar4, true);
+    PatchedProgram *blended = get(none, &alpha, uchar4, false);
+    check(blended != first, "blend state is part of the key");
+    check(get(none, &alphaCopy, uchar4, true) == blended, "blend state compared by value");
+    check(get(none, &additive, uchar4, false) != blended, "blend factors are part of the key");
+    check(get(none, &alpha, half4, false) != blended, "output format is part of the key");
+    get(none, &alpha, half4, true);
+
+    add_sphere_layout(program, true);
+    check(get(none, nullptr, uchar4, false) != first, "layout is part of the key");
+    add_sphere_layout(program, false);
+    check(get(none, nullptr, uchar4, true) == first, "rebuilt layout finds its programs again");
+    check(counted, "cacheHits and cacheMisses follow each get()");
+    check(gxm.vertexProgramsCreated - created == misses, "one patch per miss");
+
+    // A different layout under the same hash, as a collision would give
+    program.get(none, nullptr, uchar4);
+    uint64_t layoutHash = program.layoutHash;
+    program.gxmAttributes[1].offset += 4;
+    program.gxmStreams[0].stride += 4;
+    misses = program.cacheMisses;
+    PatchedProgram *collided = program.get(none, nullptr, uchar4);
+    check(program.layoutHash == layoutHash && program.cacheMisses == misses + 1 && collided != first,
+            "layouts with colliding hashes are patched apart");
+    program.gxmAttributes[1].offset -= 4;
+    program.gxmStreams[0].stride -= 4;
+    check(program.get(none, nullptr, uchar4) == first, "original layout still hits after a collision");
+
+    // The fragment half fails once, then the vertex half; then it works
+    SceGxmBlendInfo subtractive = alpha;
+    subtractive.colorFunc = SCE_GXM_BLEND_FUNC_REVERSE_SUBTRACT;
+    size_t cached = program.programCache.size();
+    unsigned vertexReleased = gxm.vertexProgramsReleased;
+    misses = program.cacheMisses;
+    gxm.failFragmentPrograms = 1;
+    check(!program.get(none, &subtractive, uchar4) && program.cacheFailures == 1,
+            "failed fragment patch gives nullptr");
+    check(gxm.vertexProgramsReleased == vertexReleased + 1, "vertex half of a failed patch released");
+    gxm.failVertexPrograms = 1;
+    check(!program.get(none, &subtractive, uchar4) && program.cacheFailures == 2,
+            "failed vertex patch gives nullptr");
+    check(program.programCache.size() == cached && program.cacheMisses == misses, "failures not cached");
+    PatchedProgram *patched = program.get(none, &subtractive, uchar4);
+    check(patched && patched->valid() && program.cacheMisses == misses + 1, "next get() after a failure patches");
+
+    gxm.failFragmentPrograms = 1;
+    PatchedProgram unpatched = program.create(none, nullptr, uchar4);
+    check(!unpatched.vertexProgram && !unpatched.fragmentProgram, "failed create() gives null programs");
+
+    printf("program cache: %u hits, %u misses, %u failures, %u patched programs\n", program.cacheHits,
+            program.cacheMisses, program.cacheFailures, (unsigned)program.programCache.size());
+}
+
+static void
+check_uniform_block(unsigned frames)
+{
+    ShaderProgram program(nullptr, nullptr, (const SceGxmProgram *)vertexProgram.data(),
+            (const SceGxmProgram *)fragmentProgram.data());
+
+    UniformBlock block(program);
+    UniformBlock::Handle uTransform = block.add_vertex("uTransform", 4);
+    UniformBlock::Handle uProjection = block.add_vertex("uProjection", 16);
+    UniformBlock::Handle uOutline = block.add_fragment("uOutline", 4);
+
+    // As for uShadowOffset in a variant without SHADOW
+    UniformBlock::Handle uMissing = block.add_fragment("uMissing", 2);
+    check(uMissing == UniformBlock::INVALID && block.uniforms.size() == 3, "unknown uniform gets no slot");
+
+    float values[16] = {};
+    float outline[4] = {};
+    block.set_float(uMissing, values, 2);
+
+    HostGxm &gxm = host_gxm();
+    unsigned reserves = gxm.uniformReserves;
+    block.flush();
+    check(gxm.uniformReserves - reserves == 2 && block.reserves == 2, "first flush reserves both stages");
+    check(block.bytesWritten == (4 + 16 + 4) * sizeof(float), "first flush writes every uniform");
+
+    values[0] = 2.f;
+    block.set_float(uTransform, values, 4);
+    block.set_float(uProjection, values, 16);
+    block.flush();
+    check(gxm.uniformBuffer[4] == 2.f, "vertex values land at their resource index");
+
+    // Frame i changes the vertex stage if bit 0 is set, the fragment stage
+    // if bit 1 is, and sets the rest again unchanged
+    unsigned expectedReserves = 0, expectedBytes = 0;
+    bool eachFrame = true;
+    reserves = block.reserves;
+    unsigned bytes = block.bytesWritten, hostReserves = gxm.uniformReserves;
+    for (unsigned i=0; i<frames; ++i) {
+        unsigned frameReserves = block.reserves, frameBytes = block.bytesWritten;
+        bool vertex = i & 1, fragment = i & 2;
+
+        values[1] += vertex ? 1.f : 0.f;
+        outline[0] += fragment ? 1.f : 0.f;
+        block.set_float(uTransform, values, 4);
+        block.set_float(uProjection, values, 16);
+        block.set_float(uOutline, outline, 4);
+        block.set_float(uMissing, values, 2);
+        block.flush();
+
+        unsigned wantReserves = vertex + fragment;
+        unsigned wantBytes = ((vertex ? 4 + 16 : 0) + (fragment ? 4 : 0)) * sizeof(float);
+        eachFrame &= block.reserves - frameReserves == wantReserves && block.bytesWritten - frameBytes == wantBytes;
+        expectedReserves += wantReserves;
+        expectedBytes += wantBytes;
+    }
+    check(eachFrame, "one reserve per changed stage each frame, none for unchanged ones");
+    check(block.reserves - reserves == expectedReserves && gxm.uniformReserves - hostReserves == expectedReserves,
+            "reserves counted by the block match the driver's");
+    check(block.bytesWritten - bytes == expectedBytes, "only changed stages are written");
+
+    reserves = block.reserves;
+    block.flush();
+    block.flush();
+    check(block.reserves == reserves, "flush with nothing changed reserves nothing");
+    block.invalidate();
+    block.flush();
+    check(block.reserves - reserves == 2, "invalidate() reserves both stages again");
+
+    printf("uniform block: %u frames, %u reserves and %u bytes, where a reserve per stage and frame is %u\n",
+            frames, expectedReserves, expectedBytes, frames * 2);
+}
+
+int
+main(int argc, char *argv[])
+{
+    unsigned frames = argc > 1 ? strtoul(argv[1], nullptr, 0) : 1000;
+    if (frames == 0) {
+        fprintf(stderr, "Usage: %s [frames]\n", argv[0]);
+        return 1;
+    }
+
+    check_layouts();
+    check_program_cache();
+    check_uniform_block(frames);
+
+    if (!failures) {
+        printf("\nshader program: ok\n");
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,103 @@
+// Checks the vector quad expansion of quadgen.h against the scalar reference
+// and times both. Exits non-zero if any output word differs.
+//
+//   quadbench [quads] [iterations]
+
+#include "quadgen.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+using namespace vitashader;
+
+typedef void (*ExpandFunc)(const QuadSource *, size_t, float, float, float, float, Vertex *);
+
+static float
+random_float(float lo, float hi)
+{
+    return lo + (hi - lo) * (rand() / (float)RAND_MAX);
+}
+
+static double
+time_kernel(ExpandFunc func, const std::vector<QuadSource> &quads, std::vector<Vertex> &out, int iterations)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i=0; i<iterations; ++i) {
+        func(quads.data(), quads.size(), 12.5f + i, 40.25f, 1.75f, 1.75f, out.data());
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::nano>(end - start).count() / ((double)iterations * quads.size());
+}
+
+int
+main(int argc, char *argv[])
+{
+    size_t count = (argc > 1) ? strtoul(argv[1], nullptr, 0) : 4096;
+    int iterations = (argc > 2) ? atoi(argv[2]) : 2000;
+    if (count == 0 || iterations <= 0) {
+        fprintf(stderr, "Usage: %s [quads] [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    srand(1);
+    std::vector<QuadSource> quads(count);
+    for (auto &q: quads) {
+        q.x0 = random_float(-2000.f, 2000.f);
+        q.y0 = random_float(-2000.f, 2000.f);
+        q.x1 = q.x0 + random_float(0.f, 64.f);
+        q.y1 = q.y0 + random_float(0.f, 64.f);
+        q.s0 = random_float(0.f, 1.f);
+        q.t0 = random_float(0.f, 1.f);
+        q.s1 = random_float(0.f, 1.f);
+        q.t1 = random_float(0.f, 1.f);
+    }
+
+    std::vector<Vertex> reference(count * 4);
+    std::vector<Vertex> result(count * 4);
+
+    // Odd origins and scales so rounding of the multiply-add is exercised
+    const float params[][4] = {
+        {0.f, 0.f, 1.f, 1.f},
+        {17.3f, -4.7f, 0.333f, 0.333f},
+        {-1e5f, 3e-3f, 123.456f, 2.f},
+    };
+
+    for (auto &p: params) {
+        expand_quads_scalar(quads.data(), count, p[0], p[1], p[2], p[3], reference.data());
+        memset(result.data(), 0xAA, result.size() * sizeof(Vertex));
+        expand_quads(quads.data(), count, p[0], p[1], p[2], p[3], result.data());
+
+        if (memcmp(reference.data(), result.data(), reference.size() * sizeof(Vertex)) != 0) {
+            const float *a = (const float *)reference.data();
+            const float *b = (const float *)result.data();
+            size_t i = 0;
+            while (memcmp(&a[i], &b[i], sizeof(float)) == 0) {
+                ++i;
+            }
+            fprintf(stderr, "Mismatch at quad %u float %u: %g != %g\n",
+                    (unsigned)(i / 20), (unsigned)(i % 20), b[i], a[i]);
+            return 1;
+        }
+    }
+
+#if defined(VS_QUADGEN_NEON)
+    const char *kernel = "neon";
+#elif defined(VS_QUADGEN_SSE)
+    const char *kernel = "sse";
+#else
+    const char *kernel = "scalar";
+#endif
+
+    double scalarNs = time_kernel(expand_quads_scalar, quads, result, iterations);
+    double vectorNs = time_kernel(expand_quads, quads, result, iterations);
+
+    printf("bit exact: yes\n");
+    printf("scalar: %.3f ns/quad\n", scalarNs);
+    printf("%s: %.3f ns/quad (%.2fx)\n", kernel, vectorNs, scalarNs / vectorNs);
+    return 0;
+}
@@ -0,0 +1,216 @@
+// Checks QuadIndexBuffer (quadindices.h): the index patterns of both modes,
+// growth on demand, and that TextBatch::upload() only writes indices when
+// the buffer grows, not per frame.
+//
+//   quadcheck [frames]
+//
+// Both modes have to give each quad its two triangles over vertices 4k..4k+3
+// with the same winding, the strip joining quads only by degenerate
+// triangles. The frame run draws text of changing length and asserts the
+// bytes written against the growth steps alone.
+
+#include "check.h"
+#include "fakefont.h"
+#include "quadindices.h"
+#include "ringalloc.h"
+#include "textbatch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <array>
+#include <string>
+#include <vector>
+
+using namespace vitashader;
+
+typedef std::array<uint16_t, 3> Triangle;
+
+// Signed area of a triangle over the strip order corners (0,0) (0,1) (1,0)
+// (1,1) of its quad
+static int
+winding(const Triangle &t)
+{
+    static const int x[] = { 0, 0, 1, 1 };
+    static const int y[] = { 0, 1, 0, 1 };
+    int a = t[0] % 4, b = t[1] % 4, c = t[2] % 4;
+    return (x[b] - x[a]) * (y[c] - y[a]) - (x[c] - x[a]) * (y[b] - y[a]);
+}
+
+// Rotated so the smallest index comes first, which keeps the winding
+static Triangle
+canonical(Triangle t)
+{
+    std::rotate(t.begin(), std::min_element(t.begin(), t.end()), t.end());
+    return t;
+}
+
+// The triangles drawn from indices, without degenerate ones; strips flip
+// every other triangle to keep their winding
+static std::vector<Triangle>
+triangles(QuadIndexBuffer::Mode mode, const std::vector<uint16_t> &indices)
+{
+    std::vector<Triangle> result;
+    if (mode == QuadIndexBuffer::TRIANGLES) {
+        for (size_t i=0; i + 2<indices.size(); i+=3) {
+            result.push_back(canonical(Triangle{{indices[i], indices[i + 1], indices[i + 2]}}));
+        }
+        return result;
+    }
+
+    for (size_t i=0; i + 2<indices.size(); ++i) {
+        Triangle t = {{indices[i], indices[i + 1], indices[i + 2]}};
+        if (t[0] == t[1] || t[1] == t[2] || t[0] == t[2]) {
+            continue;
+        }
+        if (i % 2) {
+            std::swap(t[1], t[2]);
+        }
+        result.push_back(canonical(t));
+    }
+    return result;
+}
+
+static void
+check_pattern(QuadIndexBuffer::Mode mode, uint32_t quads)
+{
+    std::vector<uint16_t> indices(QuadIndexBuffer::index_count(mode, quads));
+    QuadIndexBuffer::fill(mode, indices.data(), quads);
+
+    std::vector<Triangle> drawn = triangles(mode, indices);
+    std::vector<Triangle> expected;
+    for (uint32_t k=0; k<quads; ++k) {
+        uint16_t base = k * 4;
+        expected.push_back(canonical(Triangle{{(uint16_t)(base + 0), (uint16_t)(base + 1), (uint16_t)(base + 2)}}));
+        expected.push_back(canonical(Triangle{{(uint16_t)(base + 1), (uint16_t)(base + 3), (uint16_t)(base + 2)}}));
+    }
+
+    bool sameWinding = true, ownQuad = true;
+    for (const Triangle &t: drawn) {
+        sameWinding &= winding(t) == winding(expected[0]);
+        ownQuad &= t[0] / 4 == t[1] / 4 && t[1] / 4 == t[2] / 4;
+    }
+
+    char what[96];
+    const char *name = mode == QuadIndexBuffer::TRIANGLES ? "triangles" : "strip";
+    snprintf(what, sizeof(what), "%s: %u quads give 2 triangles each", name, quads);
+    check(drawn == expected, what);
+    snprintf(what, sizeof(what), "%s: %u quads keep one winding", name, quads);
+    check(sameWinding, what);
+    snprintf(what, sizeof(what), "%s: %u quads share no triangle", name, quads);
+    check(ownQuad, what);
+}
+
+static void
+check_patterns()
+{
+    check(QuadIndexBuffer::index_count(QuadIndexBuffer::TRIANGLES, 0) == 0 &&
+            QuadIndexBuffer::index_count(QuadIndexBuffer::STRIP, 0) == 0, "no quads, no indices");
+    check(QuadIndexBuffer::index_count(QuadIndexBuffer::TRIANGLES, 5) == 30 &&
+            QuadIndexBuffer::index_count(QuadIndexBuffer::STRIP, 5) == 28, "index counts");
+
+    std::vector<uint16_t> two(QuadIndexBuffer::index_count(QuadIndexBuffer::STRIP, 2));
+    QuadIndexBuffer::fill(QuadIndexBuffer::STRIP, two.data(), 2);
+    static const uint16_t stripOfTwo[] = { 0, 1, 2, 3, 3, 4, 4, 5, 6, 7 };
+    check(std::equal(two.begin(), two.end(), stripOfTwo), "strip of two quads joined by degenerates");
+
+    for (uint32_t quads: {1u, 2u, 3u, 17u, 256u, QuadIndexBuffer::MAX_QUADS}) {
+        check_pattern(QuadIndexBuffer::TRIANGLES, quads);
+        check_pattern(QuadIndexBuffer::STRIP, quads);
+    }
+}
+
+static void
+check_growth()
+{
+    QuadIndexBuffer quads(QuadIndexBuffer::STRIP);
+    check(quads.capacity == 0 && !quads.indices && quads.reserve(0) && quads.rebuilds == 0, "nothing reserved");
+
+    check(quads.reserve(10) && quads.capacity == 256 && quads.rebuilds == 1, "first reserve gives 256 quads");
+    uint16_t *first = quads.indices;
+    check(quads.reserve(256) && quads.indices == first && quads.rebuilds == 1, "reserve within capacity keeps it");
+    check(quads.bytesWritten == QuadIndexBuffer::index_count(QuadIndexBuffer::STRIP, 256) * sizeof(uint16_t),
+            "bytes written for 256 quads");
+
+    check(quads.reserve(257) && quads.capacity == 512 && quads.rebuilds == 2 && quads.indices != first,
+            "growth doubles");
+    check(quads.retired.size() == 1 && quads.retired[0].memory == first, "replaced buffer kept for the GPU");
+    check(quads.reserve(3000) && quads.capacity == 4096 && quads.rebuilds == 3, "growth by several doublings at once");
+
+    std::vector<uint16_t> expected(quads.count(4096));
+    QuadIndexBuffer::fill(quads.mode, expected.data(), 4096);
+    check(std::equal(expected.begin(), expected.end(), quads.indices), "grown buffer holds the pattern");
+
+    check(quads.reserve(QuadIndexBuffer::MAX_QUADS) && quads.capacity == QuadIndexBuffer::MAX_QUADS,
+            "growth up to MAX_QUADS");
+    check(!quads.reserve(QuadIndexBuffer::MAX_QUADS + 1) && quads.capacity == QuadIndexBuffer::MAX_QUADS,
+            "more than 16-bit indices can address refused");
+}
+
+static void
+check_frames(unsigned frames)
+{
+    Font font;
+    make_font(font);
+
+    std::vector<uint8_t> memory(1024 * 1024);
+    RingAllocator ring(memory.data(), memory.size());
+    QuadIndexBuffer quads;
+    TextBatch batch;
+
+    // Text that grows to 900 glyphs over the first frames, then varies below
+    std::string text;
+    size_t expectedBytes = 0;
+    uint32_t capacity = 0;
+    bool uploaded = true, writesOnGrowth = true;
+    for (unsigned f=0; f<frames; ++f) {
+        size_t length = f < 30 ? (f + 1) * 30 : 300 + (f * 7919) % 600;
+        text.assign(length, 'a' + f % 26);
+
+        ring.retire(f - 2);
+        ring.begin_frame(f);
+        batch.clear();
+        batch.add(font, text.c_str(), 0.f, 20.f, 1.f);
+        size_t before = quads.bytesWritten;
+        bool grows = batch.glyph_count() > capacity;
+        uploaded &= batch.upload(ring, quads) != nullptr;
+        ring.end_frame();
+
+        if (grows) {
+            while (capacity < batch.glyph_count()) {
+                capacity = capacity ? capacity * 2 : 256;
+            }
+            expectedBytes += quads.count(capacity) * sizeof(uint16_t);
+        }
+        writesOnGrowth &= (quads.bytesWritten != before) == grows;
+    }
+
+    check(uploaded, "every frame uploads");
+    check(quads.capacity == 1024 && quads.rebuilds == 3, "grew to the longest text only");
+    check(quads.bytesWritten == expectedBytes, "indices written only when the buffer grows");
+    check(writesOnGrowth, "no index writes in frames that fit");
+
+    printf("%u frames: %u index buffer rebuilds, %u bytes written, where rewriting per frame is %u\n", frames,
+            quads.rebuilds, (unsigned)quads.bytesWritten,
+            (unsigned)(frames * quads.count(quads.capacity) * sizeof(uint16_t)));
+}
+
+int
+main(int argc, char *argv[])
+{
+    unsigned frames = argc > 1 ? strtoul(argv[1], nullptr, 0) : 1000;
+    if (frames < 30) {
+        fprintf(stderr, "Usage: %s [frames], at least 30\n", argv[0]);
+        return 1;
+    }
+
+    check_patterns();
+    check_growth();
+    check_frames(frames);
+
+    if (!failures) {
+        printf("\nquad indices: ok\n");
+    }
+    return failures ? 1 : 0;
+}
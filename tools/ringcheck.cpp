@@ -0,0 +1,200 @@
+// Checks the bookkeeping of RingAllocator (ringalloc.h) against a simulated
+// GPU that signals fences a random number of frames late.
+//
+//   ringcheck [frames] [seed]
+//
+// Every allocation is recorded with the fence of its frame until that fence
+// is retired; no allocation may overlap one that is still live, leave the
+// block or miss its alignment, and the byte counts have to add up. Frames
+// that allocate nothing are mixed in, as a skipped text batch produces them.
+
+#include "check.h"
+#include "ringalloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <vector>
+
+using namespace vitashader;
+
+static size_t
+offset_of(const RingAllocator &ring, const void *p)
+{
+    return (const uint8_t *)p - ring.base;
+}
+
+static void
+check_basics()
+{
+    static uint8_t memory[1000];
+    RingAllocator ring(memory, sizeof(memory));
+
+    check(ring.alloc(16, 4) == nullptr, "no allocations outside a frame");
+    check(ring.begin_frame(1) && !ring.begin_frame(2), "frames do not nest");
+
+    void *a = ring.alloc(3, 1);
+    void *b = ring.alloc(8, 16);
+    check(a && b && offset_of(ring, a) == 0 && offset_of(ring, b) == 16, "alignment");
+    check(ring.alloc(1000, 1) == nullptr && ring.failedAllocs == 1, "too large for what is left");
+    ring.end_frame();
+    check(ring.frameBytes == 24 && ring.used == 24 && ring.frames_in_flight() == 1, "frame bytes include padding");
+
+    ring.retire(0);
+    check(ring.frames_in_flight() == 1, "frame kept until its fence");
+    ring.retire(1);
+    check(ring.frames_in_flight() == 0 && ring.used == 0, "frame retired at its fence");
+
+    for (uint32_t fence=2; fence<2 + RingAllocator::MAX_FRAMES; ++fence) {
+        ring.begin_frame(fence);
+        ring.end_frame();
+    }
+    check(!ring.begin_frame(100), "at most MAX_FRAMES in flight");
+    ring.retire(2 + RingAllocator::MAX_FRAMES);
+    check(ring.frames_in_flight() == 0, "empty frames retire too");
+
+    // Fences compare across the 32-bit wrap
+    ring.begin_frame(0xFFFFFFFFu);
+    ring.alloc(10, 1);
+    ring.end_frame();
+    ring.retire(0xFFFFFFFEu);
+    check(ring.frames_in_flight() == 1, "fence before the wrap still pending");
+    ring.retire(1);
+    check(ring.frames_in_flight() == 0, "fence after the wrap retires");
+}
+
+// An empty frame still in flight when the ring rewinds used to keep its old
+// end offset, which moved tail back over memory handed out since
+static void
+check_empty_frame_rewind()
+{
+    static uint8_t memory[1000];
+    RingAllocator ring(memory, sizeof(memory));
+
+    ring.begin_frame(1);
+    ring.alloc(200, 1);
+    ring.end_frame();
+    ring.begin_frame(2);
+    ring.end_frame();
+    ring.retire(1);
+
+    ring.begin_frame(3);
+    void *frame3 = ring.alloc(800, 1);
+    ring.end_frame();
+    ring.retire(2);
+
+    ring.begin_frame(4);
+    void *first = ring.alloc(150, 1);
+    void *second = ring.alloc(150, 1);
+    ring.end_frame();
+
+    check(frame3 && offset_of(ring, frame3) == 0, "rewound when nothing is live");
+    size_t end3 = offset_of(ring, frame3) + 800;
+    check(!first || offset_of(ring, first) >= end3, "no overlap with a live frame after an empty frame retires");
+    check(!second || offset_of(ring, second) >= end3, "no overlap with a live frame after a wrap");
+}
+
+struct Live {
+    uint32_t fence;
+    size_t start;
+    size_t end;
+};
+
+static void
+check_simulation(unsigned frames, unsigned seed)
+{
+    std::vector<uint8_t> memory(64 * 1024);
+    RingAllocator ring(memory.data(), memory.size());
+    std::mt19937 random(seed);
+
+    // Fences start close to the wrap so the simulation crosses it
+    uint32_t fence = 0xFFFFFF00u;
+    uint32_t completed = fence - 1;
+    std::deque<Live> live;
+    size_t allocations = 0, failed = 0, empty = 0, maxLive = 0;
+    bool overlap = false, outside = false, misaligned = false, accounting = true, lost = false;
+
+    for (unsigned f=0; f<frames; ++f) {
+        // The GPU finishes anything from 0 to all pending frames
+        unsigned pending = fence - 1 - completed;
+        completed += pending ? random() % (pending + 1) : 0;
+        ring.retire(completed);
+        while (!live.empty() && (int32_t)(completed - live.front().fence) >= 0) {
+            live.pop_front();
+        }
+        if (ring.frames_in_flight() == RingAllocator::MAX_FRAMES) {
+            completed = fence - 1;
+            ring.retire(completed);
+            live.clear();
+        }
+
+        check(ring.begin_frame(fence), "begin_frame");
+        unsigned count = random() % 5 == 0 ? 0 : 1 + random() % 6;
+        empty += count == 0;
+        for (unsigned i=0; i<count; ++i) {
+            size_t size = 1 + random() % (memory.size() / 6);
+            size_t alignment = (size_t)1 << (random() % 5);
+            bool wasEmpty = ring.used == 0;
+            uint8_t *p = (uint8_t *)ring.alloc(size, alignment);
+            ++allocations;
+            if (!p) {
+                ++failed;
+                lost |= wasEmpty;
+                continue;
+            }
+
+            Live a = {fence, offset_of(ring, p), offset_of(ring, p) + size};
+            outside |= a.end > memory.size();
+            misaligned |= a.start % alignment != 0;
+            for (const Live &other: live) {
+                overlap |= a.start < other.end && other.start < a.end;
+            }
+            live.push_back(a);
+        }
+        ring.end_frame();
+        ++fence;
+
+        size_t bytes = 0;
+        for (const Live &a: live) {
+            bytes += a.end - a.start;
+        }
+        maxLive = std::max(maxLive, bytes);
+        accounting &= ring.used >= bytes && ring.used <= memory.size() && ring.usedHighWater >= ring.used &&
+            ring.frameHighWater >= ring.frameBytes;
+    }
+
+    check(!overlap, "allocations never overlap live ones");
+    check(!outside, "allocations stay in the block");
+    check(!misaligned, "allocations are aligned");
+    check(accounting, "used covers live bytes and high-water marks hold");
+    check(!lost, "an empty ring fits any allocation up to its capacity");
+    check(ring.failedAllocs == failed, "failed allocations counted");
+
+    printf("%u frames (%u empty), %u allocations, %u failed for lack of room\n", frames, (unsigned)empty,
+            (unsigned)allocations, (unsigned)failed);
+    printf("high water: %u bytes in one frame, %u bytes in flight (%u live at most)\n",
+            (unsigned)ring.frameHighWater, (unsigned)ring.usedHighWater, (unsigned)maxLive);
+}
+
+int
+main(int argc, char *argv[])
+{
+    unsigned frames = argc > 1 ? strtoul(argv[1], nullptr, 0) : 100000;
+    unsigned seed = argc > 2 ? strtoul(argv[2], nullptr, 0) : 1;
+    if (frames == 0) {
+        fprintf(stderr, "Usage: %s [frames] [seed]\n", argv[0]);
+        return 1;
+    }
+
+    check_basics();
+    check_empty_frame_rewind();
+    check_simulation(frames, seed);
+
+    if (!failures) {
+        printf("\nring allocator: ok\n");
+    }
+    return failures ? 1 : 0;
+}
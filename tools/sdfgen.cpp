@@ -0,0 +1,450 @@
+// Generates a signed distance field font atlas (see sdffont.h) with FreeType.
+// Glyphs are rendered at upscale times the size, turned into an exact
+// Euclidean distance transform and sampled down to texels. The written file
+// is loaded back through SdfAtlas and checked: the 0.5 contour of the
+// bilinearly filtered field has to reproduce the high resolution outline
+// away from the edge, and neighbouring texels may not differ by more than
+// their distance allows.
+//
+//   sdfgen [-s size] [-r spread] [-w width] [-u upscale] [-c first count] font.ttf out.sdf
+
+#include "sdffont.h"
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+using namespace vitashader;
+
+static const float INF = 1e20f;
+
+struct Options {
+    int size;
+    int spread;
+    int width;
+    int upscale;
+    int first;
+    int count;
+};
+
+// A rendered glyph before packing, in texels
+struct Cell {
+    SdfGlyph glyph;
+    std::vector<uint8_t> texels;
+
+    // Per high resolution pixel: bit 0 inside the outline, bit 1 more than
+    // a texel away from it
+    std::vector<uint8_t> mask;
+};
+
+// Squared distance transform of a sampled function in one dimension
+// (Felzenszwalb and Huttenlocher), d[q] = min over p of (q - p)^2 + f[p]
+static void
+edt_1d(const float *f, int n, float *d, int *v, float *z)
+{
+    int k = 0;
+    v[0] = 0;
+    z[0] = -INF;
+    z[1] = INF;
+
+    for (int q=1; q<n; ++q) {
+        float s;
+        for (;;) {
+            int p = v[k];
+            s = ((f[q] + q * q) - (f[p] + p * p)) / (2.f * (q - p));
+            if (s > z[k] || k == 0) {
+                break;
+            }
+            --k;
+        }
+        if (s <= z[k]) {
+            // k == 0 and the new parabola is below everywhere
+            v[0] = q;
+            z[1] = INF;
+            continue;
+        }
+        ++k;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = INF;
+    }
+
+    k = 0;
+    for (int q=0; q<n; ++q) {
+        while (z[k + 1] < q) {
+            ++k;
+        }
+        float dq = q - v[k];
+        d[q] = dq * dq + f[v[k]];
+    }
+}
+
+// In place, over columns then rows
+static void
+edt_2d(std::vector<float> &grid, int width, int height)
+{
+    int n = std::max(width, height);
+    std::vector<float> f(n), d(n), z(n + 1);
+    std::vector<int> v(n);
+
+    for (int x=0; x<width; ++x) {
+        for (int y=0; y<height; ++y) {
+            f[y] = grid[y * width + x];
+        }
+        edt_1d(f.data(), height, d.data(), v.data(), z.data());
+        for (int y=0; y<height; ++y) {
+            grid[y * width + x] = d[y];
+        }
+    }
+
+    for (int y=0; y<height; ++y) {
+        edt_1d(&grid[y * width], width, d.data(), v.data(), z.data());
+        memcpy(&grid[y * width], d.data(), width * sizeof(float));
+    }
+}
+
+static int
+floor_div(int a, int b)
+{
+    return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+static int
+ceil_div(int a, int b)
+{
+    return -floor_div(-a, b);
+}
+
+static bool
+render_cell(FT_Face face, uint32_t codepoint, const Options &opt, int ascent, Cell &cell)
+{
+    if (FT_Load_Char(face, codepoint, FT_LOAD_RENDER | FT_LOAD_NO_HINTING) != 0) {
+        return false;
+    }
+
+    const int u = opt.upscale;
+    const FT_GlyphSlot slot = face->glyph;
+    const FT_Bitmap &bitmap = slot->bitmap;
+
+    memset(&cell.glyph, 0, sizeof(cell.glyph));
+    cell.glyph.advance = (int32_t)lround(slot->advance.x / (double)u);
+
+    if (bitmap.width == 0 || bitmap.rows == 0) {
+        return true;
+    }
+
+    // Texel rect around the bitmap, relative to the pen on the baseline
+    int bx = slot->bitmap_left;
+    int by = -slot->bitmap_top;
+    int x0 = floor_div(bx, u) - opt.spread;
+    int y0 = floor_div(by, u) - opt.spread;
+    int x1 = ceil_div(bx + (int)bitmap.width, u) + opt.spread;
+    int y1 = ceil_div(by + (int)bitmap.rows, u) + opt.spread;
+
+    int tw = x1 - x0;
+    int th = y1 - y0;
+    int gw = tw * u;
+    int gh = th * u;
+
+    std::vector<float> toInside(gw * gh);
+    std::vector<float> toOutside(gw * gh);
+    for (int gy=0; gy<gh; ++gy) {
+        for (int gx=0; gx<gw; ++gx) {
+            int px = gx + x0 * u - bx;
+            int py = gy + y0 * u - by;
+            bool inside = px >= 0 && py >= 0 && px < (int)bitmap.width && py < (int)bitmap.rows &&
+                bitmap.buffer[py * bitmap.pitch + px] >= 128;
+            toInside[gy * gw + gx] = inside ? 0.f : INF;
+            toOutside[gy * gw + gx] = inside ? INF : 0.f;
+        }
+    }
+
+    edt_2d(toInside, gw, gh);
+    edt_2d(toOutside, gw, gh);
+
+    // Signed distance of each pixel center to the outline, which runs half a
+    // pixel from the nearest center on the other side
+    std::vector<float> dist(gw * gh);
+    cell.mask.resize(gw * gh);
+    for (int i=0; i<gw*gh; ++i) {
+        bool inside = toInside[i] == 0.f;
+        dist[i] = inside ? -(sqrtf(toOutside[i]) - 0.5f) : sqrtf(toInside[i]) - 0.5f;
+        cell.mask[i] = (inside ? 1 : 0) | (fabsf(dist[i]) > u ? 2 : 0);
+    }
+
+    // Texel centers fall between four pixels
+    cell.texels.resize(tw * th);
+    int h = u / 2;
+    for (int ty=0; ty<th; ++ty) {
+        for (int tx=0; tx<tw; ++tx) {
+            const float *p = &dist[(ty * u + h - 1) * gw + tx * u + h - 1];
+            float d = (p[0] + p[1] + p[gw] + p[gw + 1]) * 0.25f / u;
+            float value = 0.5f - d / (2.f * opt.spread);
+            value = std::min(std::max(value, 0.f), 1.f);
+            cell.texels[ty * tw + tx] = (uint8_t)lrintf(value * 255.f);
+        }
+    }
+
+    cell.glyph.width = tw;
+    cell.glyph.height = th;
+    cell.glyph.left = x0;
+    cell.glyph.top = y0 + ascent;
+    return true;
+}
+
+// Shelf packing, tallest first, with a texel between glyphs. Returns the
+// atlas height.
+static int
+pack(std::vector<Cell> &cells, int width)
+{
+    std::vector<Cell *> order;
+    for (auto &cell: cells) {
+        if (cell.glyph.width) {
+            order.push_back(&cell);
+        }
+    }
+    std::stable_sort(order.begin(), order.end(), [](const Cell *a, const Cell *b) {
+        return a->glyph.height > b->glyph.height;
+    });
+
+    int x = 0, y = 0, shelf = 0;
+    for (Cell *cell: order) {
+        if (x + cell->glyph.width > width) {
+            x = 0;
+            y += shelf + 1;
+            shelf = 0;
+        }
+        if (cell->glyph.width > width) {
+            return -1;
+        }
+        cell->glyph.x = x;
+        cell->glyph.y = y;
+        x += cell->glyph.width + 1;
+        shelf = std::max(shelf, (int)cell->glyph.height);
+    }
+    return y + shelf;
+}
+
+static uint32_t
+align(uint32_t offset)
+{
+    return (offset + SDF_ALIGNMENT - 1) & ~(SDF_ALIGNMENT - 1);
+}
+
+static bool
+write_atlas(const char *filename, const SdfHeader &header, const std::vector<Cell> &cells)
+{
+    std::vector<uint8_t> file(header.size, 0);
+    memcpy(&file[0], &header, sizeof(header));
+
+    for (size_t i=0; i<cells.size(); ++i) {
+        const SdfGlyph &g = cells[i].glyph;
+        memcpy(&file[header.glyphsOffset + i * sizeof(SdfGlyph)], &g, sizeof(g));
+        for (int y=0; y<g.height; ++y) {
+            memcpy(&file[header.pixelsOffset + (g.y + y) * header.width + g.x],
+                    &cells[i].texels[y * g.width], g.width);
+        }
+    }
+
+    FILE *fp = fopen(filename, "wb");
+    if (!fp) {
+        return false;
+    }
+    bool ok = fwrite(file.data(), 1, file.size(), fp) == file.size();
+    return (fclose(fp) == 0) && ok;
+}
+
+static float
+sample(const SdfAtlas &atlas, const SdfGlyph &g, float u, float v)
+{
+    u = std::min(std::max(u, 0.f), g.width - 1.f);
+    v = std::min(std::max(v, 0.f), g.height - 1.f);
+    int x = std::min((int)u, g.width - 2);
+    int y = std::min((int)v, g.height - 2);
+    float fx = u - x;
+    float fy = v - y;
+
+    const uint8_t *p = atlas.pixels + (g.y + y) * atlas.header.width + g.x + x;
+    int w = atlas.header.width;
+    float top = p[0] + (p[1] - p[0]) * fx;
+    float bottom = p[w] + (p[w + 1] - p[w]) * fx;
+    return top + (bottom - top) * fy;
+}
+
+struct Validation {
+    size_t samples;
+    size_t mismatches;
+    size_t farMismatches;
+    size_t gradientViolations;
+    int maxStep;
+};
+
+// Compares the atlas as loaded from the file with the masks it was made from
+static Validation
+validate(const SdfAtlas &atlas, const std::vector<Cell> &cells, int upscale)
+{
+    Validation result = {};
+    const int u = upscale;
+    const float limit = 255.f / (2.f * atlas.header.spread) + 1.f;
+
+    for (size_t i=0; i<cells.size(); ++i) {
+        const SdfGlyph &g = atlas.glyphs[i];
+        if (g.width == 0) {
+            continue;
+        }
+
+        int gw = g.width * u;
+        for (int gy=0; gy<g.height*u; ++gy) {
+            for (int gx=0; gx<gw; ++gx) {
+                uint8_t mask = cells[i].mask[gy * gw + gx];
+                float value = sample(atlas, g, (gx + 0.5f) / u - 0.5f, (gy + 0.5f) / u - 0.5f);
+                bool inside = value > 127.5f;
+                if (inside != (bool)(mask & 1)) {
+                    ++result.mismatches;
+                    if (mask & 2) {
+                        ++result.farMismatches;
+                    }
+                }
+                ++result.samples;
+            }
+        }
+
+        for (int y=0; y<g.height; ++y) {
+            const uint8_t *row = atlas.pixels + (g.y + y) * atlas.header.width + g.x;
+            for (int x=0; x<g.width; ++x) {
+                int right = (x + 1 < g.width) ? abs(row[x + 1] - row[x]) : 0;
+                int down = (y + 1 < g.height) ? abs(row[x + atlas.header.width] - row[x]) : 0;
+                int step = std::max(right, down);
+                result.maxStep = std::max(result.maxStep, step);
+                if (step > limit) {
+                    ++result.gradientViolations;
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+static void
+print_sizes(const char *what, int width, int height)
+{
+    printf("  %s %dx%d: U8 %d bytes, RGBA8 %d bytes\n", what, width, height, width * height, width * height * 4);
+}
+
+int
+main(int argc, char *argv[])
+{
+    Options opt = { 32, 4, 512, 8, 32, 95 };
+    const char *args[2];
+    int nargs = 0;
+
+    for (int i=1; i<argc; ++i) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            opt.size = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            opt.spread = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            opt.width = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-u") == 0 && i + 1 < argc) {
+            opt.upscale = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-c") == 0 && i + 2 < argc) {
+            opt.first = atoi(argv[++i]);
+            opt.count = atoi(argv[++i]);
+        } else if (nargs < 2) {
+            args[nargs++] = argv[i];
+        } else {
+            nargs = 0;
+            break;
+        }
+    }
+
+    if (nargs != 2 || opt.size <= 0 || opt.spread <= 0 || opt.first < 0 || opt.count <= 0 ||
+            opt.width <= 0 || opt.width % 8 != 0 || opt.width > 65535 ||
+            opt.upscale < 2 || opt.upscale % 2 != 0) {
+        fprintf(stderr, "Usage: %s [-s size] [-r spread] [-w width] [-u upscale] [-c first count] font.ttf out.sdf\n"
+                "  width has to be a multiple of 8 and upscale even\n", argv[0]);
+        return 1;
+    }
+
+    FT_Library library;
+    FT_Face face;
+    if (FT_Init_FreeType(&library) != 0 || FT_New_Face(library, args[0], 0, &face) != 0) {
+        fprintf(stderr, "%s: cannot load font\n", args[0]);
+        return 1;
+    }
+    FT_Set_Pixel_Sizes(face, 0, opt.size * opt.upscale);
+
+    int ascent = ceil_div((int)face->size->metrics.ascender, 64 * opt.upscale);
+    float lineHeight = face->size->metrics.height / (64.f * opt.upscale);
+
+    std::vector<Cell> cells(opt.count);
+    for (int i=0; i<opt.count; ++i) {
+        if (!render_cell(face, opt.first + i, opt, ascent, cells[i])) {
+            fprintf(stderr, "U+%04X: cannot render\n", opt.first + i);
+            return 1;
+        }
+    }
+
+    FT_Done_Face(face);
+    FT_Done_FreeType(library);
+
+    int height = pack(cells, opt.width);
+    if (height <= 0 || height > 65535) {
+        fprintf(stderr, "Glyphs do not fit a %d texel wide atlas\n", opt.width);
+        return 1;
+    }
+
+    SdfHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SDF_MAGIC;
+    header.version = SDF_VERSION;
+    header.width = opt.width;
+    header.height = height;
+    header.firstChar = opt.first;
+    header.glyphCount = opt.count;
+    header.glyphsOffset = sizeof(SdfHeader);
+    header.pixelsOffset = align(header.glyphsOffset + opt.count * sizeof(SdfGlyph));
+    header.size = header.pixelsOffset + opt.width * height;
+    header.fontSize = opt.size;
+    header.spread = opt.spread;
+    header.lineHeight = lineHeight;
+
+    if (!write_atlas(args[1], header, cells)) {
+        fprintf(stderr, "%s: cannot write\n", args[1]);
+        return 1;
+    }
+
+    SdfAtlas atlas;
+    if (!atlas.open(args[1])) {
+        fprintf(stderr, "%s: cannot load back: %s\n", args[1], atlas.error);
+        return 1;
+    }
+
+    Validation v = validate(atlas, cells, opt.upscale);
+
+    printf("%s: %d glyphs at %d px, spread %d, %dx%d texels, %u bytes\n",
+            args[1], opt.count, opt.size, opt.spread, opt.width, height, header.size);
+    printf("  glyph table %u bytes (%u per glyph, %u as Glyph)\n",
+            (unsigned)(opt.count * sizeof(SdfGlyph)), (unsigned)sizeof(SdfGlyph), (unsigned)sizeof(Glyph));
+    print_sizes("this atlas", opt.width, height);
+    print_sizes("stb_font PNG atlas", 512, 433);
+    printf("  bilinear fetch: 4 bytes per sample as U8, 16 as RGBA8; sphere_f samples twice per fragment\n");
+    printf("  outline: %.3f%% of %u upscaled pixels differ, %u more than a texel from the edge\n",
+            100.0 * v.mismatches / v.samples, (unsigned)v.samples, (unsigned)v.farMismatches);
+    printf("  gradient: max step %d between texels (limit %.1f), %u violations\n",
+            v.maxStep, 255.f / (2.f * opt.spread) + 1.f, (unsigned)v.gradientViolations);
+
+    if (v.farMismatches || v.gradientViolations) {
+        fprintf(stderr, "%s: distance field validation failed\n", args[1]);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,202 @@
+// Renders text scenes with the CPU version of sphere_v/sphere_f
+// (softraster.h), compares them against golden image hashes and reports
+// throughput. With -o the images are also written as PAM files.
+//
+//   softtext [-o prefix] [-u] [atlas.png]
+//
+// -u prints the hashes of the current output instead of checking them.
+
+#include "hash.h"
+#include "softraster.h"
+#include "textbatch.h"
+
+#include <png.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+using namespace vitashader;
+
+static const int WIDTH = 960;
+static const int HEIGHT = 544;
+
+// Hashes of the RGBA output on an x86 host (SSE path)
+static const uint64_t GOLDEN_MAIN = 0xfd64627a0418ec96ull;
+static const uint64_t GOLDEN_TEXT = 0x717cd849a7d0129cull;
+
+struct Image {
+    int width;
+    int height;
+    std::vector<uint8_t> pixels;
+};
+
+static bool
+load_gray_png(const char *filename, Image &image)
+{
+    png_image png;
+    memset(&png, 0, sizeof(png));
+    png.version = PNG_IMAGE_VERSION;
+
+    if (!png_image_begin_read_from_file(&png, filename)) {
+        return false;
+    }
+
+    png.format = PNG_FORMAT_GRAY;
+    image.width = png.width;
+    image.height = png.height;
+    image.pixels.resize(PNG_IMAGE_SIZE(png));
+
+    return png_image_finish_read(&png, nullptr, image.pixels.data(), 0, nullptr) != 0;
+}
+
+static bool
+write_pam(const std::string &filename, const std::vector<uint32_t> &pixels)
+{
+    FILE *fp = fopen(filename.c_str(), "wb");
+    if (!fp) {
+        return false;
+    }
+    fprintf(fp, "P7\nWIDTH %d\nHEIGHT %d\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n", WIDTH, HEIGHT);
+    bool ok = fwrite(pixels.data(), 4, pixels.size(), fp) == pixels.size();
+    return (fclose(fp) == 0) && ok;
+}
+
+// glm::ortho(left, right, bottom, top) in column-major order
+static void
+ortho(float *m, float left, float right, float bottom, float top)
+{
+    memset(m, 0, 16 * sizeof(float));
+    m[0] = 2.f / (right - left);
+    m[5] = 2.f / (top - bottom);
+    m[10] = -1.f;
+    m[12] = -(right + left) / (right - left);
+    m[13] = -(top + bottom) / (top - bottom);
+    m[15] = 1.f;
+}
+
+static SoftUniforms
+default_uniforms()
+{
+    SoftUniforms u = {
+        { 0.5f, 0.f, 1.f, 1.f },
+        { 0.f, 0.f, 1.f, 1.f },
+        {},
+        { 1.f / 512.f, 1.f / 512.f },
+    };
+    ortho(u.projection, 0.f, 960.f, 544.f, 0.f);
+    return u;
+}
+
+// The frame main.cpp draws at startup: the whole atlas as one 900x900 quad
+static void
+scene_main(TextBatch &batch, const Font &font)
+{
+    batch.add_quad(font, 0.f, 0.f, 900.f, 900.f, 0.f, 0.f, 1.f, 1.f, 1.f);
+}
+
+// Screens full of glyph-sized quads at several scales, cut from a grid
+// over the atlas
+static void
+scene_text(TextBatch &batch, const Font &font)
+{
+    const int cells = 16;
+    unsigned seed = 1;
+    for (int line=0; line<24; ++line) {
+        float scale = 0.75f + (line % 4) * 0.25f;
+        float size = 20.f * scale;
+        float y = 4.f + line * 22.f;
+        for (float x=4.f; x + size < WIDTH; x += size * 0.6f) {
+            seed = seed * 1103515245u + 12345u;
+            int cell = (seed >> 16) % (cells * cells);
+            float s0 = (cell % cells) / (float)cells;
+            float t0 = (cell / cells) / (float)cells;
+            batch.add_quad(font, x, y, x + size, y + size,
+                    s0, t0, s0 + 1.f / cells, t0 + 1.f / cells, scale);
+        }
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    const char *atlas = "stb_font_SourceSansProSemiBold.png";
+    const char *prefix = nullptr;
+    bool update = false;
+
+    for (int i=1; i<argc; ++i) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            prefix = argv[++i];
+        } else if (strcmp(argv[i], "-u") == 0) {
+            update = true;
+        } else {
+            atlas = argv[i];
+        }
+    }
+
+    Image image;
+    if (!load_gray_png(atlas, image)) {
+        fprintf(stderr, "%s: cannot load\n", atlas);
+        return 1;
+    }
+
+    SoftTexture texture = { image.pixels.data(), image.width, image.height, image.width, 1 };
+    SoftUniforms uniforms = default_uniforms();
+    Font font;
+
+    struct Scene {
+        const char *name;
+        void (*build)(TextBatch &, const Font &);
+        uint64_t golden;
+        int iterations;
+    } scenes[] = {
+        { "main", scene_main, GOLDEN_MAIN, 20 },
+        { "text", scene_text, GOLDEN_TEXT, 20 },
+    };
+
+    int failures = 0;
+    std::vector<uint32_t> pixels(WIDTH * HEIGHT);
+    SoftTarget target = { pixels.data(), WIDTH, HEIGHT, WIDTH };
+
+    for (auto &scene: scenes) {
+        TextBatch batch;
+        scene.build(batch, font);
+
+        SoftRasterizer raster(target);
+        double seconds = 0.0;
+        size_t fragments = 0;
+
+        for (int i=0; i<scene.iterations; ++i) {
+            raster.clear(0xFF404040);
+            raster.fragments = 0;
+
+            auto start = std::chrono::steady_clock::now();
+            raster.draw_quads(batch.vertices.data(), batch.glyph_count(), texture, uniforms);
+            seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            fragments = raster.fragments;
+        }
+
+        uint64_t hash = fnv1a(pixels.data(), pixels.size() * sizeof(uint32_t));
+        bool match = hash == scene.golden;
+
+        printf("%s: %u quads, %u fragments, %.1f Mfragments/s, %.2f ms/frame, hash %016llx%s\n",
+                scene.name, (unsigned)batch.glyph_count(), (unsigned)fragments,
+                fragments * (double)scene.iterations / seconds / 1e6,
+                seconds * 1000.0 / scene.iterations, (unsigned long long)hash,
+                update ? "" : match ? " ok" : " MISMATCH");
+
+        if (!update && !match) {
+            ++failures;
+        }
+
+        if (prefix && !write_pam(std::string(prefix) + scene.name + ".pam", pixels)) {
+            fprintf(stderr, "%s%s.pam: cannot write\n", prefix, scene.name);
+            ++failures;
+        }
+    }
+
+    return failures ? 1 : 0;
+}
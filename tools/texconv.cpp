@@ -0,0 +1,349 @@
+// Converts PNG images into GPU-ready texture files (see texturefile.h), and
+// checks a converted file against its PNG while timing both load paths.
+//
+//   texconv [-f u8|rgba8] [-l] [-m] in.png out.vtex
+//   texconv -b [-n iterations] in.png in.vtex
+//
+// Gray images become U8 and everything else RGBA8 unless -f says otherwise.
+// Power of two images are swizzled unless -l asks for linear rows; -m adds
+// a box filtered mip chain. -b loads the PNG the way vita2d_load_PNG_file
+// does (libpng rows expanded to RGBA8 into texture memory) and the texture
+// file through TextureFile, checks that they agree and reports the times.
+
+#include "texturefile.h"
+
+#include <png.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+using namespace vitashader;
+
+struct Image {
+    uint32_t width;
+    uint32_t height;
+    uint32_t format;
+    std::vector<uint8_t> texels;    // tightly packed rows
+};
+
+static bool
+load_png(const char *filename, int format, Image &image)
+{
+    png_image png;
+    memset(&png, 0, sizeof(png));
+    png.version = PNG_IMAGE_VERSION;
+
+    if (!png_image_begin_read_from_file(&png, filename)) {
+        return false;
+    }
+
+    if (format < 0) {
+        format = (png.format & (PNG_FORMAT_FLAG_COLOR | PNG_FORMAT_FLAG_ALPHA)) ?
+            TEXTURE_FORMAT_RGBA8 : TEXTURE_FORMAT_U8;
+    }
+
+    png.format = (format == TEXTURE_FORMAT_U8) ? PNG_FORMAT_GRAY : PNG_FORMAT_RGBA;
+    image.width = png.width;
+    image.height = png.height;
+    image.format = format;
+    image.texels.resize(PNG_IMAGE_SIZE(png));
+
+    return png_image_finish_read(&png, nullptr, image.texels.data(), 0, nullptr) != 0;
+}
+
+// Halves both sides with a box filter, repeating the last row or column of
+// odd sizes
+static Image
+downsample(const Image &src)
+{
+    Image dst;
+    dst.width = texture_mip_size(src.width, 1);
+    dst.height = texture_mip_size(src.height, 1);
+    dst.format = src.format;
+
+    uint32_t bpp = texture_bytes_per_texel(src.format);
+    dst.texels.resize(dst.width * dst.height * bpp);
+
+    for (uint32_t y=0; y<dst.height; ++y) {
+        uint32_t y0 = y * 2;
+        uint32_t y1 = (y0 + 1 < src.height) ? y0 + 1 : y0;
+        for (uint32_t x=0; x<dst.width; ++x) {
+            uint32_t x0 = x * 2;
+            uint32_t x1 = (x0 + 1 < src.width) ? x0 + 1 : x0;
+            for (uint32_t c=0; c<bpp; ++c) {
+                uint32_t sum = src.texels[(y0 * src.width + x0) * bpp + c] +
+                    src.texels[(y0 * src.width + x1) * bpp + c] +
+                    src.texels[(y1 * src.width + x0) * bpp + c] +
+                    src.texels[(y1 * src.width + x1) * bpp + c];
+                dst.texels[(y * dst.width + x) * bpp + c] = (sum + 2) / 4;
+            }
+        }
+    }
+
+    return dst;
+}
+
+// Writes level into out in the texture layout
+static void
+store_level(const Image &level, uint32_t layout, uint8_t *out)
+{
+    uint32_t bpp = texture_bytes_per_texel(level.format);
+    uint32_t stride = texture_stride(level.format, layout, level.width);
+
+    for (uint32_t y=0; y<level.height; ++y) {
+        const uint8_t *row = &level.texels[y * level.width * bpp];
+        if (layout == TEXTURE_LAYOUT_LINEAR) {
+            memcpy(out + y * stride, row, level.width * bpp);
+            continue;
+        }
+        for (uint32_t x=0; x<level.width; ++x) {
+            memcpy(out + texture_swizzle_index(x, y, level.width, level.height) * bpp, row + x * bpp, bpp);
+        }
+    }
+}
+
+// Reads level 0 of a loaded texture back into tightly packed rows
+static std::vector<uint8_t>
+fetch_level0(const TextureFile &file)
+{
+    const TextureHeader &h = *file.header;
+    uint32_t bpp = texture_bytes_per_texel(h.format);
+    uint32_t stride = texture_stride(h.format, h.layout, h.width);
+    std::vector<uint8_t> texels(h.width * h.height * bpp);
+
+    for (uint32_t y=0; y<h.height; ++y) {
+        for (uint32_t x=0; x<h.width; ++x) {
+            uint32_t offset = (h.layout == TEXTURE_LAYOUT_LINEAR) ? y * stride + x * bpp :
+                texture_swizzle_index(x, y, h.width, h.height) * bpp;
+            memcpy(&texels[(y * h.width + x) * bpp], file.texels() + offset, bpp);
+        }
+    }
+    return texels;
+}
+
+static bool
+convert(const char *input, const char *output, int format, bool linear, bool mips)
+{
+    Image image;
+    if (!load_png(input, format, image)) {
+        fprintf(stderr, "%s: cannot load\n", input);
+        return false;
+    }
+
+    if (image.width > 0xFFFF || image.height > 0xFFFF) {
+        fprintf(stderr, "%s: too large\n", input);
+        return false;
+    }
+
+    bool pot = (image.width & (image.width - 1)) == 0 && (image.height & (image.height - 1)) == 0;
+    uint32_t layout = (pot && !linear) ? TEXTURE_LAYOUT_SWIZZLED : TEXTURE_LAYOUT_LINEAR;
+
+    uint32_t levels = 1;
+    if (mips) {
+        while (levels < TEXTURE_MAX_MIPS &&
+                (texture_mip_size(image.width, levels - 1) > 1 || texture_mip_size(image.height, levels - 1) > 1)) {
+            ++levels;
+        }
+    }
+
+    TextureHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = TEXTURE_MAGIC;
+    header.version = TEXTURE_VERSION;
+    header.format = image.format;
+    header.layout = layout;
+    header.width = image.width;
+    header.height = image.height;
+    header.mipCount = levels;
+    header.dataOffset = (sizeof(TextureHeader) + TEXTURE_ALIGNMENT - 1) & ~(TEXTURE_ALIGNMENT - 1);
+
+    for (uint32_t i=0; i<levels; ++i) {
+        header.mipOffsets[i] = header.dataSize;
+        header.dataSize += texture_level_bytes(image.format, layout, image.width, image.height, i);
+    }
+    header.size = header.dataOffset + header.dataSize;
+
+    std::vector<uint8_t> file(header.size, 0);
+    memcpy(file.data(), &header, sizeof(header));
+
+    Image level = image;
+    for (uint32_t i=0; i<levels; ++i) {
+        if (i > 0) {
+            level = downsample(level);
+        }
+        store_level(level, layout, &file[header.dataOffset + header.mipOffsets[i]]);
+    }
+
+    FILE *fp = fopen(output, "wb");
+    bool ok = fp && fwrite(file.data(), 1, file.size(), fp) == file.size();
+    if (fp && fclose(fp) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        fprintf(stderr, "%s: cannot write\n", output);
+        return false;
+    }
+
+    printf("%s: %ux%u %s %s, %u mips, %u bytes\n", output, image.width, image.height,
+            (image.format == TEXTURE_FORMAT_U8) ? "U8" : "RGBA8",
+            (layout == TEXTURE_LAYOUT_SWIZZLED) ? "swizzled" : "linear", levels, header.size);
+    return true;
+}
+
+static void
+ignore_png_warning(png_structp, png_const_charp)
+{
+}
+
+// What vita2d_load_PNG_file does: decode with libpng, expanding every
+// format to RGBA8, row by row into a texture with rows padded to 8 texels
+static bool
+load_png_like_vita2d(const char *filename)
+{
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        return false;
+    }
+
+    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, ignore_png_warning);
+    png_infop info = png ? png_create_info_struct(png) : nullptr;
+    if (!info || setjmp(png_jmpbuf(png))) {
+        png_destroy_read_struct(&png, &info, nullptr);
+        fclose(fp);
+        return false;
+    }
+
+    png_init_io(png, fp);
+    png_read_info(png, info);
+
+    uint32_t width = png_get_image_width(png, info);
+    uint32_t height = png_get_image_height(png, info);
+    int depth = png_get_bit_depth(png, info);
+    int color = png_get_color_type(png, info);
+
+    if (color == PNG_COLOR_TYPE_PALETTE) {
+        png_set_palette_to_rgb(png);
+    }
+    if (color == PNG_COLOR_TYPE_GRAY && depth < 8) {
+        png_set_expand_gray_1_2_4_to_8(png);
+    }
+    if (png_get_valid(png, info, PNG_INFO_tRNS)) {
+        png_set_tRNS_to_alpha(png);
+    }
+    if (depth == 16) {
+        png_set_strip_16(png);
+    }
+    if (color == PNG_COLOR_TYPE_GRAY || color == PNG_COLOR_TYPE_GRAY_ALPHA) {
+        png_set_gray_to_rgb(png);
+    }
+    if (!(color & PNG_COLOR_MASK_ALPHA)) {
+        png_set_filler(png, 0xFF, PNG_FILLER_AFTER);
+    }
+    png_read_update_info(png, info);
+
+    uint32_t stride = texture_stride(TEXTURE_FORMAT_RGBA8, TEXTURE_LAYOUT_LINEAR, width);
+    SceUID uid;
+    uint8_t *texels = (uint8_t *)gpu_alloc(stride * height, &uid);
+    if (texels) {
+        for (uint32_t y=0; y<height; ++y) {
+            png_read_row(png, texels + y * stride, nullptr);
+        }
+        png_read_end(png, nullptr);
+        gpu_free(uid, texels);
+    }
+
+    png_destroy_read_struct(&png, &info, nullptr);
+    fclose(fp);
+    return texels != nullptr;
+}
+
+static bool
+bench(const char *png, const char *texture, int iterations)
+{
+    TextureFile file;
+    if (!file.open(texture)) {
+        fprintf(stderr, "%s: %s\n", texture, file.error);
+        return false;
+    }
+
+    Image image;
+    if (!load_png(png, file.header->format, image)) {
+        fprintf(stderr, "%s: cannot load\n", png);
+        return false;
+    }
+
+    if (image.width != file.header->width || image.height != file.header->height ||
+            fetch_level0(file) != image.texels) {
+        fprintf(stderr, "%s: texels differ from %s\n", texture, png);
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i=0; i<iterations; ++i) {
+        if (!load_png_like_vita2d(png)) {
+            fprintf(stderr, "%s: cannot decode\n", png);
+            return false;
+        }
+    }
+    double pngSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (int i=0; i<iterations; ++i) {
+        if (!file.open(texture)) {
+            fprintf(stderr, "%s: %s\n", texture, file.error);
+            return false;
+        }
+    }
+    double fileSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%s: matches %s\n", texture, png);
+    printf("  png decode to RGBA8: %.3f ms\n", pngSeconds * 1000.0 / iterations);
+    printf("  texture file read:   %.3f ms (%u bytes, %.1fx faster)\n",
+            fileSeconds * 1000.0 / iterations, (unsigned)file.size, pngSeconds / fileSeconds);
+    return true;
+}
+
+int
+main(int argc, char *argv[])
+{
+    int format = -1;
+    bool linear = false;
+    bool mips = false;
+    bool benchmark = false;
+    int iterations = 100;
+    const char *args[2];
+    int nargs = 0;
+
+    for (int i=1; i<argc; ++i) {
+        if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            ++i;
+            format = (strcmp(argv[i], "u8") == 0) ? TEXTURE_FORMAT_U8 :
+                (strcmp(argv[i], "rgba8") == 0) ? TEXTURE_FORMAT_RGBA8 : TEXTURE_FORMAT_COUNT;
+        } else if (strcmp(argv[i], "-l") == 0) {
+            linear = true;
+        } else if (strcmp(argv[i], "-m") == 0) {
+            mips = true;
+        } else if (strcmp(argv[i], "-b") == 0) {
+            benchmark = true;
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            iterations = atoi(argv[++i]);
+        } else if (nargs < 2) {
+            args[nargs++] = argv[i];
+        } else {
+            nargs = 0;
+            break;
+        }
+    }
+
+    if (nargs != 2 || format == TEXTURE_FORMAT_COUNT || iterations <= 0) {
+        fprintf(stderr, "Usage: %s [-f u8|rgba8] [-l] [-m] in.png out.vtex\n"
+                "       %s -b [-n iterations] in.png in.vtex\n", argv[0], argv[0]);
+        return 1;
+    }
+
+    bool ok = benchmark ? bench(args[0], args[1], iterations) : convert(args[0], args[1], format, linear, mips);
+    return ok ? 0 : 1;
+}
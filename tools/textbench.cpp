@@ -0,0 +1,220 @@
+// Checks how TextBatch (textbatch.h) turns text into quads and runs, and
+// measures how fast it does.
+//
+//   textbench [strings] [frames]
+//
+// Each drawable glyph has to become one quad of four vertices, placed and
+// textured like its glyph, while newlines and codepoints without a glyph
+// add none. Runs have to split where the program or the font texture
+// changes and at MAX_QUADS_PER_RUN, and nowhere else. Uploaded vertex
+// streams have to start VERTEX_ALIGNMENT aligned. The benchmark then
+// builds frames of a screen of strings with add() and uploads them, in
+// glyphs per millisecond.
+
+#include "check.h"
+#include "fakefont.h"
+#include "quadindices.h"
+#include "ringalloc.h"
+#include "textbatch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+using namespace vitashader;
+
+// Only their addresses matter to the batch
+static char objects[4];
+static const SceGxmTexture *const textureA = (const SceGxmTexture *)&objects[0];
+static const SceGxmTexture *const textureB = (const SceGxmTexture *)&objects[1];
+static PatchedProgram *const programA = (PatchedProgram *)&objects[2];
+static PatchedProgram *const programB = (PatchedProgram *)&objects[3];
+
+static void
+check_quads(const Font &font)
+{
+    TextBatch batch;
+    batch.add(font, "Hi there", 100.f, 50.f, 2.f);
+    check(batch.glyph_count() == 8 && batch.vertices.size() == 32, "a quad per glyph, spaces included");
+
+    // 'H' at the pen, then 'i' one advance of 'H' later, both scaled
+    const Glyph &h = *font.find('H');
+    const Glyph &i = *font.find('i');
+    const Vertex *v = batch.vertices.data();
+    check(v[0].x == 100.f + h.x0 * 2.f && v[0].y == 50.f + h.y0 * 2.f && v[0].u == h.s0 && v[0].v == h.t0 &&
+            v[3].x == 100.f + h.x1 * 2.f && v[3].y == 50.f + h.y1 * 2.f && v[3].u == h.s1 && v[3].v == h.t1 &&
+            v[0].z == 2.f, "first quad placed and textured like its glyph");
+    check(v[4].x == 100.f + (h.advance + i.x0) * 2.f, "pen advances by the glyph's advance");
+
+    batch.clear();
+    batch.add(font, "a\nb\xc3\xa9\x01" "c", 0.f, 0.f, 1.f);
+    check(batch.glyph_count() == 3 && count_glyphs(font, "a\nb\xc3\xa9\x01" "c") == 3,
+            "newlines and codepoints without a glyph add no quad");
+    check(batch.vertices[4].y == font.lineHeight + font.find('b')->y0, "newline moves the pen down a line");
+
+    batch.clear();
+    batch.add(font, "", 0.f, 0.f, 1.f);
+    check(batch.glyph_count() == 0 && batch.runs.empty(), "empty text adds nothing");
+}
+
+static void
+check_runs(const Font &fontA, const Font &fontB)
+{
+    TextBatch batch;
+    batch.set_program(programA);
+    batch.add(fontA, "one", 0.f, 0.f, 1.f);
+    batch.add(fontA, "two", 0.f, 20.f, 1.f);
+    batch.set_instance(3);
+    batch.add(fontA, "three", 0.f, 40.f, 1.f);
+    check(batch.runs.size() == 1 && batch.runs[0].quadCount == 11, "same program and texture stay one run");
+
+    batch.add(fontB, "four", 0.f, 60.f, 1.f);
+    batch.set_program(programB);
+    batch.add(fontB, "five", 0.f, 80.f, 1.f);
+    batch.add(fontA, "six", 0.f, 100.f, 1.f);
+    batch.set_program(programA);
+    batch.add(fontA, "seven", 0.f, 120.f, 1.f);
+
+    static const struct {
+        PatchedProgram *program;
+        const SceGxmTexture *texture;
+        uint32_t quads;
+    } expected[] = {
+        { programA, textureA, 11 },
+        { programA, textureB, 4 },
+        { programB, textureB, 4 },
+        { programB, textureA, 3 },
+        { programA, textureA, 5 },
+    };
+    bool same = batch.runs.size() == sizeof(expected) / sizeof(expected[0]);
+    uint32_t firstVertex = 0;
+    for (size_t i=0; same && i<batch.runs.size(); ++i) {
+        const TextBatch::Run &run = batch.runs[i];
+        same &= run.program == expected[i].program && run.font->texture == expected[i].texture &&
+            run.quadCount == expected[i].quads && run.firstVertex == firstVertex;
+        firstVertex += run.quadCount * 4;
+    }
+    check(same, "runs split where the program or texture changes");
+    check(firstVertex == batch.vertices.size(), "runs cover every vertex");
+
+    // A run longer than 16-bit indices can address from its base vertex
+    TextBatch big;
+    std::string text(TextBatch::MAX_QUADS_PER_RUN + 100, 'x');
+    big.add(fontA, text.c_str(), 0.f, 0.f, 1.f);
+    check(big.runs.size() == 2 && big.runs[0].quadCount == TextBatch::MAX_QUADS_PER_RUN &&
+            big.runs[1].quadCount == 100 && big.runs[1].firstVertex == TextBatch::MAX_QUADS_PER_RUN * 4,
+            "runs split at MAX_QUADS_PER_RUN");
+}
+
+// Uploads after a 2-byte allocation that leaves the ring's head unaligned
+static void
+check_upload_alignment(const Font &font)
+{
+    std::vector<uint8_t> memory(64 * 1024);
+    RingAllocator ring(memory.data(), memory.size());
+    QuadIndexBuffer quads;
+    TextBatch batch;
+    batch.add(font, "Aligned?", 0.f, 20.f, 1.f);
+
+    ring.begin_frame(0);
+    bool aligned = true;
+    for (int packed=0; packed<2; ++packed) {
+        batch.set_packed(packed);
+        ring.alloc(2, 2);
+        uint8_t *gpuVertices = batch.upload(ring, quads);
+        aligned &= gpuVertices && (gpuVertices - ring.base) % TextBatch::VERTEX_ALIGNMENT == 0;
+        if (gpuVertices && !packed) {
+            check(memcmp(gpuVertices, batch.vertices.data(), batch.vertices.size() * sizeof(Vertex)) == 0,
+                    "float upload copies the vertices");
+        }
+    }
+    ring.end_frame();
+    check(aligned, "vertex streams VERTEX_ALIGNMENT aligned in the ring");
+}
+
+static double
+seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void
+bench(const Font &fontA, const Font &fontB, int strings, int frames)
+{
+    std::vector<std::string> texts;
+    for (int i=0; i<strings; ++i) {
+        char text[64];
+        snprintf(text, sizeof(text), "Label %d: %d points", i, i * 7919 % 100000);
+        texts.push_back(text);
+    }
+
+    std::vector<uint8_t> memory(4 * 1024 * 1024);
+    RingAllocator ring(memory.data(), memory.size());
+    QuadIndexBuffer quads;
+    TextBatch batch;
+    uint32_t fence = 0;
+
+    printf("%-24s %10s %12s %8s\n", "", "ms/frame", "glyphs/ms", "runs");
+    for (int mode=0; mode<3; ++mode) {
+        bool upload = mode > 0;
+        batch.set_packed(mode == 2);
+
+        double best = 0.0;
+        for (int f=0; f<frames; ++f) {
+            ring.retire(fence - 2);
+            ring.begin_frame(fence++);
+
+            auto start = std::chrono::steady_clock::now();
+            batch.clear();
+            for (int i=0; i<strings; ++i) {
+                // Every eighth string in the other font, as for headings
+                batch.set_program(i % 16 < 8 ? programA : programB);
+                batch.add(i % 8 ? fontA : fontB, texts[i].c_str(), 4.f + (i % 4) * 240.f, 20.f + i / 4 * 20.f, 1.f);
+            }
+            if (upload && !batch.upload(ring, quads)) {
+                check(false, "upload");
+            }
+            double seconds = seconds_since(start);
+            ring.end_frame();
+
+            if (f == 0 || seconds < best) {
+                best = seconds;
+            }
+        }
+
+        const char *names[] = { "add()", "add() + upload", "add() + packed upload" };
+        printf("%-24s %10.3f %12.0f %8u\n", names[mode], best * 1e3, batch.glyph_count() / (best * 1e3),
+                (unsigned)batch.runs.size());
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    int strings = argc > 1 ? atoi(argv[1]) : 200;
+    int frames = argc > 2 ? atoi(argv[2]) : 200;
+    if (strings < 1 || frames < 1) {
+        fprintf(stderr, "Usage: %s [strings] [frames]\n", argv[0]);
+        return 1;
+    }
+
+    Font fontA, fontB;
+    make_font(fontA);
+    make_font(fontB);
+    fontA.texture = textureA;
+    fontB.texture = textureB;
+
+    check_quads(fontA);
+    check_runs(fontA, fontB);
+    check_upload_alignment(fontA);
+    bench(fontA, fontB, strings, frames);
+
+    if (!failures) {
+        printf("\ntext batch: ok\n");
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,327 @@
+// Checks textcache.h against TextBatch::add() and measures what it saves on
+// a UI-like frame where most labels stay the same.
+//
+//   textcachebench [labels] [frames] [changed_percent]
+//
+// Cached text has to come out identical to add(), with and without
+// wrapping, at the origin and elsewhere. Editing one line of a label may
+// only lay that line out again, the cache has to stay within its budget,
+// and a working set far over the budget has to bypass it. The benchmark
+// then builds the same frames with add() and through caches of a few
+// budgets, where a share of the labels changes every frame like counters
+// and timers do.
+
+#include "check.h"
+#include "fakefont.h"
+#include "textbatch.h"
+#include "textcache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace vitashader;
+
+static double
+seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static bool
+same_batch(const TextBatch &a, const TextBatch &b)
+{
+    if (a.vertices.size() != b.vertices.size() || a.runs.size() != b.runs.size()) {
+        return false;
+    }
+    for (size_t i=0; i<a.runs.size(); ++i) {
+        const TextBatch::Run &x = a.runs[i];
+        const TextBatch::Run &y = b.runs[i];
+        if (x.program != y.program || x.font != y.font || x.firstVertex != y.firstVertex ||
+                x.quadCount != y.quadCount) {
+            return false;
+        }
+    }
+    return a.vertices.empty() ||
+        memcmp(a.vertices.data(), b.vertices.data(), a.vertices.size() * sizeof(Vertex)) == 0;
+}
+
+struct Label {
+    const Font *font;
+    std::string text;
+    float x, y;
+    float scale;
+    float wrapWidth;
+    bool changes;
+};
+
+static std::vector<Label>
+make_labels(size_t count, const Font *fonts, int changedPercent)
+{
+    static const char *const words[] = {
+        "Options", "Resume game", "Quit to title", "Inventory", "Health", "Mana", "Map",
+        "Press X to continue", "Sound volume", "Music", "Controls", "H\xC3\xA9llo",
+    };
+    const size_t nwords = sizeof(words) / sizeof(words[0]);
+
+    std::vector<Label> labels(count);
+    unsigned seed = 11;
+    for (size_t i=0; i<count; ++i) {
+        Label &label = labels[i];
+        int lines = 1 + i % 3;
+        for (int line=0; line<lines; ++line) {
+            seed = seed * 1103515245u + 12345u;
+            label.text += words[(seed >> 16) % nwords];
+            label.text += (line + 1 < lines) ? "\n" : "";
+        }
+        label.font = &fonts[(i / 23) % 2];
+        label.x = (float)(i % 8) * 120.f;
+        label.y = (float)(i / 8) * 64.f;
+        label.scale = (i % 4 == 0) ? 0.75f : 1.f;
+        label.wrapWidth = (i % 5 == 0) ? 110.f : 0.f;
+        label.changes = (int)(i * 100 / count % 100) < changedPercent;
+    }
+    return labels;
+}
+
+// Labels that change show a number on their first line, like a score
+static const char *
+frame_text(const Label &label, int frame, std::string &scratch)
+{
+    if (!label.changes) {
+        return label.text.c_str();
+    }
+    char number[16];
+    snprintf(number, sizeof(number), "%d ", frame);
+    scratch = number + label.text;
+    return scratch.c_str();
+}
+
+static void
+build_uncached(TextBatch &batch, const std::vector<Label> &labels, int frame, std::string &scratch)
+{
+    batch.clear();
+    for (const Label &label: labels) {
+        batch.add(*label.font, frame_text(label, frame, scratch), label.x, label.y, label.scale,
+                label.wrapWidth);
+    }
+}
+
+static void
+build_cached(TextBatch &batch, TextCache &cache, const std::vector<Label> &labels, int frame,
+        std::string &scratch)
+{
+    batch.clear();
+    for (const Label &label: labels) {
+        cache.add(batch, *label.font, frame_text(label, frame, scratch), label.x, label.y, label.scale,
+                label.wrapWidth);
+    }
+}
+
+static void
+check_cache(const Font *fonts)
+{
+    struct Case {
+        const char *text;
+        float x, y;
+        float scale;
+        float wrapWidth;
+    } cases[] = {
+        { "Hello", 0.f, 0.f, 1.f, 0.f },
+        { "Hello", 13.5f, 200.25f, 0.75f, 0.f },
+        { "two\nlines", 5.f, 7.f, 1.25f, 0.f },
+        { "\n\nblank lines\n", 1.f, 2.f, 1.f, 0.f },
+        { "", 3.f, 4.f, 1.f, 0.f },
+        { "H\xC3\xA9llo \xE2\x82\xAC 9.99", 0.f, 10.f, 1.f, 0.f },
+        { "the quick brown fox jumps over the lazy dog", 4.f, 8.f, 1.f, 120.f },
+        { "wrapped\nthe quick brown fox jumps over the lazy dog\nand below", 4.f, 8.f, 0.5f, 90.f },
+        { "unbreakablewordwiderthanthewrap", 0.f, 0.f, 1.f, 40.f },
+    };
+
+    TextCache cache(1024 * 1024);
+    unsigned firstPassMisses = 0;
+    for (int pass=0; pass<2; ++pass) {
+        firstPassMisses = cache.misses;
+        for (auto &c: cases) {
+            TextBatch direct;
+            direct.add(fonts[0], c.text, c.x, c.y, c.scale, c.wrapWidth);
+            TextBatch cached;
+            cache.add(cached, fonts[0], c.text, c.x, c.y, c.scale, c.wrapWidth);
+            check(same_batch(direct, cached), pass ? "cache hit matches add()" : "cache miss matches add()");
+        }
+    }
+    check(cache.misses == firstPassMisses && cache.hits > 0, "second pass only hits");
+
+    // Wrapped lines stay within the width, trailing spaces aside, and
+    // words are not split
+    std::vector<QuadSource> quads;
+    const char *sentence = "the quick brown fox jumps over the lazy dog";
+    layout_glyphs(fonts[0], sentence, quads, 120.f);
+    bool within = true;
+    float lastY = quads.empty() ? 0.f : quads[0].y0;
+    int lines = 1;
+    for (size_t i=0; i<quads.size(); ++i) {
+        within = within && (sentence[i] == ' ' || quads[i].x1 <= 120.f);
+        if (quads[i].y0 != lastY) {
+            // A new line starts with a word, right after a space
+            within = within && sentence[i - 1] == ' ' && quads[i].x0 == 0.f;
+            lastY = quads[i].y0;
+            ++lines;
+        }
+    }
+    check(within && lines > 1, "lines wrap at spaces within the width");
+    check(quads.size() == count_glyphs(fonts[0], sentence), "wrapping keeps every glyph");
+
+    // Editing one line lays out only that line
+    TextBatch batch;
+    cache.reset_counters();
+    cache.add(batch, fonts[1], "Health\nMana 10\nGold\nXP", 10.f, 10.f, 1.f);
+    cache.add(batch, fonts[1], "Health\nMana 11\nGold\nXP", 10.f, 10.f, 1.f);
+    check(cache.misses == 4 + 1 && cache.hits == 3, "an edited line is the only miss");
+
+    // Lines below a line whose wrapped height grew move, and are laid out again
+    cache.reset_counters();
+    cache.add(batch, fonts[1], "Note\nshort\nend", 0.f, 0.f, 1.f, 150.f);
+    cache.add(batch, fonts[1], "Note\nshort text that now wraps over lines\nend", 0.f, 0.f, 1.f, 150.f);
+    check(cache.hits == 1 && cache.misses == 3 + 2, "lines below a taller line are laid out again");
+
+    // The budget holds and the oldest entries go first; fewer lookups than
+    // a bypass window, so all of them go through the cache
+    TextCache small(4096);
+    char text[32];
+    for (int i=0; i<100; ++i) {
+        snprintf(text, sizeof(text), "label %d", i);
+        small.add(batch, fonts[0], text, 0.f, 0.f, 1.f);
+        small.add(batch, fonts[0], "kept", 0.f, 0.f, 1.f);
+        check(small.bytes <= small.budget, "cache within its budget");
+    }
+    check(small.evictions > 0, "entries evicted over the budget");
+    small.reset_counters();
+    small.add(batch, fonts[0], "kept", 0.f, 0.f, 1.f);
+    small.add(batch, fonts[0], "label 0", 0.f, 0.f, 1.f);
+    check(small.hits == 1 && small.misses == 1, "recently used entries survive");
+
+    size_t counted = 0, quadCount = 0, textLength = 0;
+    for (const TextCache::Entry &entry: small.entries) {
+        counted += TextCache::entry_bytes(entry);
+        quadCount += entry.quadCount;
+        textLength += entry.textLength;
+    }
+    size_t used = std::count_if(small.slots.begin(), small.slots.end(), [](uint32_t slot) { return slot != 0; });
+    check(counted == small.bytes && quadCount == small.quads.size() && textLength == small.texts.size(),
+            "bytes and pools agree");
+    check(used == small.entries.size() && used * 2 <= small.slots.size(), "every entry in the table once");
+
+    // A working set far over the budget bypasses the cache, still drawing
+    // what add() does, and stops bypassing once it fits again
+    TextCache thrashed(4096);
+    bool same = true;
+    for (int pass=0; pass<4; ++pass) {
+        for (int i=0; i<300; ++i) {
+            snprintf(text, sizeof(text), "cycling label %d", i);
+            TextBatch direct, cached;
+            direct.add(fonts[0], text, 1.f, 2.f, 1.f);
+            thrashed.add(cached, fonts[0], text, 1.f, 2.f, 1.f);
+            same = same && same_batch(direct, cached);
+        }
+    }
+    check(same, "bypassed lines match add()");
+    check(thrashed.bypassing && thrashed.bypassed > thrashed.misses / 2, "thrashing bypasses the cache");
+    check(thrashed.bytes <= thrashed.budget, "bypassing stays within the budget");
+    for (unsigned i=0; i<(TextCache::BYPASS_WINDOWS + 1) * TextCache::WINDOW * TextCache::BYPASS_SAMPLE &&
+            thrashed.bypassing; ++i) {
+        thrashed.add(batch, fonts[0], "steady", 0.f, 0.f, 1.f);
+    }
+    check(!thrashed.bypassing, "bypass ends once lookups hit");
+}
+
+int
+main(int argc, char *argv[])
+{
+    size_t labelCount = (argc > 1) ? atoi(argv[1]) : 400;
+    int frames = (argc > 2) ? atoi(argv[2]) : 200;
+    int changedPercent = (argc > 3) ? atoi(argv[3]) : 5;
+
+    Font fonts[2];
+    make_font(fonts[0], 9.f);
+    make_font(fonts[1], 12.f);
+
+    check_cache(fonts);
+
+    std::vector<Label> labels = make_labels(labelCount, fonts, changedPercent);
+    std::string scratch;
+
+    // The cached frames have to match the uncached ones throughout
+    {
+        TextBatch direct;
+        TextBatch cached;
+        TextCache cache(1024 * 1024);
+        bool same = true;
+        for (int frame=0; frame<8; ++frame) {
+            build_uncached(direct, labels, frame, scratch);
+            build_cached(cached, cache, labels, frame, scratch);
+            same = same && same_batch(direct, cached);
+        }
+        check(same, "cached frames match add()");
+    }
+
+    TextBatch batch;
+    build_uncached(batch, labels, 0, scratch);
+    printf("%zu labels, %zu glyphs, %d%% changing every frame\n\n", labels.size(), batch.glyph_count(),
+            changedPercent);
+
+    const size_t budgets[] = { 16 * 1024, 64 * 1024, 256 * 1024, 1024 * 1024 };
+    const int configs = 1 + sizeof(budgets) / sizeof(budgets[0]);
+    std::vector<std::unique_ptr<TextCache>> caches;
+    for (size_t budget: budgets) {
+        caches.emplace_back(new TextCache(budget));
+        build_cached(batch, *caches.back(), labels, 0, scratch);
+        caches.back()->reset_counters();
+    }
+
+    // Rounds alternate between add() and the caches and the fastest round
+    // of each counts, as the host is not otherwise idle
+    const int rounds = 5;
+    std::vector<double> best(configs, 1e9);
+    for (int round=0; round<rounds; ++round) {
+        for (int config=0; config<configs; ++config) {
+            auto start = std::chrono::steady_clock::now();
+            for (int frame=0; frame<frames; ++frame) {
+                int index = round * frames + frame;
+                if (config == 0) {
+                    build_uncached(batch, labels, index, scratch);
+                } else {
+                    build_cached(batch, *caches[config - 1], labels, index, scratch);
+                }
+            }
+            best[config] = std::min(best[config], seconds_since(start) / frames);
+        }
+    }
+
+    printf("%-12s %10s %8s %8s %10s %10s %10s %10s %8s\n", "budget", "us/frame", "saved", "hit rate",
+            "reused/f", "built/f", "evicted/f", "bypass/f", "entries");
+    printf("%-12s %10.1f %8s %8s %10s %10zu %10s %10s %8s\n", "add()", best[0] * 1e6, "-", "-", "-",
+            batch.glyph_count(), "-", "-", "-");
+
+    int total = rounds * frames;
+    for (int config=1; config<configs; ++config) {
+        const TextCache &cache = *caches[config - 1];
+        char name[16];
+        snprintf(name, sizeof(name), "%uK", (unsigned)(cache.budget / 1024));
+        printf("%-12s %10.1f %7.0f%% %7.1f%% %10llu %10llu %10u %10u %8zu\n", name, best[config] * 1e6,
+                (1.0 - best[config] / best[0]) * 100.0, cache.hit_rate() * 100.f,
+                (unsigned long long)(cache.quadsReused / total), (unsigned long long)(cache.quadsBuilt / total),
+                cache.evictions / total, cache.bypassed / total, cache.size());
+    }
+
+    if (!failures) {
+        printf("\ntext layout cache: ok\n");
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,137 @@
+// Checks the shader variant logic of shadervariant.h: feature declaration
+// parsing, subset enumeration, naming and runtime selection against a set
+// of available program names.
+//
+//   variantcheck [source.cg...]
+//
+// The given sources (e.g. sphere_v.cg sphere_f.cg) are parsed as well and
+// their variants listed.
+
+#include "check.h"
+#include "shadervariant.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <set>
+#include <string>
+
+using namespace vitashader;
+
+static bool
+parses(const char *source, uint32_t expected)
+{
+    uint32_t mask = ~0u;
+    std::string error;
+    return parse_shader_features(source, &mask, &error) && mask == expected;
+}
+
+static bool
+rejects(const char *source)
+{
+    uint32_t mask;
+    std::string error;
+    return !parse_shader_features(source, &mask, &error) && !error.empty();
+}
+
+static bool
+read_file(const char *filename, std::string &text)
+{
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        return false;
+    }
+    char buffer[4096];
+    size_t len;
+    while ((len = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+        text.append(buffer, len);
+    }
+    fclose(fp);
+    return true;
+}
+
+int
+main(int argc, char *argv[])
+{
+    const uint32_t SHADOW = SHADER_FEATURE_SHADOW;
+    const uint32_t OUTLINE = SHADER_FEATURE_OUTLINE;
+    const uint32_t VERTEX_COLOR = SHADER_FEATURE_VERTEX_COLOR;
+    const uint32_t PACKED_VERTEX = SHADER_FEATURE_PACKED_VERTEX;
+    const uint32_t INSTANCE_PARAMS = SHADER_FEATURE_INSTANCE_PARAMS;
+
+    check(parses("void main() {}\n", 0), "no declaration, no features");
+    check(parses("// features:\nvoid main() {}\n", 0), "empty declaration");
+    check(parses("// features: SHADOW OUTLINE\n", SHADOW | OUTLINE), "two features");
+    check(parses("// features:\tOUTLINE  SHADOW\r\n", SHADOW | OUTLINE), "order and whitespace");
+    check(parses("float x;\n// features: VERTEX_COLOR\nvoid main() {}\n", VERTEX_COLOR), "declaration after code");
+    check(parses("// features: SHADOW\n// features: OUTLINE\n", SHADOW), "first declaration wins");
+    check(parses("  // features: SHADOW\n", 0), "declaration has to start the line");
+    check(rejects("// features: SHADOW GLOW\n"), "unknown feature");
+    check(rejects("// features: SHADOW SHADOW\n"), "repeated feature");
+    check(rejects("// features: SHADOWS\n"), "prefix of a name is not a feature");
+
+    std::vector<uint32_t> masks = shader_variant_masks(SHADOW | VERTEX_COLOR);
+    std::vector<uint32_t> expected = { 0, SHADOW, VERTEX_COLOR, SHADOW | VERTEX_COLOR };
+    check(masks == expected, "subsets in increasing order");
+    check(shader_variant_masks(0) == std::vector<uint32_t>{ 0 }, "no features, one variant");
+
+    uint32_t all = (1u << SHADER_FEATURE_COUNT) - 1;
+    masks = shader_variant_masks(all);
+    std::set<std::string> names;
+    for (uint32_t mask: masks) {
+        names.insert(shader_variant_name("sphere_f", mask));
+    }
+    check(masks.size() == (1u << SHADER_FEATURE_COUNT) && names.size() == masks.size(), "distinct names per subset");
+    check(shader_variant_name("sphere_f", 0) == "sphere_f", "plain name without features");
+    check(shader_variant_name("sphere_f", OUTLINE | SHADOW) == "sphere_f+SHADOW+OUTLINE", "names in bit order");
+
+    // Programs as cgvariants would build them for sphere_f with SHADOW and
+    // OUTLINE and sphere_v with VERTEX_COLOR, PACKED_VERTEX and INSTANCE_PARAMS
+    std::set<std::string> archive;
+    for (uint32_t mask: shader_variant_masks(SHADOW | OUTLINE)) {
+        archive.insert(shader_variant_name("sphere_f", mask));
+    }
+    for (uint32_t mask: shader_variant_masks(VERTEX_COLOR | PACKED_VERTEX | INSTANCE_PARAMS)) {
+        archive.insert(shader_variant_name("sphere_v", mask));
+    }
+    auto exists = [&archive](const char *name) { return archive.count(name) != 0; };
+
+    ShaderVariantSet fragment, vertex, missing;
+    check(fragment.probe("sphere_f", exists) && fragment.supported == (SHADOW | OUTLINE), "fragment features found");
+    check(vertex.probe("sphere_v", exists) && vertex.supported == (VERTEX_COLOR | PACKED_VERTEX | INSTANCE_PARAMS),
+            "vertex features found");
+    check(!missing.probe("text_f", exists) && missing.supported == 0, "missing program");
+
+    for (uint32_t features=0; features<=all; ++features) {
+        check(archive.count(fragment.name(features)) && archive.count(vertex.name(features)),
+                "every mask selects a built variant");
+        check((fragment.resolve(features) | vertex.resolve(features)) == features, "no feature lost");
+    }
+    check(fragment.name(SHADOW | VERTEX_COLOR) == "sphere_f+SHADOW", "undeclared bits ignored");
+    check(vertex.name(SHADOW | VERTEX_COLOR) == "sphere_v+VERTEX_COLOR", "undeclared bits ignored per stage");
+    check(fragment.name(0) == "sphere_f", "no features selects the plain program");
+
+    for (int i=1; i<argc; ++i) {
+        std::string text;
+        uint32_t mask;
+        std::string error;
+        if (!read_file(argv[i], text) || !parse_shader_features(text.c_str(), &mask, &error)) {
+            fprintf(stderr, "%s: %s\n", argv[i], error.empty() ? "cannot read" : error.c_str());
+            ++failures;
+            continue;
+        }
+
+        std::string base = argv[i];
+        base = base.substr(0, base.rfind('.'));
+        printf("%s:", argv[i]);
+        for (uint32_t variant: shader_variant_masks(mask)) {
+            printf(" %s", shader_variant_name(base, variant).c_str());
+        }
+        printf("\n");
+    }
+
+    if (!failures) {
+        printf("variant parsing, enumeration and selection: ok\n");
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,456 @@
+// Host benchmark suite for the hot paths of vitashader.h and friends, run
+// against the GXM stand-in of hostgxm.h:
+//
+//   uniform_*       UniformVariable::set_float and UniformBlock
+//   layout_*        attribute layout building in ShaderProgram::create/get
+//   quadgen_*       expand_quads
+//   debugscreen_*   psvDebugScreenPuts
+//   program_*       shader archive loading against a file per program,
+//                   and ShaderProgram construction
+//
+//   vsbench [-q] [-o results.tsv] [-c baseline.tsv] [-t percent] [name...]
+//
+// Each benchmark reports the best of several timed samples in ns per
+// operation. -o writes the results as tab separated "name ns_per_op ops"
+// lines; -c compares against such a file from another commit and fails if
+// anything got slower by more than -t percent (default 10). Names given
+// select the benchmarks whose name starts with one of them; -q shortens
+// the samples for a smoke run.
+//
+// The programs are made-up GXP binaries with the parameters of sphere_v
+// and sphere_f plus padding uniforms, as no shader compiler runs here.
+
+#include "fakegxp.h"
+#include "quadgen.h"
+#include "shaderarchive.h"
+#include "vitashader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Last, as it defines short macros and a global framebuffer
+#define NO_psvDebugScreenInit
+#include "debugScreen.h"
+
+using namespace vitashader;
+
+struct Result {
+    std::string name;
+    double nsPerOp;
+    uint64_t ops;
+};
+
+static std::vector<Result> results;
+static std::vector<const char *> filters;
+static double sampleSeconds = 0.05;
+
+static bool
+selected(const char *name)
+{
+    if (filters.empty()) {
+        return true;
+    }
+    for (const char *filter: filters) {
+        if (strncmp(name, filter, strlen(filter)) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Times f(), which performs opsPerCall operations, in samples of at least
+// sampleSeconds and records the fastest sample
+template <typename Body>
+static void
+bench(const char *name, uint64_t opsPerCall, Body body)
+{
+    if (!selected(name)) {
+        return;
+    }
+
+    typedef std::chrono::steady_clock Clock;
+
+    uint64_t calls = 1;
+    for (;;) {
+        auto start = Clock::now();
+        for (uint64_t i=0; i<calls; ++i) {
+            body();
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        if (seconds >= sampleSeconds / 4 || calls >= (1ull << 40)) {
+            calls = (uint64_t)(calls * (sampleSeconds / (seconds > 0.0 ? seconds : 1e-9))) + 1;
+            break;
+        }
+        calls *= 4;
+    }
+
+    double best = 0.0;
+    for (int sample=0; sample<5; ++sample) {
+        auto start = Clock::now();
+        for (uint64_t i=0; i<calls; ++i) {
+            body();
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        if (sample == 0 || seconds < best) {
+            best = seconds;
+        }
+    }
+
+    uint64_t ops = calls * opsPerCall;
+    results.push_back(Result{name, best * 1e9 / ops, ops});
+    printf("%-32s %12.2f ns/op %14llu ops\n", name, best * 1e9 / ops, (unsigned long long)ops);
+}
+
+static std::vector<FakeParameter>
+sphere_parameters(bool fragment, std::vector<std::string> &names)
+{
+    std::vector<FakeParameter> parameters;
+    if (fragment) {
+        parameters.push_back(FakeParameter{"uColor", gxp::CATEGORY_UNIFORM, 4, 0});
+        parameters.push_back(FakeParameter{"uOutline", gxp::CATEGORY_UNIFORM, 4, 4});
+        parameters.push_back(FakeParameter{"uShadowOffset", gxp::CATEGORY_UNIFORM, 2, 8});
+        parameters.push_back(FakeParameter{"uTexture", gxp::CATEGORY_SAMPLER, 1, 0});
+    } else {
+        parameters.push_back(FakeParameter{"aPosition", gxp::CATEGORY_ATTRIBUTE, 3, 0});
+        parameters.push_back(FakeParameter{"aTexcoord", gxp::CATEGORY_ATTRIBUTE, 2, 4});
+        parameters.push_back(FakeParameter{"aColor", gxp::CATEGORY_ATTRIBUTE, 4, 8});
+        parameters.push_back(FakeParameter{"uProjection", gxp::CATEGORY_UNIFORM, 16, 0});
+        parameters.push_back(FakeParameter{"uTransform", gxp::CATEGORY_UNIFORM, 4, 16});
+    }
+
+    // Padding uniforms, so lookups are not all first-probe hits
+    for (int i=0; i<24; ++i) {
+        names.push_back((fragment ? "uFragmentPad" : "uVertexPad") + std::to_string(i));
+    }
+    for (int i=0; i<24; ++i) {
+        parameters.push_back(FakeParameter{names[names.size() - 24 + i].c_str(), gxp::CATEGORY_UNIFORM, 4,
+                (uint32_t)(32 + i * 4)});
+    }
+    return parameters;
+}
+
+static bool
+write_file(const std::string &filename, const std::vector<uint8_t> &data)
+{
+    FILE *fp = fopen(filename.c_str(), "wb");
+    if (!fp) {
+        return false;
+    }
+    bool ok = fwrite(data.data(), data.size(), 1, fp) == 1;
+    return (fclose(fp) == 0) && ok;
+}
+
+// What main.cpp did before the archive: a file per program, each read into
+// its own allocation
+static bool
+load_files(const std::string &directory, const std::vector<std::string> &names, std::vector<void *> &loaded)
+{
+    bool ok = true;
+    for (size_t i=0; i<names.size(); ++i) {
+        std::string filename = directory + "/" + names[i] + ".gxp";
+        FILE *fp = fopen(filename.c_str(), "rb");
+        if (!fp) {
+            return false;
+        }
+        fseek(fp, 0, SEEK_END);
+        long len = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+        loaded[i] = malloc(len);
+        ok = ok && loaded[i] && fread(loaded[i], len, 1, fp) == 1;
+        fclose(fp);
+    }
+    return ok;
+}
+
+static double
+result_of(const char *name)
+{
+    for (auto &result: results) {
+        if (result.name == name) {
+            return result.nsPerOp;
+        }
+    }
+    return 0.0;
+}
+
+static bool
+write_results(const char *filename)
+{
+    FILE *fp = fopen(filename, "w");
+    if (!fp) {
+        return false;
+    }
+    fprintf(fp, "# vsbench name\tns_per_op\tops\n");
+    for (auto &result: results) {
+        fprintf(fp, "%s\t%.3f\t%llu\n", result.name.c_str(), result.nsPerOp, (unsigned long long)result.ops);
+    }
+    return fclose(fp) == 0;
+}
+
+// Prints the change against a previous results file; false if any
+// benchmark got slower by more than threshold percent
+static bool
+compare_results(const char *filename, double threshold)
+{
+    FILE *fp = fopen(filename, "r");
+    if (!fp) {
+        fprintf(stderr, "%s: cannot read\n", filename);
+        return false;
+    }
+
+    bool ok = true;
+    char line[256];
+    printf("\n%-32s %12s %12s %8s\n", "vs baseline", "before", "after", "change");
+    while (fgets(line, sizeof(line), fp)) {
+        char name[128];
+        double before;
+        if (line[0] == '#' || sscanf(line, "%127s %lf", name, &before) != 2) {
+            continue;
+        }
+        for (auto &result: results) {
+            if (result.name == name) {
+                double change = (result.nsPerOp / before - 1.0) * 100.0;
+                bool regressed = change > threshold;
+                printf("%-32s %12.2f %12.2f %+7.1f%%%s\n", name, before, result.nsPerOp, change,
+                        regressed ? "  REGRESSED" : "");
+                ok = ok && !regressed;
+            }
+        }
+    }
+    fclose(fp);
+    return ok;
+}
+
+int
+main(int argc, char *argv[])
+{
+    const char *output = nullptr;
+    const char *baseline = nullptr;
+    double threshold = 10.0;
+
+    for (int i=1; i<argc; ++i) {
+        if (strcmp(argv[i], "-q") == 0) {
+            sampleSeconds = 0.005;
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            baseline = argv[++i];
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "Usage: %s [-q] [-o results.tsv] [-c baseline.tsv] [-t percent] [name...]\n", argv[0]);
+            return 1;
+        } else {
+            filters.push_back(argv[i]);
+        }
+    }
+
+    SceGxmContext *context = nullptr;
+    SceGxmShaderPatcher *patcher = nullptr;
+
+    std::vector<std::string> padNames;
+    std::vector<std::vector<uint8_t>> programs = {
+        make_program(false, sphere_parameters(false, padNames)),
+        make_program(true, sphere_parameters(true, padNames)),
+    };
+    std::vector<std::string> programNames = { "sphere_v", "sphere_f" };
+
+    char archivePath[] = "/tmp/vsbench-XXXXXX";
+    int fd = mkstemp(archivePath);
+    if (fd < 0 || !write_archive(archivePath, build_archive(programNames, programs))) {
+        fprintf(stderr, "cannot write the benchmark shader archive\n");
+        return 1;
+    }
+
+    ShaderArchive archive;
+    if (!archive.open(archivePath)) {
+        fprintf(stderr, "%s: %s\n", archivePath, archive.error);
+        return 1;
+    }
+    const SceGxmProgram *vertexProgram = (const SceGxmProgram *)archive.find("sphere_v");
+    const SceGxmProgram *fragmentProgram = (const SceGxmProgram *)archive.find("sphere_f");
+
+    ShaderProgram program(context, patcher, vertexProgram, fragmentProgram);
+    program.add_attribute("aPosition", 3, SCE_GXM_ATTRIBUTE_FORMAT_F32);
+    program.add_attribute("aTexcoord", 2, SCE_GXM_ATTRIBUTE_FORMAT_F32);
+
+    float values[16] = { 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f };
+    UniformVariable uTransform = program.get_vertex_uniform("uTransform");
+    UniformVariable uProjection = program.get_vertex_uniform("uProjection");
+    bench("uniform_set_float_vec4", 1, [&] {
+        values[0] += 1.f;
+        uTransform.set_float(values, 4);
+    });
+    bench("uniform_set_float_mat4", 1, [&] {
+        values[0] += 1.f;
+        uProjection.set_float(values, 16);
+    });
+
+    UniformBlock block(program);
+    UniformBlock::Handle hProjection = block.add_vertex("uProjection", 16);
+    UniformBlock::Handle hTransform = block.add_vertex("uTransform", 4);
+    UniformBlock::Handle hColor = block.add_fragment("uColor", 4);
+    block.set_float(hProjection, values, 16);
+    block.flush();
+    bench("uniform_block_flush_changed", 1, [&] {
+        values[0] += 1.f;
+        block.set_float(hTransform, values, 4);
+        block.set_float(hColor, values, 4);
+        block.flush();
+    });
+    bench("uniform_block_flush_unchanged", 1, [&] {
+        block.set_float(hTransform, values, 4);
+        block.set_float(hColor, values, 4);
+        block.flush();
+    });
+
+    // A layout change, then create() rebuilding it
+    bench("layout_build_create", 1, [&] {
+        program.attributes.clear();
+        program.add_attribute("aPosition", 3, SCE_GXM_ATTRIBUTE_FORMAT_F32);
+        program.add_attribute("aTexcoord", 2, SCE_GXM_ATTRIBUTE_FORMAT_F32);
+        program.add_attribute("aColor", 4, SCE_GXM_ATTRIBUTE_FORMAT_U8N);
+        PatchedProgram patched = program.create(SCE_GXM_MULTISAMPLE_NONE, nullptr);
+    });
+    bench("layout_create_unchanged", 1, [&] {
+        PatchedProgram patched = program.create(SCE_GXM_MULTISAMPLE_NONE, nullptr);
+    });
+    bench("layout_get_cached", 1, [&] {
+        PatchedProgram *patched = program.get(SCE_GXM_MULTISAMPLE_NONE, nullptr);
+        values[1] += patched ? 1.f : 0.f;
+    });
+
+    const size_t quadCount = 1024;
+    std::vector<QuadSource> quads(quadCount);
+    for (size_t i=0; i<quadCount; ++i) {
+        float x = (i % 64) * 15.f;
+        float y = (i / 64) * 20.f;
+        quads[i] = QuadSource{x, y, x + 12.f, y + 18.f, 0.25f, 0.5f, 0.3125f, 0.5625f};
+    }
+    std::vector<Vertex> vertices(quadCount * 4);
+    bench("quadgen_expand", quadCount, [&] {
+        expand_quads(quads.data(), quadCount, 10.f, 20.f, 1.5f, 1.5f, vertices.data());
+    });
+    bench("quadgen_expand_scalar", quadCount, [&] {
+        expand_quads_scalar(quads.data(), quadCount, 10.f, 20.f, 1.5f, 1.5f, vertices.data());
+    });
+
+    // A dump_program() style line, drawn in place and scrolling
+    psvDebugScreenInit();
+    static const char line[] = "  params[12] = {cat=0x00000001, name=uParam12, type=0x00000054}\n";
+    const uint64_t lineGlyphs = sizeof(line) - 2;
+    bench("debugscreen_puts_redraw", lineGlyphs, [&] {
+        psvDebugScreenPuts("\e[H");
+        psvDebugScreenPuts(line);
+    });
+    bench("debugscreen_puts_scroll", lineGlyphs, [&] {
+        psvDebugScreenPuts(line);
+    });
+
+    bench("program_archive_open", 1, [&] {
+        ShaderArchive loaded;
+        if (!loaded.open(archivePath)) {
+            fprintf(stderr, "%s: %s\n", archivePath, loaded.error);
+            exit(1);
+        }
+    });
+
+    // Startup with every variant main.cpp loads, from loose files and from
+    // one archive. The host has the files in its page cache; on the Vita
+    // each open of app0: costs far more, so the gap only grows there.
+    std::vector<std::string> startupNames;
+    std::vector<std::vector<uint8_t>> startupPrograms;
+    for (const char *name: {"sphere_f", "sphere_f+SHADOW", "sphere_f+OUTLINE", "sphere_f+SHADOW+OUTLINE"}) {
+        startupNames.push_back(name);
+        startupPrograms.push_back(programs[1]);
+    }
+    for (uint32_t features=0; features<8; ++features) {
+        std::string name = "sphere_v";
+        name += (features & 1) ? "+VERTEX_COLOR" : "";
+        name += (features & 2) ? "+PACKED_VERTEX" : "";
+        name += (features & 4) ? "+INSTANCE_PARAMS" : "";
+        startupNames.push_back(name);
+        startupPrograms.push_back(programs[0]);
+    }
+
+    char startupDirectory[] = "/tmp/vsbench-XXXXXX";
+    std::string startupArchive;
+    bool written = mkdtemp(startupDirectory) != nullptr;
+    if (written) {
+        startupArchive = std::string(startupDirectory) + "/shaders.gxa";
+        written = write_archive(startupArchive.c_str(), build_archive(startupNames, startupPrograms));
+        for (size_t i=0; written && i<startupNames.size(); ++i) {
+            std::string filename = std::string(startupDirectory) + "/" + startupNames[i] + ".gxp";
+            written = write_file(filename, startupPrograms[i]);
+        }
+    }
+    if (!written) {
+        fprintf(stderr, "cannot write the startup shaders\n");
+        return 1;
+    }
+
+    std::vector<void *> loaded(startupNames.size(), nullptr);
+    bench("program_startup_files", startupNames.size(), [&] {
+        if (!load_files(startupDirectory, startupNames, loaded)) {
+            fprintf(stderr, "%s: cannot read the startup shaders\n", startupDirectory);
+            exit(1);
+        }
+        for (void *&program: loaded) {
+            free(program);
+            program = nullptr;
+        }
+    });
+    bench("program_startup_archive", startupNames.size(), [&] {
+        ShaderArchive shaders;
+        bool found = shaders.open(startupArchive.c_str());
+        for (const std::string &name: startupNames) {
+            found = found && shaders.find(name.c_str());
+        }
+        if (!found) {
+            fprintf(stderr, "%s: %s\n", startupArchive.c_str(), shaders.error ? shaders.error : "program missing");
+            exit(1);
+        }
+    });
+    if (result_of("program_startup_files") > 0.0 && result_of("program_startup_archive") > 0.0) {
+        printf("%-32s %12.2fx faster than loose files\n", "program_startup_archive",
+                result_of("program_startup_files") / result_of("program_startup_archive"));
+    }
+
+    for (const std::string &name: startupNames) {
+        remove((std::string(startupDirectory) + "/" + name + ".gxp").c_str());
+    }
+    remove(startupArchive.c_str());
+    rmdir(startupDirectory);
+
+    bench("program_construct", 1, [&] {
+        ShaderProgram loaded(context, patcher, vertexProgram, fragmentProgram);
+    });
+    bench("program_variants_get", 1, [&] {
+        ShaderVariants variants(context, patcher, archive, "sphere_v", "sphere_f");
+        values[2] += variants.get(0) ? 1.f : 0.f;
+    });
+    bench("program_find_parameter", 4, [&] {
+        values[3] += program.find_vertex_parameter("uProjection") ? 1.f : 0.f;
+        values[3] += program.find_vertex_parameter("uVertexPad17") ? 1.f : 0.f;
+        values[3] += program.find_fragment_parameter("uColor") ? 1.f : 0.f;
+        values[3] += program.find_fragment_parameter("uMissing") ? 1.f : 0.f;
+    });
+
+    close(fd);
+    remove(archivePath);
+
+    if (output && !write_results(output)) {
+        fprintf(stderr, "%s: cannot write\n", output);
+        return 1;
+    }
+    if (baseline && !compare_results(baseline, threshold)) {
+        return 1;
+    }
+    return 0;
+}
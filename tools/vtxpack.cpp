@@ -0,0 +1,377 @@
+// Checks the quantization helpers of vertexpack.h and what GlyphVertex does
+// to text geometry, then compares the vertex bytes and packing cost of
+// Vertex and GlyphVertex.
+//
+//   vtxpack [atlas.png]
+//
+// Every half, U16N, S16N and U8N value has to survive a round trip, and
+// quantizing has to pick the nearest value (ties to even for halves). On
+// a screen of glyphs the position, texture coordinate and scale error is
+// reported against its bound. If the atlas loads, the screen is also
+// rendered with softraster.h from both vertex types and the images are
+// compared.
+
+#include "check.h"
+#include "softraster.h"
+#include "textbatch.h"
+#include "vertexlayout.h"
+#include "vertexpack.h"
+
+#include <math.h>
+#include <png.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+using namespace vitashader;
+
+static const int WIDTH = 960;
+static const int HEIGHT = 544;
+
+static float
+float_from_bits(uint32_t bits)
+{
+    float f;
+    memcpy(&f, &bits, 4);
+    return f;
+}
+
+static void
+check_f16()
+{
+    bool roundTrip = true;
+    for (uint32_t h=0; h<0x10000; ++h) {
+        float f = dequantize_f16((uint16_t)h);
+        bool nan = (h & 0x7C00) == 0x7C00 && (h & 0x3FF);
+        if (nan ? !isnan(f) || !isnan(dequantize_f16(quantize_f16(f))) : quantize_f16(f) != h) {
+            roundTrip = false;
+        }
+    }
+    check(roundTrip, "every half survives a round trip");
+
+    // A spread of float bit patterns over the whole range, both signs
+    bool nearest = true;
+    bool overflow = true;
+    for (uint64_t bits=0; bits<0x7F800000; bits+=997) {
+        for (uint32_t sign: { 0u, 0x80000000u }) {
+            float f = float_from_bits((uint32_t)bits | sign);
+            uint16_t h = quantize_f16(f);
+            if (fabsf(f) >= 65520.f) {
+                overflow &= (h & 0x7FFF) == 0x7C00 && (h & 0x8000) == (sign >> 16);
+                continue;
+            }
+
+            uint16_t magnitude = h & 0x7FFF;
+            double error = fabs((double)dequantize_f16(h) - f);
+            for (int step: { -1, 1 }) {
+                if ((step < 0 && magnitude == 0) || (step > 0 && magnitude >= 0x7BFF)) {
+                    continue;
+                }
+                double other = fabs((double)dequantize_f16((uint16_t)(h + step)) - f);
+                if (other < error || (other == error && (magnitude & 1))) {
+                    nearest = false;
+                }
+            }
+        }
+    }
+    check(nearest, "halves round to nearest, ties to even");
+    check(overflow, "halves overflow to infinity from 65520");
+    check(quantize_f16(float_from_bits(0x7F800000)) == 0x7C00, "infinity stays infinity");
+    check(isnan(dequantize_f16(quantize_f16(float_from_bits(0x7FC00000)))), "NaN stays NaN");
+    check(quantize_f16(65504.f) == 0x7BFF && quantize_f16(1.f) == 0x3C00 && quantize_f16(-2.f) == 0xC000,
+            "known halves");
+    check(quantize_f16(5.9604645e-8f) == 0x0001 && quantize_f16(2.9802322e-8f) == 0x0000,
+            "smallest subnormal, and its half rounding to even");
+}
+
+static void
+check_normalized()
+{
+    bool u16 = true, s16 = true, u8 = true;
+    for (uint32_t v=0; v<0x10000; ++v) {
+        u16 &= quantize_u16n(dequantize_u16n((uint16_t)v)) == v;
+        if (v != 0x8000) {
+            s16 &= quantize_s16n(dequantize_s16n((int16_t)v)) == (int16_t)v;
+        }
+        if (v < 0x100) {
+            u8 &= quantize_u8n(dequantize_u8n((uint8_t)v)) == v;
+        }
+    }
+    check(u16, "every U16N value survives a round trip");
+    check(s16, "every S16N value survives a round trip");
+    check(u8, "every U8N value survives a round trip");
+    check(dequantize_s16n(-32768) == -1.f, "S16N -32768 reads as -1");
+
+    // Half a step is the most any value in range may be off
+    float u16Error = 0.f, s16Error = 0.f, u8Error = 0.f;
+    for (int i=0; i<=1000000; ++i) {
+        float f = i / 1000000.f;
+        u16Error = std::max(u16Error, fabsf(dequantize_u16n(quantize_u16n(f)) - f));
+        u8Error = std::max(u8Error, fabsf(dequantize_u8n(quantize_u8n(f)) - f));
+        float g = f * 2.f - 1.f;
+        s16Error = std::max(s16Error, fabsf(dequantize_s16n(quantize_s16n(g)) - g));
+    }
+    // Plus the float rounding of the comparison itself
+    check(u16Error <= 0.5f / 65535.f + 1e-7f, "U16N is within half a step");
+    check(s16Error <= 0.5f / 32767.f + 1e-7f, "S16N is within half a step");
+    check(u8Error <= 0.5f / 255.f + 1e-7f, "U8N is within half a step");
+
+    check(quantize_u16n(-0.5f) == 0 && quantize_u16n(2.f) == 65535 && quantize_u16n(NAN) == 0, "U16N clamps");
+    check(quantize_s16n(-2.f) == -32767 && quantize_s16n(2.f) == 32767, "S16N clamps");
+    check(quantize_u8n(-1.f) == 0 && quantize_u8n(1.5f) == 255, "U8N clamps");
+    check(quantize_s16(5000.f, GLYPH_POSITION_UNITS) == 32767 && quantize_s16(-5000.f, GLYPH_POSITION_UNITS) == -32768,
+            "positions clamp at 4096 px");
+}
+
+static void
+check_layouts()
+{
+    typedef VertexTraits<GlyphVertex>::Layout Layout;
+    check(Layout::streams[0].stride == sizeof(GlyphVertex) && sizeof(GlyphVertex) == 12, "GlyphVertex stride");
+    const SceGxmVertexAttribute *a = Layout::attributes();
+    check(a[0].offset == 0 && a[0].format == SCE_GXM_ATTRIBUTE_FORMAT_S16 && a[0].componentCount == 2,
+            "GlyphVertex position");
+    check(a[1].offset == 4 && a[1].format == SCE_GXM_ATTRIBUTE_FORMAT_U16N && a[1].componentCount == 2,
+            "GlyphVertex texture coordinates");
+    check(a[2].offset == 8 && a[2].format == SCE_GXM_ATTRIBUTE_FORMAT_F16 && a[2].componentCount == 1,
+            "GlyphVertex scale");
+}
+
+// The NEON or SSE packer against the scalar one, on the batch and on
+// values at and past the edges of each format
+static void
+check_simd(const std::vector<Vertex> &vertices)
+{
+    std::vector<Vertex> edges = vertices;
+    const float specials[] = {
+        0.f, -0.f, 0.5f, 1.f, -1.f, 1.5f, 0.0625f, 0.1875f, -0.0625f, 1.f / 131070.f, 3.f / 131070.f,
+        4095.9375f, 4096.f, -4096.f, -4097.f, 1e9f, -1e9f, 65504.f, 65520.f, 1e-6f,
+        INFINITY, -INFINITY, NAN, -NAN,
+    };
+    size_t n = sizeof(specials) / sizeof(specials[0]);
+    for (size_t i=0; i<n * n; ++i) {
+        float a = specials[i % n], b = specials[i / n];
+        edges.push_back(Vertex{a, b, b, a, b});
+    }
+
+    std::vector<uint16_t> instances((edges.size() + 3) / 4);
+    for (size_t i=0; i<instances.size(); ++i) {
+        instances[i] = (uint16_t)(i * 7919);
+    }
+
+    std::vector<GlyphVertex> simd(edges.size()), scalar(edges.size());
+    pack_glyph_vertices(edges.data(), edges.size(), instances.data(), simd.data());
+    pack_glyph_vertices_scalar(edges.data(), edges.size(), instances.data(), scalar.data());
+    check(memcmp(simd.data(), scalar.data(), edges.size() * sizeof(GlyphVertex)) == 0,
+            "pack_glyph_vertices() matches the scalar packer");
+}
+
+// The quads softtext renders: glyph-sized cells of the atlas at several
+// scales, over a whole screen
+static void
+build_text(TextBatch &batch, const Font &font)
+{
+    const int cells = 16;
+    unsigned seed = 1;
+    for (int line=0; line<24; ++line) {
+        float scale = 0.75f + (line % 4) * 0.25f;
+        float size = 20.f * scale;
+        float y = 4.f + line * 22.f + (line % 3) * 0.37f;
+        for (float x=4.f + (line % 5) * 0.13f; x + size < WIDTH; x += size * 0.6f) {
+            seed = seed * 1103515245u + 12345u;
+            int cell = (seed >> 16) % (cells * cells);
+            float s0 = (cell % cells) / (float)cells;
+            float t0 = (cell / cells) / (float)cells;
+            batch.add_quad(font, x, y, x + size, y + size,
+                    s0, t0, s0 + 1.f / cells, t0 + 1.f / cells, scale);
+        }
+    }
+}
+
+struct Image {
+    int width;
+    int height;
+    std::vector<uint8_t> pixels;
+};
+
+static bool
+load_gray_png(const char *filename, Image &image)
+{
+    png_image png;
+    memset(&png, 0, sizeof(png));
+    png.version = PNG_IMAGE_VERSION;
+
+    if (!png_image_begin_read_from_file(&png, filename)) {
+        return false;
+    }
+
+    png.format = PNG_FORMAT_GRAY;
+    image.width = png.width;
+    image.height = png.height;
+    image.pixels.resize(PNG_IMAGE_SIZE(png));
+
+    return png_image_finish_read(&png, nullptr, image.pixels.data(), 0, nullptr) != 0;
+}
+
+static void
+render(const Image &image, const std::vector<Vertex> &vertices, std::vector<uint32_t> &pixels)
+{
+    SoftTexture texture = { image.pixels.data(), image.width, image.height, image.width, 1 };
+    SoftUniforms uniforms = {
+        { 0.5f, 0.f, 1.f, 1.f },
+        { 0.f, 0.f, 1.f, 1.f },
+        {},
+        { 1.f / 512.f, 1.f / 512.f },
+    };
+
+    // glm::ortho(0, 960, 544, 0) in column-major order
+    float *m = uniforms.projection;
+    memset(m, 0, 16 * sizeof(float));
+    m[0] = 2.f / WIDTH;
+    m[5] = -2.f / HEIGHT;
+    m[10] = -1.f;
+    m[12] = -1.f;
+    m[13] = 1.f;
+    m[15] = 1.f;
+
+    pixels.assign(WIDTH * HEIGHT, 0);
+    SoftTarget target = { pixels.data(), WIDTH, HEIGHT, WIDTH };
+    SoftRasterizer raster(target);
+    raster.clear(0xFF404040);
+    raster.draw_quads(vertices.data(), vertices.size() / 4, texture, uniforms);
+}
+
+static void
+compare_images(const Image &image, const std::vector<Vertex> &full, const std::vector<Vertex> &packed)
+{
+    std::vector<uint32_t> a, b;
+    render(image, full, a);
+    render(image, packed, b);
+
+    int maxDiff = 0;
+    size_t changed = 0, large = 0;
+    double sum = 0.0;
+    for (size_t i=0; i<a.size(); ++i) {
+        int pixelDiff = 0;
+        for (int shift=0; shift<32; shift+=8) {
+            int d = abs((int)((a[i] >> shift) & 0xFF) - (int)((b[i] >> shift) & 0xFF));
+            pixelDiff = std::max(pixelDiff, d);
+            sum += d;
+        }
+        maxDiff = std::max(maxDiff, pixelDiff);
+        changed += pixelDiff != 0;
+        large += pixelDiff > 16;
+    }
+
+    printf("rendered: %zu of %zu pixels differ, %zu by more than 16/255, max %d/255, mean %.4f/255 per channel\n",
+            changed, a.size(), large, maxDiff, sum / (a.size() * 4.0));
+
+    // Quad edges move by up to 1/16 px, which can flip whole pixels along
+    // them; everything else only sees the filtering shift slightly
+    check(large * 200 < a.size(), "packed render is off by more than 16/255 in under 0.5% of pixels");
+    check(sum / (a.size() * 4.0) < 0.5, "packed render has a mean error under 0.5/255");
+}
+
+static double
+seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int
+main(int argc, char *argv[])
+{
+    const char *atlas = argc > 1 ? argv[1] : "stb_font_SourceSansProSemiBold.png";
+
+    check_f16();
+    check_normalized();
+    check_layouts();
+
+    Font font;
+    TextBatch batch;
+    build_text(batch, font);
+    batch.add_quad(font, 0.f, 0.f, 900.f, 900.f, 0.f, 0.f, 1.f, 1.f, 1.f);
+
+    const std::vector<Vertex> &vertices = batch.vertices;
+    std::vector<GlyphVertex> packed(vertices.size());
+    pack_glyph_vertices(vertices.data(), vertices.size(), nullptr, packed.data());
+
+    check_simd(vertices);
+
+    std::vector<Vertex> unpacked(vertices.size());
+    double positionSq = 0.0, uvSq = 0.0;
+    float positionMax = 0.f, uvMax = 0.f, scaleMax = 0.f;
+    for (size_t i=0; i<vertices.size(); ++i) {
+        const Vertex &v = vertices[i];
+        const Vertex u = unpack_glyph_vertex(packed[i]);
+        unpacked[i] = u;
+
+        for (float d: { u.x - v.x, u.y - v.y }) {
+            positionMax = std::max(positionMax, fabsf(d));
+            positionSq += d * d;
+        }
+        for (float d: { u.u - v.u, u.v - v.v }) {
+            uvMax = std::max(uvMax, fabsf(d));
+            uvSq += d * d;
+        }
+        scaleMax = std::max(scaleMax, fabsf(u.z - v.z) / v.z);
+    }
+
+    size_t n = vertices.size();
+    printf("%zu glyphs: position error max %.4f px, rms %.4f px; uv error max %.2e, rms %.2e "
+            "(%.4f texels of 1024); scale error max %.2e\n",
+            batch.glyph_count(), positionMax, sqrt(positionSq / (n * 2)), uvMax, sqrt(uvSq / (n * 2)),
+            uvMax * 1024.f, scaleMax);
+    check(positionMax <= 0.5f / GLYPH_POSITION_UNITS + 1e-4f, "positions within half a subpixel step");
+    check(uvMax <= 0.5f / 65535.f + 1e-7f, "texture coordinates within half a U16N step");
+    check(scaleMax <= 1.f / 2048.f, "scale within half a half-float ulp");
+
+    Image image;
+    if (load_gray_png(atlas, image)) {
+        compare_images(image, vertices, unpacked);
+    } else {
+        printf("%s: cannot load, not comparing rendered images\n", atlas);
+    }
+
+    // What the GPU fetches per glyph: four vertices, and six 16-bit
+    // indices from the shared quad index buffer either way
+    printf("\n%-12s %8s %12s %10s %16s\n", "vertex", "stride", "bytes/glyph", "KB/frame", "upload ns/glyph");
+    const int rounds = 5;
+    const int iterations = 200;
+    std::vector<Vertex> copy(vertices.size());
+    double best[2] = { 1e9, 1e9 };
+    for (int round=0; round<rounds; ++round) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i=0; i<iterations; ++i) {
+            memcpy(copy.data(), vertices.data(), vertices.size() * sizeof(Vertex));
+            __asm__ __volatile__("" : : "r"(copy.data()) : "memory");
+        }
+        best[0] = std::min(best[0], seconds_since(start) / iterations);
+
+        start = std::chrono::steady_clock::now();
+        for (int i=0; i<iterations; ++i) {
+            pack_glyph_vertices(vertices.data(), vertices.size(), nullptr, packed.data());
+            __asm__ __volatile__("" : : "r"(packed.data()) : "memory");
+        }
+        best[1] = std::min(best[1], seconds_since(start) / iterations);
+    }
+
+    const char *names[] = { "Vertex", "GlyphVertex" };
+    size_t strides[] = { sizeof(Vertex), sizeof(GlyphVertex) };
+    for (int i=0; i<2; ++i) {
+        size_t bytes = strides[i] * 4 + 6 * sizeof(uint16_t);
+        printf("%-12s %8zu %12zu %10.1f %16.1f\n", names[i], strides[i], bytes,
+                bytes * batch.glyph_count() / 1024.0, best[i] * 1e9 / batch.glyph_count());
+    }
+    printf("GlyphVertex fetches %.0f%% fewer bytes per glyph\n",
+            100.0 * (1.0 - (sizeof(GlyphVertex) * 4 + 12.0) / (sizeof(Vertex) * 4 + 12.0)));
+
+    if (!failures) {
+        printf("\nvertex packing: ok\n");
+    }
+    return failures ? 1 : 0;
+}